@@ -0,0 +1,4 @@
+<xsl:stylesheet xmlns:xsl="http://www.w3.org/1999/XSL/Transform" version="1.0">
+  <xsl:import href="/manpages/docbook.xsl"/>
+  <xsl:import href="/root/repo/redis/redis-3.0.7/deps/jemalloc/doc/stylesheet.xsl"/>
+</xsl:stylesheet>
@@ -0,0 +1,413 @@
+#undef a0calloc
+#undef a0free
+#undef a0malloc
+#undef arena_alloc_junk_small
+#undef arena_bin_index
+#undef arena_bin_info
+#undef arena_boot
+#undef arena_dalloc
+#undef arena_dalloc_bin
+#undef arena_dalloc_bin_locked
+#undef arena_dalloc_junk_large
+#undef arena_dalloc_junk_small
+#undef arena_dalloc_large
+#undef arena_dalloc_large_locked
+#undef arena_dalloc_small
+#undef arena_dss_prec_get
+#undef arena_dss_prec_set
+#undef arena_malloc
+#undef arena_malloc_large
+#undef arena_malloc_small
+#undef arena_mapbits_allocated_get
+#undef arena_mapbits_binind_get
+#undef arena_mapbits_dirty_get
+#undef arena_mapbits_get
+#undef arena_mapbits_large_binind_set
+#undef arena_mapbits_large_get
+#undef arena_mapbits_large_set
+#undef arena_mapbits_large_size_get
+#undef arena_mapbits_small_runind_get
+#undef arena_mapbits_small_set
+#undef arena_mapbits_unallocated_set
+#undef arena_mapbits_unallocated_size_get
+#undef arena_mapbits_unallocated_size_set
+#undef arena_mapbits_unzeroed_get
+#undef arena_mapbits_unzeroed_set
+#undef arena_mapbitsp_get
+#undef arena_mapbitsp_read
+#undef arena_mapbitsp_write
+#undef arena_mapp_get
+#undef arena_maxclass
+#undef arena_new
+#undef arena_palloc
+#undef arena_postfork_child
+#undef arena_postfork_parent
+#undef arena_prefork
+#undef arena_prof_accum
+#undef arena_prof_accum_impl
+#undef arena_prof_accum_locked
+#undef arena_prof_ctx_get
+#undef arena_prof_ctx_set
+#undef arena_prof_promoted
+#undef arena_ptr_small_binind_get
+#undef arena_purge_all
+#undef arena_quarantine_junk_small
+#undef arena_ralloc
+#undef arena_ralloc_junk_large
+#undef arena_ralloc_no_move
+#undef arena_redzone_corruption
+#undef arena_run_regind
+#undef arena_salloc
+#undef arena_stats_merge
+#undef arena_tcache_fill_small
+#undef arenas
+#undef arenas_booted
+#undef arenas_cleanup
+#undef arenas_extend
+#undef arenas_initialized
+#undef arenas_lock
+#undef arenas_tls
+#undef arenas_tsd
+#undef arenas_tsd_boot
+#undef arenas_tsd_cleanup_wrapper
+#undef arenas_tsd_get
+#undef arenas_tsd_get_wrapper
+#undef arenas_tsd_init_head
+#undef arenas_tsd_set
+#undef atomic_add_u
+#undef atomic_add_uint32
+#undef atomic_add_uint64
+#undef atomic_add_z
+#undef atomic_sub_u
+#undef atomic_sub_uint32
+#undef atomic_sub_uint64
+#undef atomic_sub_z
+#undef base_alloc
+#undef base_boot
+#undef base_calloc
+#undef base_node_alloc
+#undef base_node_dealloc
+#undef base_postfork_child
+#undef base_postfork_parent
+#undef base_prefork
+#undef bitmap_full
+#undef bitmap_get
+#undef bitmap_info_init
+#undef bitmap_info_ngroups
+#undef bitmap_init
+#undef bitmap_set
+#undef bitmap_sfu
+#undef bitmap_size
+#undef bitmap_unset
+#undef bt_init
+#undef buferror
+#undef choose_arena
+#undef choose_arena_hard
+#undef chunk_alloc
+#undef chunk_alloc_dss
+#undef chunk_alloc_mmap
+#undef chunk_boot
+#undef chunk_dealloc
+#undef chunk_dealloc_mmap
+#undef chunk_dss_boot
+#undef chunk_dss_postfork_child
+#undef chunk_dss_postfork_parent
+#undef chunk_dss_prec_get
+#undef chunk_dss_prec_set
+#undef chunk_dss_prefork
+#undef chunk_in_dss
+#undef chunk_npages
+#undef chunk_postfork_child
+#undef chunk_postfork_parent
+#undef chunk_prefork
+#undef chunk_unmap
+#undef chunks_mtx
+#undef chunks_rtree
+#undef chunksize
+#undef chunksize_mask
+#undef ckh_bucket_search
+#undef ckh_count
+#undef ckh_delete
+#undef ckh_evict_reloc_insert
+#undef ckh_insert
+#undef ckh_isearch
+#undef ckh_iter
+#undef ckh_new
+#undef ckh_pointer_hash
+#undef ckh_pointer_keycomp
+#undef ckh_rebuild
+#undef ckh_remove
+#undef ckh_search
+#undef ckh_string_hash
+#undef ckh_string_keycomp
+#undef ckh_try_bucket_insert
+#undef ckh_try_insert
+#undef ctl_boot
+#undef ctl_bymib
+#undef ctl_byname
+#undef ctl_nametomib
+#undef ctl_postfork_child
+#undef ctl_postfork_parent
+#undef ctl_prefork
+#undef dss_prec_names
+#undef extent_tree_ad_first
+#undef extent_tree_ad_insert
+#undef extent_tree_ad_iter
+#undef extent_tree_ad_iter_recurse
+#undef extent_tree_ad_iter_start
+#undef extent_tree_ad_last
+#undef extent_tree_ad_new
+#undef extent_tree_ad_next
+#undef extent_tree_ad_nsearch
+#undef extent_tree_ad_prev
+#undef extent_tree_ad_psearch
+#undef extent_tree_ad_remove
+#undef extent_tree_ad_reverse_iter
+#undef extent_tree_ad_reverse_iter_recurse
+#undef extent_tree_ad_reverse_iter_start
+#undef extent_tree_ad_search
+#undef extent_tree_szad_first
+#undef extent_tree_szad_insert
+#undef extent_tree_szad_iter
+#undef extent_tree_szad_iter_recurse
+#undef extent_tree_szad_iter_start
+#undef extent_tree_szad_last
+#undef extent_tree_szad_new
+#undef extent_tree_szad_next
+#undef extent_tree_szad_nsearch
+#undef extent_tree_szad_prev
+#undef extent_tree_szad_psearch
+#undef extent_tree_szad_remove
+#undef extent_tree_szad_reverse_iter
+#undef extent_tree_szad_reverse_iter_recurse
+#undef extent_tree_szad_reverse_iter_start
+#undef extent_tree_szad_search
+#undef get_errno
+#undef hash
+#undef hash_fmix_32
+#undef hash_fmix_64
+#undef hash_get_block_32
+#undef hash_get_block_64
+#undef hash_rotl_32
+#undef hash_rotl_64
+#undef hash_x64_128
+#undef hash_x86_128
+#undef hash_x86_32
+#undef huge_allocated
+#undef huge_boot
+#undef huge_dalloc
+#undef huge_dalloc_junk
+#undef huge_dss_prec_get
+#undef huge_malloc
+#undef huge_mtx
+#undef huge_ndalloc
+#undef huge_nmalloc
+#undef huge_palloc
+#undef huge_postfork_child
+#undef huge_postfork_parent
+#undef huge_prefork
+#undef huge_prof_ctx_get
+#undef huge_prof_ctx_set
+#undef huge_ralloc
+#undef huge_ralloc_no_move
+#undef huge_salloc
+#undef iallocm
+#undef icalloc
+#undef icalloct
+#undef idalloc
+#undef idalloct
+#undef imalloc
+#undef imalloct
+#undef ipalloc
+#undef ipalloct
+#undef iqalloc
+#undef iqalloct
+#undef iralloc
+#undef iralloct
+#undef iralloct_realign
+#undef isalloc
+#undef isthreaded
+#undef ivsalloc
+#undef ixalloc
+#undef jemalloc_postfork_child
+#undef jemalloc_postfork_parent
+#undef jemalloc_prefork
+#undef malloc_cprintf
+#undef malloc_mutex_init
+#undef malloc_mutex_lock
+#undef malloc_mutex_postfork_child
+#undef malloc_mutex_postfork_parent
+#undef malloc_mutex_prefork
+#undef malloc_mutex_unlock
+#undef malloc_printf
+#undef malloc_snprintf
+#undef malloc_strtoumax
+#undef malloc_tsd_boot
+#undef malloc_tsd_cleanup_register
+#undef malloc_tsd_dalloc
+#undef malloc_tsd_malloc
+#undef malloc_tsd_no_cleanup
+#undef malloc_vcprintf
+#undef malloc_vsnprintf
+#undef malloc_write
+#undef map_bias
+#undef mb_write
+#undef mutex_boot
+#undef narenas_auto
+#undef narenas_total
+#undef narenas_total_get
+#undef ncpus
+#undef nhbins
+#undef opt_abort
+#undef opt_dss
+#undef opt_junk
+#undef opt_lg_chunk
+#undef opt_lg_dirty_mult
+#undef opt_lg_prof_interval
+#undef opt_lg_prof_sample
+#undef opt_lg_tcache_max
+#undef opt_narenas
+#undef opt_prof
+#undef opt_prof_accum
+#undef opt_prof_active
+#undef opt_prof_final
+#undef opt_prof_gdump
+#undef opt_prof_leak
+#undef opt_prof_prefix
+#undef opt_quarantine
+#undef opt_redzone
+#undef opt_stats_print
+#undef opt_tcache
+#undef opt_utrace
+#undef opt_valgrind
+#undef opt_xmalloc
+#undef opt_zero
+#undef p2rz
+#undef pages_purge
+#undef pow2_ceil
+#undef prof_backtrace
+#undef prof_boot0
+#undef prof_boot1
+#undef prof_boot2
+#undef prof_bt_count
+#undef prof_ctx_get
+#undef prof_ctx_set
+#undef prof_dump_open
+#undef prof_free
+#undef prof_gdump
+#undef prof_idump
+#undef prof_interval
+#undef prof_lookup
+#undef prof_malloc
+#undef prof_mdump
+#undef prof_postfork_child
+#undef prof_postfork_parent
+#undef prof_prefork
+#undef prof_promote
+#undef prof_realloc
+#undef prof_sample_accum_update
+#undef prof_sample_threshold_update
+#undef prof_tdata_booted
+#undef prof_tdata_cleanup
+#undef prof_tdata_get
+#undef prof_tdata_init
+#undef prof_tdata_initialized
+#undef prof_tdata_tls
+#undef prof_tdata_tsd
+#undef prof_tdata_tsd_boot
+#undef prof_tdata_tsd_cleanup_wrapper
+#undef prof_tdata_tsd_get
+#undef prof_tdata_tsd_get_wrapper
+#undef prof_tdata_tsd_init_head
+#undef prof_tdata_tsd_set
+#undef quarantine
+#undef quarantine_alloc_hook
+#undef quarantine_boot
+#undef quarantine_booted
+#undef quarantine_cleanup
+#undef quarantine_init
+#undef quarantine_tls
+#undef quarantine_tsd
+#undef quarantine_tsd_boot
+#undef quarantine_tsd_cleanup_wrapper
+#undef quarantine_tsd_get
+#undef quarantine_tsd_get_wrapper
+#undef quarantine_tsd_init_head
+#undef quarantine_tsd_set
+#undef register_zone
+#undef rtree_delete
+#undef rtree_get
+#undef rtree_get_locked
+#undef rtree_new
+#undef rtree_postfork_child
+#undef rtree_postfork_parent
+#undef rtree_prefork
+#undef rtree_set
+#undef s2u
+#undef sa2u
+#undef set_errno
+#undef small_size2bin
+#undef stats_cactive
+#undef stats_cactive_add
+#undef stats_cactive_get
+#undef stats_cactive_sub
+#undef stats_chunks
+#undef stats_print
+#undef tcache_alloc_easy
+#undef tcache_alloc_large
+#undef tcache_alloc_small
+#undef tcache_alloc_small_hard
+#undef tcache_arena_associate
+#undef tcache_arena_dissociate
+#undef tcache_bin_flush_large
+#undef tcache_bin_flush_small
+#undef tcache_bin_info
+#undef tcache_boot0
+#undef tcache_boot1
+#undef tcache_booted
+#undef tcache_create
+#undef tcache_dalloc_large
+#undef tcache_dalloc_small
+#undef tcache_destroy
+#undef tcache_enabled_booted
+#undef tcache_enabled_get
+#undef tcache_enabled_initialized
+#undef tcache_enabled_set
+#undef tcache_enabled_tls
+#undef tcache_enabled_tsd
+#undef tcache_enabled_tsd_boot
+#undef tcache_enabled_tsd_cleanup_wrapper
+#undef tcache_enabled_tsd_get
+#undef tcache_enabled_tsd_get_wrapper
+#undef tcache_enabled_tsd_init_head
+#undef tcache_enabled_tsd_set
+#undef tcache_event
+#undef tcache_event_hard
+#undef tcache_flush
+#undef tcache_get
+#undef tcache_initialized
+#undef tcache_maxclass
+#undef tcache_salloc
+#undef tcache_stats_merge
+#undef tcache_thread_cleanup
+#undef tcache_tls
+#undef tcache_tsd
+#undef tcache_tsd_boot
+#undef tcache_tsd_cleanup_wrapper
+#undef tcache_tsd_get
+#undef tcache_tsd_get_wrapper
+#undef tcache_tsd_init_head
+#undef tcache_tsd_set
+#undef thread_allocated_booted
+#undef thread_allocated_initialized
+#undef thread_allocated_tls
+#undef thread_allocated_tsd
+#undef thread_allocated_tsd_boot
+#undef thread_allocated_tsd_cleanup_wrapper
+#undef thread_allocated_tsd_get
+#undef thread_allocated_tsd_get_wrapper
+#undef thread_allocated_tsd_init_head
+#undef thread_allocated_tsd_set
+#undef tsd_init_check_recursion
+#undef tsd_init_finish
+#undef u2rz
@@ -0,0 +1,721 @@
+/* This file was automatically generated by size_classes.sh. */
+/******************************************************************************/
+#ifdef JEMALLOC_H_TYPES
+
+#if (LG_TINY_MIN == 3 && LG_QUANTUM == 3 && LG_PAGE == 12)
+#define	SIZE_CLASSES_DEFINED
+/*  SIZE_CLASS(bin,	delta,	sz) */
+#define	SIZE_CLASSES							\
+    SIZE_CLASS(0,	8,	8)					\
+    SIZE_CLASS(1,	8,	16)					\
+    SIZE_CLASS(2,	8,	24)					\
+    SIZE_CLASS(3,	8,	32)					\
+    SIZE_CLASS(4,	8,	40)					\
+    SIZE_CLASS(5,	8,	48)					\
+    SIZE_CLASS(6,	8,	56)					\
+    SIZE_CLASS(7,	8,	64)					\
+    SIZE_CLASS(8,	16,	80)					\
+    SIZE_CLASS(9,	16,	96)					\
+    SIZE_CLASS(10,	16,	112)					\
+    SIZE_CLASS(11,	16,	128)					\
+    SIZE_CLASS(12,	32,	160)					\
+    SIZE_CLASS(13,	32,	192)					\
+    SIZE_CLASS(14,	32,	224)					\
+    SIZE_CLASS(15,	32,	256)					\
+    SIZE_CLASS(16,	64,	320)					\
+    SIZE_CLASS(17,	64,	384)					\
+    SIZE_CLASS(18,	64,	448)					\
+    SIZE_CLASS(19,	64,	512)					\
+    SIZE_CLASS(20,	128,	640)					\
+    SIZE_CLASS(21,	128,	768)					\
+    SIZE_CLASS(22,	128,	896)					\
+    SIZE_CLASS(23,	128,	1024)					\
+    SIZE_CLASS(24,	256,	1280)					\
+    SIZE_CLASS(25,	256,	1536)					\
+    SIZE_CLASS(26,	256,	1792)					\
+    SIZE_CLASS(27,	256,	2048)					\
+    SIZE_CLASS(28,	512,	2560)					\
+    SIZE_CLASS(29,	512,	3072)					\
+    SIZE_CLASS(30,	512,	3584)					\
+
+#define	NBINS		31
+#define	SMALL_MAXCLASS	3584
+#endif
+
+#if (LG_TINY_MIN == 3 && LG_QUANTUM == 3 && LG_PAGE == 13)
+#define	SIZE_CLASSES_DEFINED
+/*  SIZE_CLASS(bin,	delta,	sz) */
+#define	SIZE_CLASSES							\
+    SIZE_CLASS(0,	8,	8)					\
+    SIZE_CLASS(1,	8,	16)					\
+    SIZE_CLASS(2,	8,	24)					\
+    SIZE_CLASS(3,	8,	32)					\
+    SIZE_CLASS(4,	8,	40)					\
+    SIZE_CLASS(5,	8,	48)					\
+    SIZE_CLASS(6,	8,	56)					\
+    SIZE_CLASS(7,	8,	64)					\
+    SIZE_CLASS(8,	16,	80)					\
+    SIZE_CLASS(9,	16,	96)					\
+    SIZE_CLASS(10,	16,	112)					\
+    SIZE_CLASS(11,	16,	128)					\
+    SIZE_CLASS(12,	32,	160)					\
+    SIZE_CLASS(13,	32,	192)					\
+    SIZE_CLASS(14,	32,	224)					\
+    SIZE_CLASS(15,	32,	256)					\
+    SIZE_CLASS(16,	64,	320)					\
+    SIZE_CLASS(17,	64,	384)					\
+    SIZE_CLASS(18,	64,	448)					\
+    SIZE_CLASS(19,	64,	512)					\
+    SIZE_CLASS(20,	128,	640)					\
+    SIZE_CLASS(21,	128,	768)					\
+    SIZE_CLASS(22,	128,	896)					\
+    SIZE_CLASS(23,	128,	1024)					\
+    SIZE_CLASS(24,	256,	1280)					\
+    SIZE_CLASS(25,	256,	1536)					\
+    SIZE_CLASS(26,	256,	1792)					\
+    SIZE_CLASS(27,	256,	2048)					\
+    SIZE_CLASS(28,	512,	2560)					\
+    SIZE_CLASS(29,	512,	3072)					\
+    SIZE_CLASS(30,	512,	3584)					\
+    SIZE_CLASS(31,	512,	4096)					\
+    SIZE_CLASS(32,	1024,	5120)					\
+    SIZE_CLASS(33,	1024,	6144)					\
+    SIZE_CLASS(34,	1024,	7168)					\
+
+#define	NBINS		35
+#define	SMALL_MAXCLASS	7168
+#endif
+
+#if (LG_TINY_MIN == 3 && LG_QUANTUM == 3 && LG_PAGE == 14)
+#define	SIZE_CLASSES_DEFINED
+/*  SIZE_CLASS(bin,	delta,	sz) */
+#define	SIZE_CLASSES							\
+    SIZE_CLASS(0,	8,	8)					\
+    SIZE_CLASS(1,	8,	16)					\
+    SIZE_CLASS(2,	8,	24)					\
+    SIZE_CLASS(3,	8,	32)					\
+    SIZE_CLASS(4,	8,	40)					\
+    SIZE_CLASS(5,	8,	48)					\
+    SIZE_CLASS(6,	8,	56)					\
+    SIZE_CLASS(7,	8,	64)					\
+    SIZE_CLASS(8,	16,	80)					\
+    SIZE_CLASS(9,	16,	96)					\
+    SIZE_CLASS(10,	16,	112)					\
+    SIZE_CLASS(11,	16,	128)					\
+    SIZE_CLASS(12,	32,	160)					\
+    SIZE_CLASS(13,	32,	192)					\
+    SIZE_CLASS(14,	32,	224)					\
+    SIZE_CLASS(15,	32,	256)					\
+    SIZE_CLASS(16,	64,	320)					\
+    SIZE_CLASS(17,	64,	384)					\
+    SIZE_CLASS(18,	64,	448)					\
+    SIZE_CLASS(19,	64,	512)					\
+    SIZE_CLASS(20,	128,	640)					\
+    SIZE_CLASS(21,	128,	768)					\
+    SIZE_CLASS(22,	128,	896)					\
+    SIZE_CLASS(23,	128,	1024)					\
+    SIZE_CLASS(24,	256,	1280)					\
+    SIZE_CLASS(25,	256,	1536)					\
+    SIZE_CLASS(26,	256,	1792)					\
+    SIZE_CLASS(27,	256,	2048)					\
+    SIZE_CLASS(28,	512,	2560)					\
+    SIZE_CLASS(29,	512,	3072)					\
+    SIZE_CLASS(30,	512,	3584)					\
+    SIZE_CLASS(31,	512,	4096)					\
+    SIZE_CLASS(32,	1024,	5120)					\
+    SIZE_CLASS(33,	1024,	6144)					\
+    SIZE_CLASS(34,	1024,	7168)					\
+    SIZE_CLASS(35,	1024,	8192)					\
+    SIZE_CLASS(36,	2048,	10240)					\
+    SIZE_CLASS(37,	2048,	12288)					\
+    SIZE_CLASS(38,	2048,	14336)					\
+
+#define	NBINS		39
+#define	SMALL_MAXCLASS	14336
+#endif
+
+#if (LG_TINY_MIN == 3 && LG_QUANTUM == 3 && LG_PAGE == 15)
+#define	SIZE_CLASSES_DEFINED
+/*  SIZE_CLASS(bin,	delta,	sz) */
+#define	SIZE_CLASSES							\
+    SIZE_CLASS(0,	8,	8)					\
+    SIZE_CLASS(1,	8,	16)					\
+    SIZE_CLASS(2,	8,	24)					\
+    SIZE_CLASS(3,	8,	32)					\
+    SIZE_CLASS(4,	8,	40)					\
+    SIZE_CLASS(5,	8,	48)					\
+    SIZE_CLASS(6,	8,	56)					\
+    SIZE_CLASS(7,	8,	64)					\
+    SIZE_CLASS(8,	16,	80)					\
+    SIZE_CLASS(9,	16,	96)					\
+    SIZE_CLASS(10,	16,	112)					\
+    SIZE_CLASS(11,	16,	128)					\
+    SIZE_CLASS(12,	32,	160)					\
+    SIZE_CLASS(13,	32,	192)					\
+    SIZE_CLASS(14,	32,	224)					\
+    SIZE_CLASS(15,	32,	256)					\
+    SIZE_CLASS(16,	64,	320)					\
+    SIZE_CLASS(17,	64,	384)					\
+    SIZE_CLASS(18,	64,	448)					\
+    SIZE_CLASS(19,	64,	512)					\
+    SIZE_CLASS(20,	128,	640)					\
+    SIZE_CLASS(21,	128,	768)					\
+    SIZE_CLASS(22,	128,	896)					\
+    SIZE_CLASS(23,	128,	1024)					\
+    SIZE_CLASS(24,	256,	1280)					\
+    SIZE_CLASS(25,	256,	1536)					\
+    SIZE_CLASS(26,	256,	1792)					\
+    SIZE_CLASS(27,	256,	2048)					\
+    SIZE_CLASS(28,	512,	2560)					\
+    SIZE_CLASS(29,	512,	3072)					\
+    SIZE_CLASS(30,	512,	3584)					\
+    SIZE_CLASS(31,	512,	4096)					\
+    SIZE_CLASS(32,	1024,	5120)					\
+    SIZE_CLASS(33,	1024,	6144)					\
+    SIZE_CLASS(34,	1024,	7168)					\
+    SIZE_CLASS(35,	1024,	8192)					\
+    SIZE_CLASS(36,	2048,	10240)					\
+    SIZE_CLASS(37,	2048,	12288)					\
+    SIZE_CLASS(38,	2048,	14336)					\
+    SIZE_CLASS(39,	2048,	16384)					\
+    SIZE_CLASS(40,	4096,	20480)					\
+    SIZE_CLASS(41,	4096,	24576)					\
+    SIZE_CLASS(42,	4096,	28672)					\
+
+#define	NBINS		43
+#define	SMALL_MAXCLASS	28672
+#endif
+
+#if (LG_TINY_MIN == 3 && LG_QUANTUM == 3 && LG_PAGE == 16)
+#define	SIZE_CLASSES_DEFINED
+/*  SIZE_CLASS(bin,	delta,	sz) */
+#define	SIZE_CLASSES							\
+    SIZE_CLASS(0,	8,	8)					\
+    SIZE_CLASS(1,	8,	16)					\
+    SIZE_CLASS(2,	8,	24)					\
+    SIZE_CLASS(3,	8,	32)					\
+    SIZE_CLASS(4,	8,	40)					\
+    SIZE_CLASS(5,	8,	48)					\
+    SIZE_CLASS(6,	8,	56)					\
+    SIZE_CLASS(7,	8,	64)					\
+    SIZE_CLASS(8,	16,	80)					\
+    SIZE_CLASS(9,	16,	96)					\
+    SIZE_CLASS(10,	16,	112)					\
+    SIZE_CLASS(11,	16,	128)					\
+    SIZE_CLASS(12,	32,	160)					\
+    SIZE_CLASS(13,	32,	192)					\
+    SIZE_CLASS(14,	32,	224)					\
+    SIZE_CLASS(15,	32,	256)					\
+    SIZE_CLASS(16,	64,	320)					\
+    SIZE_CLASS(17,	64,	384)					\
+    SIZE_CLASS(18,	64,	448)					\
+    SIZE_CLASS(19,	64,	512)					\
+    SIZE_CLASS(20,	128,	640)					\
+    SIZE_CLASS(21,	128,	768)					\
+    SIZE_CLASS(22,	128,	896)					\
+    SIZE_CLASS(23,	128,	1024)					\
+    SIZE_CLASS(24,	256,	1280)					\
+    SIZE_CLASS(25,	256,	1536)					\
+    SIZE_CLASS(26,	256,	1792)					\
+    SIZE_CLASS(27,	256,	2048)					\
+    SIZE_CLASS(28,	512,	2560)					\
+    SIZE_CLASS(29,	512,	3072)					\
+    SIZE_CLASS(30,	512,	3584)					\
+    SIZE_CLASS(31,	512,	4096)					\
+    SIZE_CLASS(32,	1024,	5120)					\
+    SIZE_CLASS(33,	1024,	6144)					\
+    SIZE_CLASS(34,	1024,	7168)					\
+    SIZE_CLASS(35,	1024,	8192)					\
+    SIZE_CLASS(36,	2048,	10240)					\
+    SIZE_CLASS(37,	2048,	12288)					\
+    SIZE_CLASS(38,	2048,	14336)					\
+    SIZE_CLASS(39,	2048,	16384)					\
+    SIZE_CLASS(40,	4096,	20480)					\
+    SIZE_CLASS(41,	4096,	24576)					\
+    SIZE_CLASS(42,	4096,	28672)					\
+    SIZE_CLASS(43,	4096,	32768)					\
+    SIZE_CLASS(44,	8192,	40960)					\
+    SIZE_CLASS(45,	8192,	49152)					\
+    SIZE_CLASS(46,	8192,	57344)					\
+
+#define	NBINS		47
+#define	SMALL_MAXCLASS	57344
+#endif
+
+#if (LG_TINY_MIN == 3 && LG_QUANTUM == 4 && LG_PAGE == 12)
+#define	SIZE_CLASSES_DEFINED
+/*  SIZE_CLASS(bin,	delta,	sz) */
+#define	SIZE_CLASSES							\
+    SIZE_CLASS(0,	8,	8)					\
+    SIZE_CLASS(1,	8,	16)					\
+    SIZE_CLASS(2,	16,	32)					\
+    SIZE_CLASS(3,	16,	48)					\
+    SIZE_CLASS(4,	16,	64)					\
+    SIZE_CLASS(5,	16,	80)					\
+    SIZE_CLASS(6,	16,	96)					\
+    SIZE_CLASS(7,	16,	112)					\
+    SIZE_CLASS(8,	16,	128)					\
+    SIZE_CLASS(9,	32,	160)					\
+    SIZE_CLASS(10,	32,	192)					\
+    SIZE_CLASS(11,	32,	224)					\
+    SIZE_CLASS(12,	32,	256)					\
+    SIZE_CLASS(13,	64,	320)					\
+    SIZE_CLASS(14,	64,	384)					\
+    SIZE_CLASS(15,	64,	448)					\
+    SIZE_CLASS(16,	64,	512)					\
+    SIZE_CLASS(17,	128,	640)					\
+    SIZE_CLASS(18,	128,	768)					\
+    SIZE_CLASS(19,	128,	896)					\
+    SIZE_CLASS(20,	128,	1024)					\
+    SIZE_CLASS(21,	256,	1280)					\
+    SIZE_CLASS(22,	256,	1536)					\
+    SIZE_CLASS(23,	256,	1792)					\
+    SIZE_CLASS(24,	256,	2048)					\
+    SIZE_CLASS(25,	512,	2560)					\
+    SIZE_CLASS(26,	512,	3072)					\
+    SIZE_CLASS(27,	512,	3584)					\
+
+#define	NBINS		28
+#define	SMALL_MAXCLASS	3584
+#endif
+
+#if (LG_TINY_MIN == 3 && LG_QUANTUM == 4 && LG_PAGE == 13)
+#define	SIZE_CLASSES_DEFINED
+/*  SIZE_CLASS(bin,	delta,	sz) */
+#define	SIZE_CLASSES							\
+    SIZE_CLASS(0,	8,	8)					\
+    SIZE_CLASS(1,	8,	16)					\
+    SIZE_CLASS(2,	16,	32)					\
+    SIZE_CLASS(3,	16,	48)					\
+    SIZE_CLASS(4,	16,	64)					\
+    SIZE_CLASS(5,	16,	80)					\
+    SIZE_CLASS(6,	16,	96)					\
+    SIZE_CLASS(7,	16,	112)					\
+    SIZE_CLASS(8,	16,	128)					\
+    SIZE_CLASS(9,	32,	160)					\
+    SIZE_CLASS(10,	32,	192)					\
+    SIZE_CLASS(11,	32,	224)					\
+    SIZE_CLASS(12,	32,	256)					\
+    SIZE_CLASS(13,	64,	320)					\
+    SIZE_CLASS(14,	64,	384)					\
+    SIZE_CLASS(15,	64,	448)					\
+    SIZE_CLASS(16,	64,	512)					\
+    SIZE_CLASS(17,	128,	640)					\
+    SIZE_CLASS(18,	128,	768)					\
+    SIZE_CLASS(19,	128,	896)					\
+    SIZE_CLASS(20,	128,	1024)					\
+    SIZE_CLASS(21,	256,	1280)					\
+    SIZE_CLASS(22,	256,	1536)					\
+    SIZE_CLASS(23,	256,	1792)					\
+    SIZE_CLASS(24,	256,	2048)					\
+    SIZE_CLASS(25,	512,	2560)					\
+    SIZE_CLASS(26,	512,	3072)					\
+    SIZE_CLASS(27,	512,	3584)					\
+    SIZE_CLASS(28,	512,	4096)					\
+    SIZE_CLASS(29,	1024,	5120)					\
+    SIZE_CLASS(30,	1024,	6144)					\
+    SIZE_CLASS(31,	1024,	7168)					\
+
+#define	NBINS		32
+#define	SMALL_MAXCLASS	7168
+#endif
+
+#if (LG_TINY_MIN == 3 && LG_QUANTUM == 4 && LG_PAGE == 14)
+#define	SIZE_CLASSES_DEFINED
+/*  SIZE_CLASS(bin,	delta,	sz) */
+#define	SIZE_CLASSES							\
+    SIZE_CLASS(0,	8,	8)					\
+    SIZE_CLASS(1,	8,	16)					\
+    SIZE_CLASS(2,	16,	32)					\
+    SIZE_CLASS(3,	16,	48)					\
+    SIZE_CLASS(4,	16,	64)					\
+    SIZE_CLASS(5,	16,	80)					\
+    SIZE_CLASS(6,	16,	96)					\
+    SIZE_CLASS(7,	16,	112)					\
+    SIZE_CLASS(8,	16,	128)					\
+    SIZE_CLASS(9,	32,	160)					\
+    SIZE_CLASS(10,	32,	192)					\
+    SIZE_CLASS(11,	32,	224)					\
+    SIZE_CLASS(12,	32,	256)					\
+    SIZE_CLASS(13,	64,	320)					\
+    SIZE_CLASS(14,	64,	384)					\
+    SIZE_CLASS(15,	64,	448)					\
+    SIZE_CLASS(16,	64,	512)					\
+    SIZE_CLASS(17,	128,	640)					\
+    SIZE_CLASS(18,	128,	768)					\
+    SIZE_CLASS(19,	128,	896)					\
+    SIZE_CLASS(20,	128,	1024)					\
+    SIZE_CLASS(21,	256,	1280)					\
+    SIZE_CLASS(22,	256,	1536)					\
+    SIZE_CLASS(23,	256,	1792)					\
+    SIZE_CLASS(24,	256,	2048)					\
+    SIZE_CLASS(25,	512,	2560)					\
+    SIZE_CLASS(26,	512,	3072)					\
+    SIZE_CLASS(27,	512,	3584)					\
+    SIZE_CLASS(28,	512,	4096)					\
+    SIZE_CLASS(29,	1024,	5120)					\
+    SIZE_CLASS(30,	1024,	6144)					\
+    SIZE_CLASS(31,	1024,	7168)					\
+    SIZE_CLASS(32,	1024,	8192)					\
+    SIZE_CLASS(33,	2048,	10240)					\
+    SIZE_CLASS(34,	2048,	12288)					\
+    SIZE_CLASS(35,	2048,	14336)					\
+
+#define	NBINS		36
+#define	SMALL_MAXCLASS	14336
+#endif
+
+#if (LG_TINY_MIN == 3 && LG_QUANTUM == 4 && LG_PAGE == 15)
+#define	SIZE_CLASSES_DEFINED
+/*  SIZE_CLASS(bin,	delta,	sz) */
+#define	SIZE_CLASSES							\
+    SIZE_CLASS(0,	8,	8)					\
+    SIZE_CLASS(1,	8,	16)					\
+    SIZE_CLASS(2,	16,	32)					\
+    SIZE_CLASS(3,	16,	48)					\
+    SIZE_CLASS(4,	16,	64)					\
+    SIZE_CLASS(5,	16,	80)					\
+    SIZE_CLASS(6,	16,	96)					\
+    SIZE_CLASS(7,	16,	112)					\
+    SIZE_CLASS(8,	16,	128)					\
+    SIZE_CLASS(9,	32,	160)					\
+    SIZE_CLASS(10,	32,	192)					\
+    SIZE_CLASS(11,	32,	224)					\
+    SIZE_CLASS(12,	32,	256)					\
+    SIZE_CLASS(13,	64,	320)					\
+    SIZE_CLASS(14,	64,	384)					\
+    SIZE_CLASS(15,	64,	448)					\
+    SIZE_CLASS(16,	64,	512)					\
+    SIZE_CLASS(17,	128,	640)					\
+    SIZE_CLASS(18,	128,	768)					\
+    SIZE_CLASS(19,	128,	896)					\
+    SIZE_CLASS(20,	128,	1024)					\
+    SIZE_CLASS(21,	256,	1280)					\
+    SIZE_CLASS(22,	256,	1536)					\
+    SIZE_CLASS(23,	256,	1792)					\
+    SIZE_CLASS(24,	256,	2048)					\
+    SIZE_CLASS(25,	512,	2560)					\
+    SIZE_CLASS(26,	512,	3072)					\
+    SIZE_CLASS(27,	512,	3584)					\
+    SIZE_CLASS(28,	512,	4096)					\
+    SIZE_CLASS(29,	1024,	5120)					\
+    SIZE_CLASS(30,	1024,	6144)					\
+    SIZE_CLASS(31,	1024,	7168)					\
+    SIZE_CLASS(32,	1024,	8192)					\
+    SIZE_CLASS(33,	2048,	10240)					\
+    SIZE_CLASS(34,	2048,	12288)					\
+    SIZE_CLASS(35,	2048,	14336)					\
+    SIZE_CLASS(36,	2048,	16384)					\
+    SIZE_CLASS(37,	4096,	20480)					\
+    SIZE_CLASS(38,	4096,	24576)					\
+    SIZE_CLASS(39,	4096,	28672)					\
+
+#define	NBINS		40
+#define	SMALL_MAXCLASS	28672
+#endif
+
+#if (LG_TINY_MIN == 3 && LG_QUANTUM == 4 && LG_PAGE == 16)
+#define	SIZE_CLASSES_DEFINED
+/*  SIZE_CLASS(bin,	delta,	sz) */
+#define	SIZE_CLASSES							\
+    SIZE_CLASS(0,	8,	8)					\
+    SIZE_CLASS(1,	8,	16)					\
+    SIZE_CLASS(2,	16,	32)					\
+    SIZE_CLASS(3,	16,	48)					\
+    SIZE_CLASS(4,	16,	64)					\
+    SIZE_CLASS(5,	16,	80)					\
+    SIZE_CLASS(6,	16,	96)					\
+    SIZE_CLASS(7,	16,	112)					\
+    SIZE_CLASS(8,	16,	128)					\
+    SIZE_CLASS(9,	32,	160)					\
+    SIZE_CLASS(10,	32,	192)					\
+    SIZE_CLASS(11,	32,	224)					\
+    SIZE_CLASS(12,	32,	256)					\
+    SIZE_CLASS(13,	64,	320)					\
+    SIZE_CLASS(14,	64,	384)					\
+    SIZE_CLASS(15,	64,	448)					\
+    SIZE_CLASS(16,	64,	512)					\
+    SIZE_CLASS(17,	128,	640)					\
+    SIZE_CLASS(18,	128,	768)					\
+    SIZE_CLASS(19,	128,	896)					\
+    SIZE_CLASS(20,	128,	1024)					\
+    SIZE_CLASS(21,	256,	1280)					\
+    SIZE_CLASS(22,	256,	1536)					\
+    SIZE_CLASS(23,	256,	1792)					\
+    SIZE_CLASS(24,	256,	2048)					\
+    SIZE_CLASS(25,	512,	2560)					\
+    SIZE_CLASS(26,	512,	3072)					\
+    SIZE_CLASS(27,	512,	3584)					\
+    SIZE_CLASS(28,	512,	4096)					\
+    SIZE_CLASS(29,	1024,	5120)					\
+    SIZE_CLASS(30,	1024,	6144)					\
+    SIZE_CLASS(31,	1024,	7168)					\
+    SIZE_CLASS(32,	1024,	8192)					\
+    SIZE_CLASS(33,	2048,	10240)					\
+    SIZE_CLASS(34,	2048,	12288)					\
+    SIZE_CLASS(35,	2048,	14336)					\
+    SIZE_CLASS(36,	2048,	16384)					\
+    SIZE_CLASS(37,	4096,	20480)					\
+    SIZE_CLASS(38,	4096,	24576)					\
+    SIZE_CLASS(39,	4096,	28672)					\
+    SIZE_CLASS(40,	4096,	32768)					\
+    SIZE_CLASS(41,	8192,	40960)					\
+    SIZE_CLASS(42,	8192,	49152)					\
+    SIZE_CLASS(43,	8192,	57344)					\
+
+#define	NBINS		44
+#define	SMALL_MAXCLASS	57344
+#endif
+
+#if (LG_TINY_MIN == 4 && LG_QUANTUM == 4 && LG_PAGE == 12)
+#define	SIZE_CLASSES_DEFINED
+/*  SIZE_CLASS(bin,	delta,	sz) */
+#define	SIZE_CLASSES							\
+    SIZE_CLASS(0,	16,	16)					\
+    SIZE_CLASS(1,	16,	32)					\
+    SIZE_CLASS(2,	16,	48)					\
+    SIZE_CLASS(3,	16,	64)					\
+    SIZE_CLASS(4,	16,	80)					\
+    SIZE_CLASS(5,	16,	96)					\
+    SIZE_CLASS(6,	16,	112)					\
+    SIZE_CLASS(7,	16,	128)					\
+    SIZE_CLASS(8,	32,	160)					\
+    SIZE_CLASS(9,	32,	192)					\
+    SIZE_CLASS(10,	32,	224)					\
+    SIZE_CLASS(11,	32,	256)					\
+    SIZE_CLASS(12,	64,	320)					\
+    SIZE_CLASS(13,	64,	384)					\
+    SIZE_CLASS(14,	64,	448)					\
+    SIZE_CLASS(15,	64,	512)					\
+    SIZE_CLASS(16,	128,	640)					\
+    SIZE_CLASS(17,	128,	768)					\
+    SIZE_CLASS(18,	128,	896)					\
+    SIZE_CLASS(19,	128,	1024)					\
+    SIZE_CLASS(20,	256,	1280)					\
+    SIZE_CLASS(21,	256,	1536)					\
+    SIZE_CLASS(22,	256,	1792)					\
+    SIZE_CLASS(23,	256,	2048)					\
+    SIZE_CLASS(24,	512,	2560)					\
+    SIZE_CLASS(25,	512,	3072)					\
+    SIZE_CLASS(26,	512,	3584)					\
+
+#define	NBINS		27
+#define	SMALL_MAXCLASS	3584
+#endif
+
+#if (LG_TINY_MIN == 4 && LG_QUANTUM == 4 && LG_PAGE == 13)
+#define	SIZE_CLASSES_DEFINED
+/*  SIZE_CLASS(bin,	delta,	sz) */
+#define	SIZE_CLASSES							\
+    SIZE_CLASS(0,	16,	16)					\
+    SIZE_CLASS(1,	16,	32)					\
+    SIZE_CLASS(2,	16,	48)					\
+    SIZE_CLASS(3,	16,	64)					\
+    SIZE_CLASS(4,	16,	80)					\
+    SIZE_CLASS(5,	16,	96)					\
+    SIZE_CLASS(6,	16,	112)					\
+    SIZE_CLASS(7,	16,	128)					\
+    SIZE_CLASS(8,	32,	160)					\
+    SIZE_CLASS(9,	32,	192)					\
+    SIZE_CLASS(10,	32,	224)					\
+    SIZE_CLASS(11,	32,	256)					\
+    SIZE_CLASS(12,	64,	320)					\
+    SIZE_CLASS(13,	64,	384)					\
+    SIZE_CLASS(14,	64,	448)					\
+    SIZE_CLASS(15,	64,	512)					\
+    SIZE_CLASS(16,	128,	640)					\
+    SIZE_CLASS(17,	128,	768)					\
+    SIZE_CLASS(18,	128,	896)					\
+    SIZE_CLASS(19,	128,	1024)					\
+    SIZE_CLASS(20,	256,	1280)					\
+    SIZE_CLASS(21,	256,	1536)					\
+    SIZE_CLASS(22,	256,	1792)					\
+    SIZE_CLASS(23,	256,	2048)					\
+    SIZE_CLASS(24,	512,	2560)					\
+    SIZE_CLASS(25,	512,	3072)					\
+    SIZE_CLASS(26,	512,	3584)					\
+    SIZE_CLASS(27,	512,	4096)					\
+    SIZE_CLASS(28,	1024,	5120)					\
+    SIZE_CLASS(29,	1024,	6144)					\
+    SIZE_CLASS(30,	1024,	7168)					\
+
+#define	NBINS		31
+#define	SMALL_MAXCLASS	7168
+#endif
+
+#if (LG_TINY_MIN == 4 && LG_QUANTUM == 4 && LG_PAGE == 14)
+#define	SIZE_CLASSES_DEFINED
+/*  SIZE_CLASS(bin,	delta,	sz) */
+#define	SIZE_CLASSES							\
+    SIZE_CLASS(0,	16,	16)					\
+    SIZE_CLASS(1,	16,	32)					\
+    SIZE_CLASS(2,	16,	48)					\
+    SIZE_CLASS(3,	16,	64)					\
+    SIZE_CLASS(4,	16,	80)					\
+    SIZE_CLASS(5,	16,	96)					\
+    SIZE_CLASS(6,	16,	112)					\
+    SIZE_CLASS(7,	16,	128)					\
+    SIZE_CLASS(8,	32,	160)					\
+    SIZE_CLASS(9,	32,	192)					\
+    SIZE_CLASS(10,	32,	224)					\
+    SIZE_CLASS(11,	32,	256)					\
+    SIZE_CLASS(12,	64,	320)					\
+    SIZE_CLASS(13,	64,	384)					\
+    SIZE_CLASS(14,	64,	448)					\
+    SIZE_CLASS(15,	64,	512)					\
+    SIZE_CLASS(16,	128,	640)					\
+    SIZE_CLASS(17,	128,	768)					\
+    SIZE_CLASS(18,	128,	896)					\
+    SIZE_CLASS(19,	128,	1024)					\
+    SIZE_CLASS(20,	256,	1280)					\
+    SIZE_CLASS(21,	256,	1536)					\
+    SIZE_CLASS(22,	256,	1792)					\
+    SIZE_CLASS(23,	256,	2048)					\
+    SIZE_CLASS(24,	512,	2560)					\
+    SIZE_CLASS(25,	512,	3072)					\
+    SIZE_CLASS(26,	512,	3584)					\
+    SIZE_CLASS(27,	512,	4096)					\
+    SIZE_CLASS(28,	1024,	5120)					\
+    SIZE_CLASS(29,	1024,	6144)					\
+    SIZE_CLASS(30,	1024,	7168)					\
+    SIZE_CLASS(31,	1024,	8192)					\
+    SIZE_CLASS(32,	2048,	10240)					\
+    SIZE_CLASS(33,	2048,	12288)					\
+    SIZE_CLASS(34,	2048,	14336)					\
+
+#define	NBINS		35
+#define	SMALL_MAXCLASS	14336
+#endif
+
+#if (LG_TINY_MIN == 4 && LG_QUANTUM == 4 && LG_PAGE == 15)
+#define	SIZE_CLASSES_DEFINED
+/*  SIZE_CLASS(bin,	delta,	sz) */
+#define	SIZE_CLASSES							\
+    SIZE_CLASS(0,	16,	16)					\
+    SIZE_CLASS(1,	16,	32)					\
+    SIZE_CLASS(2,	16,	48)					\
+    SIZE_CLASS(3,	16,	64)					\
+    SIZE_CLASS(4,	16,	80)					\
+    SIZE_CLASS(5,	16,	96)					\
+    SIZE_CLASS(6,	16,	112)					\
+    SIZE_CLASS(7,	16,	128)					\
+    SIZE_CLASS(8,	32,	160)					\
+    SIZE_CLASS(9,	32,	192)					\
+    SIZE_CLASS(10,	32,	224)					\
+    SIZE_CLASS(11,	32,	256)					\
+    SIZE_CLASS(12,	64,	320)					\
+    SIZE_CLASS(13,	64,	384)					\
+    SIZE_CLASS(14,	64,	448)					\
+    SIZE_CLASS(15,	64,	512)					\
+    SIZE_CLASS(16,	128,	640)					\
+    SIZE_CLASS(17,	128,	768)					\
+    SIZE_CLASS(18,	128,	896)					\
+    SIZE_CLASS(19,	128,	1024)					\
+    SIZE_CLASS(20,	256,	1280)					\
+    SIZE_CLASS(21,	256,	1536)					\
+    SIZE_CLASS(22,	256,	1792)					\
+    SIZE_CLASS(23,	256,	2048)					\
+    SIZE_CLASS(24,	512,	2560)					\
+    SIZE_CLASS(25,	512,	3072)					\
+    SIZE_CLASS(26,	512,	3584)					\
+    SIZE_CLASS(27,	512,	4096)					\
+    SIZE_CLASS(28,	1024,	5120)					\
+    SIZE_CLASS(29,	1024,	6144)					\
+    SIZE_CLASS(30,	1024,	7168)					\
+    SIZE_CLASS(31,	1024,	8192)					\
+    SIZE_CLASS(32,	2048,	10240)					\
+    SIZE_CLASS(33,	2048,	12288)					\
+    SIZE_CLASS(34,	2048,	14336)					\
+    SIZE_CLASS(35,	2048,	16384)					\
+    SIZE_CLASS(36,	4096,	20480)					\
+    SIZE_CLASS(37,	4096,	24576)					\
+    SIZE_CLASS(38,	4096,	28672)					\
+
+#define	NBINS		39
+#define	SMALL_MAXCLASS	28672
+#endif
+
+#if (LG_TINY_MIN == 4 && LG_QUANTUM == 4 && LG_PAGE == 16)
+#define	SIZE_CLASSES_DEFINED
+/*  SIZE_CLASS(bin,	delta,	sz) */
+#define	SIZE_CLASSES							\
+    SIZE_CLASS(0,	16,	16)					\
+    SIZE_CLASS(1,	16,	32)					\
+    SIZE_CLASS(2,	16,	48)					\
+    SIZE_CLASS(3,	16,	64)					\
+    SIZE_CLASS(4,	16,	80)					\
+    SIZE_CLASS(5,	16,	96)					\
+    SIZE_CLASS(6,	16,	112)					\
+    SIZE_CLASS(7,	16,	128)					\
+    SIZE_CLASS(8,	32,	160)					\
+    SIZE_CLASS(9,	32,	192)					\
+    SIZE_CLASS(10,	32,	224)					\
+    SIZE_CLASS(11,	32,	256)					\
+    SIZE_CLASS(12,	64,	320)					\
+    SIZE_CLASS(13,	64,	384)					\
+    SIZE_CLASS(14,	64,	448)					\
+    SIZE_CLASS(15,	64,	512)					\
+    SIZE_CLASS(16,	128,	640)					\
+    SIZE_CLASS(17,	128,	768)					\
+    SIZE_CLASS(18,	128,	896)					\
+    SIZE_CLASS(19,	128,	1024)					\
+    SIZE_CLASS(20,	256,	1280)					\
+    SIZE_CLASS(21,	256,	1536)					\
+    SIZE_CLASS(22,	256,	1792)					\
+    SIZE_CLASS(23,	256,	2048)					\
+    SIZE_CLASS(24,	512,	2560)					\
+    SIZE_CLASS(25,	512,	3072)					\
+    SIZE_CLASS(26,	512,	3584)					\
+    SIZE_CLASS(27,	512,	4096)					\
+    SIZE_CLASS(28,	1024,	5120)					\
+    SIZE_CLASS(29,	1024,	6144)					\
+    SIZE_CLASS(30,	1024,	7168)					\
+    SIZE_CLASS(31,	1024,	8192)					\
+    SIZE_CLASS(32,	2048,	10240)					\
+    SIZE_CLASS(33,	2048,	12288)					\
+    SIZE_CLASS(34,	2048,	14336)					\
+    SIZE_CLASS(35,	2048,	16384)					\
+    SIZE_CLASS(36,	4096,	20480)					\
+    SIZE_CLASS(37,	4096,	24576)					\
+    SIZE_CLASS(38,	4096,	28672)					\
+    SIZE_CLASS(39,	4096,	32768)					\
+    SIZE_CLASS(40,	8192,	40960)					\
+    SIZE_CLASS(41,	8192,	49152)					\
+    SIZE_CLASS(42,	8192,	57344)					\
+
+#define	NBINS		43
+#define	SMALL_MAXCLASS	57344
+#endif
+
+#ifndef SIZE_CLASSES_DEFINED
+#  error "No size class definitions match configuration"
+#endif
+#undef SIZE_CLASSES_DEFINED
+/*
+ * The small_size2bin lookup table uses uint8_t to encode each bin index, so we
+ * cannot support more than 256 small size classes.  Further constrain NBINS to
+ * 255 to support prof_promote, since all small size classes, plus a "not
+ * small" size class must be stored in 8 bits of arena_chunk_map_t's bits
+ * field.
+ */
+#if (NBINS > 255)
+#  error "Too many small size classes"
+#endif
+
+#endif /* JEMALLOC_H_TYPES */
+/******************************************************************************/
+#ifdef JEMALLOC_H_STRUCTS
+
+
+#endif /* JEMALLOC_H_STRUCTS */
+/******************************************************************************/
+#ifdef JEMALLOC_H_EXTERNS
+
+
+#endif /* JEMALLOC_H_EXTERNS */
+/******************************************************************************/
+#ifdef JEMALLOC_H_INLINES
+
+
+#endif /* JEMALLOC_H_INLINES */
+/******************************************************************************/
@@ -1863,6 +1863,57 @@ je_malloc_usable_size(JEMALLOC_USABLE_SIZE_CONST void *ptr)
 	return (ret);
 }
 
+/*
+ * Used by Redis active defragmentation: returns 1 if 'ptr' is a small
+ * allocation that would be worth moving, 0 otherwise.  On success *bin_util
+ * is set to the utilization of all the runs of the allocation's bin, and
+ * *run_util to the utilization of the run holding 'ptr', both as 16.16 fixed
+ * point fractions.  Moving the allocation makes sense when the run is less
+ * utilized than the bin average, since freeing it helps releasing the run.
+ * Allocations in the chunk of the current run of the bin are never reported,
+ * as that is where new allocations are served from.
+ */
+int
+je_get_defrag_hint(void *ptr, int *bin_util, int *run_util)
+{
+	arena_chunk_t *chunk;
+	size_t pageind, mapbits;
+	int defrag = 0;
+
+	if (!config_stats || ptr == NULL)
+		return (0);
+	chunk = (arena_chunk_t *)CHUNK_ADDR2BASE(ptr);
+	if (chunk == ptr) /* Huge allocation. */
+		return (0);
+	pageind = ((uintptr_t)ptr - (uintptr_t)chunk) >> LG_PAGE;
+	mapbits = arena_mapbits_get(chunk, pageind);
+	if ((mapbits & CHUNK_MAP_LARGE) == 0) {
+		arena_run_t *run = (arena_run_t *)((uintptr_t)chunk +
+		    (uintptr_t)((pageind - (mapbits >> LG_PAGE)) << LG_PAGE));
+		arena_bin_t *bin = run->bin;
+		size_t binind = bin - chunk->arena->bins;
+		arena_bin_info_t *bin_info = &arena_bin_info[binind];
+
+		malloc_mutex_lock(&bin->lock);
+		if (bin->runcur == NULL ||
+		    chunk != (arena_chunk_t *)CHUNK_ADDR2BASE(bin->runcur)) {
+			size_t curregs = bin->stats.allocated /
+			    bin_info->reg_size;
+			size_t availregs = bin_info->nregs *
+			    bin->stats.curruns;
+
+			if (availregs != 0) {
+				*bin_util = (int)((curregs << 16) / availregs);
+				*run_util = (int)(((size_t)(bin_info->nregs -
+				    run->nfree) << 16) / bin_info->nregs);
+				defrag = 1;
+			}
+		}
+		malloc_mutex_unlock(&bin->lock);
+	}
+	return (defrag);
+}
+
 /*
  * End non-standard functions.
  */
@@ -52,10 +52,10 @@ list *listCreate(void)
     return list;
 }
 
-/* Free the whole list.
+/* Remove all the elements from the list without destroying the list itself.
  *
  * This function can't fail. */
-void listRelease(list *list)
+void listEmpty(list *list)
 {
     unsigned long len;
     listNode *current, *next;
@@ -68,6 +68,16 @@ void listRelease(list *list)
         zfree(current);
         current = next;
     }
+    list->head = list->tail = NULL;
+    list->len = 0;
+}
+
+/* Free the whole list.
+ *
+ * This function can't fail. */
+void listRelease(list *list)
+{
+    listEmpty(list);
     zfree(list);
 }
 
@@ -157,6 +167,17 @@ list *listInsertNode(list *list, listNode *old_node, void *value, int after) {
  *
  * This function can't fail. */
 void listDelNode(list *list, listNode *node)
+{
+    listUnlinkNode(list, node);
+    if (list->free) list->free(node->value);
+    zfree(node);
+}
+
+/* Remove the specified node from the list without freeing it, nor the
+ * value it holds.
+ *
+ * This function can't fail. */
+void listUnlinkNode(list *list, listNode *node)
 {
     if (node->prev)
         node->prev->next = node->next;
@@ -166,8 +187,8 @@ void listDelNode(list *list, listNode *node)
         node->next->prev = node->prev;
     else
         list->tail = node->prev;
-    if (list->free) list->free(node->value);
-    zfree(node);
+    node->next = NULL;
+    node->prev = NULL;
     list->len--;
 }
 
@@ -6,11 +6,12 @@
  * reference to a file closing it means unlinking it, and the deletion of the
  * file is slow, blocking the server.
  *
- * In the future we'll either continue implementing new things we need or
- * we'll switch to libeio. However there are probably long term uses for this
- * file as we may want to put here Redis specific background tasks (for instance
- * it is not impossible that we'll need a non blocking FLUSHDB/FLUSHALL
- * implementation).
+ * Later the AOF fsync was moved here as well, and finally the lazy freeing
+ * of big objects and whole databases (UNLINK, FLUSHDB ASYNC, FLUSHALL ASYNC
+ * and the lazyfree-* options), so that releasing millions of allocations
+ * does not block the event loop. See lazyfree.c for more information.
+ * The bucket arrays of very large hash tables are also allocated here, so
+ * that resizing the keyspace does not zero gigabytes of memory inline.
  *
  * DESIGN
  * ------
@@ -147,6 +148,8 @@ void *bioProcessBackgroundJobs(void *arg) {
     pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
     pthread_setcanceltype(PTHREAD_CANCEL_ASYNCHRONOUS, NULL);
 
+    if (type == REDIS_BIO_LAZY_FREE) lazyfree_thread = 1;
+
     pthread_mutex_lock(&bio_mutex[type]);
     /* Block SIGALRM so we are sure that only the main thread will
      * receive the watchdog signal. */
@@ -176,6 +179,24 @@ void *bioProcessBackgroundJobs(void *arg) {
             close((long)job->arg1);
         } else if (type == REDIS_BIO_AOF_FSYNC) {
             aof_fsync((long)job->arg1);
+        } else if (type == REDIS_BIO_LAZY_FREE) {
+            /* What we free changes depending on what arguments are set:
+             * arg2 & arg3 -> free two dictionaries (a Redis DB), and its
+             *                key index if arg1 is set.
+             * only arg1 -> free the object at pointer.
+             * only arg2 -> free the expire index of a Redis DB.
+             * only arg3 -> free the cluster slots to keys map. */
+            if (job->arg2 && job->arg3)
+                lazyfreeFreeDatabaseFromBioThread(job->arg2,job->arg3,
+                                                  job->arg1);
+            else if (job->arg1)
+                lazyfreeFreeObjectFromBioThread(job->arg1);
+            else if (job->arg2)
+                lazyfreeFreeExpireIndexFromBioThread(job->arg2);
+            else if (job->arg3)
+                lazyfreeFreeSlotsMapFromBioThread(job->arg3);
+        } else if (type == REDIS_BIO_ALLOC_TABLE) {
+            dictAllocTableFromBioThread(job->arg1);
         } else {
             redisPanic("Wrong job type in bioProcessBackgroundJobs().");
         }
@@ -38,4 +38,6 @@ void bioKillThreads(void);
 /* Background job opcodes */
 #define REDIS_BIO_CLOSE_FILE    0 /* Deferred close(2) syscall. */
 #define REDIS_BIO_AOF_FSYNC     1 /* Deferred AOF fsync. */
-#define REDIS_BIO_NUM_OPS       2
+#define REDIS_BIO_LAZY_FREE     2 /* Deferred objects freeing. */
+#define REDIS_BIO_ALLOC_TABLE   3 /* Hash table buckets allocation. */
+#define REDIS_BIO_NUM_OPS       4
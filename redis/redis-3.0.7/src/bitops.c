@@ -55,14 +55,47 @@ static int getBitOffsetFromArgument(redisClient *c, robj *o, size_t *offset) {
     return REDIS_OK;
 }
 
-/* Count number of bits set in the binary array pointed by 's' and long
- * 'count' bytes. The implementation of this function is required to
- * work with a input string length up to 512 MB. */
-size_t redisPopcount(void *s, long count) {
+/* -----------------------------------------------------------------------------
+ * Bitmap kernels.
+ *
+ * BITCOUNT, BITPOS and BITOP spend most of their time in the loops below
+ * when called against big bitmaps. Besides the portable implementation,
+ * on x86 there are kernels using the POPCNT instruction and AVX2, compiled
+ * with function target attributes so that the rest of the server does not
+ * require those instructions. The best kernel supported by the CPU is
+ * selected the first time it is needed, and DEBUG BITOPS-KERNEL can force
+ * a different one in order to compare them with redis-benchmark.
+ * -------------------------------------------------------------------------- */
+
+#define BITOP_AND   0
+#define BITOP_OR    1
+#define BITOP_XOR   2
+#define BITOP_NOT   3
+
+#define BITOPS_KERNEL_SCALAR 0  /* Portable C code. */
+#define BITOPS_KERNEL_POPCNT 1  /* POPCNT instruction for BITCOUNT. */
+#define BITOPS_KERNEL_AVX2 2    /* AVX2 for BITCOUNT, BITPOS and BITOP. */
+#define BITOPS_KERNEL_AUTO -1   /* Not yet selected. */
+
+static int bitops_kernel = BITOPS_KERNEL_AUTO;
+static char *bitopsKernelNames[] = {"scalar","popcnt","avx2"};
+
+static const unsigned char bitsinbyte[256] = {
+    0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4,1,2,2,3,2,3,3,4,2,3,3,4,3,4,4,5,
+    1,2,2,3,2,3,3,4,2,3,3,4,3,4,4,5,2,3,3,4,3,4,4,5,3,4,4,5,4,5,5,6,
+    1,2,2,3,2,3,3,4,2,3,3,4,3,4,4,5,2,3,3,4,3,4,4,5,3,4,4,5,4,5,5,6,
+    2,3,3,4,3,4,4,5,3,4,4,5,4,5,5,6,3,4,4,5,4,5,5,6,4,5,5,6,5,6,6,7,
+    1,2,2,3,2,3,3,4,2,3,3,4,3,4,4,5,2,3,3,4,3,4,4,5,3,4,4,5,4,5,5,6,
+    2,3,3,4,3,4,4,5,3,4,4,5,4,5,5,6,3,4,4,5,4,5,5,6,4,5,5,6,5,6,6,7,
+    2,3,3,4,3,4,4,5,3,4,4,5,4,5,5,6,3,4,4,5,4,5,5,6,4,5,5,6,5,6,6,7,
+    3,4,4,5,4,5,5,6,4,5,5,6,5,6,6,7,4,5,5,6,5,6,6,7,5,6,6,7,6,7,7,8
+};
+
+/* Portable implementation of redisPopcount(), see below. */
+static size_t redisPopcountScalar(void *s, long count) {
     size_t bits = 0;
     unsigned char *p = s;
     uint32_t *p4;
-    static const unsigned char bitsinbyte[256] = {0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4,1,2,2,3,2,3,3,4,2,3,3,4,3,4,4,5,1,2,2,3,2,3,3,4,2,3,3,4,3,4,4,5,2,3,3,4,3,4,4,5,3,4,4,5,4,5,5,6,1,2,2,3,2,3,3,4,2,3,3,4,3,4,4,5,2,3,3,4,3,4,4,5,3,4,4,5,4,5,5,6,2,3,3,4,3,4,4,5,3,4,4,5,4,5,5,6,3,4,4,5,4,5,5,6,4,5,5,6,5,6,6,7,1,2,2,3,2,3,3,4,2,3,3,4,3,4,4,5,2,3,3,4,3,4,4,5,3,4,4,5,4,5,5,6,2,3,3,4,3,4,4,5,3,4,4,5,4,5,5,6,3,4,4,5,4,5,5,6,4,5,5,6,5,6,6,7,2,3,3,4,3,4,4,5,3,4,4,5,4,5,5,6,3,4,4,5,4,5,5,6,4,5,5,6,5,6,6,7,3,4,4,5,4,5,5,6,4,5,5,6,5,6,6,7,4,5,5,6,5,6,6,7,5,6,6,7,6,7,7,8};
 
     /* Count initial bytes not aligned to 32 bit. */
     while((unsigned long)p & 3 && count) {
@@ -112,6 +145,228 @@ size_t redisPopcount(void *s, long count) {
     return bits;
 }
 
+#ifdef HAVE_X86_SIMD
+#include <immintrin.h>
+
+/* redisPopcount() using the POPCNT instruction, 32 bytes per iteration
+ * into independent accumulators. */
+__attribute__((target("popcnt")))
+static size_t redisPopcountPopcnt(void *s, long count) {
+    unsigned char *p = s;
+    uint64_t *p8;
+    size_t bits = 0, aux1 = 0, aux2 = 0, aux3 = 0, aux4 = 0;
+
+    while((unsigned long)p & 7 && count) {
+        bits += bitsinbyte[*p++];
+        count--;
+    }
+    p8 = (uint64_t*)p;
+    while(count >= 32) {
+        aux1 += __builtin_popcountll(p8[0]);
+        aux2 += __builtin_popcountll(p8[1]);
+        aux3 += __builtin_popcountll(p8[2]);
+        aux4 += __builtin_popcountll(p8[3]);
+        p8 += 4;
+        count -= 32;
+    }
+    bits += aux1 + aux2 + aux3 + aux4;
+    p = (unsigned char*)p8;
+    while(count--) bits += bitsinbyte[*p++];
+    return bits;
+}
+
+/* Add to 'acc' the number of bits set in every byte of 'v': the count of
+ * every nibble is looked up in a 16 entries table with VPSHUFB. */
+#define POPCOUNT_AVX2_BYTES(acc,v) do { \
+    __m256i _lo = _mm256_and_si256((v),low_mask); \
+    __m256i _hi = _mm256_and_si256(_mm256_srli_epi16((v),4),low_mask); \
+    (acc) = _mm256_add_epi8((acc),_mm256_shuffle_epi8(lookup,_lo)); \
+    (acc) = _mm256_add_epi8((acc),_mm256_shuffle_epi8(lookup,_hi)); \
+} while(0)
+
+/* redisPopcount() using AVX2, 64 bytes per iteration. The per byte counts
+ * are accumulated with byte additions, and summed into 64 bit counters with
+ * VPSADBW before they may overflow. */
+__attribute__((target("avx2")))
+static size_t redisPopcountAVX2(void *s, long count) {
+    unsigned char *p = s;
+    const __m256i lookup = _mm256_setr_epi8(
+        0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4,
+        0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4);
+    const __m256i low_mask = _mm256_set1_epi8(0x0f);
+    __m256i total = _mm256_setzero_si256();
+    uint64_t lanes[4];
+    size_t bits;
+
+    while(count >= 64) {
+        __m256i acc = _mm256_setzero_si256();
+        int j;
+
+        /* Every iteration adds at most 16 to each byte counter. */
+        for (j = 0; j < 15 && count >= 64; j++) {
+            __m256i v1 = _mm256_loadu_si256((__m256i*)p);
+            __m256i v2 = _mm256_loadu_si256((__m256i*)(p+32));
+            POPCOUNT_AVX2_BYTES(acc,v1);
+            POPCOUNT_AVX2_BYTES(acc,v2);
+            p += 64;
+            count -= 64;
+        }
+        total = _mm256_add_epi64(total,
+                    _mm256_sad_epu8(acc,_mm256_setzero_si256()));
+    }
+    _mm256_storeu_si256((__m256i*)lanes,total);
+    bits = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    while(count--) bits += bitsinbyte[*p++];
+    return bits;
+}
+
+/* Return the number of bytes at the start of 's' (up to 'count') that
+ * are all zeros if 'bit' is 1, or all ones if 'bit' is 0, in blocks of
+ * 32 bytes, so that redisBitpos() can start from there. */
+__attribute__((target("avx2")))
+static unsigned long redisBitposSkipAVX2(unsigned char *s, unsigned long count,
+                                         int bit)
+{
+    const __m256i ones = _mm256_set1_epi8(-1);
+    unsigned long skipped = 0;
+
+    while (count - skipped >= 128) {
+        __m256i v1 = _mm256_loadu_si256((__m256i*)(s+skipped));
+        __m256i v2 = _mm256_loadu_si256((__m256i*)(s+skipped+32));
+        __m256i v3 = _mm256_loadu_si256((__m256i*)(s+skipped+64));
+        __m256i v4 = _mm256_loadu_si256((__m256i*)(s+skipped+96));
+
+        if (bit) {
+            __m256i v = _mm256_or_si256(_mm256_or_si256(v1,v2),
+                                        _mm256_or_si256(v3,v4));
+            if (!_mm256_testz_si256(v,v)) break;
+        } else {
+            __m256i v = _mm256_and_si256(_mm256_and_si256(v1,v2),
+                                         _mm256_and_si256(v3,v4));
+            if (!_mm256_testc_si256(v,ones)) break;
+        }
+        skipped += 128;
+    }
+    while (count - skipped >= 32) {
+        __m256i v = _mm256_loadu_si256((__m256i*)(s+skipped));
+
+        if (bit ? !_mm256_testz_si256(v,v) : !_mm256_testc_si256(v,ones))
+            break;
+        skipped += 32;
+    }
+    return skipped;
+}
+
+/* Compute 'len' bytes of the result of BITOP 'op' into 'res', 128 bytes
+ * at a time. Return the number of bytes processed, a multiple of 32 that
+ * is less than 32 bytes from 'len'. The source strings must all be at
+ * least 'len' bytes. */
+#define BITOP_AVX2_LOOP(block,intrin) do { \
+    for (; j + (block) <= len; j += (block)) { \
+        for (k = 0; k < (block)/32; k++) \
+            v[k] = _mm256_loadu_si256((__m256i*)(src[0]+j+k*32)); \
+        for (i = 1; i < numkeys; i++) { \
+            for (k = 0; k < (block)/32; k++) \
+                v[k] = intrin(v[k], \
+                    _mm256_loadu_si256((__m256i*)(src[i]+j+k*32))); \
+        } \
+        for (k = 0; k < (block)/32; k++) \
+            _mm256_storeu_si256((__m256i*)(res+j+k*32),v[k]); \
+    } \
+} while(0)
+
+__attribute__((target("avx2")))
+static unsigned long bitopAVX2(int op, unsigned char *res,
+                               unsigned char **src, unsigned long numkeys,
+                               unsigned long len)
+{
+    unsigned long i, j = 0;
+    __m256i v[4];
+    int k;
+
+    if (op == BITOP_AND) {
+        BITOP_AVX2_LOOP(128,_mm256_and_si256);
+        BITOP_AVX2_LOOP(32,_mm256_and_si256);
+    } else if (op == BITOP_OR) {
+        BITOP_AVX2_LOOP(128,_mm256_or_si256);
+        BITOP_AVX2_LOOP(32,_mm256_or_si256);
+    } else if (op == BITOP_XOR) {
+        BITOP_AVX2_LOOP(128,_mm256_xor_si256);
+        BITOP_AVX2_LOOP(32,_mm256_xor_si256);
+    } else if (op == BITOP_NOT) {
+        const __m256i ones = _mm256_set1_epi8(-1);
+
+        for (; j + 32 <= len; j += 32) {
+            v[0] = _mm256_loadu_si256((__m256i*)(src[0]+j));
+            _mm256_storeu_si256((__m256i*)(res+j),
+                                _mm256_xor_si256(v[0],ones));
+        }
+    }
+    return j;
+}
+#endif
+
+/* Return non zero if the specified kernel can run on this CPU. */
+static int bitopsKernelSupported(int kernel) {
+    if (kernel == BITOPS_KERNEL_SCALAR) return 1;
+#ifdef HAVE_X86_SIMD
+    __builtin_cpu_init();
+    if (kernel == BITOPS_KERNEL_POPCNT)
+        return __builtin_cpu_supports("popcnt");
+    if (kernel == BITOPS_KERNEL_AVX2)
+        return __builtin_cpu_supports("avx2");
+#endif
+    return 0;
+}
+
+/* Return the kernel to use, selecting the best one available the first
+ * time the function is called. */
+static int bitopsKernel(void) {
+    if (bitops_kernel == BITOPS_KERNEL_AUTO) {
+        bitops_kernel = BITOPS_KERNEL_AVX2;
+        while (!bitopsKernelSupported(bitops_kernel)) bitops_kernel--;
+    }
+    return bitops_kernel;
+}
+
+/* Return the name of the kernel in use. */
+char *bitopsGetKernelName(void) {
+    return bitopsKernelNames[bitopsKernel()];
+}
+
+/* Force the kernel with the specified name, or select again the best one if
+ * the name is "auto". Returns REDIS_ERR if the kernel does not exist or is
+ * not supported by this CPU. */
+int bitopsSetKernel(char *name) {
+    int j;
+
+    if (!strcasecmp(name,"auto")) {
+        bitops_kernel = BITOPS_KERNEL_AUTO;
+        return REDIS_OK;
+    }
+    for (j = BITOPS_KERNEL_SCALAR; j <= BITOPS_KERNEL_AVX2; j++) {
+        if (!strcasecmp(name,bitopsKernelNames[j])) {
+            if (!bitopsKernelSupported(j)) return REDIS_ERR;
+            bitops_kernel = j;
+            return REDIS_OK;
+        }
+    }
+    return REDIS_ERR;
+}
+
+/* Count number of bits set in the binary array pointed by 's' and long
+ * 'count' bytes. The implementation of this function is required to
+ * work with a input string length up to 512 MB. */
+size_t redisPopcount(void *s, long count) {
+#ifdef HAVE_X86_SIMD
+    switch(bitopsKernel()) {
+    case BITOPS_KERNEL_AVX2: return redisPopcountAVX2(s,count);
+    case BITOPS_KERNEL_POPCNT: return redisPopcountPopcnt(s,count);
+    }
+#endif
+    return redisPopcountScalar(s,count);
+}
+
 /* Return the position of the first bit set to one (if 'bit' is 1) or
  * zero (if 'bit' is 0) in the bitmap starting at 's' and long 'count' bytes.
  *
@@ -145,6 +400,16 @@ long redisBitpos(void *s, unsigned long count, int bit) {
         pos += 8;
     }
 
+#ifdef HAVE_X86_SIMD
+    /* Skip bits with a 32 bytes step. */
+    if (bitopsKernel() == BITOPS_KERNEL_AVX2) {
+        unsigned long skipped = redisBitposSkipAVX2(c,count,bit);
+        c += skipped;
+        count -= skipped;
+        pos += skipped*8;
+    }
+#endif
+
     /* Skip bits with full word step. */
     skipval = bit ? 0 : ULONG_MAX;
     l = (unsigned long*) c;
@@ -203,11 +468,6 @@ long redisBitpos(void *s, unsigned long count, int bit) {
  * Bits related string commands: GETBIT, SETBIT, BITCOUNT, BITOP.
  * -------------------------------------------------------------------------- */
 
-#define BITOP_AND   0
-#define BITOP_OR    1
-#define BITOP_XOR   2
-#define BITOP_NOT   3
-
 /* SETBIT key offset bitvalue */
 void setbitCommand(redisClient *c) {
     robj *o;
@@ -360,64 +620,58 @@ void bitopCommand(redisClient *c) {
          * can take a fast path that performs much better than the
          * vanilla algorithm. */
         j = 0;
-        if (minlen >= sizeof(unsigned long)*4 && numkeys <= 16) {
-            unsigned long *lp[16];
-            unsigned long *lres = (unsigned long*) res;
-
-            /* Note: sds pointer is always aligned to 8 byte boundary. */
-            memcpy(lp,src,sizeof(unsigned long*)*numkeys);
-            memcpy(res,src[0],minlen);
-
-            /* Different branches per different operations for speed (sorry). */
-            if (op == BITOP_AND) {
-                while(minlen >= sizeof(unsigned long)*4) {
+#ifdef HAVE_X86_SIMD
+        if (bitopsKernel() == BITOPS_KERNEL_AVX2 && minlen >= 32) {
+            j = bitopAVX2(op,res,src,numkeys,minlen);
+            minlen -= j;
+        }
+#endif
+        if (minlen >= sizeof(unsigned long)*4) {
+            unsigned long lres[4], lsrc[4];
+
+            /* Note: the sds headers have different sizes, so the strings
+             * are not aligned to the size of a long. Words are loaded and
+             * stored with memcpy(), that compiles to unaligned moves. The
+             * SIMD pass stops at a multiple of 32 bytes: continue from the
+             * first byte it did not process. */
+            while(minlen >= sizeof(lres)) {
+                memcpy(lres,src[0]+j,sizeof(lres));
+
+                /* Different branches per different operations for speed
+                 * (sorry). */
+                if (op == BITOP_AND) {
                     for (i = 1; i < numkeys; i++) {
-                        lres[0] &= lp[i][0];
-                        lres[1] &= lp[i][1];
-                        lres[2] &= lp[i][2];
-                        lres[3] &= lp[i][3];
-                        lp[i]+=4;
+                        memcpy(lsrc,src[i]+j,sizeof(lsrc));
+                        lres[0] &= lsrc[0];
+                        lres[1] &= lsrc[1];
+                        lres[2] &= lsrc[2];
+                        lres[3] &= lsrc[3];
                     }
-                    lres+=4;
-                    j += sizeof(unsigned long)*4;
-                    minlen -= sizeof(unsigned long)*4;
-                }
-            } else if (op == BITOP_OR) {
-                while(minlen >= sizeof(unsigned long)*4) {
+                } else if (op == BITOP_OR) {
                     for (i = 1; i < numkeys; i++) {
-                        lres[0] |= lp[i][0];
-                        lres[1] |= lp[i][1];
-                        lres[2] |= lp[i][2];
-                        lres[3] |= lp[i][3];
-                        lp[i]+=4;
+                        memcpy(lsrc,src[i]+j,sizeof(lsrc));
+                        lres[0] |= lsrc[0];
+                        lres[1] |= lsrc[1];
+                        lres[2] |= lsrc[2];
+                        lres[3] |= lsrc[3];
                     }
-                    lres+=4;
-                    j += sizeof(unsigned long)*4;
-                    minlen -= sizeof(unsigned long)*4;
-                }
-            } else if (op == BITOP_XOR) {
-                while(minlen >= sizeof(unsigned long)*4) {
+                } else if (op == BITOP_XOR) {
                     for (i = 1; i < numkeys; i++) {
-                        lres[0] ^= lp[i][0];
-                        lres[1] ^= lp[i][1];
-                        lres[2] ^= lp[i][2];
-                        lres[3] ^= lp[i][3];
-                        lp[i]+=4;
+                        memcpy(lsrc,src[i]+j,sizeof(lsrc));
+                        lres[0] ^= lsrc[0];
+                        lres[1] ^= lsrc[1];
+                        lres[2] ^= lsrc[2];
+                        lres[3] ^= lsrc[3];
                     }
-                    lres+=4;
-                    j += sizeof(unsigned long)*4;
-                    minlen -= sizeof(unsigned long)*4;
-                }
-            } else if (op == BITOP_NOT) {
-                while(minlen >= sizeof(unsigned long)*4) {
+                } else if (op == BITOP_NOT) {
                     lres[0] = ~lres[0];
                     lres[1] = ~lres[1];
                     lres[2] = ~lres[2];
                     lres[3] = ~lres[3];
-                    lres+=4;
-                    j += sizeof(unsigned long)*4;
-                    minlen -= sizeof(unsigned long)*4;
                 }
+                memcpy(res+j,lres,sizeof(lres));
+                j += sizeof(lres);
+                minlen -= sizeof(lres);
             }
         }
 
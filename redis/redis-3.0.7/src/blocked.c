@@ -117,10 +117,11 @@ void processUnblockedClients(void) {
         listDelNode(server.unblocked_clients,ln);
         c->flags &= ~REDIS_UNBLOCKED;
 
-        /* Process remaining data in the input buffer. */
-        if (c->querybuf && sdslen(c->querybuf) > 0) {
+        /* Process remaining data in the input buffer, or the commands
+         * already parsed by the I/O threads. */
+        if (clientHasPendingInput(c)) {
             server.current_client = c;
-            processInputBuffer(c);
+            processInputBufferAndReplicate(c);
             server.current_client = NULL;
         }
     }
@@ -73,6 +73,8 @@ void resetManualFailover(void);
 void clusterCloseAllSlots(void);
 void clusterSetNodeAsMaster(clusterNode *n);
 void clusterDelNode(clusterNode *delnode);
+void clusterSlotMigrationCron(void);
+void clusterMigrateSlotCommand(redisClient *c);
 sds representRedisNodeFlags(sds ci, uint16_t flags);
 uint64_t clusterGetMaxEpoch(void);
 int clusterBumpConfigEpochWithoutConsensus(void);
@@ -415,6 +417,12 @@ void clusterInit(void) {
     server.cluster->lastVoteEpoch = 0;
     server.cluster->stats_bus_messages_sent = 0;
     server.cluster->stats_bus_messages_received = 0;
+    server.cluster->stats_bus_bytes_sent = 0;
+    server.cluster->stats_bus_bytes_received = 0;
+    server.cluster->stats_pfail_nodes = 0;
+    memset(server.cluster->compact_slots,0,
+           sizeof(server.cluster->compact_slots));
+    server.cluster->compact_slots_version = 1;
     memset(server.cluster->slots,0, sizeof(server.cluster->slots));
     clusterCloseAllSlots();
 
@@ -466,8 +474,9 @@ void clusterInit(void) {
         }
     }
 
-    /* The slots -> keys map is a sorted set. Init it. */
-    server.cluster->slots_to_keys = zslCreate();
+    /* The slots -> keys map has a dictionary for every slot. Init it. */
+    server.cluster->slots_to_keys = slotToKeyCreate();
+    server.cluster->slot_migration = NULL;
 
     /* Set myself->port to my listening port, we'll just need to discover
      * the IP address via MEET messages. */
@@ -495,7 +504,7 @@ void clusterReset(int hard) {
     if (nodeIsSlave(myself)) {
         clusterSetNodeAsMaster(myself);
         replicationUnsetMaster();
-        emptyDb(NULL);
+        emptyDb(-1,EMPTYDB_NO_FLAGS,NULL);
     }
 
     /* Close slots, reset manual failover state. */
@@ -550,6 +559,9 @@ clusterLink *createClusterLink(clusterNode *node) {
     link->rcvbuf = sdsempty();
     link->node = node;
     link->fd = -1;
+    link->compact = 0;
+    link->slots_version_sent = 0;
+    link->peer_slots = NULL;
     return link;
 }
 
@@ -563,6 +575,7 @@ void freeClusterLink(clusterLink *link) {
     }
     sdsfree(link->sndbuf);
     sdsfree(link->rcvbuf);
+    zfree(link->peer_slots);
     if (link->node)
         link->node->link = NULL;
     close(link->fd);
@@ -1550,6 +1563,11 @@ int clusterProcessPacket(clusterLink *link) {
         return 1;
     }
 
+    /* Send compact PING / PONG on this link only if the peer asks for it
+     * (nodes not supporting them never set the flag). */
+    link->compact = server.cluster_compact_bus &&
+                    (hdr->mflags[0] & CLUSTERMSG_FLAG0_COMPACT);
+
     uint16_t flags = ntohs(hdr->flags);
     uint64_t senderCurrentEpoch = 0, senderConfigEpoch = 0;
     clusterNode *sender;
@@ -1900,7 +1918,7 @@ int clusterProcessPacket(clusterLink *link) {
         /* Don't bother creating useless objects if there are no
          * Pub/Sub subscribers. */
         if (dictSize(server.pubsub_channels) ||
-           listLength(server.pubsub_patterns))
+           server.pubsub_numpat)
         {
             channel_len = ntohl(hdr->data.publish.msg.channel_len);
             message_len = ntohl(hdr->data.publish.msg.message_len);
@@ -2003,6 +2021,85 @@ void clusterWriteHandler(aeEventLoop *el, int fd, void *privdata, int mask) {
 /* Read data. Try to read the first field of the header first to check the
  * full length of the packet. When a whole packet is in memory this function
  * will call the function to process the packet. And so forth. */
+/* Decode the slots of a compact message with CLUSTERMSG_SLOTS_RUNS encoding
+ * into 'slots'. Returns REDIS_ERR if the runs don't describe exactly all the
+ * slots. */
+static int clusterDecodeSlotRuns(unsigned char *slots, unsigned char *p,
+                                 uint32_t len)
+{
+    int slot = 0, served = 0, j;
+
+    if (len % 2) return REDIS_ERR;
+    memset(slots,0,REDIS_CLUSTER_SLOTS/8);
+    for (; len; len -= 2, p += 2, served = !served) {
+        int run = (p[0] << 8) | p[1];
+
+        if (slot+run > REDIS_CLUSTER_SLOTS) return REDIS_ERR;
+        if (served) {
+            for (j = slot; j < slot+run; j++)
+                slots[j>>3] |= 1<<(j&7);
+        }
+        slot += run;
+    }
+    return (slot == REDIS_CLUSTER_SLOTS) ? REDIS_OK : REDIS_ERR;
+}
+
+/* Turn the compact message in the link receive buffer into the equivalent
+ * full message, using the slots last received on the link if the message
+ * doesn't include them. Returns REDIS_ERR if the message is malformed. */
+static int clusterExpandCompactMessage(clusterLink *link) {
+    clusterMsgCompact *cm = (clusterMsgCompact*) link->rcvbuf;
+    uint32_t totlen = ntohl(cm->totlen), slotslen = ntohl(cm->slots_len);
+    uint16_t type = ntohs(cm->type), count = ntohs(cm->count);
+    uint16_t enc = ntohs(cm->slots_enc);
+    size_t gossiplen = sizeof(clusterMsgDataGossip)*count;
+    unsigned char slots[REDIS_CLUSTER_SLOTS/8], *slotsdata;
+    clusterMsg *hdr;
+    sds buf;
+
+    if (type != CLUSTERMSG_TYPE_PING && type != CLUSTERMSG_TYPE_PONG)
+        return REDIS_ERR;
+    if (totlen != sizeof(*cm)+gossiplen+slotslen) return REDIS_ERR;
+    slotsdata = ((unsigned char*)cm->gossip)+gossiplen;
+
+    if (enc == CLUSTERMSG_SLOTS_SAME) {
+        if (slotslen != 0 || link->peer_slots == NULL) return REDIS_ERR;
+        memcpy(slots,link->peer_slots,sizeof(slots));
+    } else if (enc == CLUSTERMSG_SLOTS_BITMAP) {
+        if (slotslen != sizeof(slots)) return REDIS_ERR;
+        memcpy(slots,slotsdata,sizeof(slots));
+    } else if (enc == CLUSTERMSG_SLOTS_RUNS) {
+        if (clusterDecodeSlotRuns(slots,slotsdata,slotslen) == REDIS_ERR)
+            return REDIS_ERR;
+    } else {
+        return REDIS_ERR;
+    }
+    if (link->peer_slots == NULL) link->peer_slots = zmalloc(sizeof(slots));
+    memcpy(link->peer_slots,slots,sizeof(slots));
+
+    buf = sdsnewlen(NULL,CLUSTERMSG_MIN_LEN+gossiplen);
+    hdr = (clusterMsg*) buf;
+    memcpy(hdr->sig,"RCmb",4);
+    hdr->totlen = htonl(CLUSTERMSG_MIN_LEN+gossiplen);
+    hdr->ver = cm->ver;
+    hdr->type = cm->type;
+    hdr->count = cm->count;
+    hdr->currentEpoch = cm->currentEpoch;
+    hdr->configEpoch = cm->configEpoch;
+    hdr->offset = cm->offset;
+    memcpy(hdr->sender,cm->sender,REDIS_CLUSTER_NAMELEN);
+    memcpy(hdr->myslots,slots,sizeof(slots));
+    memcpy(hdr->slaveof,cm->slaveof,REDIS_CLUSTER_NAMELEN);
+    hdr->port = cm->port;
+    hdr->flags = cm->flags;
+    hdr->state = cm->state;
+    memcpy(hdr->mflags,cm->mflags,sizeof(hdr->mflags));
+    memcpy(hdr->data.ping.gossip,cm->gossip,gossiplen);
+    sdsfree(link->rcvbuf);
+    link->rcvbuf = buf;
+    return REDIS_OK;
+}
+
 void clusterReadHandler(aeEventLoop *el, int fd, void *privdata, int mask) {
     char buf[sizeof(clusterMsg)];
     ssize_t nread;
@@ -2024,8 +2121,13 @@ void clusterReadHandler(aeEventLoop *el, int fd, void *privdata, int mask) {
             if (rcvbuflen == 8) {
                 /* Perform some sanity check on the message signature
                  * and length. */
-                if (memcmp(hdr->sig,"RCmb",4) != 0 ||
-                    ntohl(hdr->totlen) < CLUSTERMSG_MIN_LEN)
+                int full = memcmp(hdr->sig,"RCmb",4) == 0;
+                int compact = memcmp(hdr->sig,"RCmc",4) == 0;
+                uint32_t totlen = ntohl(hdr->totlen);
+
+                if ((!full && !compact) ||
+                    (full && totlen < CLUSTERMSG_MIN_LEN) ||
+                    (compact && totlen < sizeof(clusterMsgCompact)))
                 {
                     redisLog(REDIS_WARNING,
                         "Bad message length or signature received "
@@ -2052,10 +2154,20 @@ void clusterReadHandler(aeEventLoop *el, int fd, void *privdata, int mask) {
             link->rcvbuf = sdscatlen(link->rcvbuf,buf,nread);
             hdr = (clusterMsg*) link->rcvbuf;
             rcvbuflen += nread;
+            server.cluster->stats_bus_bytes_received += nread;
         }
 
         /* Total length obtained? Process this packet. */
         if (rcvbuflen >= 8 && rcvbuflen == ntohl(hdr->totlen)) {
+            if (memcmp(hdr->sig,"RCmc",4) == 0 &&
+                clusterExpandCompactMessage(link) == REDIS_ERR)
+            {
+                redisLog(REDIS_VERBOSE,
+                    "Discarding malformed compact message from Cluster bus.");
+                sdsfree(link->rcvbuf);
+                link->rcvbuf = sdsempty();
+                continue;
+            }
             if (clusterProcessPacket(link)) {
                 sdsfree(link->rcvbuf);
                 link->rcvbuf = sdsempty();
@@ -2078,6 +2190,7 @@ void clusterSendMessage(clusterLink *link, unsigned char *msg, size_t msglen) {
 
     link->sndbuf = sdscatlen(link->sndbuf, msg, msglen);
     server.cluster->stats_bus_messages_sent++;
+    server.cluster->stats_bus_bytes_sent += msglen;
 }
 
 /* Send a message to all the nodes that are part of the cluster having
@@ -2147,6 +2260,8 @@ void clusterBuildMessageHdr(clusterMsg *hdr, int type) {
     /* Set the message flags. */
     if (nodeIsMaster(myself) && server.cluster->mf_end)
         hdr->mflags[0] |= CLUSTERMSG_FLAG0_PAUSED;
+    if (server.cluster_compact_bus)
+        hdr->mflags[0] |= CLUSTERMSG_FLAG0_COMPACT;
 
     /* Compute the message length for certain messages. For other messages
      * this is up to the caller. */
@@ -2161,6 +2276,91 @@ void clusterBuildMessageHdr(clusterMsg *hdr, int type) {
     /* For PING, PONG, and MEET, fixing the totlen field is up to the caller. */
 }
 
+/* Encode the slots bitmap 'slots' as CLUSTERMSG_SLOTS_RUNS into 'p', that
+ * must have room for 'maxlen' bytes. Returns the number of bytes used, or
+ * -1 if the encoding would need more than 'maxlen' bytes. */
+static int clusterEncodeSlotRuns(unsigned char *p, int maxlen,
+                                 unsigned char *slots)
+{
+    int slot = 0, served = 0, len = 0;
+
+    while (slot < REDIS_CLUSTER_SLOTS) {
+        int run = 0;
+
+        while (slot < REDIS_CLUSTER_SLOTS &&
+               ((slots[slot>>3] & (1<<(slot&7))) != 0) == served)
+        {
+            slot++;
+            run++;
+        }
+        if (len+2 > maxlen) return -1;
+        p[len++] = run >> 8;
+        p[len++] = run & 0xff;
+        served = !served;
+    }
+    return len;
+}
+
+/* Send the PING or PONG in 'hdr', already populated with 'gossipcount'
+ * gossip sections, in the compact format. */
+static void clusterSendCompactPing(clusterLink *link, clusterMsg *hdr,
+                                   int gossipcount)
+{
+    size_t gossiplen = sizeof(clusterMsgDataGossip)*gossipcount;
+    size_t slotsmax = sizeof(hdr->myslots), totlen;
+    clusterMsgCompact *cm;
+    int slotslen = 0, enc;
+
+    /* Every time the slots we advertise change, a new version is created,
+     * and links will send them again with the next message. */
+    if (memcmp(server.cluster->compact_slots,hdr->myslots,
+               sizeof(hdr->myslots)) != 0)
+    {
+        memcpy(server.cluster->compact_slots,hdr->myslots,
+               sizeof(hdr->myslots));
+        server.cluster->compact_slots_version++;
+    }
+
+    cm = zmalloc(sizeof(*cm)+gossiplen+slotsmax);
+    memcpy(cm->sig,"RCmc",4);
+    cm->ver = hdr->ver;
+    cm->type = hdr->type;
+    cm->count = htons(gossipcount);
+    cm->currentEpoch = hdr->currentEpoch;
+    cm->configEpoch = hdr->configEpoch;
+    cm->offset = hdr->offset;
+    memcpy(cm->sender,hdr->sender,REDIS_CLUSTER_NAMELEN);
+    memcpy(cm->slaveof,hdr->slaveof,REDIS_CLUSTER_NAMELEN);
+    cm->port = hdr->port;
+    cm->flags = hdr->flags;
+    cm->state = hdr->state;
+    memcpy(cm->mflags,hdr->mflags,sizeof(cm->mflags));
+    cm->notused1 = 0;
+    memcpy(cm->gossip,hdr->data.ping.gossip,gossiplen);
+
+    if (link->slots_version_sent == server.cluster->compact_slots_version) {
+        enc = CLUSTERMSG_SLOTS_SAME;
+    } else {
+        unsigned char *p = ((unsigned char*)cm->gossip)+gossiplen;
+
+        slotslen = clusterEncodeSlotRuns(p,slotsmax,hdr->myslots);
+        if (slotslen != -1) {
+            enc = CLUSTERMSG_SLOTS_RUNS;
+        } else {
+            enc = CLUSTERMSG_SLOTS_BITMAP;
+            slotslen = slotsmax;
+            memcpy(p,hdr->myslots,slotsmax);
+        }
+        link->slots_version_sent = server.cluster->compact_slots_version;
+    }
+    totlen = sizeof(*cm)+gossiplen+slotslen;
+    cm->slots_enc = htons(enc);
+    cm->slots_len = htonl(slotslen);
+    cm->totlen = htonl(totlen);
+    clusterSendMessage(link,(unsigned char*)cm,totlen);
+    zfree(cm);
+}
+
 /* Send a PING or PONG packet to the specified node, making sure to add enough
  * gossip informations. */
 void clusterSendPing(clusterLink *link, int type) {
@@ -2200,8 +2400,21 @@ void clusterSendPing(clusterLink *link, int type) {
      *
      * Since we have non-voting slaves that lower the probability of an entry
      * to feature our node, we set the number of entires per packet as
-     * 10% of the total nodes we have. */
-    wanted = floor(dictSize(server.cluster->nodes)/10);
+     * 10% of the total nodes we have.
+     *
+     * The above is only needed while some node is failing: when we don't
+     * see any node in PFAIL or FAIL state we just need to propagate the
+     * ping and pong times and the configuration changes, so we send 1/40
+     * of the nodes, that makes a big difference in bus traffic in very big
+     * clusters. As soon as a node is flagged as PFAIL by us we switch back
+     * to 1/10, and the other nodes will start doing the same as they
+     * detect the failure as well. */
+    if (server.cluster->stats_pfail_nodes)
+        wanted = floor(dictSize(server.cluster->nodes)/
+                       REDIS_CLUSTER_GOSSIP_DIV);
+    else
+        wanted = floor(dictSize(server.cluster->nodes)/
+                       REDIS_CLUSTER_GOSSIP_QUIET_DIV);
     if (wanted < 3) wanted = 3;
     if (wanted > freshnodes) wanted = freshnodes;
 
@@ -2271,6 +2484,17 @@ void clusterSendPing(clusterLink *link, int type) {
         gossipcount++;
     }
 
+    /* Use the compact format if the node supports it. MEET messages are
+     * always sent in full since we still don't know anything about the
+     * receiver. */
+    if (link->compact && server.cluster_compact_bus &&
+        type != CLUSTERMSG_TYPE_MEET)
+    {
+        clusterSendCompactPing(link,hdr,gossipcount);
+        zfree(buf);
+        return;
+    }
+
     /* Ready to send... fix the totlen fiend and queue the message in the
      * output buffer. */
     totlen = sizeof(clusterMsg)-sizeof(union clusterMsgData);
@@ -3057,6 +3281,7 @@ void clusterCron(void) {
     int orphaned_masters; /* How many masters there are without ok slaves. */
     int max_slaves; /* Max number of ok slaves for a single master. */
     int this_slaves; /* Number of ok slaves for our master (if we are slave). */
+    int pfail_nodes; /* Number of nodes in PFAIL or FAIL state. */
     mstime_t min_pong = 0, now = mstime();
     clusterNode *min_pong_node = NULL;
     static unsigned long long iteration = 0;
@@ -3169,10 +3394,12 @@ void clusterCron(void) {
      * 1) Check if there are orphaned masters (masters without non failing
      *    slaves).
      * 2) Count the max number of non failing slaves for a single master.
-     * 3) Count the number of slaves for our master, if we are a slave. */
+     * 3) Count the number of slaves for our master, if we are a slave.
+     * 4) Count the nodes in PFAIL or FAIL state, to tune the gossip. */
     orphaned_masters = 0;
     max_slaves = 0;
     this_slaves = 0;
+    pfail_nodes = 0;
     di = dictGetSafeIterator(server.cluster->nodes);
     while((de = dictNext(di)) != NULL) {
         clusterNode *node = dictGetVal(de);
@@ -3183,6 +3410,8 @@ void clusterCron(void) {
             (REDIS_NODE_MYSELF|REDIS_NODE_NOADDR|REDIS_NODE_HANDSHAKE))
                 continue;
 
+        if (node->flags & (REDIS_NODE_PFAIL|REDIS_NODE_FAIL)) pfail_nodes++;
+
         /* Orphaned master check, useful only if the current instance
          * is a slave that may migrate to another master. */
         if (nodeIsSlave(myself) && nodeIsMaster(node) && !nodeFailed(node)) {
@@ -3259,6 +3488,7 @@ void clusterCron(void) {
         }
     }
     dictReleaseIterator(di);
+    server.cluster->stats_pfail_nodes = pfail_nodes;
 
     /* If we are a slave node but the replication is still turned off,
      * enable it if we know the address of our master and it appears to
@@ -3286,6 +3516,9 @@ void clusterCron(void) {
             clusterHandleSlaveMigration(max_slaves);
     }
 
+    /* Handle timeouts and throttling of CLUSTER MIGRATESLOT. */
+    clusterSlotMigrationCron();
+
     if (update_state || server.cluster->state == REDIS_CLUSTER_FAIL)
         clusterUpdateState();
 }
@@ -4066,6 +4299,8 @@ void clusterCommand(redisClient *c) {
             "cluster_my_epoch:%llu\r\n"
             "cluster_stats_messages_sent:%lld\r\n"
             "cluster_stats_messages_received:%lld\r\n"
+            "cluster_stats_bytes_sent:%lld\r\n"
+            "cluster_stats_bytes_received:%lld\r\n"
             , statestr[server.cluster->state],
             slots_assigned,
             slots_ok,
@@ -4076,7 +4311,9 @@ void clusterCommand(redisClient *c) {
             (unsigned long long) server.cluster->currentEpoch,
             (unsigned long long) myepoch,
             server.cluster->stats_bus_messages_sent,
-            server.cluster->stats_bus_messages_received
+            server.cluster->stats_bus_messages_received,
+            server.cluster->stats_bus_bytes_sent,
+            server.cluster->stats_bus_bytes_received
         );
         addReplySds(c,sdscatprintf(sdsempty(),"$%lu\r\n",
             (unsigned long)sdslen(info)));
@@ -4110,7 +4347,7 @@ void clusterCommand(redisClient *c) {
         /* CLUSTER GETKEYSINSLOT <slot> <count> */
         long long maxkeys, slot;
         unsigned int numkeys, j;
-        robj **keys;
+        sds *keys;
 
         if (getLongLongFromObjectOrReply(c,c->argv[2],&slot,NULL) != REDIS_OK)
             return;
@@ -4122,10 +4359,13 @@ void clusterCommand(redisClient *c) {
             return;
         }
 
-        keys = zmalloc(sizeof(robj*)*maxkeys);
+        /* Don't allocate more than needed if the count is huge. */
+        if (maxkeys > countKeysInSlot(slot)) maxkeys = countKeysInSlot(slot);
+        keys = zmalloc(sizeof(sds)*maxkeys);
         numkeys = getKeysInSlot(slot, keys, maxkeys);
         addReplyMultiBulkLen(c,numkeys);
-        for (j = 0; j < numkeys; j++) addReplyBulk(c,keys[j]);
+        for (j = 0; j < numkeys; j++)
+            addReplyBulkCBuffer(c,keys[j],sdslen(keys[j]));
         zfree(keys);
     } else if (!strcasecmp(c->argv[1]->ptr,"forget") && c->argc == 3) {
         /* CLUSTER FORGET <NODE ID> */
@@ -4335,6 +4575,9 @@ void clusterCommand(redisClient *c) {
         }
         clusterReset(hard);
         addReply(c,shared.ok);
+    } else if (!strcasecmp(c->argv[1]->ptr,"migrateslot") && c->argc >= 3) {
+        /* CLUSTER MIGRATESLOT <slot> [options] | STATUS | CANCEL */
+        clusterMigrateSlotCommand(c);
     } else {
         addReplyError(c,"Wrong CLUSTER subcommand or number of arguments");
     }
@@ -4857,6 +5100,604 @@ socket_err:
     return;
 }
 
+/* -----------------------------------------------------------------------------
+ * CLUSTER MIGRATESLOT
+ *
+ * Moving a slot with MIGRATE means a GETKEYSINSLOT + MIGRATE round trip for
+ * every batch of keys, with the source node blocked while it waits for the
+ * target to reply. CLUSTER MIGRATESLOT instead streams all the keys of a
+ * slot that is in MIGRATING state to the node it is migrating to, as
+ * pipelined RESTORE-ASKING batches over a non blocking connection handled
+ * by the event loop. Keys are deleted locally as soon as the target
+ * acknowledges them.
+ *
+ * Since the server keeps serving clients meanwhile, a key that is modified
+ * or deleted after being sent, but before the target acknowledged it, is
+ * not deleted: it is sent again with REPLACE (or deleted in the target) when
+ * the acknowledge arrives. Until then the key is served by this node even
+ * if it was deleted, instead of redirecting its clients to the target with
+ * -ASK: writes performed in the target would be overwritten by the RESTORE,
+ * or deleted by the DEL, that are still to be sent for the key. New keys
+ * can't be created in a MIGRATING slot, so once the slot is empty the
+ * migration is done, and the slot can be assigned to the target with
+ * CLUSTER SETSLOT ... NODE as usual.
+ * -------------------------------------------------------------------------- */
+
+#define MIGSLOT_STATE_NONE 0
+#define MIGSLOT_STATE_CONNECTING 1
+#define MIGSLOT_STATE_RUNNING 2
+#define MIGSLOT_STATE_DONE 3
+#define MIGSLOT_STATE_FAILED 4
+#define MIGSLOT_STATE_CANCELLED 5
+
+#define MIGSLOT_DEFAULT_BATCH 100       /* Keys per batch. */
+#define MIGSLOT_DEFAULT_TIMEOUT 10000   /* I/O timeout in milliseconds. */
+#define MIGSLOT_MAX_BATCHES_INFLIGHT 4  /* Pipeline depth in batches. */
+#define MIGSLOT_MAX_OBUF (1024*1024*4)  /* Don't serialize more than that. */
+
+/* What a command in the pipeline is about. */
+#define MIGSLOT_CMD_RESTORE 0   /* RESTORE-ASKING of a key. */
+#define MIGSLOT_CMD_ASKING 1    /* ASKING before a DEL. */
+#define MIGSLOT_CMD_DEL 2       /* DEL of a key deleted while in flight. */
+
+/* State of a key that is queued or in flight. */
+typedef struct migslotKey {
+    int inflight;   /* Sent, waiting for the acknowledge. */
+    int dirty;      /* Modified or deleted while in flight. */
+} migslotKey;
+
+/* A command waiting for a reply from the target, in pipeline order. */
+typedef struct migslotCommand {
+    int type;       /* MIGSLOT_CMD_* */
+    sds key;        /* The key, shared with the 'keys' dictionary. */
+} migslotCommand;
+
+typedef struct clusterSlotMigration {
+    int slot;
+    int state;                  /* MIGSLOT_STATE_* */
+    char target[REDIS_CLUSTER_NAMELEN]; /* Target node name. */
+    char ip[REDIS_IP_STR_LEN];  /* Target node address. */
+    int port;
+    int fd;                     /* Connection with the target, or -1. */
+    int replace;                /* Send RESTORE with REPLACE. */
+    int cancel;                 /* CANCEL called: finish the keys in flight
+                                   but don't send new ones. */
+    long batch;                 /* Keys per batch. */
+    long long maxbytes;         /* Max bytes per second, 0 = unlimited. */
+    mstime_t timeout;           /* I/O timeout. */
+    dict *keys;                 /* Keys queued or in flight -> migslotKey. */
+    list *resend;               /* Keys (sds) to send again. */
+    list *pending;              /* Commands waiting replies (migslotCommand). */
+    sds obuf;                   /* Data to write to the target. */
+    sds ibuf;                   /* Replies not yet processed. */
+    unsigned long cursor;       /* dictScan() cursor in the slot keys. */
+    mstime_t start_time, end_time;
+    mstime_t last_io_time;      /* Last time we got a reply or connected. */
+    mstime_t window_start;      /* Start of the current throttling second. */
+    long long window_bytes;     /* Bytes sent in the current second. */
+    long long keys_migrated;    /* Keys acknowledged and deleted here. */
+    long long keys_resent;      /* Keys sent again as modified in flight. */
+    long long bytes_sent;
+    sds error;                  /* Why the migration failed, if it did. */
+} clusterSlotMigration;
+
+static void migslotReadHandler(aeEventLoop *el, int fd, void *privdata, int mask);
+static void migslotWriteHandler(aeEventLoop *el, int fd, void *privdata, int mask);
+static void migslotFeed(clusterSlotMigration *m);
+
+static char *migslotStateName(int state) {
+    switch(state) {
+    case MIGSLOT_STATE_CONNECTING: return "connecting";
+    case MIGSLOT_STATE_RUNNING: return "running";
+    case MIGSLOT_STATE_DONE: return "done";
+    case MIGSLOT_STATE_FAILED: return "failed";
+    case MIGSLOT_STATE_CANCELLED: return "cancelled";
+    default: return "none";
+    }
+}
+
+/* Close the connection and release everything but the stats, that are
+ * retained so that CLUSTER MIGRATESLOT STATUS can report them. */
+static void migslotTerminate(clusterSlotMigration *m, int state, sds error) {
+    listNode *ln;
+
+    if (m->fd != -1) {
+        aeDeleteFileEvent(server.el,m->fd,AE_READABLE|AE_WRITABLE);
+        close(m->fd);
+        m->fd = -1;
+    }
+    while((ln = listFirst(m->pending)) != NULL) {
+        zfree(ln->value);
+        listDelNode(m->pending,ln);
+    }
+    listEmpty(m->resend);
+    dictEmpty(m->keys,NULL);
+    sdsclear(m->obuf);
+    sdsclear(m->ibuf);
+    m->state = state;
+    m->end_time = mstime();
+    sdsfree(m->error);
+    m->error = error;
+    if (error) {
+        redisLog(REDIS_WARNING,"Migration of slot %d to %.40s failed: %s",
+            m->slot, m->target, error);
+    } else {
+        redisLog(REDIS_NOTICE,
+            "Migration of slot %d to %.40s %s: %lld keys migrated",
+            m->slot, m->target, migslotStateName(state), m->keys_migrated);
+    }
+}
+
+static void migslotFree(clusterSlotMigration *m) {
+    if (m->fd != -1) migslotTerminate(m,MIGSLOT_STATE_CANCELLED,NULL);
+    dictRelease(m->keys);
+    listRelease(m->resend);
+    listRelease(m->pending);
+    sdsfree(m->obuf);
+    sdsfree(m->ibuf);
+    sdsfree(m->error);
+    zfree(m);
+}
+
+/* Append a command for 'key' to the output buffer, and remember we need
+ * to consume its reply. */
+static void migslotAppendCommand(clusterSlotMigration *m, int type, sds key,
+                                 int replace)
+{
+    migslotCommand *cmd = zmalloc(sizeof(*cmd));
+    rio r;
+
+    rioInitWithBuffer(&r,m->obuf);
+    if (type == MIGSLOT_CMD_ASKING) {
+        redisAssert(rioWriteBulkCount(&r,'*',1));
+        redisAssert(rioWriteBulkString(&r,"ASKING",6));
+    } else if (type == MIGSLOT_CMD_DEL) {
+        redisAssert(rioWriteBulkCount(&r,'*',2));
+        redisAssert(rioWriteBulkString(&r,"DEL",3));
+        redisAssert(rioWriteBulkString(&r,key,sdslen(key)));
+    } else {
+        robj keyobj, *o;
+        dictEntry *de = dictFind(server.db[0].dict,key);
+        long long ttl = 0, expireat;
+        rio payload;
+
+        redisAssert(de != NULL);
+        o = dictGetVal(de);
+        initStaticStringObject(keyobj,key);
+        expireat = getExpire(&server.db[0],&keyobj);
+        if (expireat != -1) {
+            ttl = expireat-mstime();
+            if (ttl < 1) ttl = 1;
+        }
+        redisAssert(rioWriteBulkCount(&r,'*',replace ? 5 : 4));
+        redisAssert(rioWriteBulkString(&r,"RESTORE-ASKING",14));
+        redisAssert(rioWriteBulkString(&r,key,sdslen(key)));
+        redisAssert(rioWriteBulkLongLong(&r,ttl));
+        createDumpPayload(&payload,o);
+        redisAssert(rioWriteBulkString(&r,payload.io.buffer.ptr,
+                                       sdslen(payload.io.buffer.ptr)));
+        sdsfree(payload.io.buffer.ptr);
+        if (replace) redisAssert(rioWriteBulkString(&r,"REPLACE",7));
+    }
+    m->obuf = r.io.buffer.ptr;
+    cmd->type = type;
+    cmd->key = key;
+    listAddNodeTail(m->pending,cmd);
+}
+
+/* dictScan() callback collecting keys of the slot not already migrating. */
+static void migslotScanCallback(void *privdata, const dictEntry *de) {
+    clusterSlotMigration *m = privdata;
+    sds key = dictGetKey(de);
+    migslotKey *mk;
+
+    if (dictFind(m->keys,key) != NULL) return;
+    mk = zcalloc(sizeof(*mk));
+    mk->inflight = 1;
+    key = sdsdup(key);
+    dictAdd(m->keys,key,mk);
+    migslotAppendCommand(m,MIGSLOT_CMD_RESTORE,key,m->replace);
+}
+
+/* Serialize more keys into the output buffer, as long as the pipeline,
+ * the output buffer and the bytes per second limit allow it. */
+static void migslotFeed(clusterSlotMigration *m) {
+    mstime_t now = mstime();
+    size_t before = sdslen(m->obuf);
+
+    if (m->state != MIGSLOT_STATE_RUNNING) return;
+    if (now - m->window_start >= 1000) {
+        m->window_start = now;
+        m->window_bytes = 0;
+    }
+
+    while ((long)listLength(m->pending) < m->batch*MIGSLOT_MAX_BATCHES_INFLIGHT &&
+           sdslen(m->obuf) < MIGSLOT_MAX_OBUF &&
+           (m->maxbytes == 0 || m->window_bytes +
+               (long long)(sdslen(m->obuf)-before) < m->maxbytes))
+    {
+        long added = 0;
+
+        /* Keys modified or deleted while in flight go first. */
+        while (listLength(m->resend) && added < m->batch) {
+            listNode *ln = listFirst(m->resend);
+            sds key = ln->value;
+            dictEntry *de = dictFind(m->keys,key);
+            migslotKey *mk = dictGetVal(de);
+
+            listDelNode(m->resend,ln);
+            mk->inflight = 1;
+            mk->dirty = 0;
+            /* If it no longer exists here, delete it in the target. */
+            if (dictFind(server.db[0].dict,key) == NULL) {
+                migslotAppendCommand(m,MIGSLOT_CMD_ASKING,key,0);
+                migslotAppendCommand(m,MIGSLOT_CMD_DEL,key,0);
+            } else {
+                migslotAppendCommand(m,MIGSLOT_CMD_RESTORE,key,1);
+            }
+            m->keys_resent++;
+            added++;
+        }
+
+        /* Then a batch of keys never sent. */
+        if (!m->cancel && added < m->batch &&
+            countKeysInSlot(m->slot) > dictSize(m->keys))
+        {
+            dict *d = server.cluster->slots_to_keys[m->slot];
+            unsigned long pending = listLength(m->pending);
+
+            do {
+                m->cursor = dictScan(d,m->cursor,migslotScanCallback,m);
+            } while (m->cursor &&
+                     listLength(m->pending)-pending < (unsigned long)m->batch);
+            added += listLength(m->pending)-pending;
+        }
+        if (added == 0) break;
+    }
+
+    if (sdslen(m->obuf) > before) {
+        m->window_bytes += sdslen(m->obuf)-before;
+        aeCreateFileEvent(server.el,m->fd,AE_WRITABLE,migslotWriteHandler,m);
+    }
+
+    /* Nothing left to send and nothing to wait for: we are done. */
+    if (listLength(m->pending) == 0 && listLength(m->resend) == 0 &&
+        sdslen(m->obuf) == 0)
+    {
+        if (m->cancel)
+            migslotTerminate(m,MIGSLOT_STATE_CANCELLED,NULL);
+        else if (countKeysInSlot(m->slot) == 0)
+            migslotTerminate(m,MIGSLOT_STATE_DONE,NULL);
+    }
+}
+
+/* Handle the reply to the first command in the pipeline. */
+static void migslotProcessReply(clusterSlotMigration *m, char *reply) {
+    listNode *ln = listFirst(m->pending);
+    migslotCommand *cmd;
+    migslotKey *mk;
+    dictEntry *de;
+
+    if (ln == NULL) {
+        migslotTerminate(m,MIGSLOT_STATE_FAILED,
+            sdsnew("unexpected reply from target"));
+        return;
+    }
+    cmd = ln->value;
+    listDelNode(m->pending,ln);
+    if (reply[0] == '-') {
+        migslotTerminate(m,MIGSLOT_STATE_FAILED,
+            sdscatprintf(sdsempty(),"target replied with error: %s",reply+1));
+        zfree(cmd);
+        return;
+    }
+    if (cmd->type == MIGSLOT_CMD_ASKING) {
+        zfree(cmd);
+        return;
+    }
+
+    de = dictFind(m->keys,cmd->key);
+    mk = dictGetVal(de);
+    mk->inflight = 0;
+    if (mk->dirty) {
+        /* Modified or deleted while in flight: send it again. */
+        listAddNodeTail(m->resend,cmd->key);
+    } else if (cmd->type == MIGSLOT_CMD_DEL) {
+        /* Deleted here, now deleted in the target as well. */
+        dictDelete(m->keys,cmd->key);
+    } else {
+        robj *keyobj = createStringObject(cmd->key,sdslen(cmd->key));
+
+        /* The target has the current version: delete it here propagating
+         * the DEL, like MIGRATE does. */
+        dictDelete(m->keys,cmd->key);
+        dbDelete(&server.db[0],keyobj);
+        propagateExpire(&server.db[0],keyobj);
+        signalModifiedKey(&server.db[0],keyobj);
+        server.dirty++;
+        m->keys_migrated++;
+        decrRefCount(keyobj);
+    }
+    zfree(cmd);
+}
+
+static void migslotWriteHandler(aeEventLoop *el, int fd, void *privdata, int mask) {
+    clusterSlotMigration *m = privdata;
+    ssize_t nwritten;
+    REDIS_NOTUSED(el);
+    REDIS_NOTUSED(mask);
+
+    if (m->state == MIGSLOT_STATE_CONNECTING) {
+        int err = 0;
+        socklen_t errlen = sizeof(err);
+
+        if (getsockopt(fd,SOL_SOCKET,SO_ERROR,&err,&errlen) == -1) err = errno;
+        if (err) {
+            migslotTerminate(m,MIGSLOT_STATE_FAILED,
+                sdscatprintf(sdsempty(),"can't connect to target: %s",
+                    strerror(err)));
+            return;
+        }
+        m->state = MIGSLOT_STATE_RUNNING;
+        m->last_io_time = mstime();
+        aeDeleteFileEvent(server.el,fd,AE_WRITABLE);
+        if (aeCreateFileEvent(server.el,fd,AE_READABLE,migslotReadHandler,m)
+            == AE_ERR)
+        {
+            migslotTerminate(m,MIGSLOT_STATE_FAILED,
+                sdsnew("can't create readable event"));
+            return;
+        }
+        migslotFeed(m);
+        return;
+    }
+
+    nwritten = write(fd,m->obuf,sdslen(m->obuf));
+    if (nwritten == -1) {
+        if (errno == EAGAIN) return;
+        migslotTerminate(m,MIGSLOT_STATE_FAILED,
+            sdscatprintf(sdsempty(),"error writing to target: %s",
+                strerror(errno)));
+        return;
+    }
+    sdsrange(m->obuf,nwritten,-1);
+    m->bytes_sent += nwritten;
+    if (sdslen(m->obuf) == 0) aeDeleteFileEvent(server.el,fd,AE_WRITABLE);
+}
+
+static void migslotReadHandler(aeEventLoop *el, int fd, void *privdata, int mask) {
+    clusterSlotMigration *m = privdata;
+    char buf[REDIS_IOBUF_LEN];
+    ssize_t nread;
+    char *p;
+    REDIS_NOTUSED(el);
+    REDIS_NOTUSED(mask);
+
+    nread = read(fd,buf,sizeof(buf));
+    if (nread == -1 && errno == EAGAIN) return;
+    if (nread <= 0) {
+        migslotTerminate(m,MIGSLOT_STATE_FAILED,
+            sdscatprintf(sdsempty(),"error reading from target: %s",
+                nread ? strerror(errno) : "connection lost"));
+        return;
+    }
+    m->ibuf = sdscatlen(m->ibuf,buf,nread);
+    m->last_io_time = mstime();
+
+    /* Every command we send has a single line reply. */
+    while(m->state == MIGSLOT_STATE_RUNNING &&
+          (p = strstr(m->ibuf,"\r\n")) != NULL)
+    {
+        *p = '\0';
+        migslotProcessReply(m,m->ibuf);
+        if (m->state != MIGSLOT_STATE_RUNNING) return;
+        sdsrange(m->ibuf,(p-m->ibuf)+2,-1);
+    }
+    migslotFeed(m);
+}
+
+/* Called by clusterCron(): handle timeouts, throttling and changes of the
+ * slot configuration. */
+void clusterSlotMigrationCron(void) {
+    clusterSlotMigration *m = server.cluster->slot_migration;
+    clusterNode *target;
+
+    if (m == NULL || (m->state != MIGSLOT_STATE_CONNECTING &&
+                      m->state != MIGSLOT_STATE_RUNNING)) return;
+
+    target = clusterLookupNode(m->target);
+    if (server.cluster->slots[m->slot] != myself || target == NULL ||
+        server.cluster->migrating_slots_to[m->slot] != target)
+    {
+        migslotTerminate(m,MIGSLOT_STATE_FAILED,
+            sdsnew("the slot is no longer migrating to the target"));
+        return;
+    }
+    if ((m->state == MIGSLOT_STATE_CONNECTING || listLength(m->pending)) &&
+        mstime() - m->last_io_time > m->timeout)
+    {
+        migslotTerminate(m,MIGSLOT_STATE_FAILED,sdsnew("timeout"));
+        return;
+    }
+    /* Resume sending if we stopped because of the bytes per second limit. */
+    migslotFeed(m);
+}
+
+/* Called by signalModifiedKey(): if the key is in flight, it must not be
+ * deleted when the target acknowledges it. */
+void clusterSlotMigrationTouchKey(robj *key) {
+    clusterSlotMigration *m = server.cluster->slot_migration;
+    dictEntry *de;
+
+    if (m == NULL || m->state != MIGSLOT_STATE_RUNNING) return;
+    if ((de = dictFind(m->keys,key->ptr)) != NULL) {
+        migslotKey *mk = dictGetVal(de);
+        if (mk->inflight) mk->dirty = 1;
+    }
+}
+
+/* Return true if the key was sent to the target, or is going to be sent
+ * again, by the running migration: getNodeByQuery() serves such keys here
+ * even if they don't exist anymore, see the top comment. */
+static int clusterSlotMigrationHasKey(robj *key) {
+    clusterSlotMigration *m = server.cluster->slot_migration;
+
+    if (m == NULL || m->state != MIGSLOT_STATE_RUNNING) return 0;
+    return dictFind(m->keys,key->ptr) != NULL;
+}
+
+/* CLUSTER MIGRATESLOT <slot> [REPLACE] [BATCH <keys>] [MAXBYTES <bytes/sec>]
+ *                            [TIMEOUT <ms>]
+ * CLUSTER MIGRATESLOT STATUS
+ * CLUSTER MIGRATESLOT CANCEL */
+void clusterMigrateSlotCommand(redisClient *c) {
+    clusterSlotMigration *m = server.cluster->slot_migration;
+    long long batch = MIGSLOT_DEFAULT_BATCH, maxbytes = 0;
+    long long timeout = MIGSLOT_DEFAULT_TIMEOUT;
+    int replace = 0, slot, fd, j;
+    clusterNode *target;
+
+    if (!strcasecmp(c->argv[2]->ptr,"status") && c->argc == 3) {
+        sds info = sdsempty();
+        mstime_t end = m && m->end_time ? m->end_time : mstime();
+
+        if (m == NULL) {
+            info = sdscat(info,"state:none\r\n");
+        } else {
+            info = sdscatprintf(info,
+                "slot:%d\r\n"
+                "target:%.40s\r\n"
+                "target_addr:%s:%d\r\n"
+                "state:%s\r\n"
+                "keys_migrated:%lld\r\n"
+                "keys_resent:%lld\r\n"
+                "keys_left:%u\r\n"
+                "bytes_sent:%lld\r\n"
+                "elapsed_ms:%lld\r\n"
+                "error:%s\r\n",
+                m->slot, m->target, m->ip, m->port,
+                (m->cancel && m->state == MIGSLOT_STATE_RUNNING) ?
+                    "cancelling" : migslotStateName(m->state),
+                m->keys_migrated, m->keys_resent,
+                server.cluster->slots[m->slot] == myself ?
+                    countKeysInSlot(m->slot) : 0,
+                m->bytes_sent,
+                (long long)(end - m->start_time),
+                m->error ? m->error : "");
+        }
+        addReplySds(c,sdscatprintf(sdsempty(),"$%lu\r\n",
+            (unsigned long)sdslen(info)));
+        addReplySds(c,info);
+        addReply(c,shared.crlf);
+        return;
+    } else if (!strcasecmp(c->argv[2]->ptr,"cancel") && c->argc == 3) {
+        if (m == NULL || (m->state != MIGSLOT_STATE_CONNECTING &&
+                          m->state != MIGSLOT_STATE_RUNNING))
+        {
+            addReplyError(c,"No slot migration in progress");
+            return;
+        }
+        /* Keys deleted here while in flight must still be deleted in the
+         * target, or they would be found there by the clients redirected
+         * with -ASK: a running migration stops only after the replies to
+         * the keys already sent are handled. */
+        if (m->state == MIGSLOT_STATE_RUNNING) {
+            m->cancel = 1;
+            migslotFeed(m);
+        } else {
+            migslotTerminate(m,MIGSLOT_STATE_CANCELLED,NULL);
+        }
+        addReply(c,shared.ok);
+        return;
+    }
+
+    if ((slot = getSlotOrReply(c,c->argv[2])) == -1) return;
+    for (j = 3; j < c->argc; j++) {
+        int moreargs = j < c->argc-1;
+
+        if (!strcasecmp(c->argv[j]->ptr,"replace")) {
+            replace = 1;
+        } else if (!strcasecmp(c->argv[j]->ptr,"batch") && moreargs) {
+            if (getLongLongFromObjectOrReply(c,c->argv[++j],&batch,NULL)
+                != REDIS_OK) return;
+            if (batch <= 0) {
+                addReplyError(c,"BATCH must be positive");
+                return;
+            }
+        } else if (!strcasecmp(c->argv[j]->ptr,"maxbytes") && moreargs) {
+            if (getLongLongFromObjectOrReply(c,c->argv[++j],&maxbytes,NULL)
+                != REDIS_OK) return;
+            if (maxbytes < 0) {
+                addReplyError(c,"MAXBYTES can't be negative");
+                return;
+            }
+        } else if (!strcasecmp(c->argv[j]->ptr,"timeout") && moreargs) {
+            if (getLongLongFromObjectOrReply(c,c->argv[++j],&timeout,NULL)
+                != REDIS_OK) return;
+            if (timeout <= 0) timeout = MIGSLOT_DEFAULT_TIMEOUT;
+        } else {
+            addReply(c,shared.syntaxerr);
+            return;
+        }
+    }
+
+    if (m && (m->state == MIGSLOT_STATE_CONNECTING ||
+              m->state == MIGSLOT_STATE_RUNNING))
+    {
+        addReplyErrorFormat(c,"Slot %d is already being migrated", m->slot);
+        return;
+    }
+    if (server.cluster->slots[slot] != myself) {
+        addReplyErrorFormat(c,"I'm not the owner of hash slot %u",slot);
+        return;
+    }
+    if ((target = server.cluster->migrating_slots_to[slot]) == NULL) {
+        addReplyErrorFormat(c,"Slot %d is not in migrating state. "
+            "Use CLUSTER SETSLOT <slot> MIGRATING <node> first", slot);
+        return;
+    }
+
+    fd = anetTcpNonBlockConnect(server.neterr,target->ip,target->port);
+    if (fd == -1) {
+        addReplyErrorFormat(c,"Can't connect to target node: %s",
+            server.neterr);
+        return;
+    }
+    anetEnableTcpNoDelay(server.neterr,fd);
+
+    if (m) migslotFree(m);
+    m = zcalloc(sizeof(*m));
+    m->slot = slot;
+    m->state = MIGSLOT_STATE_CONNECTING;
+    memcpy(m->target,target->name,REDIS_CLUSTER_NAMELEN);
+    memcpy(m->ip,target->ip,sizeof(m->ip));
+    m->port = target->port;
+    m->fd = fd;
+    m->replace = replace;
+    m->batch = batch;
+    m->maxbytes = maxbytes;
+    m->timeout = timeout;
+    m->keys = dictCreate(&migrateSlotKeysDictType,NULL);
+    m->resend = listCreate();
+    m->pending = listCreate();
+    m->obuf = sdsempty();
+    m->ibuf = sdsempty();
+    m->start_time = m->last_io_time = m->window_start = mstime();
+    server.cluster->slot_migration = m;
+
+    if (aeCreateFileEvent(server.el,fd,AE_WRITABLE,migslotWriteHandler,m)
+        == AE_ERR)
+    {
+        migslotTerminate(m,MIGSLOT_STATE_FAILED,
+            sdsnew("can't create writable event"));
+        addReplyError(c,"Can't create writable event");
+        return;
+    }
+    redisLog(REDIS_NOTICE,"Migrating slot %d (%u keys) to %.40s",
+        slot, countKeysInSlot(slot), m->target);
+    addReply(c,shared.ok);
+}
+
 /* -----------------------------------------------------------------------------
  * Cluster functions related to serving / redirecting clients
  * -------------------------------------------------------------------------- */
@@ -5016,9 +5857,11 @@ clusterNode *getNodeByQuery(redisClient *c, struct redisCommand *cmd, robj **arg
                 }
             }
 
-            /* Migarting / Improrting slot? Count keys we don't have. */
+            /* Migarting / Improrting slot? Count keys we don't have. Keys
+             * still tracked by CLUSTER MIGRATESLOT are handled here. */
             if ((migrating_slot || importing_slot) &&
-                lookupKeyRead(&server.db[0],thiskey) == NULL)
+                lookupKeyRead(&server.db[0],thiskey) == NULL &&
+                !(migrating_slot && clusterSlotMigrationHasKey(thiskey)))
             {
                 missing_keys++;
             }
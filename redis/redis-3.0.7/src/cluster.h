@@ -16,6 +16,7 @@
 #define REDIS_CLUSTER_DEFAULT_NODE_TIMEOUT 15000
 #define REDIS_CLUSTER_DEFAULT_SLAVE_VALIDITY 10 /* Slave max data age factor. */
 #define REDIS_CLUSTER_DEFAULT_REQUIRE_FULL_COVERAGE 1
+#define REDIS_CLUSTER_DEFAULT_COMPACT_BUS 1
 #define REDIS_CLUSTER_FAIL_REPORT_VALIDITY_MULT 2 /* Fail report validity. */
 #define REDIS_CLUSTER_FAIL_UNDO_TIME_MULT 2 /* Undo fail if master is back. */
 #define REDIS_CLUSTER_FAIL_UNDO_TIME_ADD 10 /* Some additional time. */
@@ -24,6 +25,8 @@
 #define REDIS_CLUSTER_MF_TIMEOUT 5000 /* Milliseconds to do a manual failover. */
 #define REDIS_CLUSTER_MF_PAUSE_MULT 2 /* Master pause manual failover mult. */
 #define REDIS_CLUSTER_SLAVE_MIGRATION_DELAY 5000 /* Delay for slave migration */
+#define REDIS_CLUSTER_GOSSIP_DIV 10 /* Gossip 1/10 of the nodes per ping... */
+#define REDIS_CLUSTER_GOSSIP_QUIET_DIV 40 /* ...or 1/40 if no node is failing. */
 
 /* Redirection errors returned by getNodeByQuery(). */
 #define REDIS_CLUSTER_REDIR_NONE 0          /* Node can serve the request. */
@@ -43,6 +46,11 @@ typedef struct clusterLink {
     sds sndbuf;                 /* Packet send buffer */
     sds rcvbuf;                 /* Packet reception buffer */
     struct clusterNode *node;   /* Node related to this link if any, or NULL */
+    int compact;                /* The peer accepts compact PING / PONG. */
+    uint64_t slots_version_sent; /* Slots version last sent to the peer in a
+                                    compact message, see clusterSendPing(). */
+    unsigned char *peer_slots;  /* Slots bitmap last received from the peer
+                                   in a compact message, or NULL. */
 } clusterLink;
 
 /* Cluster node flags and macros. */
@@ -115,7 +123,9 @@ typedef struct clusterState {
     clusterNode *migrating_slots_to[REDIS_CLUSTER_SLOTS];
     clusterNode *importing_slots_from[REDIS_CLUSTER_SLOTS];
     clusterNode *slots[REDIS_CLUSTER_SLOTS];
-    zskiplist *slots_to_keys;
+    dict **slots_to_keys; /* Slot -> keys index, see slotToKeyAdd(). */
+    struct clusterSlotMigration *slot_migration; /* CLUSTER MIGRATESLOT
+                                                    job, or NULL. */
     /* The following fields are used to take the slave state on elections. */
     mstime_t failover_auth_time; /* Time of previous or next election. */
     int failover_auth_count;    /* Number of votes received so far. */
@@ -139,6 +149,14 @@ typedef struct clusterState {
     int todo_before_sleep; /* Things to do in clusterBeforeSleep(). */
     long long stats_bus_messages_sent;  /* Num of msg sent via cluster bus. */
     long long stats_bus_messages_received; /* Num of msg rcvd via cluster bus.*/
+    long long stats_bus_bytes_sent;     /* Bytes sent via cluster bus. */
+    long long stats_bus_bytes_received; /* Bytes received via cluster bus. */
+    int stats_pfail_nodes;      /* Nodes in PFAIL or FAIL state, as counted by
+                                   the last clusterCron() call. */
+    /* Slots bitmap we last advertised in a compact message, and its version,
+     * incremented every time the advertised bitmap changes. */
+    unsigned char compact_slots[REDIS_CLUSTER_SLOTS/8];
+    uint64_t compact_slots_version;
 } clusterState;
 
 /* clusterState todo_before_sleep flags. */
@@ -247,11 +265,45 @@ typedef struct {
 
 #define CLUSTERMSG_MIN_LEN (sizeof(clusterMsg)-sizeof(union clusterMsgData))
 
+/* Compact PING and PONG messages, only sent to nodes announcing that they
+ * understand them with the CLUSTERMSG_FLAG0_COMPACT flag. They carry the
+ * same information as the full messages, but the slots bitmap, that makes
+ * most of the full header, is only sent when it changed since the last
+ * compact message sent on the same link, and run length encoded. The
+ * receiver turns them into a full message before processing them. */
+typedef struct {
+    char sig[4];        /* Signature "RCmc" (Redis Cluster message compact). */
+    uint32_t totlen;    /* Total length of this message */
+    uint16_t ver;       /* Protocol version, currently set to 0. */
+    uint16_t slots_enc; /* How slots are encoded: CLUSTERMSG_SLOTS_... */
+    uint16_t type;      /* CLUSTERMSG_TYPE_PING or CLUSTERMSG_TYPE_PONG. */
+    uint16_t count;     /* Number of gossip sections. */
+    uint64_t currentEpoch;  /* Same as the full header from here... */
+    uint64_t configEpoch;
+    uint64_t offset;
+    char sender[REDIS_CLUSTER_NAMELEN];
+    char slaveof[REDIS_CLUSTER_NAMELEN];
+    uint16_t port;
+    uint16_t flags;
+    unsigned char state;
+    unsigned char mflags[3]; /* ...to here. */
+    uint32_t slots_len; /* Bytes of slots data after the gossip sections. */
+    uint32_t notused1;
+    /* 'count' gossip sections, followed by 'slots_len' bytes of slots. */
+    clusterMsgDataGossip gossip[];
+} clusterMsgCompact;
+
+#define CLUSTERMSG_SLOTS_SAME 0     /* Same slots as the last message. */
+#define CLUSTERMSG_SLOTS_RUNS 1     /* 16 bit lengths of alternating runs of
+                                       not served and served slots. */
+#define CLUSTERMSG_SLOTS_BITMAP 2   /* Full bitmap. */
+
 /* Message flags better specify the packet content or are used to
  * provide some information about the node state. */
 #define CLUSTERMSG_FLAG0_PAUSED (1<<0) /* Master paused for manual failover. */
 #define CLUSTERMSG_FLAG0_FORCEACK (1<<1) /* Give ACK to AUTH_REQUEST even if
                                             master is up. */
+#define CLUSTERMSG_FLAG0_COMPACT (1<<2) /* Sender accepts compact messages. */
 
 /* ---------------------- API exported outside cluster.c -------------------- */
 clusterNode *getNodeByQuery(redisClient *c, struct redisCommand *cmd, robj **argv, int argc, int *hashslot, int *ask);
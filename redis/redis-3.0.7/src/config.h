@@ -66,6 +66,21 @@
 #define HAVE_BACKTRACE 1
 #endif
 
+/* Test for x86 SIMD kernels, compiled with function target attributes and
+ * selected at runtime according to the CPU features (see bitops.c). */
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__clang__) || \
+    (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+#define HAVE_X86_SIMD 1
+#endif
+
+/* Hint the CPU to bring in cache the memory at 'p' before accessing it.
+ * Prefetching never faults, even for invalid addresses. */
+#if defined(__GNUC__) || defined(__clang__)
+#define redis_prefetch(p) __builtin_prefetch(p)
+#else
+#define redis_prefetch(p) ((void)(p))
+#endif
+
 /* Test for polling API */
 #ifdef __linux__
 #define HAVE_EPOLL 1
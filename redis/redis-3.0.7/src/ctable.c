@@ -0,0 +1,404 @@
+/* Compact open addressing hash table.
+ *
+ * Sets and hashes that are too big for an intset or a ziplist are usually
+ * represented with a dict, that costs a dictEntry (allocated in the 32 bytes
+ * class) and a bucket pointer for every element, plus a string object for
+ * every field and value of a hash. A ctable stores every element in a single
+ * allocation instead: the element, or the field of a hash, is an sds string,
+ * and for hashes the value follows the null term of the field, prefixed by
+ * its length encoded 7 bits per byte:
+ *
+ * <sds header><field>\0<value len><value>\0
+ *
+ * So an entry can be used wherever an sds is expected, and the table itself
+ * is just an array of pointers to the entries, preceded by a control byte
+ * for every slot.
+ *
+ * Collisions are resolved with open addressing. A control byte is EMPTY,
+ * DELETED, or for full slots the 7 low bits of the hash of the entry. Slots
+ * are probed a group of CTABLE_GROUP at a time: the control bytes of the
+ * group are compared with the hash bits using a couple of SSE2 instructions
+ * (a plain loop where SSE2 is not available), and only the matching entries
+ * are compared with the key, so a lookup usually touches a single cache line
+ * of control bytes and the entry itself. Groups are probed in triangular
+ * order starting from the "home" group selected by the other hash bits,
+ * until a group with an EMPTY slot is found. A slot of a group without EMPTY
+ * slots is marked DELETED when its entry is removed, since other entries may
+ * have been stored past it.
+ *
+ * The table grows when 7/8 of the slots are full or deleted, and shrinks when
+ * less than 1/8 are full, rehashing all the entries at once: the size of the
+ * tables is capped by the *-max-ctable-entries options.
+ *
+ * ctableScan() offers the same guarantees as dictScan(): the cursor visits
+ * the home groups with the same reversed binary increment, and every entry is
+ * reported when its home group is visited, wherever it is actually stored.
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * Copyright (c) 2009-2016, Salvatore Sanfilippo <antirez at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "fmacros.h"
+#include <stdlib.h>
+#include <string.h>
+#include "ctable.h"
+#include "dict.h"
+#include "zmalloc.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define CTABLE_EMPTY 0x80
+#define CTABLE_DELETED 0xfe
+
+/* Max number of full plus deleted slots before a rehash is needed. */
+#define ctableMaxFill(size) ((size)-(size)/8)
+
+static unsigned int ctableHash(const char *key, size_t klen) {
+    return dictGenHashFunction(key,(int)klen);
+}
+
+/* Return a bitmap with the bit j set if the control byte j of the group
+ * starting at 'g' is 'b'. */
+static inline unsigned int ctableMatch(const unsigned char *g,
+                                       unsigned char b)
+{
+#ifdef __SSE2__
+    __m128i ctrl = _mm_loadu_si128((const __m128i*)g);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(ctrl,_mm_set1_epi8((char)b)));
+#else
+    unsigned int j, mask = 0;
+
+    for (j = 0; j < CTABLE_GROUP; j++)
+        if (g[j] == b) mask |= 1<<j;
+    return mask;
+#endif
+}
+
+/* Like ctableMatch() but for the slots that are EMPTY or DELETED, the only
+ * control bytes with the most significant bit set. */
+static inline unsigned int ctableMatchFree(const unsigned char *g) {
+#ifdef __SSE2__
+    return _mm_movemask_epi8(_mm_loadu_si128((const __m128i*)g));
+#else
+    unsigned int j, mask = 0;
+
+    for (j = 0; j < CTABLE_GROUP; j++)
+        if (g[j] & 0x80) mask |= 1<<j;
+    return mask;
+#endif
+}
+
+/* Write 'len' at 'p' 7 bits per byte, the most significant bit of a byte
+ * telling if another one follows. Returns the number of bytes used, that is
+ * all that is computed when 'p' is NULL. */
+static size_t ctableEncodeLen(unsigned char *p, size_t len) {
+    size_t n = 0;
+
+    do {
+        unsigned char b = len & 0x7f;
+
+        len >>= 7;
+        if (p) p[n] = b | (len ? 0x80 : 0);
+        n++;
+    } while(len);
+    return n;
+}
+
+static size_t ctableDecodeLen(const unsigned char *p, size_t *len) {
+    size_t n = 0;
+    int shift = 0;
+
+    *len = 0;
+    do {
+        *len |= (size_t)(p[n] & 0x7f) << shift;
+        shift += 7;
+    } while(p[n++] & 0x80);
+    return n;
+}
+
+/* Create the entry for 'key' and, if the table stores pairs, its value. */
+static sds ctableEntryNew(int pairs, const char *key, size_t klen,
+                          const char *val, size_t vlen)
+{
+    size_t lenlen;
+    sds e;
+
+    if (!pairs) return sdsnewlen(key,klen);
+    lenlen = ctableEncodeLen(NULL,vlen);
+    e = sdsnewlen(NULL,klen+1+lenlen+vlen);
+    memcpy(e,key,klen);
+    ctableEncodeLen((unsigned char*)e+klen+1,vlen);
+    memcpy(e+klen+1+lenlen,val,vlen);
+    sdssetlen(e,klen);
+    return e;
+}
+
+/* Return the value stored in the entry of a table of pairs, setting
+ * '*vlen' to its length. The value is null terminated. */
+char *ctableEntryValue(sds entry, size_t *vlen) {
+    unsigned char *p = (unsigned char*)entry+sdslen(entry)+1;
+
+    return (char*)p+ctableDecodeLen(p,vlen);
+}
+
+static void ctableAllocSlots(ctable *ct, uint32_t size) {
+    ct->ctrl = zmalloc(size+size*sizeof(sds));
+    memset(ct->ctrl,CTABLE_EMPTY,size);
+    ct->size = size;
+    ct->used = 0;
+    ct->deleted = 0;
+}
+
+/* Create an empty table. If 'pairs' is true every key has a value. */
+ctable *ctableCreate(int pairs) {
+    ctable *ct = zmalloc(sizeof(*ct));
+
+    ct->pairs = pairs;
+    ctableAllocSlots(ct,CTABLE_MIN_SIZE);
+    return ct;
+}
+
+void ctableRelease(ctable *ct) {
+    sds *entries = ctableEntries(ct);
+    uint32_t j;
+
+    for (j = 0; j < ct->size; j++)
+        if (ctableSlotIsFull(ct,j)) sdsfree(entries[j]);
+    zfree(ct->ctrl);
+    zfree(ct);
+}
+
+/* Return the index of the slot holding 'key', or -1 if it is not found.
+ * 'h' is the hash of the key. */
+static long ctableLookup(ctable *ct, const char *key, size_t klen,
+                         unsigned int h)
+{
+    unsigned long gmask = ct->size/CTABLE_GROUP-1;
+    unsigned long g = (h>>7) & gmask, i = 0;
+    sds *entries = ctableEntries(ct);
+
+    while(1) {
+        unsigned char *ctrl = ct->ctrl+g*CTABLE_GROUP;
+        unsigned int m = ctableMatch(ctrl,h & 0x7f);
+
+        while(m) {
+            unsigned long j = g*CTABLE_GROUP+__builtin_ctz(m);
+            sds e = entries[j];
+
+            if (sdslen(e) == klen && memcmp(e,key,klen) == 0) return j;
+            m &= m-1;
+        }
+        if (ctableMatch(ctrl,CTABLE_EMPTY)) return -1;
+        g = (g+(++i)) & gmask;
+    }
+}
+
+/* Store the entry 'e', with hash 'h', in the first slot of its probe
+ * sequence that is not full. The key must not be already in the table, and
+ * the table must have room for it. */
+static void ctableInsertEntry(ctable *ct, sds e, unsigned int h) {
+    unsigned long gmask = ct->size/CTABLE_GROUP-1;
+    unsigned long g = (h>>7) & gmask, i = 0, j;
+    unsigned int m;
+
+    while((m = ctableMatchFree(ct->ctrl+g*CTABLE_GROUP)) == 0)
+        g = (g+(++i)) & gmask;
+    j = g*CTABLE_GROUP+__builtin_ctz(m);
+    if (ct->ctrl[j] == CTABLE_DELETED) ct->deleted--;
+    ct->ctrl[j] = h & 0x7f;
+    ctableEntries(ct)[j] = e;
+    ct->used++;
+}
+
+/* Move all the entries into a new array of 'size' slots. */
+static void ctableRehash(ctable *ct, uint32_t size) {
+    unsigned char *oldctrl = ct->ctrl;
+    uint32_t oldsize = ct->size, j;
+    sds *old = (sds*)(oldctrl+oldsize);
+
+    ctableAllocSlots(ct,size);
+    for (j = 0; j < oldsize; j++) {
+        if (oldctrl[j] & 0x80) continue;
+        ctableInsertEntry(ct,old[j],ctableHash(old[j],sdslen(old[j])));
+    }
+    zfree(oldctrl);
+}
+
+/* Return the number of slots for 'len' entries to fill at most 7/16 of
+ * the table, so that it can double its entries before growing again. */
+static uint32_t ctableSizeFor(unsigned long len) {
+    uint32_t size = CTABLE_MIN_SIZE;
+
+    while ((unsigned long)size/16*7 < len) size *= 2;
+    return size;
+}
+
+/* Make room for 'len' entries without further rehashing. */
+void ctableExpand(ctable *ct, unsigned long len) {
+    uint32_t size = ctableSizeFor(len);
+
+    if (size > ct->size) ctableRehash(ct,size);
+}
+
+/* Return the entry of 'key', or NULL if it is not in the table. */
+sds ctableFind(ctable *ct, const char *key, size_t klen) {
+    long j = ctableLookup(ct,key,klen,ctableHash(key,klen));
+
+    return j == -1 ? NULL : ctableEntries(ct)[j];
+}
+
+/* Add 'key' to the table, with the value 'val' if the table stores pairs.
+ * Returns 1 if the key was added, 0 if it already existed, in which case
+ * its value, if any, is replaced. */
+int ctableSet(ctable *ct, const char *key, size_t klen,
+              const char *val, size_t vlen)
+{
+    unsigned int h = ctableHash(key,klen);
+    long j = ctableLookup(ct,key,klen,h);
+
+    if (j != -1) {
+        sds *entries = ctableEntries(ct), e = entries[j];
+
+        if (ct->pairs) {
+            size_t oldlen;
+            char *oldval = ctableEntryValue(e,&oldlen);
+
+            if (oldlen == vlen) {
+                /* Updates of counters often don't change the length. */
+                memcpy(oldval,val,vlen);
+            } else {
+                entries[j] = ctableEntryNew(1,key,klen,val,vlen);
+                sdsfree(e);
+            }
+        }
+        return 0;
+    }
+
+    if (ct->used+ct->deleted+1 > ctableMaxFill(ct->size))
+        ctableRehash(ct,ctableSizeFor(ct->used+1));
+    ctableInsertEntry(ct,ctableEntryNew(ct->pairs,key,klen,val,vlen),h);
+    return 1;
+}
+
+/* Remove 'key' from the table. Returns 1 if it was found, 0 otherwise. */
+int ctableDelete(ctable *ct, const char *key, size_t klen) {
+    long j = ctableLookup(ct,key,klen,ctableHash(key,klen));
+
+    if (j == -1) return 0;
+    sdsfree(ctableEntries(ct)[j]);
+
+    /* No probe sequence ever went past a group with an EMPTY slot, so
+     * in such a group the slot can be made EMPTY again. */
+    if (ctableMatch(ct->ctrl+(j & ~(CTABLE_GROUP-1)),CTABLE_EMPTY)) {
+        ct->ctrl[j] = CTABLE_EMPTY;
+    } else {
+        ct->ctrl[j] = CTABLE_DELETED;
+        ct->deleted++;
+    }
+    ct->used--;
+
+    if (ct->size > CTABLE_MIN_SIZE && ct->used < ct->size/8)
+        ctableRehash(ct,ctableSizeFor(ct->used));
+    return 1;
+}
+
+/* Return the first entry stored at or after the slot '*pos', updating
+ * '*pos' to the slot following it, or NULL when there are no more entries.
+ * Start with '*pos' set to zero. The table must not be modified while it
+ * is iterated. */
+sds ctableNext(ctable *ct, unsigned long *pos) {
+    while (*pos < ct->size) {
+        unsigned long j = (*pos)++;
+
+        if (ctableSlotIsFull(ct,j)) return ctableEntries(ct)[j];
+    }
+    return NULL;
+}
+
+/* Return a random entry of a non empty table. All the slots are sampled
+ * with the same probability, and at least 1/8 of them are full unless the
+ * table has the minimum size. */
+sds ctableRandomEntry(ctable *ct) {
+    unsigned long j;
+
+    do {
+        j = random() & (ct->size-1);
+    } while(!ctableSlotIsFull(ct,j));
+    return ctableEntries(ct)[j];
+}
+
+/* Reverse the bits of 'v', see dictScan(). */
+static unsigned long ctableRev(unsigned long v) {
+    unsigned long s = 8 * sizeof(v);
+    unsigned long mask = ~0;
+
+    while ((s >>= 1) > 0) {
+        mask ^= (mask << s);
+        v = ((v >> s) & mask) | ((v << s) & ~mask);
+    }
+    return v;
+}
+
+/* Call 'fn' for the entries whose home group is the one selected by the
+ * cursor 'v', and return the next cursor, 0 when the iteration is over.
+ * The entries of a home group are all stored in the groups of its probe
+ * sequence, up to the first one with an EMPTY slot. */
+unsigned long ctableScan(ctable *ct, unsigned long v, ctableScanFunction *fn,
+                         void *privdata)
+{
+    unsigned long gmask = ct->size/CTABLE_GROUP-1;
+    unsigned long home = v & gmask, g = home, i = 0;
+    sds *entries = ctableEntries(ct);
+
+    if (ct->used == 0) return 0;
+    while(1) {
+        unsigned char *ctrl = ct->ctrl+g*CTABLE_GROUP;
+        unsigned int j;
+
+        for (j = 0; j < CTABLE_GROUP; j++) {
+            sds e;
+
+            if (ctrl[j] & 0x80) continue;
+            e = entries[g*CTABLE_GROUP+j];
+            if (((ctableHash(e,sdslen(e))>>7) & gmask) == home)
+                fn(privdata,e);
+        }
+        if (ctableMatch(ctrl,CTABLE_EMPTY)) break;
+        g = (g+(++i)) & gmask;
+    }
+
+    /* Increment the reversed cursor, exactly like dictScan() does. */
+    v |= ~gmask;
+    v = ctableRev(v);
+    v++;
+    v = ctableRev(v);
+    return v;
+}
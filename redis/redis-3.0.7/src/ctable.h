@@ -0,0 +1,73 @@
+/* Compact open addressing hash table, used as the encoding of sets and
+ * hashes that are too big for an intset or a ziplist but not big enough
+ * to be worth a dict: see ctable.c for the details.
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * Copyright (c) 2009-2016, Salvatore Sanfilippo <antirez at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __CTABLE_H
+#define __CTABLE_H
+
+#include <stdint.h>
+#include "sds.h"
+
+/* Number of slots whose control bytes are checked at once. */
+#define CTABLE_GROUP 16
+#define CTABLE_MIN_SIZE CTABLE_GROUP
+
+typedef struct ctable {
+    unsigned char *ctrl;    /* 'size' control bytes, then 'size' entries. */
+    uint32_t size;          /* Number of slots, a power of two. */
+    uint32_t used;          /* Number of entries. */
+    uint32_t deleted;       /* Number of slots marked as deleted. */
+    uint32_t pairs;         /* If true entries hold a value after the key. */
+} ctable;
+
+typedef void ctableScanFunction(void *privdata, sds entry);
+
+/* Array of the entries, valid for the slots whose control byte is full. */
+#define ctableEntries(ct) ((sds*)((ct)->ctrl+(ct)->size))
+#define ctableSlotIsFull(ct,j) (((ct)->ctrl[j] & 0x80) == 0)
+#define ctableLen(ct) ((ct)->used)
+
+ctable *ctableCreate(int pairs);
+void ctableRelease(ctable *ct);
+void ctableExpand(ctable *ct, unsigned long len);
+sds ctableFind(ctable *ct, const char *key, size_t klen);
+int ctableSet(ctable *ct, const char *key, size_t klen,
+              const char *val, size_t vlen);
+int ctableDelete(ctable *ct, const char *key, size_t klen);
+char *ctableEntryValue(sds entry, size_t *vlen);
+sds ctableNext(ctable *ct, unsigned long *pos);
+sds ctableRandomEntry(ctable *ct);
+unsigned long ctableScan(ctable *ct, unsigned long v, ctableScanFunction *fn,
+                         void *privdata);
+
+#endif /* __CTABLE_H */
@@ -33,10 +33,6 @@
 #include <signal.h>
 #include <ctype.h>
 
-void slotToKeyAdd(robj *key);
-void slotToKeyDel(robj *key);
-void slotToKeyFlush(void);
-
 /*-----------------------------------------------------------------------------
  * C-level DB API
  *----------------------------------------------------------------------------*/
@@ -46,11 +42,15 @@ robj *lookupKey(redisDb *db, robj *key) {
     if (de) {
         robj *val = dictGetVal(de);
 
-        /* Update the access time for the ageing algorithm.
-         * Don't do it if we have a saving child, as this will trigger
-         * a copy on write madness. */
-        if (server.rdb_child_pid == -1 && server.aof_child_pid == -1)
-            val->lru = LRU_CLOCK();
+        /* Update the access time (or frequency, with the LFU policies)
+         * for the ageing algorithm. Don't do it if we have a saving child,
+         * as this will trigger a copy on write madness. */
+        if (server.rdb_child_pid == -1 && server.aof_child_pid == -1) {
+            if (REDIS_MAXMEMORY_IS_LFU(server.maxmemory_policy))
+                updateLFU(val);
+            else
+                val->lru = LRU_CLOCK();
+        }
         return val;
     } else {
         return NULL;
@@ -71,6 +71,7 @@ robj *lookupKeyRead(redisDb *db, robj *key) {
 
 robj *lookupKeyWrite(redisDb *db, robj *key) {
     expireIfNeeded(db,key);
+    if (server.rdb_forkless_in_progress) rdbForklessTouchKey(db,key,0);
     return lookupKey(db,key);
 }
 
@@ -86,6 +87,26 @@ robj *lookupKeyWriteOrReply(redisClient *c, robj *key, robj *reply) {
     return o;
 }
 
+/* Prefetch in the CPU caches the entries, names and values of the 'keys'
+ * in the dictionary of the DB, and their entries in the dictionary of the
+ * expires if it is not empty (see dictPrefetch()), before looking them up.
+ * Used by commands accessing many keys and for batches of pipelined
+ * commands, so that the memory accesses of the lookups overlap. */
+void dbPrefetchKeys(redisDb *db, robj **keys, int numkeys) {
+    void *names[DICT_PREFETCH_BATCH];
+    int j, i, n;
+
+    /* A single lookup has nothing to overlap with. */
+    if (numkeys < 2) return;
+    for (j = 0; j < numkeys; j += n) {
+        n = numkeys-j;
+        if (n > DICT_PREFETCH_BATCH) n = DICT_PREFETCH_BATCH;
+        for (i = 0; i < n; i++) names[i] = keys[j+i]->ptr;
+        dictPrefetch(db->dict,names,n,1);
+        if (dictSize(db->expires)) dictPrefetch(db->expires,names,n,0);
+    }
+}
+
 /* Add the key to the DB. It's up to the caller to increment the reference
  * counter of the value if needed.
  *
@@ -96,19 +117,35 @@ void dbAdd(redisDb *db, robj *key, robj *val) {
 
     redisAssertWithInfo(NULL,key,retval == REDIS_OK);
     if (val->type == REDIS_LIST) signalListAsReady(db, key);
-    if (server.cluster_enabled) slotToKeyAdd(key);
+    if (server.cluster_enabled) slotToKeyAdd(copy);
+    if (db->key_index) keyIndexInsert(db->key_index,val->type,copy);
+    if (server.rdb_forkless_in_progress) rdbForklessAddKey(db,copy);
  }
 
 /* Overwrite an existing key with a new value. Incrementing the reference
  * count of the new value is up to the caller.
  * This function does not modify the expire time of the existing key.
  *
+ * When lazyfree-lazy-server-del is enabled the old value is released by
+ * the lazy free thread if it is big enough.
+ *
  * The program is aborted if the key was not already present. */
 void dbOverwrite(redisDb *db, robj *key, robj *val) {
     dictEntry *de = dictFind(db->dict,key->ptr);
+    robj *old;
 
     redisAssertWithInfo(NULL,key,de != NULL);
-    dictReplace(db->dict, key->ptr, val);
+    old = dictGetVal(de);
+    if (db->key_index && old->type != val->type) {
+        keyIndexDelete(db->key_index,old->type,dictGetKey(de));
+        keyIndexInsert(db->key_index,val->type,dictGetKey(de));
+    }
+    if (server.lazyfree_lazy_server_del) {
+        dictSetVal(db->dict,de,val);
+        freeObjAsync(old);
+    } else {
+        dictReplace(db->dict, key->ptr, val);
+    }
 }
 
 /* High level Set operation. This function can be used in order to set
@@ -159,18 +196,38 @@ robj *dbRandomKey(redisDb *db) {
 }
 
 /* Delete a key, value, and associated expiration entry if any, from the DB */
-int dbDelete(redisDb *db, robj *key) {
+int dbSyncDelete(redisDb *db, robj *key) {
+    dictEntry *de;
+
+    if (server.rdb_forkless_in_progress) rdbForklessTouchKey(db,key,1);
+
     /* Deleting an entry from the expires dict will not free the sds of
      * the key, because it is shared with the main dictionary. */
-    if (dictSize(db->expires) > 0) dictDelete(db->expires,key->ptr);
-    if (dictDelete(db->dict,key->ptr) == DICT_OK) {
-        if (server.cluster_enabled) slotToKeyDel(key);
+    dbDeleteExpire(db,key->ptr);
+    de = dictUnlink(db->dict,key->ptr);
+    if (de) {
+        /* The slots index and the key index reference the key sds of the
+         * main dictionary, so remove it from there before releasing the
+         * entry. */
+        if (server.cluster_enabled) slotToKeyDel(dictGetKey(de));
+        if (db->key_index) {
+            robj *val = dictGetVal(de);
+            keyIndexDelete(db->key_index,val->type,dictGetKey(de));
+        }
+        dictFreeUnlinkedEntry(db->dict,de);
         return 1;
     } else {
         return 0;
     }
 }
 
+/* This is a wrapper whose behavior depends on the Redis lazy free
+ * configuration. Deletes the key synchronously or asynchronously. */
+int dbDelete(redisDb *db, robj *key) {
+    return server.lazyfree_lazy_server_del ? dbAsyncDelete(db,key) :
+                                             dbSyncDelete(db,key);
+}
+
 /* Prepare the string object stored at 'key' to be modified destructively
  * to implement commands like SETBIT or APPEND.
  *
@@ -209,16 +266,57 @@ robj *dbUnshareStringValue(redisDb *db, robj *key, robj *o) {
     return o;
 }
 
-long long emptyDb(void(callback)(void*)) {
-    int j;
+/* Remove all keys from all the databases in a Redis server.
+ * If callback is given the function is called from time to time to
+ * signal that work is in progress.
+ *
+ * The dbnum can be -1 if all the DBs should be flushed, or the specified
+ * DB number if we want to flush only a single Redis database number.
+ *
+ * Flags are be EMPTYDB_NO_FLAGS if no special flags are specified or
+ * EMPTYDB_ASYNC if we want the memory to be freed in a different thread
+ * and the function to return ASAP.
+ *
+ * On success the fuction returns the number of keys removed from the
+ * database(s). Otherwise -1 is returned in the specific case the
+ * DB number is out of range, and errno is set to EINVAL. */
+long long emptyDb(int dbnum, int flags, void(callback)(void*)) {
+    int j, async = (flags & EMPTYDB_ASYNC);
     long long removed = 0;
 
+    if (dbnum < -1 || dbnum >= server.dbnum) {
+        errno = EINVAL;
+        return -1;
+    }
+    /* A forkless BGSAVE can't complete once the keys it did not save yet
+     * are gone. */
+    rdbForklessCancel();
+
     for (j = 0; j < server.dbnum; j++) {
+        if (dbnum != -1 && dbnum != j) continue;
         removed += dictSize(server.db[j].dict);
-        dictEmpty(server.db[j].dict,callback);
-        dictEmpty(server.db[j].expires,callback);
+        if (async) {
+            emptyDbAsync(&server.db[j]);
+        } else {
+            if (server.db[j].expire_index) {
+                expireIndexRelease(server.db[j].expire_index);
+                server.db[j].expire_index = expireIndexCreate();
+            }
+            if (server.db[j].key_index) {
+                keyIndexRelease(server.db[j].key_index);
+                server.db[j].key_index = keyIndexCreate();
+            }
+            dictEmpty(server.db[j].dict,callback);
+            dictEmpty(server.db[j].expires,callback);
+        }
+    }
+    if (server.cluster_enabled) {
+        if (async) {
+            slotToKeyFlushAsync();
+        } else {
+            slotToKeyFlush();
+        }
     }
-    if (server.cluster_enabled) slotToKeyFlush();
     return removed;
 }
 
@@ -240,6 +338,7 @@ int selectDb(redisClient *c, int id) {
 
 void signalModifiedKey(redisDb *db, robj *key) {
     touchWatchedKey(db,key);
+    if (server.cluster_enabled) clusterSlotMigrationTouchKey(key);
 }
 
 void signalFlushedDb(int dbid) {
@@ -250,18 +349,50 @@ void signalFlushedDb(int dbid) {
  * Type agnostic commands operating on the key space
  *----------------------------------------------------------------------------*/
 
+/* Return the set of flags to use for the emptyDb() call for FLUSHALL
+ * and FLUSHDB commands.
+ *
+ * Currently the command just attempts to parse the "ASYNC" option. It
+ * also checks if the command arity is wrong.
+ *
+ * On success REDIS_OK is returned and the flags are stored in *flags,
+ * otherwise REDIS_ERR is returned and the function sends an error to the
+ * client. */
+int getFlushCommandFlags(redisClient *c, int *flags) {
+    /* Parse the optional ASYNC option. */
+    if (c->argc > 1) {
+        if (c->argc > 2 || strcasecmp(c->argv[1]->ptr,"async")) {
+            addReply(c,shared.syntaxerr);
+            return REDIS_ERR;
+        }
+        *flags = EMPTYDB_ASYNC;
+    } else {
+        *flags = EMPTYDB_NO_FLAGS;
+    }
+    return REDIS_OK;
+}
+
+/* FLUSHDB [ASYNC]
+ *
+ * Flushes the currently SELECTed Redis DB. */
 void flushdbCommand(redisClient *c) {
-    server.dirty += dictSize(c->db->dict);
+    int flags;
+
+    if (getFlushCommandFlags(c,&flags) == REDIS_ERR) return;
     signalFlushedDb(c->db->id);
-    dictEmpty(c->db->dict,NULL);
-    dictEmpty(c->db->expires,NULL);
-    if (server.cluster_enabled) slotToKeyFlush();
+    server.dirty += emptyDb(c->db->id,flags,NULL);
     addReply(c,shared.ok);
 }
 
+/* FLUSHALL [ASYNC]
+ *
+ * Flushes the whole server data set. */
 void flushallCommand(redisClient *c) {
+    int flags;
+
+    if (getFlushCommandFlags(c,&flags) == REDIS_ERR) return;
     signalFlushedDb(-1);
-    server.dirty += emptyDb(NULL);
+    server.dirty += emptyDb(-1,flags,NULL);
     addReply(c,shared.ok);
     if (server.rdb_child_pid != -1) {
         kill(server.rdb_child_pid,SIGUSR1);
@@ -277,12 +408,16 @@ void flushallCommand(redisClient *c) {
     server.dirty++;
 }
 
-void delCommand(redisClient *c) {
+/* This command implements DEL and UNLINK. */
+void delGenericCommand(redisClient *c, int lazy) {
     int deleted = 0, j;
 
+    dbPrefetchKeys(c->db,c->argv+1,c->argc-1);
     for (j = 1; j < c->argc; j++) {
         expireIfNeeded(c->db,c->argv[j]);
-        if (dbDelete(c->db,c->argv[j])) {
+        int deleted_key = lazy ? dbAsyncDelete(c->db,c->argv[j]) :
+                                 dbSyncDelete(c->db,c->argv[j]);
+        if (deleted_key) {
             signalModifiedKey(c->db,c->argv[j]);
             notifyKeyspaceEvent(REDIS_NOTIFY_GENERIC,
                 "del",c->argv[j],c->db->id);
@@ -293,12 +428,24 @@ void delCommand(redisClient *c) {
     addReplyLongLong(c,deleted);
 }
 
+void delCommand(redisClient *c) {
+    delGenericCommand(c,0);
+}
+
+/* UNLINK key1 key2 ... key_N.
+ * Like DEL, but the memory of big values is reclaimed by a background
+ * thread, so the command is O(1) for every key regardless of its size. */
+void unlinkCommand(redisClient *c) {
+    delGenericCommand(c,1);
+}
+
 /* EXISTS key1 key2 ... key_N.
  * Return value is the number of keys existing. */
 void existsCommand(redisClient *c) {
     long long count = 0;
     int j;
 
+    dbPrefetchKeys(c->db,c->argv+1,c->argc-1);
     for (j = 1; j < c->argc; j++) {
         expireIfNeeded(c->db,c->argv[j]);
         if (dbExists(c->db,c->argv[j])) count++;
@@ -336,14 +483,57 @@ void randomkeyCommand(redisClient *c) {
     decrRefCount(key);
 }
 
+/* Implements KEYS using the key index when the pattern has a literal
+ * prefix: only the range of the keys starting with the prefix is visited,
+ * for every type. */
+static void keysIndexCommand(redisClient *c, sds pattern, int prefixlen) {
+    int plen = sdslen(pattern), type;
+    unsigned long numkeys = 0;
+    void *replylen = addDeferredMultiBulkLength(c);
+
+    for (type = REDIS_STRING; type <= REDIS_HASH; type++) {
+        keyIndexNode *n = keyIndexSeek(c->db->key_index,type,pattern,
+                                       prefixlen);
+
+        while (n && n->type == type && sdslen(n->key) >= (size_t)prefixlen &&
+               memcmp(n->key,pattern,prefixlen) == 0)
+        {
+            /* Get the next node before expireIfNeeded() may delete this
+             * one. */
+            keyIndexNode *next = n->forward[0];
+            sds key = n->key;
+
+            if (stringmatchlen(pattern,plen,key,sdslen(key),0)) {
+                robj *keyobj = createStringObject(key,sdslen(key));
+
+                if (expireIfNeeded(c->db,keyobj) == 0) {
+                    addReplyBulk(c,keyobj);
+                    numkeys++;
+                }
+                decrRefCount(keyobj);
+            }
+            n = next;
+        }
+    }
+    setDeferredMultiBulkLength(c,replylen,numkeys);
+}
+
 void keysCommand(redisClient *c) {
     dictIterator *di;
     dictEntry *de;
     sds pattern = c->argv[1]->ptr;
-    int plen = sdslen(pattern), allkeys;
+    int plen = sdslen(pattern), allkeys, prefixlen;
     unsigned long numkeys = 0;
-    void *replylen = addDeferredMultiBulkLength(c);
+    void *replylen;
+
+    if (c->db->key_index &&
+        (prefixlen = stringmatchPrefixLen(pattern,plen)) > 0)
+    {
+        keysIndexCommand(c,pattern,prefixlen);
+        return;
+    }
 
+    replylen = addDeferredMultiBulkLength(c);
     di = dictGetSafeIterator(c->db->dict);
     allkeys = (pattern[0] == '*' && pattern[1] == '\0');
     while((de = dictNext(di)) != NULL) {
@@ -394,17 +584,36 @@ void scanCallback(void *privdata, const dictEntry *de) {
     if (val) listAddNodeTail(keys, val);
 }
 
+/* The equivalent of scanCallback() for sets and hashes encoded as compact
+ * tables, called by ctableScan(). */
+void scanCtableCallback(void *privdata, sds entry) {
+    void **pd = (void**) privdata;
+    list *keys = pd[0];
+    robj *o = pd[1];
+
+    listAddNodeTail(keys, createStringObject(entry, sdslen(entry)));
+    if (o->type == REDIS_HASH) {
+        size_t vlen;
+        char *val = ctableEntryValue(entry, &vlen);
+
+        listAddNodeTail(keys, createStringObject(val, vlen));
+    }
+}
+
 /* Try to parse a SCAN cursor stored at object 'o':
  * if the cursor is valid, store it as unsigned integer into *cursor and
  * returns REDIS_OK. Otherwise return REDIS_ERR and send an error to the
  * client. */
-int parseScanCursorOrReply(redisClient *c, robj *o, unsigned long *cursor) {
+int parseScanCursorOrReply(redisClient *c, robj *o,
+                           unsigned long long *cursor)
+{
     char *eptr;
 
-    /* Use strtoul() because we need an *unsigned* long, so
-     * getLongLongFromObject() does not cover the whole cursor space. */
+    /* Use strtoull() because we need an *unsigned* long long, so
+     * getLongLongFromObject() does not cover the whole cursor space. The
+     * cursors of the key index have 63 bits even on 32 bit systems. */
     errno = 0;
-    *cursor = strtoul(o->ptr, &eptr, 10);
+    *cursor = strtoull(o->ptr, &eptr, 10);
     if (isspace(((char*)o->ptr)[0]) || eptr[0] != '\0' || errno == ERANGE)
     {
         addReplyError(c, "invalid cursor");
@@ -413,6 +622,100 @@ int parseScanCursorOrReply(redisClient *c, robj *o, unsigned long *cursor) {
     return REDIS_OK;
 }
 
+/* Return the type of the values that the TYPE command names 'name', or -1
+ * if there is no such type. */
+static int getTypeByName(char *name) {
+    if (!strcasecmp(name,"string")) return REDIS_STRING;
+    if (!strcasecmp(name,"list")) return REDIS_LIST;
+    if (!strcasecmp(name,"set")) return REDIS_SET;
+    if (!strcasecmp(name,"zset")) return REDIS_ZSET;
+    if (!strcasecmp(name,"hash")) return REDIS_HASH;
+    return -1;
+}
+
+/* When SCAN uses the key index the keys are visited one type after the
+ * other, and in lexicographical order. The cursor is the position to resume
+ * the iteration from: the first key at or after the MATCH prefix followed by
+ * up to SCAN_INDEX_BYTES bytes taken from the next key to return. It is made
+ * of, from the most significant bits:
+ *
+ * - 3 bits: the type of the next key plus one, so that it is never zero.
+ * - 4 bits: the number of bytes, or SCAN_INDEX_BYTES+1 if the next key has
+ *   more bytes after the prefix, and was truncated.
+ * - 56 bits: the bytes, left aligned.
+ *
+ * The position doesn't depend on the keys added or removed in the meantime,
+ * so all the keys present during the whole iteration are returned. When the
+ * next key was truncated the keys between the position and the next key are
+ * returned again, and if more than COUNT keys share the SCAN_INDEX_BYTES
+ * bytes after the prefix the position can't advance: the iteration then
+ * continues with a scan of the whole main dictionary, flagged by the type
+ * SCAN_INDEX_DICT in the cursor, that may return again some keys, but always
+ * terminates. */
+#define SCAN_INDEX_BYTES 7
+#define SCAN_INDEX_DICT 7ULL
+
+static unsigned long long scanIndexCursor(int type, sds key, int prefixlen) {
+    unsigned long long cursor = 0;
+    int len = sdslen(key)-prefixlen, j;
+
+    for (j = 0; j < SCAN_INDEX_BYTES; j++)
+        cursor = (cursor << 8) | (j < len ? (unsigned char)key[prefixlen+j] : 0);
+    if (len > SCAN_INDEX_BYTES) len = SCAN_INDEX_BYTES+1;
+    return ((unsigned long long)(type+1) << 60) |
+           ((unsigned long long)len << 56) | cursor;
+}
+
+/* Helper for scanGenericCommand(), used to SCAN the keys of 'db' with the
+ * key index. Adds to 'keys' up to 'count' keys of type 'type' (of any type
+ * if -1) starting with the 'prefixlen' bytes at 'prefix', from the position
+ * 'cursor', and returns the cursor to continue the iteration from. */
+static unsigned long long scanKeyIndex(redisDb *db, list *keys,
+                                       unsigned long long cursor, long count,
+                                       char *prefix, int prefixlen, int type)
+{
+    keyIndexNode *n;
+    int t = (type == -1) ? REDIS_STRING : type;
+    sds start = sdsnewlen(prefix,prefixlen);
+
+    if (cursor != 0) {
+        int len = (cursor >> 56) & 0xf, j;
+
+        t = (int)(cursor >> 60)-1;
+        if (t < REDIS_STRING || t > REDIS_HASH || (type != -1 && t != type)) {
+            sdsfree(start);
+            return 0;
+        }
+        if (len > SCAN_INDEX_BYTES) len = SCAN_INDEX_BYTES;
+        for (j = 0; j < len; j++) {
+            char byte = (cursor >> (8*(SCAN_INDEX_BYTES-1-j))) & 0xff;
+            start = sdscatlen(start,&byte,1);
+        }
+    }
+    n = keyIndexSeek(db->key_index,t,start,sdslen(start));
+    sdsfree(start);
+
+    while(1) {
+        unsigned long long next;
+
+        if (n == NULL || n->type != t || sdslen(n->key) < (size_t)prefixlen ||
+            memcmp(n->key,prefix,prefixlen) != 0)
+        {
+            /* Continue with the range of the next type, if any. */
+            if (type != -1 || t == REDIS_HASH) return 0;
+            t++;
+            n = keyIndexSeek(db->key_index,t,prefix,prefixlen);
+            continue;
+        }
+        if (listLength(keys) >= (unsigned long)count) {
+            next = scanIndexCursor(t,n->key,prefixlen);
+            return (next == cursor) ? SCAN_INDEX_DICT << 60 : next;
+        }
+        listAddNodeTail(keys,createStringObject(n->key,sdslen(n->key)));
+        n = n->forward[0];
+    }
+}
+
 /* This command implements SCAN, HSCAN and SSCAN commands.
  * If object 'o' is passed, then it must be a Hash or Set object, otherwise
  * if 'o' is NULL the command will operate on the dictionary associated with
@@ -424,14 +727,16 @@ int parseScanCursorOrReply(redisClient *c, robj *o, unsigned long *cursor) {
  *
  * In the case of a Hash object the function returns both the field and value
  * of every element on the Hash. */
-void scanGenericCommand(redisClient *c, robj *o, unsigned long cursor) {
+void scanGenericCommand(redisClient *c, robj *o, unsigned long long cursor) {
     int i, j;
     list *keys = listCreate();
     listNode *node, *nextnode;
     long count = 10;
     sds pat;
-    int patlen, use_pattern = 0;
+    int patlen, use_pattern = 0, type = -1, prefixlen = 0, use_index = 0;
+    int index_fallback = 0;
     dict *ht;
+    ctable *ct;
 
     /* Object must be NULL (to iterate keys names), or the type of the object
      * must be Set, Sorted Set, or Hash. */
@@ -465,6 +770,15 @@ void scanGenericCommand(redisClient *c, robj *o, unsigned long cursor) {
              * equivalent to disabling it. */
             use_pattern = !(pat[0] == '*' && patlen == 1);
 
+            i += 2;
+        } else if (!strcasecmp(c->argv[i]->ptr, "type") && o == NULL &&
+                   j >= 2)
+        {
+            if ((type = getTypeByName(c->argv[i+1]->ptr)) == -1) {
+                addReplyErrorFormat(c,"unknown type name '%s'",
+                    (char*)c->argv[i+1]->ptr);
+                goto cleanup;
+            }
             i += 2;
         } else {
             addReply(c,shared.syntaxerr);
@@ -480,10 +794,27 @@ void scanGenericCommand(redisClient *c, robj *o, unsigned long cursor) {
      * just return everything inside the object in a single call, setting the
      * cursor to zero to signal the end of the iteration. */
 
-    /* Handle the case of a hash table. */
+    /* The keys starting with the literal prefix of the pattern, or of
+     * the requested type, are in a few ranges of the key index if it is
+     * enabled: only visit them. */
+    if (use_pattern) prefixlen = stringmatchPrefixLen(pat,patlen);
+    if (o == NULL && c->db->key_index && (prefixlen > 0 || type != -1)) {
+        if ((cursor >> 60) == SCAN_INDEX_DICT) {
+            /* The key index can't resume the iteration, see
+             * scanKeyIndex(): continue with the main dictionary. */
+            index_fallback = 1;
+            cursor &= ~(SCAN_INDEX_DICT << 60);
+        } else {
+            use_index = 1;
+        }
+    }
+
+    /* Handle the case of a hash table, or of a compact table, that are
+     * iterated with the same cursor semantics. */
     ht = NULL;
+    ct = NULL;
     if (o == NULL) {
-        ht = c->db->dict;
+        if (!use_index) ht = c->db->dict;
     } else if (o->type == REDIS_SET && o->encoding == REDIS_ENCODING_HT) {
         ht = o->ptr;
     } else if (o->type == REDIS_HASH && o->encoding == REDIS_ENCODING_HT) {
@@ -493,9 +824,16 @@ void scanGenericCommand(redisClient *c, robj *o, unsigned long cursor) {
         zset *zs = o->ptr;
         ht = zs->dict;
         count *= 2; /* We return key / value for this type. */
+    } else if ((o->type == REDIS_SET || o->type == REDIS_HASH) &&
+               o->encoding == REDIS_ENCODING_CTABLE) {
+        ct = o->ptr;
+        if (o->type == REDIS_HASH) count *= 2;
     }
 
-    if (ht) {
+    if (use_index) {
+        cursor = scanKeyIndex(c->db,keys,cursor,count,
+                              use_pattern ? pat : "",prefixlen,type);
+    } else if (ht) {
         void *privdata[2];
         /* We set the max number of iterations to ten times the specified
          * COUNT, so if the hash table is in a pathological state (very
@@ -513,6 +851,17 @@ void scanGenericCommand(redisClient *c, robj *o, unsigned long cursor) {
         } while (cursor &&
               maxiterations-- &&
               listLength(keys) < (unsigned long)count);
+    } else if (ct) {
+        void *privdata[2];
+        long maxiterations = count*10;
+
+        privdata[0] = keys;
+        privdata[1] = o;
+        do {
+            cursor = ctableScan(ct, cursor, scanCtableCallback, privdata);
+        } while (cursor &&
+              maxiterations-- &&
+              listLength(keys) < (unsigned long)count);
     } else if (o->type == REDIS_SET) {
         int pos = 0;
         int64_t ll;
@@ -560,6 +909,15 @@ void scanGenericCommand(redisClient *c, robj *o, unsigned long cursor) {
             }
         }
 
+        /* Filter element if it is a key of another type. The keys from
+         * the key index are already of the requested type. */
+        if (!filter && o == NULL && type != -1 && !use_index) {
+            dictEntry *de = dictFind(c->db->dict,kobj->ptr);
+
+            if (de == NULL || ((robj*)dictGetVal(de))->type != type)
+                filter = 1;
+        }
+
         /* Filter element if it is an expired key. */
         if (!filter && o == NULL && expireIfNeeded(c->db, kobj)) filter = 1;
 
@@ -585,6 +943,7 @@ void scanGenericCommand(redisClient *c, robj *o, unsigned long cursor) {
     }
 
     /* Step 4: Reply to the client. */
+    if (index_fallback && cursor) cursor |= SCAN_INDEX_DICT << 60;
     addReplyMultiBulkLen(c, 2);
     addReplyBulkLongLong(c,cursor);
 
@@ -603,7 +962,7 @@ cleanup:
 
 /* The SCAN command completely relies on scanGenericCommand. */
 void scanCommand(redisClient *c) {
-    unsigned long cursor;
+    unsigned long long cursor;
     if (parseScanCursorOrReply(c,c->argv[1],&cursor) == REDIS_ERR) return;
     scanGenericCommand(c,NULL,cursor);
 }
@@ -773,7 +1132,24 @@ int removeExpire(redisDb *db, robj *key) {
     /* An expire may only be removed if there is a corresponding entry in the
      * main dict. Otherwise, the key will never be freed. */
     redisAssertWithInfo(NULL,key,dictFind(db->dict,key->ptr) != NULL);
-    return dictDelete(db->expires,key->ptr) == DICT_OK;
+    if (server.rdb_forkless_in_progress) rdbForklessTouchKey(db,key,0);
+    return dbDeleteExpire(db,key->ptr);
+}
+
+/* Remove the expire of the key 'key' from the expires dictionary, and from
+ * the expire index if enabled. Unlike removeExpire() the key does not need
+ * to be in the main dictionary: this is used by the deletion functions.
+ * Returns 1 if the key had an expire, 0 otherwise. */
+int dbDeleteExpire(redisDb *db, sds key) {
+    dictEntry *de;
+
+    if (dictSize(db->expires) == 0) return 0;
+    if (db->expire_index) {
+        if ((de = dictFind(db->expires,key)) == NULL) return 0;
+        expireIndexDelete(db->expire_index,dictGetSignedIntegerVal(de),
+                          dictGetKey(de));
+    }
+    return dictDelete(db->expires,key) == DICT_OK;
 }
 
 void setExpire(redisDb *db, robj *key, long long when) {
@@ -782,8 +1158,17 @@ void setExpire(redisDb *db, robj *key, long long when) {
     /* Reuse the sds from the main dict in the expire dict */
     kde = dictFind(db->dict,key->ptr);
     redisAssertWithInfo(NULL,key,kde != NULL);
+    if (server.rdb_forkless_in_progress) rdbForklessTouchKey(db,key,0);
+    if (db->expire_index &&
+        (de = dictFind(db->expires,dictGetKey(kde))) != NULL)
+    {
+        expireIndexDelete(db->expire_index,dictGetSignedIntegerVal(de),
+                          dictGetKey(de));
+    }
     de = dictReplaceRaw(db->expires,dictGetKey(kde));
     dictSetSignedIntegerVal(de,when);
+    if (db->expire_index)
+        expireIndexInsert(db->expire_index,when,dictGetKey(kde));
 }
 
 /* Return the expire time of the specified key, or -1 if no expire
@@ -858,7 +1243,8 @@ int expireIfNeeded(redisDb *db, robj *key) {
     propagateExpire(db,key);
     notifyKeyspaceEvent(REDIS_NOTIFY_EXPIRED,
         "expired",key,db->id);
-    return dbDelete(db,key);
+    return server.lazyfree_lazy_expire ? dbAsyncDelete(db,key) :
+                                         dbSyncDelete(db,key);
 }
 
 /*-----------------------------------------------------------------------------
@@ -1160,88 +1546,116 @@ int *migrateGetKeys(struct redisCommand *cmd, robj **argv, int argc, int *numkey
 
 /* Slot to Key API. This is used by Redis Cluster in order to obtain in
  * a fast way a key that belongs to a specified hash slot. This is useful
- * while rehashing the cluster. */
-void slotToKeyAdd(robj *key) {
-    unsigned int hashslot = keyHashSlot(key->ptr,sdslen(key->ptr));
+ * while rehashing the cluster.
+ *
+ * Every hash slot has its own dictionary holding the keys of the slot.
+ * The keys are the same sds strings used by the main dictionary of the DB
+ * (cluster nodes only use DB 0), so the only overhead per key is a dict
+ * entry: adding and removing keys is O(1), and counting the keys in a slot
+ * is just a dictSize() call. The dictionaries are created on demand and
+ * released when they become empty, so empty slots cost a NULL pointer. */
+dict **slotToKeyCreate(void) {
+    return zcalloc(sizeof(dict*)*REDIS_CLUSTER_SLOTS);
+}
+
+/* Release a slots -> keys map. The keys themselves are not touched. */
+void slotToKeyRelease(dict **slots) {
+    int j;
 
-    zslInsert(server.cluster->slots_to_keys,hashslot,key);
-    incrRefCount(key);
+    for (j = 0; j < REDIS_CLUSTER_SLOTS; j++)
+        if (slots[j]) dictRelease(slots[j]);
+    zfree(slots);
 }
 
-void slotToKeyDel(robj *key) {
-    unsigned int hashslot = keyHashSlot(key->ptr,sdslen(key->ptr));
+/* Add the key, that must be the sds owned by the main dictionary, to the
+ * index of its slot. */
+void slotToKeyAdd(sds key) {
+    unsigned int hashslot = keyHashSlot(key,sdslen(key));
+    dict **slots = server.cluster->slots_to_keys;
 
-    zslDelete(server.cluster->slots_to_keys,hashslot,key);
+    if (slots[hashslot] == NULL)
+        slots[hashslot] = dictCreate(&slotToKeyDictType,NULL);
+    dictAdd(slots[hashslot],key,NULL);
 }
 
-void slotToKeyFlush(void) {
-    zslFree(server.cluster->slots_to_keys);
-    server.cluster->slots_to_keys = zslCreate();
+/* Remove the key, that must be the sds owned by the main dictionary, from
+ * the index of its slot. Must be called before the key is freed. */
+void slotToKeyDel(sds key) {
+    unsigned int hashslot = keyHashSlot(key,sdslen(key));
+    dict *d = server.cluster->slots_to_keys[hashslot];
+
+    if (d == NULL || dictDelete(d,key) != DICT_OK) return;
+    if (dictSize(d) == 0) {
+        dictRelease(d);
+        server.cluster->slots_to_keys[hashslot] = NULL;
+    } else if (htNeedsResize(d)) {
+        dictResize(d);
+    }
 }
 
-unsigned int getKeysInSlot(unsigned int hashslot, robj **keys, unsigned int count) {
-    zskiplistNode *n;
-    zrangespec range;
-    int j = 0;
+/* Replace the key 'oldkey' with 'newkey', an sds with the same content at a
+ * different address, in the index of its slot. Used by the active
+ * defragmentation when it moves the key names owned by the main dictionary.
+ * The index is keyed by address, so 'oldkey', that was already freed, is
+ * never dereferenced. */
+void slotToKeyReplace(sds oldkey, sds newkey) {
+    unsigned int hashslot = keyHashSlot(newkey,sdslen(newkey));
+    dict *d = server.cluster->slots_to_keys[hashslot];
+
+    if (d == NULL || dictDelete(d,oldkey) != DICT_OK) return;
+    dictAdd(d,newkey,NULL);
+}
 
-    range.min = range.max = hashslot;
-    range.minex = range.maxex = 0;
+void slotToKeyFlush(void) {
+    slotToKeyRelease(server.cluster->slots_to_keys);
+    server.cluster->slots_to_keys = slotToKeyCreate();
+}
 
-    n = zslFirstInRange(server.cluster->slots_to_keys, &range);
-    while(n && n->score == hashslot && count--) {
-        keys[j++] = n->obj;
-        n = n->level[0].forward;
-    }
+/* Populate 'keys' with up to 'count' keys of the specified hash slot, and
+ * return the number of keys. The returned sds strings are the ones of the
+ * keyspace, so they are only valid until the keyspace is modified. */
+unsigned int getKeysInSlot(unsigned int hashslot, sds *keys, unsigned int count) {
+    dict *d = server.cluster->slots_to_keys[hashslot];
+    dictIterator *di;
+    dictEntry *de;
+    unsigned int j = 0;
+
+    if (d == NULL || count == 0) return 0;
+    di = dictGetIterator(d);
+    while(j < count && (de = dictNext(di)) != NULL)
+        keys[j++] = dictGetKey(de);
+    dictReleaseIterator(di);
     return j;
 }
 
 /* Remove all the keys in the specified hash slot.
  * The number of removed items is returned. */
 unsigned int delKeysInSlot(unsigned int hashslot) {
-    zskiplistNode *n;
-    zrangespec range;
-    int j = 0;
-
-    range.min = range.max = hashslot;
-    range.minex = range.maxex = 0;
-
-    n = zslFirstInRange(server.cluster->slots_to_keys, &range);
-    while(n && n->score == hashslot) {
-        robj *key = n->obj;
-        n = n->level[0].forward; /* Go to the next item before freeing it. */
-        incrRefCount(key); /* Protect the object while freeing it. */
-        dbDelete(&server.db[0],key);
-        decrRefCount(key);
-        j++;
+    unsigned int numkeys = countKeysInSlot(hashslot), j;
+    robj **keys;
+    sds *names;
+
+    if (numkeys == 0) return 0;
+
+    /* Deleting the keys modifies (and eventually releases) the dictionary
+     * of the slot, so collect the keys first. */
+    names = zmalloc(sizeof(sds)*numkeys);
+    keys = zmalloc(sizeof(robj*)*numkeys);
+    numkeys = getKeysInSlot(hashslot,names,numkeys);
+    for (j = 0; j < numkeys; j++)
+        keys[j] = createStringObject(names[j],sdslen(names[j]));
+    zfree(names);
+
+    for (j = 0; j < numkeys; j++) {
+        dbDelete(&server.db[0],keys[j]);
+        decrRefCount(keys[j]);
     }
-    return j;
+    zfree(keys);
+    return numkeys;
 }
 
 unsigned int countKeysInSlot(unsigned int hashslot) {
-    zskiplist *zsl = server.cluster->slots_to_keys;
-    zskiplistNode *zn;
-    zrangespec range;
-    int rank, count = 0;
-
-    range.min = range.max = hashslot;
-    range.minex = range.maxex = 0;
-
-    /* Find first element in range */
-    zn = zslFirstInRange(zsl, &range);
+    dict *d = server.cluster->slots_to_keys[hashslot];
 
-    /* Use rank of first element, if any, to determine preliminary count */
-    if (zn != NULL) {
-        rank = zslGetRank(zsl, zn->score, zn->obj);
-        count = (zsl->length - (rank - 1));
-
-        /* Find last element in range */
-        zn = zslLastInRange(zsl, &range);
-
-        /* Use rank of last element, if any, to determine the actual count */
-        if (zn != NULL) {
-            rank = zslGetRank(zsl, zn->score, zn->obj);
-            count -= (zsl->length - rank);
-        }
-    }
-    return count;
+    return d ? dictSize(d) : 0;
 }
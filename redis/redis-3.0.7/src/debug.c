@@ -124,7 +124,7 @@ void computeDatasetDigest(unsigned char *final) {
         redisDb *db = server.db+j;
 
         if (dictSize(db->dict) == 0) continue;
-        di = dictGetIterator(db->dict);
+        di = dictGetSafeIterator(db->dict);
 
         /* hash the DB id, so the same dataset moved in a different
          * DB will lead to a different digest */
@@ -267,7 +267,7 @@ void debugCommand(redisClient *c) {
             addReply(c,shared.err);
             return;
         }
-        emptyDb(NULL);
+        emptyDb(-1,EMPTYDB_NO_FLAGS,NULL);
         if (rdbLoad(server.rdb_filename) != REDIS_OK) {
             addReplyError(c,"Error trying to load the RDB dump");
             return;
@@ -275,7 +275,7 @@ void debugCommand(redisClient *c) {
         redisLog(REDIS_WARNING,"DB reloaded by DEBUG RELOAD");
         addReply(c,shared.ok);
     } else if (!strcasecmp(c->argv[1]->ptr,"loadaof")) {
-        emptyDb(NULL);
+        emptyDb(-1,EMPTYDB_NO_FLAGS,NULL);
         if (loadAppendOnlyFile(server.aof_filename) != REDIS_OK) {
             addReply(c,shared.err);
             return;
@@ -287,6 +287,7 @@ void debugCommand(redisClient *c) {
         dictEntry *de;
         robj *val;
         char *strenc;
+        char extra[256] = {0};
 
         if ((de = dictFind(c->db->dict,c->argv[2]->ptr)) == NULL) {
             addReply(c,shared.nokeyerr);
@@ -295,13 +296,43 @@ void debugCommand(redisClient *c) {
         val = dictGetVal(de);
         strenc = strEncoding(val->encoding);
 
+        /* For quicklists report the number of nodes, the average fill
+         * and how much of the list is compressed. */
+        if (val->type == REDIS_LIST &&
+            val->encoding == REDIS_ENCODING_QUICKLIST)
+        {
+            quicklist *ql = val->ptr;
+            quicklistNode *node = ql->head;
+            unsigned long compressed = 0;
+            unsigned long long zl_bytes = 0, raw_bytes = 0;
+
+            while (node) {
+                if (quicklistNodeIsCompressed(node)) {
+                    void *data;
+                    compressed++;
+                    zl_bytes += quicklistGetLzf(node,&data);
+                } else {
+                    zl_bytes += node->sz;
+                }
+                raw_bytes += node->sz;
+                node = node->next;
+            }
+            snprintf(extra,sizeof(extra),
+                " ql_nodes:%u ql_avg_node:%.2f ql_compressed_nodes:%lu"
+                " ql_ziplist_max:%d ql_compressed:%d"
+                " ql_uncompressed_size:%llu ql_compressed_size:%llu",
+                ql->len, ql->len ? (double)ql->count/ql->len : 0,
+                compressed, ql->fill, ql->compress != 0,
+                raw_bytes, zl_bytes);
+        }
+
         addReplyStatusFormat(c,
             "Value at:%p refcount:%d "
             "encoding:%s serializedlength:%lld "
-            "lru:%d lru_seconds_idle:%llu",
+            "lru:%d lru_seconds_idle:%llu%s",
             (void*)val, val->refcount,
             strenc, (long long) rdbSavedObjectLen(val),
-            val->lru, estimateObjectIdleTime(val)/1000);
+            val->lru, estimateObjectIdleTime(val)/1000, extra);
     } else if (!strcasecmp(c->argv[1]->ptr,"sdslen") && c->argc == 3) {
         dictEntry *de;
         robj *val;
@@ -372,6 +403,16 @@ void debugCommand(redisClient *c) {
     {
         server.active_expire_enabled = atoi(c->argv[2]->ptr);
         addReply(c,shared.ok);
+    } else if (!strcasecmp(c->argv[1]->ptr,"bitops-kernel") &&
+               (c->argc == 2 || c->argc == 3))
+    {
+        /* DEBUG BITOPS-KERNEL [scalar|popcnt|avx2|auto] */
+        if (c->argc == 3 && bitopsSetKernel(c->argv[2]->ptr) == REDIS_ERR) {
+            addReplyError(c,"Unknown bitops kernel or not supported by "
+                            "this CPU");
+            return;
+        }
+        addReplyStatus(c,bitopsGetKernelName());
     } else if (!strcasecmp(c->argv[1]->ptr,"error") && c->argc == 3) {
         sds errstr = sdsnewlen("-",1);
 
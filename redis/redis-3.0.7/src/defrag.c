@@ -0,0 +1,750 @@
+/* Active memory defragmentation.
+ *
+ * With churny workloads the allocator ends up with many runs (the groups of
+ * pages jemalloc uses to serve a given size class) that are only partially
+ * used: the memory can't be returned to the OS, and the RSS stays much
+ * higher than the memory actually used by the dataset.
+ *
+ * The functions in this file scan the keyspace incrementally from
+ * serverCron() and, for every allocation that belongs to the dataset (dict
+ * entries, key names, objects, sds strings, ziplists, intsets, quicklist and
+ * skiplist nodes), ask the allocator whether it lives in a run that is less
+ * utilized than the average of its size class. If so the allocation is
+ * copied to a new address, allocated bypassing the thread cache so that it
+ * lands in the most utilized run, and every reference to the old address is
+ * updated. Sparse runs empty out over time and are released. Skiplist nodes
+ * allocated from the slabs of their skiplist are moved out of the slabs
+ * that are mostly empty in the same way.
+ *
+ * The scan only starts when the fragmentation reported by the allocator
+ * exceeds active-defrag-threshold-lower and active-defrag-ignore-bytes, and
+ * uses between active-defrag-cycle-min and active-defrag-cycle-max percent
+ * of the CPU time depending on how bad the fragmentation is. Values with
+ * more than active-defrag-max-scan-fields elements are processed a few
+ * elements at a time, in order to respect the time limit of every cycle.
+ *
+ * Only allocations referenced exclusively by the dataset are moved: objects
+ * with a refcount greater than expected may be referenced by the output
+ * buffers of clients, so they are left where they are.
+ *
+ * This requires the je_get_defrag_hint() function added to the jemalloc
+ * version shipped with Redis, so active defragmentation is not available
+ * when Redis is built with a different allocator.
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * Copyright (c) 2009-2016, Salvatore Sanfilippo <antirez at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "redis.h"
+
+#ifdef HAVE_DEFRAG
+
+/* Number of dictScan() calls, or of reallocations, between two checks of
+ * the time limit of the cycle. */
+#define DEFRAG_CHECK_TIME_SCANS 16
+#define DEFRAG_CHECK_TIME_HITS 1000
+/* Utilization margin (1/64, in 16.16 fixed point) within which a run is
+ * considered as utilized as the average of its bin. */
+#define DEFRAG_UTIL_MARGIN ((1<<16)/64)
+
+/* -----------------------------------------------------------------------------
+ * Low level reallocation of single allocations
+ * -------------------------------------------------------------------------- */
+
+/* Move the allocation 'ptr' to a new address if the allocator reports that
+ * it lives in a run less utilized than the average of its size class.
+ * Returns the new address, or NULL if the allocation was not moved. In the
+ * first case 'ptr' is freed, and the caller must update every reference. */
+void *activeDefragAlloc(void *ptr) {
+    int bin_util, run_util;
+    size_t size;
+    void *newptr;
+
+    if (!je_get_defrag_hint(ptr,&bin_util,&run_util)) {
+        server.stat_active_defrag_misses++;
+        return NULL;
+    }
+    /* If the run is more utilized than the average of the bin, or full,
+     * moving the allocation would not help releasing it. Runs utilized about
+     * as much as the average are still processed: when all the runs of a bin
+     * are equally sparse, as after deleting every other key, the average is
+     * just below their utilization because of the current run. */
+    if (run_util > bin_util+DEFRAG_UTIL_MARGIN || run_util == 1<<16) {
+        server.stat_active_defrag_misses++;
+        return NULL;
+    }
+    /* The new allocation must bypass the thread cache, that would just
+     * return a region recently freed, likely in a sparse run as well. */
+    size = zmalloc_size(ptr);
+    newptr = zmalloc_no_tcache(size);
+    memcpy(newptr,ptr,size);
+    zfree_no_tcache(ptr);
+    server.stat_active_defrag_hits++;
+    return newptr;
+}
+
+/* Like activeDefragAlloc() but for sds strings, that don't start at the
+ * beginning of their allocation. Returns the new sds or NULL. */
+sds activeDefragSds(sds s) {
+    void *ptr = sdsAllocPtr(s);
+    void *newptr = activeDefragAlloc(ptr);
+
+    if (newptr == NULL) return NULL;
+    return (char*)newptr + (s - (char*)ptr);
+}
+
+/* Defrag a string object, only if its refcount is exactly 'refcount', that
+ * is, if it is only referenced by the data structure we are processing.
+ * Returns the new object address if the object itself was moved, or NULL.
+ * The sds of a RAW object may be moved in both cases. '*defragged' is
+ * incremented by the number of reallocations performed. */
+robj *activeDefragStringOb(robj *ob, int refcount, long *defragged) {
+    robj *ret = NULL;
+
+    if (ob->type != REDIS_STRING || ob->refcount != refcount) return NULL;
+
+    if (ob->encoding == REDIS_ENCODING_EMBSTR) {
+        /* The sds is part of the same allocation of the object. */
+        long ofs = (char*)ob->ptr - (char*)ob;
+
+        if ((ret = activeDefragAlloc(ob)) != NULL) {
+            ret->ptr = (char*)ret + ofs;
+            (*defragged)++;
+        }
+        return ret;
+    }
+
+    if ((ret = activeDefragAlloc(ob)) != NULL) {
+        ob = ret;
+        (*defragged)++;
+    }
+    if (ob->encoding == REDIS_ENCODING_RAW) {
+        sds newsds = activeDefragSds(ob->ptr);
+
+        if (newsds) {
+            ob->ptr = newsds;
+            (*defragged)++;
+        }
+    }
+    return ret;
+}
+
+/* Move the entry 'de' of the dictionary 'd', updating the pointer referencing
+ * it in the hash table. The key of the entry must already be its final
+ * address, since it is used to locate the entry. */
+static long activeDefragDictEntry(dict *d, dictEntry *de) {
+    dictEntry **deref, *newde;
+
+    deref = dictFindEntryRefByPtrAndHash(d,de->key,dictHashKey(d,de->key));
+    if (deref == NULL) return 0;
+    redisAssert(*deref == de);
+    if ((newde = activeDefragAlloc(de)) == NULL) return 0;
+    *deref = newde;
+    return 1;
+}
+
+/* Move the dict structure and its hash tables. Small hash tables are
+ * normal allocations as well, while big ones are never reported as worth
+ * moving by the allocator. Returns the new dict address, or NULL. */
+static dict *activeDefragDictStruct(dict *d, long *defragged) {
+    dict *newd;
+    dictEntry **newtable;
+    int j;
+
+    if ((newd = activeDefragAlloc(d)) != NULL) {
+        d = newd;
+        (*defragged)++;
+    }
+    for (j = 0; j <= 1; j++) {
+        if (d->ht[j].table == NULL) continue;
+        if ((newtable = activeDefragAlloc(d->ht[j].table)) != NULL) {
+            d->ht[j].table = newtable;
+            (*defragged)++;
+        }
+    }
+    return newd;
+}
+
+/* -----------------------------------------------------------------------------
+ * Values
+ * -------------------------------------------------------------------------- */
+
+/* Move the quicklist structure, its nodes, and the ziplists (compressed or
+ * not) of the nodes. */
+static long activeDefragQuicklist(robj *ob) {
+    quicklist *ql = ob->ptr, *newql;
+    quicklistNode *node, *newnode;
+    unsigned char *newzl;
+    long defragged = 0;
+
+    if ((newql = activeDefragAlloc(ql)) != NULL) {
+        ob->ptr = ql = newql;
+        defragged++;
+    }
+    node = ql->head;
+    while (node) {
+        if ((newnode = activeDefragAlloc(node)) != NULL) {
+            if (newnode->prev) newnode->prev->next = newnode;
+            else ql->head = newnode;
+            if (newnode->next) newnode->next->prev = newnode;
+            else ql->tail = newnode;
+            node = newnode;
+            defragged++;
+        }
+        if ((newzl = activeDefragAlloc(node->zl)) != NULL) {
+            node->zl = newzl;
+            defragged++;
+        }
+        node = node->next;
+    }
+    return defragged;
+}
+
+/* Move a set or hash encoded as a compact table: the table structure, the
+ * array of slots and every entry. The tables are small enough (see the
+ * *-max-ctable-entries options) to be processed in a single step. */
+static long activeDefragCtable(robj *ob) {
+    ctable *ct = ob->ptr, *newct;
+    unsigned char *newctrl;
+    sds *entries, newentry;
+    long defragged = 0;
+    uint32_t j;
+
+    if ((newct = activeDefragAlloc(ct)) != NULL) {
+        ob->ptr = ct = newct;
+        defragged++;
+    }
+    if ((newctrl = activeDefragAlloc(ct->ctrl)) != NULL) {
+        ct->ctrl = newctrl;
+        defragged++;
+    }
+    entries = ctableEntries(ct);
+    for (j = 0; j < ct->size; j++) {
+        if (!ctableSlotIsFull(ct,j)) continue;
+        if ((newentry = activeDefragSds(entries[j])) != NULL) {
+            entries[j] = newentry;
+            defragged++;
+        }
+    }
+    return defragged;
+}
+
+/* Move the skiplist node 'x', if it lives in a sparse slab of the skiplist
+ * or, when allocated with zmalloc(), in a sparse run. Then update the
+ * forward pointers of the nodes preceding it at every level, and the
+ * backward pointer of the next node (or the tail of the list). Returns the
+ * new node address, or NULL if the node was not moved. */
+static zskiplistNode *zslDefrag(zskiplist *zsl, zskiplistNode *x) {
+    zskiplistNode *update[ZSKIPLIST_MAXLEVEL], *y, *newx;
+    int i;
+
+    if (zslNodeSlab(zsl,x)) {
+        if ((newx = zslEvacuateNode(zsl,x)) == NULL) return NULL;
+        server.stat_active_defrag_hits++;
+    } else {
+        if ((newx = activeDefragAlloc(x)) == NULL) return NULL;
+    }
+
+    /* The usual search path, but the old node is matched by address since
+     * it was already released. */
+    y = zsl->header;
+    for (i = zsl->level-1; i >= 0; i--) {
+        while (y->level[i].forward &&
+               y->level[i].forward != x &&
+               (y->level[i].forward->score < newx->score ||
+                (y->level[i].forward->score == newx->score &&
+                 compareStringObjects(y->level[i].forward->obj,
+                                      newx->obj) < 0)))
+            y = y->level[i].forward;
+        update[i] = y;
+    }
+    for (i = 0; i < zsl->level; i++) {
+        if (update[i]->level[i].forward == x)
+            update[i]->level[i].forward = newx;
+    }
+    if (newx->level[0].forward)
+        newx->level[0].forward->backward = newx;
+    else
+        zsl->tail = newx;
+    return newx;
+}
+
+/* State passed to the dictScan() callbacks of the values. */
+typedef struct defragScanState {
+    dict *d;            /* The dictionary we are scanning. */
+    zset *zs;           /* The sorted set when scanning zset->dict. */
+    long defragged;     /* Number of reallocations performed. */
+} defragScanState;
+
+/* dictScan() callback for sets: elements are string objects. */
+static void defragSetCallback(void *privdata, const dictEntry *_de) {
+    defragScanState *st = privdata;
+    dictEntry *de = (dictEntry*)_de;
+    robj *newele;
+
+    if ((newele = activeDefragStringOb(de->key,1,&st->defragged)) != NULL)
+        de->key = newele;
+    st->defragged += activeDefragDictEntry(st->d,de);
+}
+
+/* dictScan() callback for hashes: both fields and values are objects. */
+static void defragHashCallback(void *privdata, const dictEntry *_de) {
+    defragScanState *st = privdata;
+    dictEntry *de = (dictEntry*)_de;
+    robj *newob;
+
+    if ((newob = activeDefragStringOb(de->key,1,&st->defragged)) != NULL)
+        de->key = newob;
+    if ((newob = activeDefragStringOb(de->v.val,1,&st->defragged)) != NULL)
+        de->v.val = newob;
+    st->defragged += activeDefragDictEntry(st->d,de);
+}
+
+/* dictScan() callback for sorted sets. The element object is shared by the
+ * dict entry and the skiplist node, and the value of the entry points to
+ * the score stored inside the node, so the three are moved together. */
+static void defragZsetCallback(void *privdata, const dictEntry *_de) {
+    defragScanState *st = privdata;
+    dictEntry *de = (dictEntry*)_de;
+    zskiplistNode *x, *newx;
+    robj *newele;
+
+    x = (zskiplistNode*)((char*)de->v.val - offsetof(zskiplistNode,score));
+    if ((newele = activeDefragStringOb(de->key,1,&st->defragged)) != NULL) {
+        de->key = newele;
+        x->obj = newele;
+    }
+    if ((newx = zslDefrag(st->zs->zsl,x)) != NULL) {
+        de->v.val = &newx->score;
+        st->defragged++;
+    }
+    st->defragged += activeDefragDictEntry(st->d,de);
+}
+
+/* Return the dictionary holding the elements of the value, if the value is
+ * a set, hash or sorted set represented with a hash table. */
+static dict *defragValueDict(robj *ob) {
+    if ((ob->type == REDIS_SET || ob->type == REDIS_HASH) &&
+        ob->encoding == REDIS_ENCODING_HT) return ob->ptr;
+    if (ob->type == REDIS_ZSET && ob->encoding == REDIS_ENCODING_SKIPLIST)
+        return ((zset*)ob->ptr)->dict;
+    return NULL;
+}
+
+/* Move the structures describing a value represented with a hash table:
+ * the dict (and for sorted sets the zset and skiplist structures), but not
+ * the elements, that are processed by defragValueDictStep(). */
+static long defragValueDictStruct(robj *ob) {
+    long defragged = 0;
+    dict *newd;
+
+    if (ob->type == REDIS_ZSET) {
+        zset *zs = ob->ptr, *newzs;
+        zskiplist *newzsl;
+        zskiplistNode *newheader;
+        zskiplistSlab **newslabs;
+
+        if ((newzs = activeDefragAlloc(zs)) != NULL) {
+            ob->ptr = zs = newzs;
+            defragged++;
+        }
+        if ((newzsl = activeDefragAlloc(zs->zsl)) != NULL) {
+            zs->zsl = newzsl;
+            defragged++;
+        }
+        /* No node points back to the header, and the array of the slabs
+         * is only referenced by the skiplist. */
+        if ((newheader = activeDefragAlloc(zs->zsl->header)) != NULL) {
+            zs->zsl->header = newheader;
+            defragged++;
+        }
+        if (zs->zsl->slabs &&
+            (newslabs = activeDefragAlloc(zs->zsl->slabs)) != NULL)
+        {
+            zs->zsl->slabs = newslabs;
+            defragged++;
+        }
+        if ((newd = activeDefragDictStruct(zs->dict,&defragged)) != NULL)
+            zs->dict = newd;
+    } else {
+        if ((newd = activeDefragDictStruct(ob->ptr,&defragged)) != NULL)
+            ob->ptr = newd;
+    }
+    return defragged;
+}
+
+/* Perform one dictScan() step over the elements of a value represented with
+ * a hash table, starting at 'cursor'. Returns the next cursor, 0 when done. */
+static unsigned long defragValueDictStep(robj *ob, unsigned long cursor,
+                                         long *defragged)
+{
+    defragScanState st;
+    dictScanFunction *fn;
+
+    st.d = defragValueDict(ob);
+    st.zs = NULL;
+    st.defragged = 0;
+    if (ob->type == REDIS_SET) {
+        fn = defragSetCallback;
+    } else if (ob->type == REDIS_HASH) {
+        fn = defragHashCallback;
+    } else {
+        fn = defragZsetCallback;
+        st.zs = ob->ptr;
+    }
+    cursor = dictScan(st.d,cursor,fn,&st);
+    *defragged += st.defragged;
+    return cursor;
+}
+
+/* Move the allocations of the value 'ob', that is already at its final
+ * address. Values with more than active-defrag-max-scan-fields elements in
+ * a hash table are not processed here: 1 is returned, and the caller will
+ * process the value incrementally. Otherwise 0 is returned. */
+static int defragValue(robj *ob, long *defragged) {
+    void *newptr;
+    dict *d;
+
+    switch(ob->type) {
+    case REDIS_STRING:
+        if (ob->encoding == REDIS_ENCODING_RAW) {
+            sds newsds = activeDefragSds(ob->ptr);
+            if (newsds) {
+                ob->ptr = newsds;
+                (*defragged)++;
+            }
+        }
+        break;
+    case REDIS_LIST:
+        if (ob->encoding == REDIS_ENCODING_QUICKLIST)
+            *defragged += activeDefragQuicklist(ob);
+        break;
+    case REDIS_SET:
+    case REDIS_HASH:
+    case REDIS_ZSET:
+        if ((d = defragValueDict(ob)) != NULL) {
+            unsigned long cursor = 0;
+
+            if (dictSize(d) > server.active_defrag_max_scan_fields)
+                return 1;
+            *defragged += defragValueDictStruct(ob);
+            do {
+                cursor = defragValueDictStep(ob,cursor,defragged);
+            } while(cursor);
+        } else if (ob->encoding == REDIS_ENCODING_CTABLE) {
+            *defragged += activeDefragCtable(ob);
+        } else if ((newptr = activeDefragAlloc(ob->ptr)) != NULL) {
+            /* Intsets and ziplists are single allocations. */
+            ob->ptr = newptr;
+            (*defragged)++;
+        }
+        break;
+    }
+    return 0;
+}
+
+/* -----------------------------------------------------------------------------
+ * Keyspace scan
+ * -------------------------------------------------------------------------- */
+
+/* Names of the keys of the DB being scanned whose value is too big to be
+ * processed in a single step, and the dictScan() cursor of the first one. */
+static list *defrag_later = NULL;
+static unsigned long defrag_later_cursor = 0;
+
+/* Move the key name, the value object, and the dict entries referencing them
+ * in the main dictionary and in the expires dictionary. The key name is also
+ * referenced by the slots -> keys index in cluster mode, and by the key
+ * index if enabled. Returns the number of reallocations performed. */
+static long defragKey(redisDb *db, dictEntry *de) {
+    sds keysds = de->key, newsds;
+    robj *ob = de->v.val, *newob;
+    dictEntry **deref, *newde;
+    long defragged = 0;
+
+    deref = NULL;
+    if ((newsds = activeDefragSds(keysds)) != NULL) {
+        de->key = newsds;
+        defragged++;
+        if (dictSize(db->expires)) {
+            deref = dictFindEntryRefByPtrAndHash(db->expires,keysds,
+                        dictHashKey(db->expires,newsds));
+            if (deref) {
+                (*deref)->key = newsds;
+                if (db->expire_index) {
+                    long long when = dictGetSignedIntegerVal(*deref);
+
+                    expireIndexDelete(db->expire_index,when,keysds);
+                    expireIndexInsert(db->expire_index,when,newsds);
+                }
+            }
+        }
+        if (server.cluster_enabled) slotToKeyReplace(keysds,newsds);
+        if (db->key_index) keyIndexReplace(db->key_index,ob->type,newsds);
+    } else if (dictSize(db->expires)) {
+        deref = dictFindEntryRefByPtrAndHash(db->expires,keysds,
+                    dictHashKey(db->expires,keysds));
+    }
+    if (deref && (newde = activeDefragAlloc(*deref)) != NULL) {
+        *deref = newde;
+        defragged++;
+    }
+
+    /* The value object. EMBSTR objects include their sds. */
+    if (ob->refcount == 1) {
+        if (ob->type == REDIS_STRING) {
+            newob = activeDefragStringOb(ob,1,&defragged);
+            if (newob) de->v.val = newob;
+            ob = NULL; /* Nothing else to do. */
+        } else if ((newob = activeDefragAlloc(ob)) != NULL) {
+            de->v.val = ob = newob;
+            defragged++;
+        }
+        if (ob && defragValue(ob,&defragged)) {
+            if (defrag_later == NULL) defrag_later = listCreate();
+            listAddNodeTail(defrag_later,sdsdup(de->key));
+        }
+    }
+
+    /* The node of the key in the key index: it lives as long as the key. */
+    if (db->key_index && keyIndexMoveNode(db->key_index,
+            ((robj*)de->v.val)->type,de->key,
+            activeDefragAlloc))
+        defragged++;
+
+    defragged += activeDefragDictEntry(db->dict,de);
+    return defragged;
+}
+
+/* dictScan() callback for the main dictionary of a DB. */
+static void defragScanCallback(void *privdata, const dictEntry *de) {
+    redisDb *db = privdata;
+
+    if (defragKey(db,(dictEntry*)de))
+        server.stat_active_defrag_key_hits++;
+    else
+        server.stat_active_defrag_key_misses++;
+}
+
+/* Forget the values queued for incremental processing. */
+static void defragLaterEmpty(void) {
+    listNode *ln;
+
+    if (defrag_later == NULL) return;
+    while ((ln = listFirst(defrag_later)) != NULL) {
+        sdsfree(ln->value);
+        listDelNode(defrag_later,ln);
+    }
+    defrag_later_cursor = 0;
+}
+
+/* Process the values queued by defragKey(), a few elements at a time.
+ * Returns 1 if the time limit 'endtime' was reached before the queue was
+ * drained, 0 otherwise. */
+static int defragLaterStep(redisDb *db, long long endtime) {
+    unsigned int iterations = 0;
+    long long hits = server.stat_active_defrag_hits;
+    listNode *ln;
+
+    while (defrag_later && (ln = listFirst(defrag_later)) != NULL) {
+        sds key = ln->value;
+        dictEntry *de = dictFind(db->dict,key);
+        robj *ob = de ? dictGetVal(de) : NULL;
+        long defragged = 0;
+
+        /* The key may have been deleted or overwritten meanwhile. */
+        if (ob && ob->refcount == 1 && defragValueDict(ob) != NULL) {
+            if (defrag_later_cursor == 0)
+                defragged += defragValueDictStruct(ob);
+            do {
+                defrag_later_cursor =
+                    defragValueDictStep(ob,defrag_later_cursor,&defragged);
+                if (++iterations > DEFRAG_CHECK_TIME_SCANS ||
+                    server.stat_active_defrag_hits - hits >
+                        DEFRAG_CHECK_TIME_HITS)
+                {
+                    if (ustime() > endtime) break;
+                    iterations = 0;
+                    hits = server.stat_active_defrag_hits;
+                }
+            } while(defrag_later_cursor);
+            if (defrag_later_cursor) return 1;
+        }
+        sdsfree(key);
+        listDelNode(defrag_later,ln);
+    }
+    return 0;
+}
+
+/* Return the fragmentation inside the allocator as a percentage, that is,
+ * how many bytes of the pages used for small and large allocations are not
+ * allocated, compared to the allocated bytes. The RSS based ratio reported
+ * by INFO can't be used, since it also accounts for pages the allocator
+ * retains and for memory not used by the allocator at all: a scan would
+ * never be able to lower it. */
+static float getAllocatorFragmentation(size_t *frag_bytes) {
+    size_t allocated, active, resident;
+
+    *frag_bytes = 0;
+    if (!zmalloc_get_allocator_info(&allocated,&active,&resident) ||
+        allocated == 0 || active <= allocated) return 0;
+    *frag_bytes = active-allocated;
+    return ((float)active/allocated)*100-100;
+}
+
+/* Start a scan if the fragmentation justifies it, and set the percentage of
+ * CPU it can use, interpolating between the min and max cycle settings as
+ * the fragmentation goes from the lower to the upper threshold. A running
+ * scan may be made more aggressive, but never less. */
+static void computeDefragCycles(void) {
+    size_t frag_bytes;
+    float frag_pct = getAllocatorFragmentation(&frag_bytes);
+    int lower = server.active_defrag_threshold_lower;
+    int upper = server.active_defrag_threshold_upper;
+    int cmin = server.active_defrag_cycle_min;
+    int cmax = server.active_defrag_cycle_max;
+    int cpu_pct;
+
+    if (!server.active_defrag_running &&
+        (frag_pct < lower || frag_bytes < server.active_defrag_ignore_bytes))
+        return;
+
+    if (frag_pct >= upper || upper <= lower)
+        cpu_pct = cmax;
+    else if (frag_pct <= lower)
+        cpu_pct = cmin;
+    else
+        cpu_pct = cmin + (int)((frag_pct-lower)*(cmax-cmin)/(upper-lower));
+    if (cpu_pct < cmin) cpu_pct = cmin;
+    if (cpu_pct > cmax) cpu_pct = cmax;
+    if (cpu_pct < 1) cpu_pct = 1;
+
+    if (cpu_pct > server.active_defrag_running) {
+        if (!server.active_defrag_running)
+            redisLog(REDIS_VERBOSE,
+                "Starting active defrag, frag=%.0f%%, frag_bytes=%zu, cpu=%d%%",
+                frag_pct, frag_bytes, cpu_pct);
+        server.active_defrag_running = cpu_pct;
+    }
+}
+
+/* Perform an incremental step of the active defragmentation scan. Called by
+ * serverCron() when activedefrag is enabled. The step lasts at most the
+ * fraction of the cron period given by server.active_defrag_running. */
+void activeDefragCycle(void) {
+    static int current_db = -1;
+    static unsigned long cursor = 0;
+    static long long start_scan, start_hits;
+    redisDb *db;
+    unsigned int iterations = 0;
+    long long hits, start, endtime;
+
+    if (!server.active_defrag_enabled) {
+        /* Disabled while a scan was in progress: reset the state. */
+        if (server.active_defrag_running) {
+            server.active_defrag_running = 0;
+            current_db = -1;
+            cursor = 0;
+            defragLaterEmpty();
+        }
+        return;
+    }
+
+    /* Moving memory while a child is saving would just trigger copy on
+     * write, and the forkless snapshot references the key names by address
+     * until it completes. */
+    if (server.rdb_child_pid != -1 || server.aof_child_pid != -1 ||
+        server.rdb_forkless_in_progress || server.loading) return;
+
+    /* Check once a second if a scan should start, or be more aggressive. */
+    run_with_period(1000) {
+        computeDefragCycles();
+    }
+    if (!server.active_defrag_running) return;
+
+    start = ustime();
+    endtime = start + 1000000LL*server.active_defrag_running/server.hz/100;
+    hits = server.stat_active_defrag_hits;
+
+    while(1) {
+        /* Values queued by the scan of the current DB go first: they must
+         * be processed before moving to the next DB. */
+        if (current_db >= 0 && defragLaterStep(server.db+current_db,endtime))
+            return;
+
+        /* Move to the next DB when the current one is done, or complete
+         * the scan. */
+        if (cursor == 0) {
+            if (++current_db >= server.dbnum) {
+                size_t frag_bytes;
+                float frag_pct = getAllocatorFragmentation(&frag_bytes);
+
+                redisLog(REDIS_VERBOSE,
+                    "Active defrag done in %lldms, reallocated=%lld, "
+                    "frag=%.0f%%, frag_bytes=%zu",
+                    (ustime()-start_scan)/1000,
+                    server.stat_active_defrag_hits-start_hits,
+                    frag_pct, frag_bytes);
+                current_db = -1;
+                server.active_defrag_running = 0;
+                /* A new scan will start at the next check, if needed. */
+                return;
+            }
+            if (current_db == 0) {
+                start_scan = ustime();
+                start_hits = server.stat_active_defrag_hits;
+            }
+        }
+        db = server.db+current_db;
+
+        do {
+            if (dictSize(db->dict) == 0) {
+                cursor = 0;
+                break;
+            }
+            cursor = dictScan(db->dict,cursor,defragScanCallback,db);
+            if (++iterations > DEFRAG_CHECK_TIME_SCANS ||
+                server.stat_active_defrag_hits - hits > DEFRAG_CHECK_TIME_HITS)
+            {
+                if (ustime() > endtime) return;
+                iterations = 0;
+                hits = server.stat_active_defrag_hits;
+            }
+        } while(cursor && (defrag_later == NULL ||
+                           listLength(defrag_later) == 0));
+    }
+}
+
+#else /* HAVE_DEFRAG */
+
+void activeDefragCycle(void) {
+    /* Not supported without the defrag hint of the bundled jemalloc. */
+}
+
+#endif
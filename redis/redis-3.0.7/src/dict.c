@@ -46,6 +46,7 @@
 #include "dict.h"
 #include "zmalloc.h"
 #include "redisassert.h"
+#include "config.h"
 
 /* Using dictEnableResize() / dictDisableResize() we make possible to
  * enable/disable resizing of the hash table as needed. This is very important
@@ -61,6 +62,7 @@ static unsigned int dict_force_resize_ratio = 5;
 /* -------------------------- private prototypes ---------------------------- */
 
 static int _dictExpandIfNeeded(dict *ht);
+static int _dictExpandAllowed(dict *d, unsigned long size);
 static unsigned long _dictNextPower(unsigned long size);
 static int _dictKeyIndex(dict *ht, const void *key);
 static int _dictInit(dict *ht, dictType *type, void *privDataPtr);
@@ -197,27 +199,19 @@ int dictResize(dict *d)
     minimal = d->ht[0].used;
     if (minimal < DICT_HT_INITIAL_SIZE)
         minimal = DICT_HT_INITIAL_SIZE;
+    if (!_dictExpandAllowed(d,minimal)) return DICT_ERR;
     return dictExpand(d, minimal);
 }
 
-/* Expand or create the hash table */
-int dictExpand(dict *d, unsigned long size)
+/* Install 'table', an array of 'size' NULL pointers, as the new hash table
+ * of the dictionary. The size must already be a valid power of two. */
+static int _dictInstallTable(dict *d, dictEntry **table, unsigned long size)
 {
     dictht n; /* the new hash table */
-    unsigned long realsize = _dictNextPower(size);
-
-    /* the size is invalid if it is smaller than the number of
-     * elements already inside the hash table */
-    if (dictIsRehashing(d) || d->ht[0].used > size)
-        return DICT_ERR;
-
-    /* Rehashing to the same table size is not useful. */
-    if (realsize == d->ht[0].size) return DICT_ERR;
 
-    /* Allocate the new hash table and initialize all pointers to NULL */
-    n.size = realsize;
-    n.sizemask = realsize-1;
-    n.table = zcalloc(realsize*sizeof(dictEntry*));
+    n.size = size;
+    n.sizemask = size-1;
+    n.table = table;
     n.used = 0;
 
     /* Is this the first initialization? If so it's not really a rehashing
@@ -233,6 +227,36 @@ int dictExpand(dict *d, unsigned long size)
     return DICT_OK;
 }
 
+/* Expand or create the hash table */
+int dictExpand(dict *d, unsigned long size)
+{
+    unsigned long realsize = _dictNextPower(size);
+
+    /* the size is invalid if it is smaller than the number of
+     * elements already inside the hash table */
+    if (dictIsRehashing(d) || d->ht[0].used > size)
+        return DICT_ERR;
+
+    /* Rehashing to the same table size is not useful. */
+    if (realsize == d->ht[0].size) return DICT_ERR;
+
+    /* Allocate the new hash table and initialize all pointers to NULL */
+    return _dictInstallTable(d,zcalloc(realsize*sizeof(dictEntry*)),realsize);
+}
+
+/* Like dictExpand(), but uses 'table', an already allocated array of 'size'
+ * NULL pointers, instead of allocating it. This allows the caller to
+ * allocate big tables elsewhere (for instance in a different thread).
+ * On success the dictionary takes ownership of the table, otherwise DICT_ERR
+ * is returned and the table must be released by the caller. */
+int dictExpandWithTable(dict *d, dictEntry **table, unsigned long size)
+{
+    if (dictIsRehashing(d) || d->ht[0].used > size) return DICT_ERR;
+    if (size != _dictNextPower(size) || size == d->ht[0].size)
+        return DICT_ERR;
+    return _dictInstallTable(d,table,size);
+}
+
 /* Performs N steps of incremental rehashing. Returns 1 if there are still
  * keys to move from the old to the new hash table, otherwise 0 is returned.
  *
@@ -294,6 +318,13 @@ long long timeInMilliseconds(void) {
     return (((long long)tv.tv_sec)*1000)+(tv.tv_usec/1000);
 }
 
+long long timeInMicroseconds(void) {
+    struct timeval tv;
+
+    gettimeofday(&tv,NULL);
+    return (((long long)tv.tv_sec)*1000000)+tv.tv_usec;
+}
+
 /* Rehash for an amount of time between ms milliseconds and ms+1 milliseconds */
 int dictRehashMilliseconds(dict *d, int ms) {
     long long start = timeInMilliseconds();
@@ -306,6 +337,19 @@ int dictRehashMilliseconds(dict *d, int ms) {
     return rehashes;
 }
 
+/* Rehash for about 'us' microseconds. Like dictRehashMilliseconds() but
+ * with a finer resolution, for callers that tune the budget dynamically. */
+int dictRehashMicroseconds(dict *d, long long us) {
+    long long start = timeInMicroseconds();
+    int rehashes = 0;
+
+    while(dictRehash(d,100)) {
+        rehashes += 100;
+        if (timeInMicroseconds()-start >= us) break;
+    }
+    return rehashes;
+}
+
 /* This function performs just a step of rehashing, and only if there are
  * no safe iterators bound to our hash table. When we have iterators in the
  * middle of a rehashing we can't mess with the two hash tables otherwise
@@ -405,14 +449,16 @@ dictEntry *dictReplaceRaw(dict *d, void *key) {
     return entry ? entry : dictAddRaw(d,key);
 }
 
-/* Search and remove an element */
-static int dictGenericDelete(dict *d, const void *key, int nofree)
+/* Search and unlink an element from the table. The entry is returned so
+ * that the caller can decide if and when to release it, or NULL is
+ * returned if the key was not found. */
+static dictEntry *dictGenericDelete(dict *d, const void *key)
 {
     unsigned int h, idx;
     dictEntry *he, *prevHe;
     int table;
 
-    if (d->ht[0].size == 0) return DICT_ERR; /* d->ht[0].table is NULL */
+    if (d->ht[0].size == 0) return NULL; /* d->ht[0].table is NULL */
     if (dictIsRehashing(d)) _dictRehashStep(d);
     h = dictHashKey(d, key);
 
@@ -427,28 +473,65 @@ static int dictGenericDelete(dict *d, const void *key, int nofree)
                     prevHe->next = he->next;
                 else
                     d->ht[table].table[idx] = he->next;
-                if (!nofree) {
-                    dictFreeKey(d, he);
-                    dictFreeVal(d, he);
-                }
-                zfree(he);
                 d->ht[table].used--;
-                return DICT_OK;
+                return he;
             }
             prevHe = he;
             he = he->next;
         }
         if (!dictIsRehashing(d)) break;
     }
-    return DICT_ERR; /* not found */
+    return NULL; /* not found */
 }
 
 int dictDelete(dict *ht, const void *key) {
-    return dictGenericDelete(ht,key,0);
+    dictEntry *he = dictGenericDelete(ht,key);
+
+    if (he == NULL) return DICT_ERR;
+    dictFreeUnlinkedEntry(ht,he);
+    return DICT_OK;
 }
 
 int dictDeleteNoFree(dict *ht, const void *key) {
-    return dictGenericDelete(ht,key,1);
+    dictEntry *he = dictGenericDelete(ht,key);
+
+    if (he == NULL) return DICT_ERR;
+    zfree(he);
+    return DICT_OK;
+}
+
+/* Remove an element from the table, without actually releasing the key,
+ * value and dictionary entry. The dictionary entry is returned if the
+ * element was found (and unlinked from the table), and the user should
+ * later call dictFreeUnlinkedEntry() with it in order to release it.
+ * Otherwise if the key is not found, NULL is returned.
+ *
+ * This function is useful when we want to remove something from the hash
+ * table but want to use its value before actually deleting the entry.
+ * Without this function the pattern would require two lookups:
+ *
+ *  entry = dictFind(dictionary,key);
+ *  // Do something with entry
+ *  dictDelete(dictionary,key);
+ *
+ * Thanks to this function it is possible to avoid this, and use
+ * instead:
+ *
+ *  entry = dictUnlink(dictionary,key);
+ *  // Do something with entry
+ *  dictFreeUnlinkedEntry(dictionary,entry); // <- No second lookup.
+ */
+dictEntry *dictUnlink(dict *ht, const void *key) {
+    return dictGenericDelete(ht,key);
+}
+
+/* You need to call this function to really free the entry after a call
+ * to dictUnlink(). It's safe to call this function with 'he' = NULL. */
+void dictFreeUnlinkedEntry(dict *d, dictEntry *he) {
+    if (he == NULL) return;
+    dictFreeKey(d, he);
+    dictFreeVal(d, he);
+    zfree(he);
 }
 
 /* Destroy an entire dictionary */
@@ -507,6 +590,83 @@ dictEntry *dictFind(dict *d, const void *key)
     return NULL;
 }
 
+/* Find the reference to the dict entry holding the key pointer 'oldptr'
+ * (compared by pointer, not by value), given the hash of the key. This is
+ * used to replace the entry, or the key itself, with a reallocated copy.
+ * Unlike dictFind() no rehashing step is performed, so that it is safe to
+ * call from a dictScan() callback. Returns NULL if the key is not found. */
+dictEntry **dictFindEntryRefByPtrAndHash(dict *d, const void *oldptr, unsigned int hash) {
+    dictEntry *he, **heref;
+    unsigned int idx, table;
+
+    if (d->ht[0].size == 0) return NULL; /* We don't have a table at all */
+    for (table = 0; table <= 1; table++) {
+        idx = hash & d->ht[table].sizemask;
+        heref = &d->ht[table].table[idx];
+        he = *heref;
+        while(he) {
+            if (oldptr == he->key)
+                return heref;
+            heref = &he->next;
+            he = *heref;
+        }
+        if (!dictIsRehashing(d)) return NULL;
+    }
+    return NULL;
+}
+
+/* Prefetch in the CPU caches the memory dictFind() is going to access in
+ * order to look up the 'count' keys in the 'keys' array, and if 'values' is
+ * true also the memory pointed by the values of the entries found.
+ *
+ * A lookup is a chain of dependent memory accesses (bucket, entry, key),
+ * so when many keys are looked up one after the other, most of the time is
+ * spent waiting for the memory. Here the keys are processed in batches of
+ * DICT_PREFETCH_BATCH keys, and every stage is performed for all the keys
+ * of the batch before moving to the next one, so that the cache misses of
+ * different keys overlap: first all the keys are hashed and their buckets
+ * prefetched, then the first entry of every bucket is prefetched, and
+ * finally the keys (and values) of these entries.
+ *
+ * Only the first entry of every bucket is considered, since the chains are
+ * short on average. Nothing is modified: the lookups that follow must be
+ * performed as usually, with dictFind() or the functions calling it. */
+void dictPrefetch(dict *d, void **keys, unsigned long count, int values) {
+    dictEntry **bucket[2][DICT_PREFETCH_BATCH], *he[2][DICT_PREFETCH_BATCH];
+    unsigned long j, i, n;
+    int table, tables;
+
+    if (d->ht[0].size == 0) return; /* We don't have a table at all */
+    tables = dictIsRehashing(d) ? 2 : 1;
+    for (j = 0; j < count; j += n) {
+        n = count-j;
+        if (n > DICT_PREFETCH_BATCH) n = DICT_PREFETCH_BATCH;
+
+        for (i = 0; i < n; i++) {
+            unsigned int h = dictHashKey(d,keys[j+i]);
+
+            for (table = 0; table < tables; table++) {
+                bucket[table][i] =
+                    d->ht[table].table+(h & d->ht[table].sizemask);
+                redis_prefetch(bucket[table][i]);
+            }
+        }
+        for (i = 0; i < n; i++) {
+            for (table = 0; table < tables; table++) {
+                he[table][i] = *bucket[table][i];
+                if (he[table][i]) redis_prefetch(he[table][i]);
+            }
+        }
+        for (i = 0; i < n; i++) {
+            for (table = 0; table < tables; table++) {
+                if (he[table][i] == NULL) continue;
+                redis_prefetch(he[table][i]->key);
+                if (values) redis_prefetch(he[table][i]->v.val);
+            }
+        }
+    }
+}
+
 void *dictFetchValue(dict *d, const void *key) {
     dictEntry *he;
 
@@ -777,7 +937,9 @@ static unsigned long rev(unsigned long v) {
  *
  * For every element returned, the callback argument 'fn' is
  * called with 'privdata' as first argument and the dictionary entry
- * 'de' as second argument.
+ * 'de' as second argument. The callback is allowed to replace the entry
+ * with a reallocated copy (see dictFindEntryRefByPtrAndHash()), since the
+ * next entry of the chain is fetched before calling it.
  *
  * HOW IT WORKS.
  *
@@ -852,7 +1014,7 @@ unsigned long dictScan(dict *d,
                        void *privdata)
 {
     dictht *t0, *t1;
-    const dictEntry *de;
+    const dictEntry *de, *next;
     unsigned long m0, m1;
 
     if (dictSize(d) == 0) return 0;
@@ -864,8 +1026,9 @@ unsigned long dictScan(dict *d,
         /* Emit entries at cursor */
         de = t0->table[v & m0];
         while (de) {
+            next = de->next;
             fn(privdata, de);
-            de = de->next;
+            de = next;
         }
 
     } else {
@@ -884,8 +1047,9 @@ unsigned long dictScan(dict *d,
         /* Emit entries at cursor */
         de = t0->table[v & m0];
         while (de) {
+            next = de->next;
             fn(privdata, de);
-            de = de->next;
+            de = next;
         }
 
         /* Iterate over indices in larger table that are the expansion
@@ -894,8 +1058,9 @@ unsigned long dictScan(dict *d,
             /* Emit entries at cursor */
             de = t1->table[v & m1];
             while (de) {
+                next = de->next;
                 fn(privdata, de);
-                de = de->next;
+                de = next;
             }
 
             /* Increment bits not covered by the smaller mask */
@@ -917,6 +1082,19 @@ unsigned long dictScan(dict *d,
     return v;
 }
 
+/* Return non zero if the entries with hash 'h' were already emitted by a
+ * dictScan() iteration started from cursor zero, whose last call returned
+ * the cursor 'v'. This is true regardless of the table being resized
+ * between the calls, since the cursor progresses in reversed bits order,
+ * so the elements still to visit are exactly the ones whose reversed hash
+ * is not lower than the reversed cursor. A cursor of zero means the
+ * iteration was not started (or is already complete), and in this case
+ * the function always returns zero. */
+int dictScanVisited(unsigned long v, unsigned int h) {
+    if (v == 0) return 0;
+    return rev(h) < rev(v);
+}
+
 /* ------------------------- private functions ------------------------------ */
 
 /* Expand the hash table if needed */
@@ -936,11 +1114,22 @@ static int _dictExpandIfNeeded(dict *d)
         (dict_can_resize ||
          d->ht[0].used/d->ht[0].size > dict_force_resize_ratio))
     {
+        /* If the expansion is deferred we just keep using the current
+         * table for now, with a higher load factor. */
+        if (!_dictExpandAllowed(d, d->ht[0].used*2)) return DICT_OK;
         return dictExpand(d, d->ht[0].used*2);
     }
     return DICT_OK;
 }
 
+/* Ask the dict type if we can allocate a new table with room for 'size'
+ * elements right now. */
+static int _dictExpandAllowed(dict *d, unsigned long size)
+{
+    if (d->type->expandAllowed == NULL || d->ht[0].table == NULL) return 1;
+    return d->type->expandAllowed(d,_dictNextPower(size));
+}
+
 /* Our hash table capability is a power of two */
 static unsigned long _dictNextPower(unsigned long size)
 {
@@ -55,6 +55,8 @@ typedef struct dictEntry {
     struct dictEntry *next;
 } dictEntry;
 
+struct dict;
+
 typedef struct dictType {
     unsigned int (*hashFunction)(const void *key);
     void *(*keyDup)(void *privdata, const void *key);
@@ -62,6 +64,10 @@ typedef struct dictType {
     int (*keyCompare)(void *privdata, const void *key1, const void *key2);
     void (*keyDestructor)(void *privdata, void *key);
     void (*valDestructor)(void *privdata, void *obj);
+    /* Called before allocating a new table of 'size' buckets for a dict
+     * that already has one: returning 0 skips the resize for now, so that
+     * the caller may provide the table later with dictExpandWithTable(). */
+    int (*expandAllowed)(struct dict *d, unsigned long size);
 } dictType;
 
 /* This is our hash table structure. Every dictionary has two of this as we
@@ -99,6 +105,9 @@ typedef void (dictScanFunction)(void *privdata, const dictEntry *de);
 /* This is the initial size of every hash table */
 #define DICT_HT_INITIAL_SIZE     4
 
+/* Number of keys dictPrefetch() processes at the same time. */
+#define DICT_PREFETCH_BATCH      16
+
 /* ------------------------------- Macros ------------------------------------*/
 #define dictFreeVal(d, entry) \
     if ((d)->type->valDestructor) \
@@ -149,15 +158,19 @@ typedef void (dictScanFunction)(void *privdata, const dictEntry *de);
 /* API */
 dict *dictCreate(dictType *type, void *privDataPtr);
 int dictExpand(dict *d, unsigned long size);
+int dictExpandWithTable(dict *d, dictEntry **table, unsigned long size);
 int dictAdd(dict *d, void *key, void *val);
 dictEntry *dictAddRaw(dict *d, void *key);
 int dictReplace(dict *d, void *key, void *val);
 dictEntry *dictReplaceRaw(dict *d, void *key);
 int dictDelete(dict *d, const void *key);
 int dictDeleteNoFree(dict *d, const void *key);
+dictEntry *dictUnlink(dict *ht, const void *key);
+void dictFreeUnlinkedEntry(dict *d, dictEntry *he);
 void dictRelease(dict *d);
 dictEntry * dictFind(dict *d, const void *key);
 void *dictFetchValue(dict *d, const void *key);
+void dictPrefetch(dict *d, void **keys, unsigned long count, int values);
 int dictResize(dict *d);
 dictIterator *dictGetIterator(dict *d);
 dictIterator *dictGetSafeIterator(dict *d);
@@ -173,9 +186,12 @@ void dictEnableResize(void);
 void dictDisableResize(void);
 int dictRehash(dict *d, int n);
 int dictRehashMilliseconds(dict *d, int ms);
+int dictRehashMicroseconds(dict *d, long long us);
 void dictSetHashFunctionSeed(unsigned int initval);
 unsigned int dictGetHashFunctionSeed(void);
 unsigned long dictScan(dict *d, unsigned long v, dictScanFunction *fn, void *privdata);
+dictEntry **dictFindEntryRefByPtrAndHash(dict *d, const void *oldptr, unsigned int hash);
+int dictScanVisited(unsigned long v, unsigned int h);
 
 /* Hash table types */
 extern dictType dictTypeHeapStringCopyKey;
@@ -0,0 +1,205 @@
+/* Time ordered index of the keys with an expire set.
+ *
+ * By default activeExpireCycle() samples random keys from db->expires, and
+ * repeats while enough of them are found expired. With many volatile keys
+ * and uneven TTLs this leaves a lot of already expired keys in memory, and
+ * fast cycles keep burning CPU looking for them.
+ *
+ * When active-expire-index is enabled every DB also keeps its volatile keys
+ * in a skiplist ordered by expire time, so that the cron can reclaim exactly
+ * the keys that are due, starting from the head of the list, and stop at the
+ * first key that is not. The index references the key sds owned by the main
+ * dictionary (like db->expires does), and is updated by setExpire(),
+ * removeExpire() and the deletion functions, so expireIfNeeded() and the
+ * propagation of expires are not affected.
+ *
+ * Nodes are ordered by expire time, then by the address of the key, so that
+ * a node can be found and removed knowing just the key pointer and its
+ * expire time, without comparing strings. Nodes don't store their level nor
+ * a backward pointer: the overhead is ~32 bytes per volatile key, with the
+ * usual 1/4 probability of a node having an additional level.
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * Copyright (c) 2009-2016, Salvatore Sanfilippo <antirez at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "redis.h"
+
+static expireIndexNode *expireIndexCreateNode(int level, long long when,
+                                              sds key)
+{
+    expireIndexNode *n = zmalloc(sizeof(*n)+level*sizeof(expireIndexNode*));
+    n->when = when;
+    n->key = key;
+    return n;
+}
+
+expireIndex *expireIndexCreate(void) {
+    expireIndex *ei = zmalloc(sizeof(*ei));
+    int j;
+
+    ei->header = expireIndexCreateNode(EXPIRE_INDEX_MAXLEVEL,0,NULL);
+    for (j = 0; j < EXPIRE_INDEX_MAXLEVEL; j++) ei->header->forward[j] = NULL;
+    ei->level = 1;
+    ei->length = 0;
+    ei->bytes = zmalloc_size(ei)+zmalloc_size(ei->header);
+    return ei;
+}
+
+void expireIndexRelease(expireIndex *ei) {
+    expireIndexNode *n = ei->header->forward[0], *next;
+
+    while(n) {
+        next = n->forward[0];
+        zfree(n);
+        n = next;
+    }
+    zfree(ei->header);
+    zfree(ei);
+}
+
+/* Returns a random level for a new node, between 1 and EXPIRE_INDEX_MAXLEVEL,
+ * with a powerlaw-alike distribution where higher levels are less likely. */
+static int expireIndexRandomLevel(void) {
+    int level = 1;
+    while ((random()&0xFFFF) < (EXPIRE_INDEX_P * 0xFFFF))
+        level += 1;
+    return (level<EXPIRE_INDEX_MAXLEVEL) ? level : EXPIRE_INDEX_MAXLEVEL;
+}
+
+/* Is the node 'n' before the position of the pair 'when', 'key'? */
+static int expireIndexBefore(expireIndexNode *n, long long when, sds key) {
+    return n->when < when ||
+           (n->when == when && (uintptr_t)n->key < (uintptr_t)key);
+}
+
+/* Fill 'update' with the last node before the pair 'when', 'key' at every
+ * level of the index. */
+static void expireIndexSearch(expireIndex *ei, long long when, sds key,
+                              expireIndexNode **update)
+{
+    expireIndexNode *x = ei->header;
+    int i;
+
+    for (i = ei->level-1; i >= 0; i--) {
+        while (x->forward[i] && expireIndexBefore(x->forward[i],when,key))
+            x = x->forward[i];
+        update[i] = x;
+    }
+}
+
+/* Add the key 'key', expiring at 'when', to the index. The key must not
+ * already be in the index with the same expire time. */
+void expireIndexInsert(expireIndex *ei, long long when, sds key) {
+    expireIndexNode *update[EXPIRE_INDEX_MAXLEVEL], *x;
+    int i, level;
+
+    expireIndexSearch(ei,when,key,update);
+    level = expireIndexRandomLevel();
+    if (level > ei->level) {
+        for (i = ei->level; i < level; i++) update[i] = ei->header;
+        ei->level = level;
+    }
+    x = expireIndexCreateNode(level,when,key);
+    for (i = 0; i < level; i++) {
+        x->forward[i] = update[i]->forward[i];
+        update[i]->forward[i] = x;
+    }
+    ei->length++;
+    ei->bytes += zmalloc_size(x);
+}
+
+/* Remove the key 'key', expiring at 'when', from the index. The key is only
+ * compared by address, so it does not need to be valid anymore. Returns 1 if
+ * the key was found and removed, 0 otherwise. */
+int expireIndexDelete(expireIndex *ei, long long when, sds key) {
+    expireIndexNode *update[EXPIRE_INDEX_MAXLEVEL], *x;
+    int i;
+
+    expireIndexSearch(ei,when,key,update);
+    x = update[0]->forward[0];
+    if (x == NULL || x->when != when || x->key != key) return 0;
+    for (i = 0; i < ei->level; i++) {
+        if (update[i]->forward[i] != x) break;
+        update[i]->forward[i] = x->forward[i];
+    }
+    while(ei->level > 1 && ei->header->forward[ei->level-1] == NULL)
+        ei->level--;
+    ei->length--;
+    ei->bytes -= zmalloc_size(x);
+    zfree(x);
+    return 1;
+}
+
+/* Return the node of the key expiring first, or NULL if the index is
+ * empty. */
+expireIndexNode *expireIndexFirst(expireIndex *ei) {
+    return ei->header->forward[0];
+}
+
+/* Populate the index of 'db' from its expires dictionary. This is O(N) in
+ * the number of volatile keys of the DB. */
+static void expireIndexBuild(redisDb *db) {
+    dictIterator *di = dictGetIterator(db->expires);
+    dictEntry *de;
+
+    while((de = dictNext(di)) != NULL)
+        expireIndexInsert(db->expire_index,dictGetSignedIntegerVal(de),
+                          dictGetKey(de));
+    dictReleaseIterator(di);
+}
+
+/* Create or release the expire index of every DB, according to the value of
+ * server.active_expire_index. */
+void expireIndexUpdateConfig(void) {
+    int j;
+
+    for (j = 0; j < server.dbnum; j++) {
+        redisDb *db = server.db+j;
+
+        if (server.active_expire_index && db->expire_index == NULL) {
+            db->expire_index = expireIndexCreate();
+            expireIndexBuild(db);
+        } else if (!server.active_expire_index && db->expire_index) {
+            expireIndexRelease(db->expire_index);
+            db->expire_index = NULL;
+        }
+    }
+}
+
+/* Return the memory used by the expire indexes of all the DBs. */
+size_t expireIndexMemory(void) {
+    size_t bytes = 0;
+    int j;
+
+    for (j = 0; j < server.dbnum; j++)
+        if (server.db[j].expire_index)
+            bytes += server.db[j].expire_index->bytes;
+    return bytes;
+}
@@ -0,0 +1,210 @@
+/* hdrhistogram.c -- High Dynamic Range latency histogram
+ *
+ * This is a minimal implementation of the HdrHistogram data structure by
+ * Gil Tene, used by redis-benchmark to record latencies: values are recorded
+ * in constant time and constant memory, no matter how many samples are
+ * taken, while percentiles are reported with a bounded relative error.
+ *
+ * Values are grouped in buckets covering power of two ranges, and every
+ * bucket is split in 'sub_bucket_count' linear sub buckets, so that with
+ * 3 significant figures every value is counted with an error of at most
+ * 1/1000 of the value itself. Tracking from 1 microsecond to 100 seconds
+ * takes ~150k of memory.
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * Copyright (c) 2009-2016, Salvatore Sanfilippo <antirez at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+
+#include "hdrhistogram.h"
+#include "zmalloc.h"
+
+/* Index of the power of two bucket of 'value'. */
+static int hdrBucketIndex(hdrHistogram *h, int64_t value) {
+    int pow2ceiling = 64-__builtin_clzll(value | h->sub_bucket_mask);
+    return pow2ceiling - h->unit_magnitude -
+           (h->sub_bucket_half_count_magnitude+1);
+}
+
+/* Index of the linear sub bucket of 'value' inside bucket 'bucket'. */
+static int hdrSubBucketIndex(hdrHistogram *h, int64_t value, int bucket) {
+    return (int)(value >> (bucket+h->unit_magnitude));
+}
+
+static int hdrCountsIndex(hdrHistogram *h, int bucket, int sub_bucket) {
+    /* The first half of every bucket but the first overlaps with the
+     * previous bucket, so it is not stored. */
+    return ((bucket+1) << h->sub_bucket_half_count_magnitude) +
+           (sub_bucket-h->sub_bucket_half_count);
+}
+
+static int64_t hdrValueFromIndex(hdrHistogram *h, int bucket, int sub_bucket) {
+    return (int64_t)sub_bucket << (bucket+h->unit_magnitude);
+}
+
+/* Lowest value counted in the slot 'index' of the counts array. */
+static int64_t hdrValueAtIndex(hdrHistogram *h, int index) {
+    int bucket = (index >> h->sub_bucket_half_count_magnitude)-1;
+    int sub_bucket = (index & (h->sub_bucket_half_count-1)) +
+                     h->sub_bucket_half_count;
+
+    if (bucket < 0) {
+        sub_bucket -= h->sub_bucket_half_count;
+        bucket = 0;
+    }
+    return hdrValueFromIndex(h,bucket,sub_bucket);
+}
+
+/* Highest value counted in the same slot of 'value'. */
+static int64_t hdrHighestEquivalentValue(hdrHistogram *h, int64_t value) {
+    int bucket = hdrBucketIndex(h,value);
+    int sub_bucket = hdrSubBucketIndex(h,value,bucket);
+    int adjusted = (sub_bucket >= h->sub_bucket_count) ? bucket+1 : bucket;
+
+    return hdrValueFromIndex(h,bucket,sub_bucket) +
+           ((int64_t)1 << (h->unit_magnitude+adjusted)) - 1;
+}
+
+/* Create an histogram able to count values from 'lowest' (at least 1) to
+ * 'highest' with 'sigfigs' significant decimal digits (1 to 5). */
+hdrHistogram *hdrCreate(int64_t lowest, int64_t highest, int sigfigs) {
+    int64_t largest_single_unit, smallest_untrackable;
+    int unit_magnitude = 0, sub_bucket_count_magnitude = 0;
+    int bucket_count = 1, counts_len;
+    hdrHistogram *h;
+
+    assert(lowest >= 1 && highest >= 2*lowest && sigfigs >= 1 && sigfigs <= 5);
+    while (((int64_t)2 << unit_magnitude) <= lowest) unit_magnitude++;
+    largest_single_unit = 2*(int64_t)pow(10,sigfigs);
+    while (((int64_t)1 << sub_bucket_count_magnitude) < largest_single_unit)
+        sub_bucket_count_magnitude++;
+
+    /* Number of power of two buckets required to cover 'highest'. */
+    smallest_untrackable = ((int64_t)1 << sub_bucket_count_magnitude) <<
+                           unit_magnitude;
+    while (smallest_untrackable <= highest) {
+        if (smallest_untrackable > INT64_MAX/2) {
+            bucket_count++;
+            break;
+        }
+        smallest_untrackable <<= 1;
+        bucket_count++;
+    }
+    counts_len = (bucket_count+1) << (sub_bucket_count_magnitude-1);
+
+    h = zmalloc(sizeof(*h)+sizeof(int64_t)*counts_len);
+    h->lowest = lowest;
+    h->highest = highest;
+    h->unit_magnitude = unit_magnitude;
+    h->sub_bucket_half_count_magnitude = sub_bucket_count_magnitude-1;
+    h->sub_bucket_count = 1 << sub_bucket_count_magnitude;
+    h->sub_bucket_half_count = h->sub_bucket_count/2;
+    h->sub_bucket_mask = (int64_t)(h->sub_bucket_count-1) << unit_magnitude;
+    h->counts_len = counts_len;
+    hdrReset(h);
+    return h;
+}
+
+void hdrRelease(hdrHistogram *h) {
+    zfree(h);
+}
+
+void hdrReset(hdrHistogram *h) {
+    h->total_count = 0;
+    h->min = INT64_MAX;
+    h->max = 0;
+    h->sum = 0;
+    memset(h->counts,0,sizeof(int64_t)*h->counts_len);
+}
+
+/* Count one occurrence of 'value'. Values out of the trackable range are
+ * clamped to the range. */
+void hdrRecordValue(hdrHistogram *h, int64_t value) {
+    int bucket, index;
+
+    if (value < 0) value = 0;
+    if (value > h->highest) value = h->highest;
+    bucket = hdrBucketIndex(h,value);
+    index = hdrCountsIndex(h,bucket,hdrSubBucketIndex(h,value,bucket));
+    h->counts[index]++;
+    h->total_count++;
+    h->sum += value;
+    if (value < h->min) h->min = value;
+    if (value > h->max) h->max = value;
+}
+
+/* Add the counts of 'src' to 'dst'. Both must have been created with the
+ * same arguments. */
+void hdrAdd(hdrHistogram *dst, hdrHistogram *src) {
+    int j;
+
+    assert(dst->counts_len == src->counts_len &&
+           dst->unit_magnitude == src->unit_magnitude);
+    if (src->total_count == 0) return;
+    for (j = 0; j < src->counts_len; j++) dst->counts[j] += src->counts[j];
+    dst->total_count += src->total_count;
+    dst->sum += src->sum;
+    if (src->min < dst->min) dst->min = src->min;
+    if (src->max > dst->max) dst->max = src->max;
+}
+
+/* Return the value below which 'percentile' percent of the recorded values
+ * fall, or 0 if the histogram is empty. */
+int64_t hdrValueAtPercentile(hdrHistogram *h, double percentile) {
+    int64_t target, count = 0, value;
+    int j;
+
+    if (h->total_count == 0) return 0;
+    if (percentile > 100) percentile = 100;
+    target = (int64_t)(percentile/100*h->total_count+0.5);
+    if (target < 1) target = 1;
+    for (j = 0; j < h->counts_len; j++) {
+        count += h->counts[j];
+        if (count >= target) {
+            value = hdrHighestEquivalentValue(h,hdrValueAtIndex(h,j));
+            return value < h->max ? value : h->max;
+        }
+    }
+    return h->max;
+}
+
+int64_t hdrMin(hdrHistogram *h) {
+    return h->total_count ? h->min : 0;
+}
+
+int64_t hdrMax(hdrHistogram *h) {
+    return h->max;
+}
+
+double hdrMean(hdrHistogram *h) {
+    return h->total_count ? h->sum/h->total_count : 0;
+}
@@ -0,0 +1,64 @@
+/* hdrhistogram.h -- High Dynamic Range latency histogram header file
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * Copyright (c) 2009-2016, Salvatore Sanfilippo <antirez at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __HDRHISTOGRAM_H
+#define __HDRHISTOGRAM_H
+
+#include <stdint.h>
+
+typedef struct hdrHistogram {
+    int64_t lowest;         /* Lowest value that can be told from zero. */
+    int64_t highest;        /* Highest trackable value, larger are clamped. */
+    int unit_magnitude;     /* log2 of 'lowest'. */
+    int sub_bucket_half_count_magnitude;
+    int sub_bucket_half_count;
+    int sub_bucket_count;   /* Linear sub buckets in every bucket. */
+    int64_t sub_bucket_mask;
+    int counts_len;
+    int64_t total_count;
+    int64_t min;
+    int64_t max;
+    double sum;             /* Used to compute the exact mean. */
+    int64_t counts[];
+} hdrHistogram;
+
+hdrHistogram *hdrCreate(int64_t lowest, int64_t highest, int sigfigs);
+void hdrRelease(hdrHistogram *h);
+void hdrReset(hdrHistogram *h);
+void hdrRecordValue(hdrHistogram *h, int64_t value);
+void hdrAdd(hdrHistogram *dst, hdrHistogram *src);
+int64_t hdrValueAtPercentile(hdrHistogram *h, double percentile);
+int64_t hdrMin(hdrHistogram *h);
+int64_t hdrMax(hdrHistogram *h);
+double hdrMean(hdrHistogram *h);
+
+#endif /* __HDRHISTOGRAM_H */
@@ -497,13 +497,13 @@ int hllDenseAdd(uint8_t *registers, unsigned char *ele, size_t elesize) {
     }
 }
 
-/* Compute SUM(2^-reg) in the dense representation.
- * PE is an array with a pre-computer table of values 2^-reg indexed by reg.
- * As a side effect the integer pointed by 'ezp' is set to the number
- * of zero registers. */
-double hllDenseSum(uint8_t *registers, double *PE, int *ezp) {
-    double E = 0;
-    int j, ez = 0;
+/* Compute the register histogram in the dense representation: reghisto[v]
+ * is incremented for every register set to 'v'. The histogram is all that
+ * is needed to compute SUM(2^-reg) in hllCount(), and since it is made of
+ * integers, every implementation computing it yields exactly the same
+ * cardinality. */
+void hllDenseRegHistoScalar(uint8_t *registers, int *reghisto) {
+    int j;
 
     /* Redis default is to use 16384 registers 6 bits each. The code works
      * with other values by modifying the defines, but for our target value
@@ -514,29 +514,27 @@ double hllDenseSum(uint8_t *registers, double *PE, int *ezp) {
                       r10, r11, r12, r13, r14, r15;
         for (j = 0; j < 1024; j++) {
             /* Handle 16 registers per iteration. */
-            r0 = r[0] & 63; if (r0 == 0) ez++;
-            r1 = (r[0] >> 6 | r[1] << 2) & 63; if (r1 == 0) ez++;
-            r2 = (r[1] >> 4 | r[2] << 4) & 63; if (r2 == 0) ez++;
-            r3 = (r[2] >> 2) & 63; if (r3 == 0) ez++;
-            r4 = r[3] & 63; if (r4 == 0) ez++;
-            r5 = (r[3] >> 6 | r[4] << 2) & 63; if (r5 == 0) ez++;
-            r6 = (r[4] >> 4 | r[5] << 4) & 63; if (r6 == 0) ez++;
-            r7 = (r[5] >> 2) & 63; if (r7 == 0) ez++;
-            r8 = r[6] & 63; if (r8 == 0) ez++;
-            r9 = (r[6] >> 6 | r[7] << 2) & 63; if (r9 == 0) ez++;
-            r10 = (r[7] >> 4 | r[8] << 4) & 63; if (r10 == 0) ez++;
-            r11 = (r[8] >> 2) & 63; if (r11 == 0) ez++;
-            r12 = r[9] & 63; if (r12 == 0) ez++;
-            r13 = (r[9] >> 6 | r[10] << 2) & 63; if (r13 == 0) ez++;
-            r14 = (r[10] >> 4 | r[11] << 4) & 63; if (r14 == 0) ez++;
-            r15 = (r[11] >> 2) & 63; if (r15 == 0) ez++;
-
-            /* Additional parens will allow the compiler to optimize the
-             * code more with a loss of precision that is not very relevant
-             * here (floating point math is not commutative!). */
-            E += (PE[r0] + PE[r1]) + (PE[r2] + PE[r3]) + (PE[r4] + PE[r5]) +
-                 (PE[r6] + PE[r7]) + (PE[r8] + PE[r9]) + (PE[r10] + PE[r11]) +
-                 (PE[r12] + PE[r13]) + (PE[r14] + PE[r15]);
+            r0 = r[0] & 63;
+            r1 = (r[0] >> 6 | r[1] << 2) & 63;
+            r2 = (r[1] >> 4 | r[2] << 4) & 63;
+            r3 = (r[2] >> 2) & 63;
+            r4 = r[3] & 63;
+            r5 = (r[3] >> 6 | r[4] << 2) & 63;
+            r6 = (r[4] >> 4 | r[5] << 4) & 63;
+            r7 = (r[5] >> 2) & 63;
+            r8 = r[6] & 63;
+            r9 = (r[6] >> 6 | r[7] << 2) & 63;
+            r10 = (r[7] >> 4 | r[8] << 4) & 63;
+            r11 = (r[8] >> 2) & 63;
+            r12 = r[9] & 63;
+            r13 = (r[9] >> 6 | r[10] << 2) & 63;
+            r14 = (r[10] >> 4 | r[11] << 4) & 63;
+            r15 = (r[11] >> 2) & 63;
+
+            reghisto[r0]++; reghisto[r1]++; reghisto[r2]++; reghisto[r3]++;
+            reghisto[r4]++; reghisto[r5]++; reghisto[r6]++; reghisto[r7]++;
+            reghisto[r8]++; reghisto[r9]++; reghisto[r10]++; reghisto[r11]++;
+            reghisto[r12]++; reghisto[r13]++; reghisto[r14]++; reghisto[r15]++;
             r += 12;
         }
     } else {
@@ -544,17 +542,164 @@ double hllDenseSum(uint8_t *registers, double *PE, int *ezp) {
             unsigned long reg;
 
             HLL_DENSE_GET_REGISTER(reg,registers,j);
-            if (reg == 0) {
-                ez++;
-                /* Increment E at the end of the loop. */
-            } else {
-                E += PE[reg]; /* Precomputed 2^(-reg[j]). */
-            }
+            reghisto[reg]++;
+        }
+    }
+}
+
+/* Merge by computing MAX(max[i],registers[i]) the dense HLL registers
+ * 'registers' into the array of uint8_t HLL_REGISTERS registers 'max'. */
+void hllDenseMergeScalar(uint8_t *max, uint8_t *registers) {
+    int j;
+
+    if (HLL_REGISTERS == 16384 && HLL_BITS == 6) {
+        uint8_t *r = registers, *m = max, val;
+
+        /* Handle 4 registers (3 bytes) per iteration. */
+        for (j = 0; j < HLL_REGISTERS/4; j++) {
+            val = r[0] & 63;
+            if (val > m[0]) m[0] = val;
+            val = (r[0] >> 6 | r[1] << 2) & 63;
+            if (val > m[1]) m[1] = val;
+            val = (r[1] >> 4 | r[2] << 4) & 63;
+            if (val > m[2]) m[2] = val;
+            val = (r[2] >> 2) & 63;
+            if (val > m[3]) m[3] = val;
+            r += 3;
+            m += 4;
+        }
+    } else {
+        uint8_t val;
+
+        for (j = 0; j < HLL_REGISTERS; j++) {
+            HLL_DENSE_GET_REGISTER(val,registers,j);
+            if (val > max[j]) max[j] = val;
+        }
+    }
+}
+
+/* Set the dense HLL 'registers' to the values of the array of uint8_t
+ * HLL_REGISTERS registers 'raw'. */
+void hllDenseSetRegisters(uint8_t *registers, uint8_t *raw) {
+    int j;
+
+    if (HLL_REGISTERS == 16384 && HLL_BITS == 6) {
+        uint8_t *r = registers, *m = raw;
+
+        /* Handle 4 registers (3 bytes) per iteration. */
+        for (j = 0; j < HLL_REGISTERS/4; j++) {
+            r[0] = m[0] | m[1] << 6;
+            r[1] = m[1] >> 2 | m[2] << 4;
+            r[2] = m[2] >> 4 | m[3] << 2;
+            r += 3;
+            m += 4;
+        }
+    } else {
+        for (j = 0; j < HLL_REGISTERS; j++) {
+            HLL_DENSE_SET_REGISTER(registers,j,raw[j]);
         }
-        E += ez; /* Add 2^0 'ez' times. */
     }
-    *ezp = ez;
-    return E;
+}
+
+#ifdef HAVE_X86_SIMD
+#include <immintrin.h>
+
+/* AVX2 versions of the dense registers functions. They are compiled with
+ * a function target attribute and used only if the CPU supports AVX2,
+ * see hllUseAVX2(). PFSELFTEST checks they agree with the scalar ones. */
+
+/* Unpack the 32 registers stored in the 24 bytes at 'p' into the 32 bytes
+ * of a vector. Every 3 bytes holding 4 registers are moved into a 32 bit
+ * lane, then every register is shifted into its own byte of the lane. */
+__attribute__((target("avx2")))
+static inline __m256i hllDenseUnpack32(uint8_t *p) {
+    const __m256i shuffle = _mm256_setr_epi8(
+        0,1,2,-1,3,4,5,-1,6,7,8,-1,9,10,11,-1,
+        4,5,6,-1,7,8,9,-1,10,11,12,-1,13,14,15,-1);
+    const __m256i mask = _mm256_set1_epi32(0x3f);
+    __m256i v, r01, r23;
+
+    /* The upper lane is loaded from p+8 so that we never read more than
+     * the 24 bytes, its 12 bytes are at offset 4. */
+    v = _mm256_inserti128_si256(
+            _mm256_castsi128_si256(_mm_loadu_si128((__m128i*)p)),
+            _mm_loadu_si128((__m128i*)(p+8)),1);
+    v = _mm256_shuffle_epi8(v,shuffle);
+    r01 = _mm256_or_si256(
+            _mm256_and_si256(v,mask),
+            _mm256_and_si256(_mm256_slli_epi32(v,2),
+                             _mm256_slli_epi32(mask,8)));
+    r23 = _mm256_or_si256(
+            _mm256_and_si256(_mm256_slli_epi32(v,4),
+                             _mm256_slli_epi32(mask,16)),
+            _mm256_and_si256(_mm256_slli_epi32(v,6),
+                             _mm256_slli_epi32(mask,24)));
+    return _mm256_or_si256(r01,r23);
+}
+
+__attribute__((target("avx2")))
+static void hllDenseMergeAVX2(uint8_t *max, uint8_t *registers) {
+    int j;
+
+    for (j = 0; j < HLL_REGISTERS; j += 32) {
+        __m256i regs = hllDenseUnpack32(registers+j/4*3);
+        __m256i m = _mm256_loadu_si256((__m256i*)(max+j));
+        _mm256_storeu_si256((__m256i*)(max+j),_mm256_max_epu8(m,regs));
+    }
+}
+
+__attribute__((target("avx2")))
+static void hllDenseUnpackAVX2(uint8_t *raw, uint8_t *registers) {
+    int j;
+
+    for (j = 0; j < HLL_REGISTERS; j += 32)
+        _mm256_storeu_si256((__m256i*)(raw+j),
+                            hllDenseUnpack32(registers+j/4*3));
+}
+#endif
+
+/* Return non zero if the AVX2 dense registers functions can be used. */
+static int hllUseAVX2(void) {
+#ifdef HAVE_X86_SIMD
+    static int avx2 = -1;
+
+    if (avx2 == -1) {
+        __builtin_cpu_init();
+        avx2 = HLL_REGISTERS % 32 == 0 && HLL_BITS == 6 &&
+               __builtin_cpu_supports("avx2");
+    }
+    return avx2;
+#else
+    return 0;
+#endif
+}
+
+void hllRawRegHisto(uint8_t *registers, int *reghisto);
+
+/* Compute the histogram of the dense registers, see
+ * hllDenseRegHistoScalar(). */
+void hllDenseRegHisto(uint8_t *registers, int *reghisto) {
+#ifdef HAVE_X86_SIMD
+    if (hllUseAVX2()) {
+        uint8_t raw[HLL_REGISTERS];
+
+        hllDenseUnpackAVX2(raw,registers);
+        hllRawRegHisto(raw,reghisto);
+        return;
+    }
+#endif
+    hllDenseRegHistoScalar(registers,reghisto);
+}
+
+/* Merge the dense registers into 'max', see hllDenseMergeScalar(). */
+void hllDenseMerge(uint8_t *max, uint8_t *registers) {
+#ifdef HAVE_X86_SIMD
+    if (hllUseAVX2()) {
+        hllDenseMergeAVX2(max,registers);
+        return;
+    }
+#endif
+    hllDenseMergeScalar(max,registers);
 }
 
 /* ================== Sparse representation implementation  ================= */
@@ -881,76 +1026,64 @@ promote: /* Promote to dense representation. */
     return dense_retval;
 }
 
-/* Compute SUM(2^-reg) in the sparse representation.
- * PE is an array with a pre-computer table of values 2^-reg indexed by reg.
- * As a side effect the integer pointed by 'ezp' is set to the number
- * of zero registers. */
-double hllSparseSum(uint8_t *sparse, int sparselen, double *PE, int *ezp, int *invalid) {
-    double E = 0;
-    int ez = 0, idx = 0, runlen, regval;
+/* Compute the register histogram in the sparse representation.
+ * If the sparse representation is not valid, the integer pointed by
+ * 'invalid' is set to non-zero. */
+void hllSparseRegHisto(uint8_t *sparse, int sparselen, int *invalid, int* reghisto) {
+    int idx = 0, runlen, regval;
     uint8_t *end = sparse+sparselen, *p = sparse;
 
     while(p < end) {
         if (HLL_SPARSE_IS_ZERO(p)) {
             runlen = HLL_SPARSE_ZERO_LEN(p);
             idx += runlen;
-            ez += runlen;
-            /* Increment E at the end of the loop. */
+            reghisto[0] += runlen;
             p++;
         } else if (HLL_SPARSE_IS_XZERO(p)) {
             runlen = HLL_SPARSE_XZERO_LEN(p);
             idx += runlen;
-            ez += runlen;
-            /* Increment E at the end of the loop. */
+            reghisto[0] += runlen;
             p += 2;
         } else {
             runlen = HLL_SPARSE_VAL_LEN(p);
             regval = HLL_SPARSE_VAL_VALUE(p);
             idx += runlen;
-            E += PE[regval]*runlen;
+            reghisto[regval] += runlen;
             p++;
         }
     }
     if (idx != HLL_REGISTERS && invalid) *invalid = 1;
-    E += ez; /* Add 2^0 'ez' times. */
-    *ezp = ez;
-    return E;
 }
 
 /* ========================= HyperLogLog Count ==============================
  * This is the core of the algorithm where the approximated count is computed.
- * The function uses the lower level hllDenseSum() and hllSparseSum() functions
- * as helpers to compute the SUM(2^-reg) part of the computation, which is
- * representation-specific, while all the rest is common. */
-
-/* Implements the SUM operation for uint8_t data type which is only used
- * internally as speedup for PFCOUNT with multiple keys. */
-double hllRawSum(uint8_t *registers, double *PE, int *ezp) {
-    double E = 0;
-    int j, ez = 0;
+ * The function uses the lower level hllDenseRegHisto() and hllSparseRegHisto()
+ * functions as helpers to compute the histogram of the registers values,
+ * which is representation-specific, while all the rest is common. */
+
+/* Compute the register histogram of the uint8_t registers data type, which
+ * is only used internally as speedup for PFCOUNT with multiple keys. */
+void hllRawRegHisto(uint8_t *registers, int *reghisto) {
     uint64_t *word = (uint64_t*) registers;
     uint8_t *bytes;
+    int j;
 
     for (j = 0; j < HLL_REGISTERS/8; j++) {
         if (*word == 0) {
-            ez += 8;
+            reghisto[0] += 8;
         } else {
             bytes = (uint8_t*) word;
-            if (bytes[0]) E += PE[bytes[0]]; else ez++;
-            if (bytes[1]) E += PE[bytes[1]]; else ez++;
-            if (bytes[2]) E += PE[bytes[2]]; else ez++;
-            if (bytes[3]) E += PE[bytes[3]]; else ez++;
-            if (bytes[4]) E += PE[bytes[4]]; else ez++;
-            if (bytes[5]) E += PE[bytes[5]]; else ez++;
-            if (bytes[6]) E += PE[bytes[6]]; else ez++;
-            if (bytes[7]) E += PE[bytes[7]]; else ez++;
+            reghisto[bytes[0]]++;
+            reghisto[bytes[1]]++;
+            reghisto[bytes[2]]++;
+            reghisto[bytes[3]]++;
+            reghisto[bytes[4]]++;
+            reghisto[bytes[5]]++;
+            reghisto[bytes[6]]++;
+            reghisto[bytes[7]]++;
         }
         word++;
     }
-    E += ez; /* 2^(-reg[j]) is 1 when m is 0, add it 'ez' times for every
-                zero register in the HLL. */
-    *ezp = ez;
-    return E;
 }
 
 /* Return the approximated cardinality of the set based on the harmonic
@@ -968,6 +1101,7 @@ uint64_t hllCount(struct hllhdr *hdr, int *invalid) {
     double m = HLL_REGISTERS;
     double E, alpha = 0.7213/(1+1.079/m);
     int j, ez; /* Number of registers equal to 0. */
+    int reghisto[HLL_REGISTER_MAX+1] = {0};
 
     /* We precompute 2^(-reg[j]) in a small table in order to
      * speedup the computation of SUM(2^-register[0..i]). */
@@ -982,18 +1116,25 @@ uint64_t hllCount(struct hllhdr *hdr, int *invalid) {
         initialized = 1;
     }
 
-    /* Compute SUM(2^-register[0..i]). */
+    /* Compute the histogram of the registers values. */
     if (hdr->encoding == HLL_DENSE) {
-        E = hllDenseSum(hdr->registers,PE,&ez);
+        hllDenseRegHisto(hdr->registers,reghisto);
     } else if (hdr->encoding == HLL_SPARSE) {
-        E = hllSparseSum(hdr->registers,
-                         sdslen((sds)hdr)-HLL_HDR_SIZE,PE,&ez,invalid);
+        hllSparseRegHisto(hdr->registers,
+                         sdslen((sds)hdr)-HLL_HDR_SIZE,invalid,reghisto);
     } else if (hdr->encoding == HLL_RAW) {
-        E = hllRawSum(hdr->registers,PE,&ez);
+        hllRawRegHisto(hdr->registers,reghisto);
     } else {
         redisPanic("Unknown HyperLogLog encoding in hllCount()");
     }
 
+    /* Compute SUM(2^-register[0..i]) from the histogram, starting from the
+     * smallest terms. Registers set to zero add 2^0 each. */
+    E = 0;
+    for (j = HLL_REGISTER_MAX; j >= 1; j--) E += reghisto[j]*PE[j];
+    ez = reghisto[0];
+    E += ez;
+
     /* Muliply the inverse of E for alpha_m * m^2 to have the raw estimate. */
     E = (1/E)*alpha*m*m;
 
@@ -1046,12 +1187,7 @@ int hllMerge(uint8_t *max, robj *hll) {
     int i;
 
     if (hdr->encoding == HLL_DENSE) {
-        uint8_t val;
-
-        for (i = 0; i < HLL_REGISTERS; i++) {
-            HLL_DENSE_GET_REGISTER(val,hdr->registers,i);
-            if (val > max[i]) max[i] = val;
-        }
+        hllDenseMerge(max,hdr->registers);
     } else {
         uint8_t *p = hll->ptr, *end = p + sdslen(hll->ptr);
         long runlen, regval;
@@ -1329,9 +1465,7 @@ void pfmergeCommand(redisClient *c) {
     /* Write the resulting HLL to the destination HLL registers and
      * invalidate the cached value. */
     hdr = o->ptr;
-    for (j = 0; j < HLL_REGISTERS; j++) {
-        HLL_DENSE_SET_REGISTER(hdr->registers,j,max[j]);
-    }
+    hllDenseSetRegisters(hdr->registers,max);
     HLL_INVALIDATE_CACHE(hdr);
 
     signalModifiedKey(c->db,c->argv[1]);
@@ -1382,7 +1516,54 @@ void pfselftestCommand(redisClient *c) {
         }
     }
 
-    /* Test 2: approximation error.
+    /* Test 2: dense registers functions.
+     * Merging dense registers, computing their histogram and setting them
+     * all at once must give the same results of the register by register
+     * access, both with the scalar and the optimized implementations. */
+    for (j = 0; j < HLL_TEST_CYCLES/10; j++) {
+        uint8_t max0[HLL_REGISTERS], max1[HLL_REGISTERS], max2[HLL_REGISTERS];
+        uint8_t dense[HLL_DENSE_SIZE-HLL_HDR_SIZE];
+        int histo1[HLL_REGISTER_MAX+1] = {0}, histo2[HLL_REGISTER_MAX+1] = {0};
+        int histo3[HLL_REGISTER_MAX+1] = {0};
+
+        for (i = 0; i < HLL_REGISTERS; i++) {
+            /* Use small values half of the times like in real HLLs. */
+            unsigned int r = rand() & ((j&1) ? HLL_REGISTER_MAX : 3);
+
+            bytecounters[i] = r;
+            HLL_DENSE_SET_REGISTER(hdr->registers,i,r);
+            max0[i] = max1[i] = max2[i] = rand() & HLL_REGISTER_MAX;
+        }
+        hllDenseMergeScalar(max1,hdr->registers);
+        hllDenseMerge(max2,hdr->registers);
+        for (i = 0; i < HLL_REGISTERS; i++) {
+            uint8_t expected = max0[i] > bytecounters[i] ? max0[i] :
+                                                           bytecounters[i];
+            if (max1[i] != expected || max2[i] != expected) {
+                addReplyErrorFormat(c,
+                    "TESTFAILED Merged register %d should be %d but is "
+                    "%d (scalar) %d (optimized)",
+                    i, (int) expected, (int) max1[i], (int) max2[i]);
+                goto cleanup;
+            }
+        }
+        hllDenseRegHistoScalar(hdr->registers,histo1);
+        hllDenseRegHisto(hdr->registers,histo2);
+        hllRawRegHisto(bytecounters,histo3);
+        if (memcmp(histo1,histo3,sizeof(histo1)) ||
+            memcmp(histo2,histo3,sizeof(histo1)))
+        {
+            addReplyError(c,"TESTFAILED Registers histograms disagree");
+            goto cleanup;
+        }
+        hllDenseSetRegisters(dense,bytecounters);
+        if (memcmp(dense,hdr->registers,sizeof(dense))) {
+            addReplyError(c,"TESTFAILED Dense registers set incorrectly");
+            goto cleanup;
+        }
+    }
+
+    /* Test 3: approximation error.
      * The test adds unique elements and check that the estimated value
      * is always reasonable bounds.
      *
@@ -35,6 +35,10 @@
 #include "zmalloc.h"
 #include "endianconv.h"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 /* Note that these encodings are ordered, so:
  * INTSET_ENC_INT16 < INTSET_ENC_INT32 < INTSET_ENC_INT64. */
 #define INTSET_ENC_INT16 (sizeof(int16_t))
@@ -108,6 +112,47 @@ static intset *intsetResize(intset *is, uint32_t len) {
     return is;
 }
 
+/* The binary search of intsetSearch() stops once the range to search is
+ * down to this number of elements, that are scanned linearly instead. */
+#define INTSET_SEARCH_WINDOW 16
+
+/* Return the number of elements smaller than "value" among the "count" ones
+ * starting at position "start". The value must be representable with the
+ * encoding of the intset. Since elements are sorted, the comparison mask
+ * of a block is a run of ones, and the scan stops at the first block that
+ * is not entirely smaller than the value. */
+static uint32_t intsetCountSmaller(intset *is, int start, int count,
+                                   int64_t value)
+{
+    uint8_t enc = intrev32ifbe(is->encoding);
+    int j = 0;
+
+#ifdef __SSE2__
+    if (enc == INTSET_ENC_INT16) {
+        int16_t *p = ((int16_t*)is->contents)+start;
+        __m128i v = _mm_set1_epi16((int16_t)value);
+
+        for (; j+8 <= count; j += 8) {
+            __m128i e = _mm_loadu_si128((__m128i*)(p+j));
+            int mask = _mm_movemask_epi8(_mm_cmplt_epi16(e,v));
+            if (mask != 0xffff) return j+__builtin_ctz(~mask)/2;
+        }
+    } else if (enc == INTSET_ENC_INT32) {
+        int32_t *p = ((int32_t*)is->contents)+start;
+        __m128i v = _mm_set1_epi32((int32_t)value);
+
+        for (; j+4 <= count; j += 4) {
+            __m128i e = _mm_loadu_si128((__m128i*)(p+j));
+            int mask = _mm_movemask_epi8(_mm_cmplt_epi32(e,v));
+            if (mask != 0xffff) return j+__builtin_ctz(~mask)/4;
+        }
+    }
+#endif
+    for (; j < count; j++)
+        if (_intsetGetEncoded(is,start+j,enc) >= value) break;
+    return j;
+}
+
 /* Search for the position of "value". Return 1 when the value was found and
  * sets "pos" to the position of the value within the intset. Return 0 when
  * the value is not present in the intset and sets "pos" to the position
@@ -132,7 +177,7 @@ static uint8_t intsetSearch(intset *is, int64_t value, uint32_t *pos) {
         }
     }
 
-    while(max >= min) {
+    while(max-min >= INTSET_SEARCH_WINDOW) {
         mid = ((unsigned int)min + (unsigned int)max) >> 1;
         cur = _intsetGet(is,mid);
         if (value > cur) {
@@ -140,17 +185,16 @@ static uint8_t intsetSearch(intset *is, int64_t value, uint32_t *pos) {
         } else if (value < cur) {
             max = mid-1;
         } else {
-            break;
+            if (pos) *pos = mid;
+            return 1;
         }
     }
 
-    if (value == cur) {
-        if (pos) *pos = mid;
-        return 1;
-    } else {
-        if (pos) *pos = min;
-        return 0;
-    }
+    /* If present, the value is between min and max: the number of elements
+     * smaller than it in this range gives its position. */
+    mid = min + intsetCountSmaller(is,min,max-min+1,value);
+    if (pos) *pos = mid;
+    return mid <= max && _intsetGet(is,mid) == value;
 }
 
 /* Upgrades the intset to a larger encoding and inserts the given integer. */
@@ -281,6 +325,238 @@ size_t intsetBlobLen(intset *is) {
     return sizeof(intset)+intrev32ifbe(is->length)*intrev32ifbe(is->encoding);
 }
 
+/* -----------------------------------------------------------------------------
+ * Set operations
+ *
+ * The functions below compute the intersection, union and difference of two
+ * intsets merging their sorted arrays, instead of looking up every element
+ * of one set into the other. The intersection of sets with the same 16 or
+ * 32 bit encoding compares a block of elements of one set against all the
+ * rotations of a block of the other with SSE2. The resulting intset always
+ * has the same content and encoding of a set created adding the resulting
+ * elements one after the other.
+ * -------------------------------------------------------------------------- */
+
+/* When one of the sets is this number of times bigger than the other, the
+ * intersection looks up the elements of the small set in the big one. */
+#define INTSET_SEARCH_RATIO 32
+
+/* Create an empty intset with the specified encoding and room for 'len'
+ * elements. */
+static intset *intsetNewSized(uint8_t enc, uint32_t len) {
+    intset *is = zmalloc(sizeof(intset)+(size_t)len*enc);
+    is->encoding = intrev32ifbe(enc);
+    is->length = 0;
+    return is;
+}
+
+/* Set the length of 'is', just filled with 'len' sorted elements, moving it
+ * to the smallest encoding able to represent them, and release the memory
+ * that is no longer needed. Only the first and last elements can require
+ * the bigger encoding, and narrowing the elements in place from the start
+ * never overwrites one not yet moved. */
+static intset *intsetFinalize(intset *is, uint32_t len) {
+    uint8_t curenc = intrev32ifbe(is->encoding), newenc = INTSET_ENC_INT16;
+    uint32_t j;
+
+    if (len) {
+        uint8_t first = _intsetValueEncoding(_intsetGetEncoded(is,0,curenc));
+        uint8_t last = _intsetValueEncoding(_intsetGetEncoded(is,len-1,curenc));
+        newenc = first > last ? first : last;
+    }
+    if (newenc < curenc) {
+        is->encoding = intrev32ifbe(newenc);
+        for (j = 0; j < len; j++)
+            _intsetSet(is,j,_intsetGetEncoded(is,j,curenc));
+    }
+    is->length = intrev32ifbe(len);
+    return intsetResize(is,len);
+}
+
+#ifdef __SSE2__
+/* Rotate the 16 bit lanes of 'v' by 'n' positions. */
+#define INTSET_ROTATE16(v,n) \
+    _mm_or_si128(_mm_srli_si128(v,2*(n)),_mm_slli_si128(v,16-2*(n)))
+
+/* Intersect 'a' and 'b', both 16 bit encoded, eight elements at a time
+ * into 'dst', advancing the block with the smaller last element. Returns
+ * the number of elements stored, and sets '*i' and '*j' to the first
+ * elements of 'a' and 'b' that were not processed. */
+static uint32_t intsetIntersection16(intset *a, uint32_t *i, intset *b,
+                                     uint32_t *j, intset *dst)
+{
+    int16_t *pa = (int16_t*)a->contents, *pb = (int16_t*)b->contents;
+    int16_t *out = (int16_t*)dst->contents, amax, bmax;
+    uint32_t alen = intrev32ifbe(a->length), blen = intrev32ifbe(b->length);
+    uint32_t ia = 0, ib = 0, n = 0;
+
+    while (ia+8 <= alen && ib+8 <= blen) {
+        __m128i va = _mm_loadu_si128((__m128i*)(pa+ia));
+        __m128i vb = _mm_loadu_si128((__m128i*)(pb+ib));
+        __m128i eq = _mm_cmpeq_epi16(va,vb);
+        int mask;
+
+        eq = _mm_or_si128(eq,_mm_cmpeq_epi16(va,INTSET_ROTATE16(vb,1)));
+        eq = _mm_or_si128(eq,_mm_cmpeq_epi16(va,INTSET_ROTATE16(vb,2)));
+        eq = _mm_or_si128(eq,_mm_cmpeq_epi16(va,INTSET_ROTATE16(vb,3)));
+        eq = _mm_or_si128(eq,_mm_cmpeq_epi16(va,INTSET_ROTATE16(vb,4)));
+        eq = _mm_or_si128(eq,_mm_cmpeq_epi16(va,INTSET_ROTATE16(vb,5)));
+        eq = _mm_or_si128(eq,_mm_cmpeq_epi16(va,INTSET_ROTATE16(vb,6)));
+        eq = _mm_or_si128(eq,_mm_cmpeq_epi16(va,INTSET_ROTATE16(vb,7)));
+        mask = _mm_movemask_epi8(eq) & 0x5555;
+        while (mask) {
+            out[n++] = pa[ia+__builtin_ctz(mask)/2];
+            mask &= mask-1;
+        }
+        amax = pa[ia+7];
+        bmax = pb[ib+7];
+        if (amax <= bmax) ia += 8;
+        if (bmax <= amax) ib += 8;
+    }
+    *i = ia;
+    *j = ib;
+    return n;
+}
+
+/* Like intsetIntersection16() for 32 bit encoded intsets, four elements at
+ * a time. */
+static uint32_t intsetIntersection32(intset *a, uint32_t *i, intset *b,
+                                     uint32_t *j, intset *dst)
+{
+    int32_t *pa = (int32_t*)a->contents, *pb = (int32_t*)b->contents;
+    int32_t *out = (int32_t*)dst->contents, amax, bmax;
+    uint32_t alen = intrev32ifbe(a->length), blen = intrev32ifbe(b->length);
+    uint32_t ia = 0, ib = 0, n = 0;
+
+    while (ia+4 <= alen && ib+4 <= blen) {
+        __m128i va = _mm_loadu_si128((__m128i*)(pa+ia));
+        __m128i vb = _mm_loadu_si128((__m128i*)(pb+ib));
+        __m128i eq = _mm_cmpeq_epi32(va,vb);
+        int mask;
+
+        eq = _mm_or_si128(eq,_mm_cmpeq_epi32(va,
+                _mm_shuffle_epi32(vb,_MM_SHUFFLE(0,3,2,1))));
+        eq = _mm_or_si128(eq,_mm_cmpeq_epi32(va,
+                _mm_shuffle_epi32(vb,_MM_SHUFFLE(1,0,3,2))));
+        eq = _mm_or_si128(eq,_mm_cmpeq_epi32(va,
+                _mm_shuffle_epi32(vb,_MM_SHUFFLE(2,1,0,3))));
+        mask = _mm_movemask_ps(_mm_castsi128_ps(eq));
+        while (mask) {
+            out[n++] = pa[ia+__builtin_ctz(mask)];
+            mask &= mask-1;
+        }
+        amax = pa[ia+3];
+        bmax = pb[ib+3];
+        if (amax <= bmax) ia += 4;
+        if (bmax <= amax) ib += 4;
+    }
+    *i = ia;
+    *j = ib;
+    return n;
+}
+#endif
+
+/* Return a new intset with the elements both in 'a' and 'b'. */
+intset *intsetIntersection(intset *a, intset *b) {
+    uint32_t alen, blen, i = 0, j = 0, n = 0;
+    uint8_t aenc, benc;
+    intset *dst;
+
+    /* Make 'a' the smallest set. */
+    if (intrev32ifbe(a->length) > intrev32ifbe(b->length)) {
+        dst = a;
+        a = b;
+        b = dst;
+    }
+    alen = intrev32ifbe(a->length);
+    blen = intrev32ifbe(b->length);
+    aenc = intrev32ifbe(a->encoding);
+    benc = intrev32ifbe(b->encoding);
+
+    /* Every common element is representable with both the encodings. */
+    dst = intsetNewSized(aenc < benc ? aenc : benc,alen);
+
+    if ((uint64_t)alen*INTSET_SEARCH_RATIO < blen) {
+        for (i = 0; i < alen; i++) {
+            int64_t value = _intsetGetEncoded(a,i,aenc);
+            if (intsetFind(b,value)) _intsetSet(dst,n++,value);
+        }
+        return intsetFinalize(dst,n);
+    }
+
+#ifdef __SSE2__
+    if (aenc == benc && aenc == INTSET_ENC_INT16)
+        n = intsetIntersection16(a,&i,b,&j,dst);
+    else if (aenc == benc && aenc == INTSET_ENC_INT32)
+        n = intsetIntersection32(a,&i,b,&j,dst);
+#endif
+
+    /* Merge what is left. */
+    while (i < alen && j < blen) {
+        int64_t va = _intsetGetEncoded(a,i,aenc);
+        int64_t vb = _intsetGetEncoded(b,j,benc);
+
+        if (va < vb) {
+            i++;
+        } else if (va > vb) {
+            j++;
+        } else {
+            _intsetSet(dst,n++,va);
+            i++;
+            j++;
+        }
+    }
+    return intsetFinalize(dst,n);
+}
+
+/* Return a new intset with the elements in 'a', 'b', or both. */
+intset *intsetUnion(intset *a, intset *b) {
+    uint32_t alen = intrev32ifbe(a->length), blen = intrev32ifbe(b->length);
+    uint8_t aenc = intrev32ifbe(a->encoding), benc = intrev32ifbe(b->encoding);
+    uint32_t i = 0, j = 0, n = 0;
+    intset *dst = intsetNewSized(aenc > benc ? aenc : benc,alen+blen);
+
+    while (i < alen && j < blen) {
+        int64_t va = _intsetGetEncoded(a,i,aenc);
+        int64_t vb = _intsetGetEncoded(b,j,benc);
+
+        if (va <= vb) {
+            _intsetSet(dst,n++,va);
+            i++;
+            if (va == vb) j++;
+        } else {
+            _intsetSet(dst,n++,vb);
+            j++;
+        }
+    }
+    for (; i < alen; i++) _intsetSet(dst,n++,_intsetGetEncoded(a,i,aenc));
+    for (; j < blen; j++) _intsetSet(dst,n++,_intsetGetEncoded(b,j,benc));
+    return intsetFinalize(dst,n);
+}
+
+/* Return a new intset with the elements in 'a' that are not in 'b'. */
+intset *intsetDifference(intset *a, intset *b) {
+    uint32_t alen = intrev32ifbe(a->length), blen = intrev32ifbe(b->length);
+    uint8_t aenc = intrev32ifbe(a->encoding), benc = intrev32ifbe(b->encoding);
+    uint32_t i = 0, j = 0, n = 0;
+    intset *dst = intsetNewSized(aenc,alen);
+
+    while (i < alen && j < blen) {
+        int64_t va = _intsetGetEncoded(a,i,aenc);
+        int64_t vb = _intsetGetEncoded(b,j,benc);
+
+        if (va < vb) {
+            _intsetSet(dst,n++,va);
+            i++;
+        } else {
+            if (va == vb) i++;
+            j++;
+        }
+    }
+    for (; i < alen; i++) _intsetSet(dst,n++,_intsetGetEncoded(a,i,aenc));
+    return intsetFinalize(dst,n);
+}
+
 #ifdef INTSET_TEST_MAIN
 #include <sys/time.h>
 
@@ -332,7 +608,7 @@ intset *createSet(int bits, int size) {
 void checkConsistency(intset *is) {
     int i;
 
-    for (i = 0; i < (intrev32ifbe(is->length)-1); i++) {
+    for (i = 0; i+1 < intrev32ifbe(is->length); i++) {
         uint32_t encoding = intrev32ifbe(is->encoding);
 
         if (encoding == INTSET_ENC_INT16) {
@@ -479,5 +755,87 @@ int main(int argc, char **argv) {
         checkConsistency(is);
         ok();
     }
+
+    printf("Search in every encoding: "); {
+        int bits;
+        for (bits = 8; bits <= 48; bits += 20) {
+            int64_t mask = (1LL<<bits)-1, v;
+            uint32_t pos;
+            is = createSet(bits,1000);
+            checkConsistency(is);
+            for (i = 0; i < 10000; i++) {
+                int64_t prev, next;
+                v = (rand() & mask) - (mask>>1);
+                if (_intsetValueEncoding(v) > intrev32ifbe(is->encoding))
+                    continue;
+                intsetSearch(is,v,&pos);
+                prev = pos ? _intsetGet(is,pos-1) : INT64_MIN;
+                next = pos < intrev32ifbe(is->length) ?
+                       _intsetGet(is,pos) : INT64_MAX;
+                assert(prev < v && v <= next);
+            }
+        }
+        ok();
+    }
+
+    printf("Intersection, union and difference: "); {
+        int bits1, bits2;
+        for (i = 0; i < 100; i++) {
+            intset *a, *b, *inter, *uni, *diff;
+            uint32_t j, count;
+            int64_t v;
+
+            bits1 = 10+rand()%40;
+            bits2 = 10+rand()%40;
+            a = createSet(bits1,rand()%2000);
+            b = createSet(bits2,rand()%2000);
+            inter = intsetIntersection(a,b);
+            uni = intsetUnion(a,b);
+            diff = intsetDifference(a,b);
+            checkConsistency(inter);
+            checkConsistency(uni);
+            checkConsistency(diff);
+
+            count = 0;
+            for (j = 0; intsetGet(a,j,&v); j++) {
+                assert(intsetFind(inter,v) == intsetFind(b,v));
+                assert(intsetFind(diff,v) == !intsetFind(b,v));
+                assert(intsetFind(uni,v));
+                if (intsetFind(b,v)) count++;
+            }
+            assert(intsetLen(inter) == count);
+            assert(intsetLen(diff) == intsetLen(a)-count);
+            assert(intsetLen(uni) == intsetLen(a)+intsetLen(b)-count);
+            for (j = 0; intsetGet(b,j,&v); j++) assert(intsetFind(uni,v));
+            zfree(a);
+            zfree(b);
+            zfree(inter);
+            zfree(uni);
+            zfree(diff);
+        }
+        ok();
+    }
+
+    printf("Result encoding: "); {
+        intset *a = intsetNew(), *b = intsetNew(), *c;
+        a = intsetAdd(a,1,NULL);
+        a = intsetAdd(a,2,NULL);
+        a = intsetAdd(a,4294967295,NULL);
+        b = intsetAdd(b,2,NULL);
+        b = intsetAdd(b,3,NULL);
+        c = intsetIntersection(a,b);
+        assert(intrev32ifbe(c->encoding) == INTSET_ENC_INT16);
+        assert(intsetLen(c) == 1 && intsetFind(c,2));
+        zfree(c);
+        c = intsetDifference(a,b);
+        assert(intrev32ifbe(c->encoding) == INTSET_ENC_INT64);
+        assert(intsetLen(c) == 2);
+        a = intsetRemove(a,4294967295,NULL);
+        zfree(c);
+        c = intsetUnion(a,b);
+        assert(intrev32ifbe(c->encoding) == INTSET_ENC_INT16);
+        assert(intsetLen(c) == 3);
+        ok();
+    }
 }
 #endif
@@ -0,0 +1,244 @@
+/* Ordered index of the keys of a DB, by type and name.
+ *
+ * KEYS and SCAN visit the whole main dictionary of the DB and match every
+ * key against the pattern, so finding the few keys starting with a given
+ * prefix, or of a given type, costs as much as listing all the keys.
+ *
+ * When key-index is enabled every DB also keeps all its keys in a skiplist
+ * ordered by value type, then by key name (binary comparison), so that the
+ * keys of a given type starting with a given prefix are always found in a
+ * single range of the index. KEYS and SCAN with a MATCH pattern starting
+ * with a literal prefix, or with the TYPE option, then only visit the
+ * matching range, see scanGenericCommand().
+ *
+ * The index references the key sds owned by the main dictionary (like
+ * db->expires does), and is updated by dbAdd(), dbOverwrite() (that may
+ * change the type of the value) and the deletion functions. Nodes don't
+ * store their level nor a backward pointer: the overhead is ~32 bytes per
+ * key, with the usual 1/4 probability of a node having an additional level.
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * Copyright (c) 2009-2016, Salvatore Sanfilippo <antirez at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "redis.h"
+
+static keyIndexNode *keyIndexCreateNode(int level, int type, sds key) {
+    keyIndexNode *n = zmalloc(sizeof(*n)+level*sizeof(keyIndexNode*));
+    n->type = type;
+    n->key = key;
+    return n;
+}
+
+keyIndex *keyIndexCreate(void) {
+    keyIndex *ki = zmalloc(sizeof(*ki));
+    int j;
+
+    ki->header = keyIndexCreateNode(KEY_INDEX_MAXLEVEL,0,NULL);
+    for (j = 0; j < KEY_INDEX_MAXLEVEL; j++) ki->header->forward[j] = NULL;
+    ki->level = 1;
+    ki->length = 0;
+    ki->bytes = zmalloc_size(ki)+zmalloc_size(ki->header);
+    return ki;
+}
+
+void keyIndexRelease(keyIndex *ki) {
+    keyIndexNode *n = ki->header->forward[0], *next;
+
+    while(n) {
+        next = n->forward[0];
+        zfree(n);
+        n = next;
+    }
+    zfree(ki->header);
+    zfree(ki);
+}
+
+/* Returns a random level for a new node, between 1 and KEY_INDEX_MAXLEVEL,
+ * with a powerlaw-alike distribution where higher levels are less likely. */
+static int keyIndexRandomLevel(void) {
+    int level = 1;
+    while ((random()&0xFFFF) < (KEY_INDEX_P * 0xFFFF))
+        level += 1;
+    return (level<KEY_INDEX_MAXLEVEL) ? level : KEY_INDEX_MAXLEVEL;
+}
+
+/* Is the node 'n' before the position of the pair 'type', 'key' of length
+ * 'len'? */
+static int keyIndexBefore(keyIndexNode *n, int type, char *key, size_t len) {
+    size_t nlen;
+    int cmp;
+
+    if (n->type != type) return n->type < type;
+    nlen = sdslen(n->key);
+    cmp = memcmp(n->key,key,nlen < len ? nlen : len);
+    return cmp < 0 || (cmp == 0 && nlen < len);
+}
+
+/* Fill 'update' with the last node before the pair 'type', 'key' at every
+ * level of the index. */
+static void keyIndexSearch(keyIndex *ki, int type, char *key, size_t len,
+                           keyIndexNode **update)
+{
+    keyIndexNode *x = ki->header;
+    int i;
+
+    for (i = ki->level-1; i >= 0; i--) {
+        while (x->forward[i] && keyIndexBefore(x->forward[i],type,key,len))
+            x = x->forward[i];
+        update[i] = x;
+    }
+}
+
+/* Add the key 'key', holding a value of type 'type', to the index. The key
+ * must not already be in the index. */
+void keyIndexInsert(keyIndex *ki, int type, sds key) {
+    keyIndexNode *update[KEY_INDEX_MAXLEVEL], *x;
+    int i, level;
+
+    keyIndexSearch(ki,type,key,sdslen(key),update);
+    level = keyIndexRandomLevel();
+    if (level > ki->level) {
+        for (i = ki->level; i < level; i++) update[i] = ki->header;
+        ki->level = level;
+    }
+    x = keyIndexCreateNode(level,type,key);
+    for (i = 0; i < level; i++) {
+        x->forward[i] = update[i]->forward[i];
+        update[i]->forward[i] = x;
+    }
+    ki->length++;
+    ki->bytes += zmalloc_size(x);
+}
+
+/* Remove the key 'key', holding a value of type 'type', from the index.
+ * Returns 1 if the key was found and removed, 0 otherwise. */
+int keyIndexDelete(keyIndex *ki, int type, sds key) {
+    keyIndexNode *update[KEY_INDEX_MAXLEVEL], *x;
+    int i;
+
+    keyIndexSearch(ki,type,key,sdslen(key),update);
+    x = update[0]->forward[0];
+    if (x == NULL || x->type != type || sdscmp(x->key,key) != 0) return 0;
+    for (i = 0; i < ki->level; i++) {
+        if (update[i]->forward[i] != x) break;
+        update[i]->forward[i] = x->forward[i];
+    }
+    while(ki->level > 1 && ki->header->forward[ki->level-1] == NULL)
+        ki->level--;
+    ki->length--;
+    ki->bytes -= zmalloc_size(x);
+    zfree(x);
+    return 1;
+}
+
+/* Make the node of the key 'newkey', holding a value of type 'type',
+ * reference 'newkey' instead of the sds with the same content it was
+ * referencing. Used when the key sds of the main dictionary is moved. */
+void keyIndexReplace(keyIndex *ki, int type, sds newkey) {
+    keyIndexNode *update[KEY_INDEX_MAXLEVEL], *x;
+
+    keyIndexSearch(ki,type,newkey,sdslen(newkey),update);
+    x = update[0]->forward[0];
+    redisAssert(x != NULL && x->type == type && sdscmp(x->key,newkey) == 0);
+    x->key = newkey;
+}
+
+/* Let 'moveptr' move the node of the key 'key', holding a value of type
+ * 'type', to a new address, and update the links to it. 'moveptr' returns
+ * the new address, or NULL if the node was not moved. Used by the active
+ * defragmentation. Returns 1 if the node was moved, 0 otherwise. */
+int keyIndexMoveNode(keyIndex *ki, int type, sds key,
+                     void *(*moveptr)(void*))
+{
+    keyIndexNode *update[KEY_INDEX_MAXLEVEL], *x, *newx;
+    int i;
+
+    keyIndexSearch(ki,type,key,sdslen(key),update);
+    x = update[0]->forward[0];
+    redisAssert(x != NULL && x->type == type && sdscmp(x->key,key) == 0);
+    if ((newx = moveptr(x)) == NULL) return 0;
+    for (i = 0; i < ki->level; i++) {
+        if (update[i]->forward[i] != x) break;
+        update[i]->forward[i] = newx;
+    }
+    return 1;
+}
+
+/* Return the first node at or after the pair 'type', 'key' of length 'len',
+ * or NULL if there is no such node. */
+keyIndexNode *keyIndexSeek(keyIndex *ki, int type, char *key, size_t len) {
+    keyIndexNode *update[KEY_INDEX_MAXLEVEL];
+
+    keyIndexSearch(ki,type,key,len,update);
+    return update[0]->forward[0];
+}
+
+/* Populate the index of 'db' from its main dictionary. This is O(N) in the
+ * number of keys of the DB. */
+static void keyIndexBuild(redisDb *db) {
+    dictIterator *di = dictGetIterator(db->dict);
+    dictEntry *de;
+
+    while((de = dictNext(di)) != NULL) {
+        robj *val = dictGetVal(de);
+
+        keyIndexInsert(db->key_index,val->type,dictGetKey(de));
+    }
+    dictReleaseIterator(di);
+}
+
+/* Create or release the key index of every DB, according to the value of
+ * server.key_index. */
+void keyIndexUpdateConfig(void) {
+    int j;
+
+    for (j = 0; j < server.dbnum; j++) {
+        redisDb *db = server.db+j;
+
+        if (server.key_index && db->key_index == NULL) {
+            db->key_index = keyIndexCreate();
+            keyIndexBuild(db);
+        } else if (!server.key_index && db->key_index) {
+            keyIndexRelease(db->key_index);
+            db->key_index = NULL;
+        }
+    }
+}
+
+/* Return the memory used by the key indexes of all the DBs. */
+size_t keyIndexMemory(void) {
+    size_t bytes = 0;
+    int j;
+
+    for (j = 0; j < server.dbnum; j++)
+        if (server.db[j].key_index)
+            bytes += server.db[j].key_index->bytes;
+    return bytes;
+}
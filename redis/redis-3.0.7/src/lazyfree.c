@@ -0,0 +1,271 @@
+/* Lazy freeing of keys and databases.
+ *
+ * Releasing a big aggregate value (a list, set, sorted set or hash with
+ * millions of elements), or a whole database, may take seconds since every
+ * single element must be returned to the allocator. The functions in this
+ * file unlink such values from the keyspace in constant time, and hand them
+ * to a bio.c thread (REDIS_BIO_LAZY_FREE) that performs the actual freeing
+ * in the background.
+ *
+ * While a free is pending the memory is still accounted by zmalloc, since
+ * it will only be returned when the background thread is done. The number
+ * of objects waiting to be released is reported by INFO as
+ * lazyfree_pending_objects, and freeMemoryIfNeeded() checks the actual used
+ * memory while evicting instead of trusting the amount of memory it thinks
+ * it released.
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * Copyright (c) 2009-2016, Salvatore Sanfilippo <antirez at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "redis.h"
+#include "bio.h"
+#include "atomicvar.h"
+#include "cluster.h"
+
+/* Number of objects (or keys, for databases) still to be released by the
+ * lazy free thread. */
+static size_t lazyfree_objects = 0;
+
+/* Objects met by the lazy free thread that are also referenced by the main
+ * thread: their reference count is decremented by the main thread, see
+ * decrRefCount(). */
+static list *lazyfree_deferred = NULL;
+static size_t lazyfree_deferred_count = 0;
+static pthread_mutex_t lazyfree_deferred_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Set once by the lazy free thread when it starts, so that decrRefCount()
+ * can tell it apart from the other threads without any call. */
+__thread int lazyfree_thread = 0;
+
+/* Return the number of currently pending objects to free. */
+size_t lazyfreeGetPendingObjectsCount(void) {
+    size_t aux;
+    atomicGet(lazyfree_objects,aux);
+    return aux;
+}
+
+/* Return the amount of work needed in order to free an object.
+ * The return value is not always the actual number of allocations the
+ * object is composed of, but a number proportional to it.
+ *
+ * For strings the function always returns 1.
+ *
+ * For aggregated objects represented by hash tables, compact tables or
+ * skiplists the function returns the number of elements the object is
+ * composed of. For lists it is the number of quicklist nodes, every node
+ * being a single ziplist allocation.
+ *
+ * Objects composed of single allocations (ziplists and intsets) are always
+ * reported as having a single item even if they are actually logical
+ * composed of multiple elements. */
+size_t lazyfreeGetFreeEffort(robj *obj) {
+    if (obj->type == REDIS_LIST && obj->encoding == REDIS_ENCODING_QUICKLIST) {
+        quicklist *ql = obj->ptr;
+        return ql->len;
+    } else if (obj->type == REDIS_SET && obj->encoding == REDIS_ENCODING_HT) {
+        dict *ht = obj->ptr;
+        return dictSize(ht);
+    } else if (obj->type == REDIS_ZSET && obj->encoding == REDIS_ENCODING_SKIPLIST){
+        zset *zs = obj->ptr;
+        return zs->zsl->length;
+    } else if (obj->type == REDIS_HASH && obj->encoding == REDIS_ENCODING_HT) {
+        dict *ht = obj->ptr;
+        return dictSize(ht);
+    } else if ((obj->type == REDIS_SET || obj->type == REDIS_HASH) &&
+               obj->encoding == REDIS_ENCODING_CTABLE) {
+        return ctableLen((ctable*)obj->ptr);
+    } else {
+        return 1; /* Everything else is a single allocation. */
+    }
+}
+
+/* Delete a key, value, and associated expiration entry if any, from the DB.
+ * If there are enough allocations to free the value object may be put into
+ * a lazy free list instead of being freed synchronously. The lazy free list
+ * will be reclaimed in a different bio.c thread. */
+#define LAZYFREE_THRESHOLD 64
+int dbAsyncDelete(redisDb *db, robj *key) {
+    dictEntry *de;
+
+    if (server.rdb_forkless_in_progress) rdbForklessTouchKey(db,key,1);
+
+    /* Deleting an entry from the expires dict will not free the sds of
+     * the key, because it is shared with the main dictionary. */
+    dbDeleteExpire(db,key->ptr);
+
+    /* If the value is composed of a few allocations, to free in a lazy way
+     * is actually just slower... So under a certain limit we just free
+     * the object synchronously. */
+    de = dictUnlink(db->dict,key->ptr);
+    if (de) {
+        robj *val = dictGetVal(de);
+        size_t free_effort = lazyfreeGetFreeEffort(val);
+
+        /* The key index needs the type of the value to find the key. */
+        if (db->key_index)
+            keyIndexDelete(db->key_index,val->type,dictGetKey(de));
+
+        /* If releasing the object is too much work, do it in the
+         * background by adding the object to the lazy free list. Note that
+         * if the object is shared, to reclaim it now is not possible. */
+        if (free_effort > LAZYFREE_THRESHOLD && val->refcount == 1) {
+            atomicIncr(lazyfree_objects,1);
+            bioCreateBackgroundJob(REDIS_BIO_LAZY_FREE,val,NULL,NULL);
+            dictSetVal(db->dict,de,NULL);
+        }
+    }
+
+    /* Release the key-val pair, or just the key if we set the val
+     * field to NULL in order to lazy free it later. */
+    if (de) {
+        /* The slots index references the key sds of the main dictionary,
+         * so remove it from there before releasing the entry. */
+        if (server.cluster_enabled) slotToKeyDel(dictGetKey(de));
+        dictFreeUnlinkedEntry(db->dict,de);
+        return 1;
+    } else {
+        return 0;
+    }
+}
+
+/* Free an object, if the object is huge enough, free it in async way.
+ * This is used when a value is replaced or removed outside of a
+ * dbDelete() call, for instance by dbOverwrite(). */
+void freeObjAsync(robj *o) {
+    size_t free_effort = lazyfreeGetFreeEffort(o);
+    if (free_effort > LAZYFREE_THRESHOLD && o->refcount == 1) {
+        atomicIncr(lazyfree_objects,1);
+        bioCreateBackgroundJob(REDIS_BIO_LAZY_FREE,o,NULL,NULL);
+    } else {
+        decrRefCount(o);
+    }
+}
+
+/* Empty a Redis DB asynchronously. What the function does actually is to
+ * create a new empty set of hash tables and scheduling the old ones for
+ * lazy freeing. */
+void emptyDbAsync(redisDb *db) {
+    dict *oldht1 = db->dict, *oldht2 = db->expires;
+    keyIndex *oldki = db->key_index;
+    db->dict = dictCreate(&dbDictType,NULL);
+    db->expires = dictCreate(&keyptrDictType,NULL);
+    if (oldki) db->key_index = keyIndexCreate();
+    atomicIncr(lazyfree_objects,dictSize(oldht1));
+    bioCreateBackgroundJob(REDIS_BIO_LAZY_FREE,oldki,oldht1,oldht2);
+    if (db->expire_index) {
+        expireIndex *oldei = db->expire_index;
+        db->expire_index = expireIndexCreate();
+        bioCreateBackgroundJob(REDIS_BIO_LAZY_FREE,NULL,oldei,NULL);
+    }
+}
+
+/* Empty the slots-keys map of Redis Cluster by creating a new empty one
+ * and scheduling the old for lazy freeing. */
+void slotToKeyFlushAsync(void) {
+    dict **oldslots = server.cluster->slots_to_keys;
+    size_t numkeys = 0;
+    int j;
+
+    for (j = 0; j < REDIS_CLUSTER_SLOTS; j++)
+        if (oldslots[j]) numkeys += dictSize(oldslots[j]);
+    server.cluster->slots_to_keys = slotToKeyCreate();
+    atomicIncr(lazyfree_objects,numkeys);
+    bioCreateBackgroundJob(REDIS_BIO_LAZY_FREE,NULL,NULL,oldslots);
+}
+
+/* Release objects from the lazyfree thread. It's just decrRefCount()
+ * updating the count of objects to release. */
+void lazyfreeFreeObjectFromBioThread(robj *o) {
+    decrRefCount(o);
+    atomicDecr(lazyfree_objects,1);
+}
+
+/* Release a database from the lazyfree thread. 'ht1' and 'ht2' are the
+ * main and expires dictionaries of a database that was substituted with
+ * fresh ones in the main thread when it was logically emptied, and 'ki'
+ * its key index, or NULL. */
+void lazyfreeFreeDatabaseFromBioThread(dict *ht1, dict *ht2, keyIndex *ki) {
+    size_t numkeys = dictSize(ht1);
+    if (ki) keyIndexRelease(ki);
+    dictRelease(ht1);
+    dictRelease(ht2);
+    atomicDecr(lazyfree_objects,numkeys);
+}
+
+/* Called by decrRefCount() in the lazyfree thread for an object with other
+ * references, that only the main thread may modify. */
+void lazyfreeDeferDecrRefCount(robj *o) {
+    pthread_mutex_lock(&lazyfree_deferred_mutex);
+    if (lazyfree_deferred == NULL) lazyfree_deferred = listCreate();
+    listAddNodeTail(lazyfree_deferred,o);
+    atomicIncr(lazyfree_deferred_count,1);
+    pthread_mutex_unlock(&lazyfree_deferred_mutex);
+}
+
+/* Perform in the main thread the decrements deferred by the lazyfree
+ * thread. Called from beforeSleep(). */
+void lazyfreeReleaseDeferred(void) {
+    list *deferred;
+    size_t count;
+
+    atomicGet(lazyfree_deferred_count,count);
+    if (count == 0) return;
+
+    pthread_mutex_lock(&lazyfree_deferred_mutex);
+    deferred = lazyfree_deferred;
+    lazyfree_deferred = NULL;
+    atomicSetWithSync(lazyfree_deferred_count,0);
+    pthread_mutex_unlock(&lazyfree_deferred_mutex);
+
+    if (deferred) {
+        listSetFreeMethod(deferred,decrRefCountVoid);
+        listRelease(deferred);
+    }
+}
+
+/* Release the expire index of a database that was emptied, in the lazyfree
+ * thread. The index only references the keys, that are released together
+ * with the main dictionary of the database. */
+void lazyfreeFreeExpireIndexFromBioThread(expireIndex *ei) {
+    expireIndexRelease(ei);
+}
+
+/* Release the map of Redis Cluster slots to keys in the lazyfree thread.
+ * Only the per-slot dictionaries are freed: the keys are owned by the
+ * main dictionary of the DB. */
+void lazyfreeFreeSlotsMapFromBioThread(dict **slots) {
+    size_t numkeys = 0;
+    int j;
+
+    for (j = 0; j < REDIS_CLUSTER_SLOTS; j++)
+        if (slots[j]) numkeys += dictSize(slots[j]);
+    slotToKeyRelease(slots);
+    atomicDecr(lazyfree_objects,numkeys);
+}
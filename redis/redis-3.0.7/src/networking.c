@@ -28,33 +28,35 @@
  */
 
 #include "redis.h"
+#include "atomicvar.h"
 #include <sys/uio.h>
 #include <math.h>
 
-static void setProtocolError(redisClient *c, int pos);
+static void setProtocolError(const char *errstr, redisClient *c, int pos);
+static int postponeClientRead(redisClient *c);
 
-/* To evaluate the output buffer size of a client we need to get size of
- * allocated objects, however we can't used zmalloc_size() directly on sds
- * strings because of the trick they use to work (the header is before the
- * returned pointer), so we use this helper function. */
-size_t zmalloc_size_sds(sds s) {
-    return zmalloc_size(s-sizeof(struct sdshdr));
-}
+/* True while processEventsWhileBlocked() is running: in this context we
+ * never defer reads to the I/O threads, see postponeClientRead(). */
+static int ProcessingEventsWhileBlocked = 0;
 
-/* Return the amount of memory used by the sds string at object->ptr
- * for a string object. */
-size_t getStringObjectSdsUsedMemory(robj *o) {
-    redisAssertWithInfo(NULL,o,o->type == REDIS_STRING);
-    switch(o->encoding) {
-    case REDIS_ENCODING_RAW: return zmalloc_size_sds(o->ptr);
-    case REDIS_ENCODING_EMBSTR: return sdslen(o->ptr);
-    default: return 0; /* Just integer encoding for now. */
-    }
-}
+/* Protects server.clients_to_close, that the I/O threads may access via
+ * freeClientAsync() while reading or writing from the client sockets. */
+static pthread_mutex_t async_free_queue_mutex = PTHREAD_MUTEX_INITIALIZER;
 
+/* List methods of the c->reply list of clientReplyBlock structures. The
+ * value of a node may be NULL while it is a placeholder for a deferred
+ * multi bulk length, see addDeferredMultiBulkLength(). */
 void *dupClientReplyValue(void *o) {
-    incrRefCount((robj*)o);
-    return o;
+    clientReplyBlock *old = o, *new;
+
+    if (old == NULL) return NULL;
+    new = zmalloc(sizeof(clientReplyBlock)+old->size);
+    memcpy(new,old,sizeof(clientReplyBlock)+old->used);
+    return new;
+}
+
+void freeClientReplyValue(void *o) {
+    zfree(o);
 }
 
 int listMatchObjects(void *a, void *b) {
@@ -88,6 +90,7 @@ redisClient *createClient(int fd) {
     c->name = NULL;
     c->bufpos = 0;
     c->querybuf = sdsempty();
+    c->pending_querybuf = sdsempty();
     c->querybuf_peak = 0;
     c->reqtype = 0;
     c->argc = 0;
@@ -101,15 +104,17 @@ redisClient *createClient(int fd) {
     c->authenticated = 0;
     c->replstate = REDIS_REPL_NONE;
     c->repl_put_online_on_ack = 0;
+    c->read_reploff = 0;
     c->reploff = 0;
     c->repl_ack_off = 0;
     c->repl_ack_time = 0;
     c->slave_listening_port = 0;
     c->slave_capa = SLAVE_CAPA_NONE;
+    c->psync_initial_db = -1;
     c->reply = listCreate();
     c->reply_bytes = 0;
     c->obuf_soft_limit_reached_time = 0;
-    listSetFreeMethod(c->reply,decrRefCountVoid);
+    listSetFreeMethod(c->reply,freeClientReplyValue);
     listSetDupMethod(c->reply,dupClientReplyValue);
     c->btype = REDIS_BLOCKED_NONE;
     c->bpop.timeout = 0;
@@ -122,6 +127,10 @@ redisClient *createClient(int fd) {
     c->pubsub_channels = dictCreate(&setDictType,NULL);
     c->pubsub_patterns = listCreate();
     c->peerid = NULL;
+    c->pcmds = NULL;
+    c->pcmds_len = 0;
+    c->pcmds_pos = 0;
+    c->proto_err = NULL;
     listSetFreeMethod(c->pubsub_patterns,decrRefCountVoid);
     listSetMatchMethod(c->pubsub_patterns,listMatchObjects);
     if (fd != -1) listAddNodeTail(server.clients,c);
@@ -129,22 +138,30 @@ redisClient *createClient(int fd) {
     return c;
 }
 
+/* Return true if the specified client has pending reply buffers to write to
+ * the socket. */
+int clientHasPendingReplies(redisClient *c) {
+    return c->bufpos || listLength(c->reply);
+}
+
 /* This function is called every time we are going to transmit new data
  * to the client. The behavior is the following:
  *
  * If the client should receive new data (normal clients will) the function
- * returns REDIS_OK, and make sure to install the write handler in our event
- * loop so that when the socket is writable new data gets written.
+ * returns REDIS_OK, and make sure to put the client in the list of clients
+ * with pending writes, so that before re-entering the event loop we can try
+ * to write the output buffer directly to the socket (or from the I/O
+ * threads), installing the write handler only if the socket can't accept
+ * the whole reply.
  *
  * If the client should not receive new data, because it is a fake client
- * (used to load AOF in memory), a master or because the setup of the write
- * handler failed, the function returns REDIS_ERR.
+ * (used to load AOF in memory) or a master, the function returns REDIS_ERR.
  *
- * The function may return REDIS_OK without actually installing the write
- * event handler in the following cases:
+ * The function may return REDIS_OK without actually queueing the client
+ * in the following cases:
  *
- * 1) The event handler should already be installed since the output buffer
- *    already contained something.
+ * 1) The client was already queued, or the event handler should already be
+ *    installed since the output buffer already contained something.
  * 2) The client is a slave but not yet online, so we want to just accumulate
  *    writes in the buffer but not actually sending them yet.
  *
@@ -163,41 +180,23 @@ int prepareClientToWrite(redisClient *c) {
 
     if (c->fd <= 0) return REDIS_ERR; /* Fake client for AOF loading. */
 
-    /* Only install the handler if not already installed and, in case of
-     * slaves, if the client can actually receive writes. */
-    if (c->bufpos == 0 && listLength(c->reply) == 0 &&
+    /* Schedule the client to write the output buffers to the socket only
+     * if not already done (there were no pending writes already and the
+     * client was yet not flagged), and, for slaves, if the slave can
+     * actually receive writes at this stage. */
+    if (!clientHasPendingReplies(c) &&
+        !(c->flags & REDIS_PENDING_WRITE) &&
         (c->replstate == REDIS_REPL_NONE ||
          (c->replstate == REDIS_REPL_ONLINE && !c->repl_put_online_on_ack)))
     {
-        /* Try to install the write handler. */
-        if (aeCreateFileEvent(server.el, c->fd, AE_WRITABLE,
-                sendReplyToClient, c) == AE_ERR)
-        {
-            freeClientAsync(c);
-            return REDIS_ERR;
-        }
+        c->flags |= REDIS_PENDING_WRITE;
+        listAddNodeHead(server.clients_pending_write,c);
     }
 
     /* Authorize the caller to queue in the output buffer of this client. */
     return REDIS_OK;
 }
 
-/* Create a duplicate of the last object in the reply list when
- * it is not exclusively owned by the reply list. */
-robj *dupLastObjectIfNeeded(list *reply) {
-    robj *new, *cur;
-    listNode *ln;
-    redisAssert(listLength(reply) > 0);
-    ln = listLast(reply);
-    cur = listNodeValue(ln);
-    if (cur->refcount > 1) {
-        new = dupStringObject(cur);
-        decrRefCount(cur);
-        listNodeValue(ln) = new;
-    }
-    return listNodeValue(ln);
-}
-
 /* -----------------------------------------------------------------------------
  * Low level functions to add more data to output buffers.
  * -------------------------------------------------------------------------- */
@@ -219,96 +218,44 @@ int _addReplyToBuffer(redisClient *c, char *s, size_t len) {
     return REDIS_OK;
 }
 
-void _addReplyObjectToList(redisClient *c, robj *o) {
-    robj *tail;
-
-    if (c->flags & REDIS_CLOSE_AFTER_REPLY) return;
-
-    if (listLength(c->reply) == 0) {
-        incrRefCount(o);
-        listAddNodeTail(c->reply,o);
-        c->reply_bytes += getStringObjectSdsUsedMemory(o);
-    } else {
-        tail = listNodeValue(listLast(c->reply));
+/* Allocate a new reply block able to hold at least 'len' bytes. Small
+ * blocks take REDIS_REPLY_CHUNK_BYTES header included, so that the next
+ * small writes can be appended to them without wasting a bigger allocator
+ * size class, and any slack left by the allocator is made usable as well. */
+static clientReplyBlock *createClientReplyBlock(size_t len) {
+    size_t minlen = REDIS_REPLY_CHUNK_BYTES-sizeof(clientReplyBlock);
+    clientReplyBlock *b;
 
-        /* Append to this object when possible. */
-        if (tail->ptr != NULL &&
-            tail->encoding == REDIS_ENCODING_RAW &&
-            sdslen(tail->ptr)+sdslen(o->ptr) <= REDIS_REPLY_CHUNK_BYTES)
-        {
-            c->reply_bytes -= zmalloc_size_sds(tail->ptr);
-            tail = dupLastObjectIfNeeded(c->reply);
-            tail->ptr = sdscatlen(tail->ptr,o->ptr,sdslen(o->ptr));
-            c->reply_bytes += zmalloc_size_sds(tail->ptr);
-        } else {
-            incrRefCount(o);
-            listAddNodeTail(c->reply,o);
-            c->reply_bytes += getStringObjectSdsUsedMemory(o);
-        }
-    }
-    asyncCloseClientOnOutputBufferLimitReached(c);
-}
-
-/* This method takes responsibility over the sds. When it is no longer
- * needed it will be free'd, otherwise it ends up in a robj. */
-void _addReplySdsToList(redisClient *c, sds s) {
-    robj *tail;
-
-    if (c->flags & REDIS_CLOSE_AFTER_REPLY) {
-        sdsfree(s);
-        return;
-    }
-
-    if (listLength(c->reply) == 0) {
-        listAddNodeTail(c->reply,createObject(REDIS_STRING,s));
-        c->reply_bytes += zmalloc_size_sds(s);
-    } else {
-        tail = listNodeValue(listLast(c->reply));
-
-        /* Append to this object when possible. */
-        if (tail->ptr != NULL && tail->encoding == REDIS_ENCODING_RAW &&
-            sdslen(tail->ptr)+sdslen(s) <= REDIS_REPLY_CHUNK_BYTES)
-        {
-            c->reply_bytes -= zmalloc_size_sds(tail->ptr);
-            tail = dupLastObjectIfNeeded(c->reply);
-            tail->ptr = sdscatlen(tail->ptr,s,sdslen(s));
-            c->reply_bytes += zmalloc_size_sds(tail->ptr);
-            sdsfree(s);
-        } else {
-            listAddNodeTail(c->reply,createObject(REDIS_STRING,s));
-            c->reply_bytes += zmalloc_size_sds(s);
-        }
-    }
-    asyncCloseClientOnOutputBufferLimitReached(c);
+    if (len < minlen) len = minlen;
+    b = zmalloc(sizeof(clientReplyBlock)+len);
+    b->size = zmalloc_size(b)-sizeof(clientReplyBlock);
+    b->used = 0;
+    return b;
 }
 
 void _addReplyStringToList(redisClient *c, char *s, size_t len) {
-    robj *tail;
+    listNode *ln = listLast(c->reply);
+    clientReplyBlock *tail = ln ? listNodeValue(ln) : NULL;
 
     if (c->flags & REDIS_CLOSE_AFTER_REPLY) return;
 
-    if (listLength(c->reply) == 0) {
-        robj *o = createStringObject(s,len);
-
-        listAddNodeTail(c->reply,o);
-        c->reply_bytes += getStringObjectSdsUsedMemory(o);
-    } else {
-        tail = listNodeValue(listLast(c->reply));
-
-        /* Append to this object when possible. */
-        if (tail->ptr != NULL && tail->encoding == REDIS_ENCODING_RAW &&
-            sdslen(tail->ptr)+len <= REDIS_REPLY_CHUNK_BYTES)
-        {
-            c->reply_bytes -= zmalloc_size_sds(tail->ptr);
-            tail = dupLastObjectIfNeeded(c->reply);
-            tail->ptr = sdscatlen(tail->ptr,s,len);
-            c->reply_bytes += zmalloc_size_sds(tail->ptr);
-        } else {
-            robj *o = createStringObject(s,len);
+    /* Fill the free space of the last block first, then put what is left
+     * into a new block. */
+    if (tail != NULL) {
+        size_t avail = tail->size - tail->used;
+        size_t copy = avail >= len ? len : avail;
 
-            listAddNodeTail(c->reply,o);
-            c->reply_bytes += getStringObjectSdsUsedMemory(o);
-        }
+        memcpy(tail->buf+tail->used,s,copy);
+        tail->used += copy;
+        s += copy;
+        len -= copy;
+    }
+    if (len) {
+        tail = createClientReplyBlock(len);
+        memcpy(tail->buf,s,len);
+        tail->used = len;
+        listAddNodeTail(c->reply,tail);
+        c->reply_bytes += tail->size;
     }
     asyncCloseClientOnOutputBufferLimitReached(c);
 }
@@ -321,16 +268,12 @@ void _addReplyStringToList(redisClient *c, char *s, size_t len) {
 void addReply(redisClient *c, robj *obj) {
     if (prepareClientToWrite(c) != REDIS_OK) return;
 
-    /* This is an important place where we can avoid copy-on-write
-     * when there is a saving child running, avoiding touching the
-     * refcount field of the object if it's not needed.
-     *
-     * If the encoding is RAW and there is room in the static buffer
-     * we'll be able to send the object to the client without
-     * messing with its page. */
+    /* The object is always copied into the output buffers, so that we
+     * never touch its refcount: this avoids copy-on-write of the object
+     * page when there is a saving child running. */
     if (sdsEncodedObject(obj)) {
         if (_addReplyToBuffer(c,obj->ptr,sdslen(obj->ptr)) != REDIS_OK)
-            _addReplyObjectToList(c,obj);
+            _addReplyStringToList(c,obj->ptr,sdslen(obj->ptr));
     } else if (obj->encoding == REDIS_ENCODING_INT) {
         /* Optimization: if there is room in the static buffer for 32 bytes
          * (more than the max chars a 64 bit integer can take as string) we
@@ -347,7 +290,7 @@ void addReply(redisClient *c, robj *obj) {
         }
         obj = getDecodedObject(obj);
         if (_addReplyToBuffer(c,obj->ptr,sdslen(obj->ptr)) != REDIS_OK)
-            _addReplyObjectToList(c,obj);
+            _addReplyStringToList(c,obj->ptr,sdslen(obj->ptr));
         decrRefCount(obj);
     } else {
         redisPanic("Wrong obj->encoding in addReply()");
@@ -360,12 +303,9 @@ void addReplySds(redisClient *c, sds s) {
         sdsfree(s);
         return;
     }
-    if (_addReplyToBuffer(c,s,sdslen(s)) == REDIS_OK) {
-        sdsfree(s);
-    } else {
-        /* This method free's the sds when it is no longer needed. */
-        _addReplySdsToList(c,s);
-    }
+    if (_addReplyToBuffer(c,s,sdslen(s)) != REDIS_OK)
+        _addReplyStringToList(c,s,sdslen(s));
+    sdsfree(s);
 }
 
 void addReplyString(redisClient *c, char *s, size_t len) {
@@ -419,40 +359,56 @@ void addReplyStatusFormat(redisClient *c, const char *fmt, ...) {
     sdsfree(s);
 }
 
-/* Adds an empty object to the reply list that will contain the multi bulk
+/* Adds an empty node to the reply list that will contain the multi bulk
  * length, which is not known when this function is called. */
 void *addDeferredMultiBulkLength(redisClient *c) {
     /* Note that we install the write event here even if the object is not
      * ready to be sent, since we are sure that before returning to the
      * event loop setDeferredMultiBulkLength() will be called. */
     if (prepareClientToWrite(c) != REDIS_OK) return NULL;
-    listAddNodeTail(c->reply,createObject(REDIS_STRING,NULL));
+    listAddNodeTail(c->reply,NULL);
     return listLast(c->reply);
 }
 
-/* Populate the length object and try gluing it to the next chunk. */
+/* Populate the length placeholder. The header is stored in the free space
+ * around it when possible (the static buffer or the previous block, or the
+ * head of the next block), so that no new block is allocated just for a
+ * few bytes. */
 void setDeferredMultiBulkLength(redisClient *c, void *node, long length) {
     listNode *ln = (listNode*)node;
-    robj *len, *next;
+    clientReplyBlock *prev, *next, *b;
+    char lenstr[128];
+    size_t lenstr_len;
 
     /* Abort when *node is NULL (see addDeferredMultiBulkLength). */
     if (node == NULL) return;
-
-    len = listNodeValue(ln);
-    len->ptr = sdscatprintf(sdsempty(),"*%ld\r\n",length);
-    len->encoding = REDIS_ENCODING_RAW; /* in case it was an EMBSTR. */
-    c->reply_bytes += zmalloc_size_sds(len->ptr);
-    if (ln->next != NULL) {
-        next = listNodeValue(ln->next);
-
-        /* Only glue when the next node is non-NULL (an sds in this case) */
-        if (next->ptr != NULL) {
-            c->reply_bytes -= zmalloc_size_sds(len->ptr);
-            c->reply_bytes -= getStringObjectSdsUsedMemory(next);
-            len->ptr = sdscatlen(len->ptr,next->ptr,sdslen(next->ptr));
-            c->reply_bytes += zmalloc_size_sds(len->ptr);
-            listDelNode(c->reply,ln->next);
-        }
+    redisAssert(listNodeValue(ln) == NULL);
+
+    lenstr_len = sprintf(lenstr,"*%ld\r\n",length);
+    prev = ln->prev ? listNodeValue(ln->prev) : NULL;
+    next = ln->next ? listNodeValue(ln->next) : NULL;
+
+    if (ln->prev == NULL && sizeof(c->buf)-c->bufpos >= lenstr_len) {
+        /* The placeholder is the head of the list: what is before it
+         * is the static buffer. */
+        memcpy(c->buf+c->bufpos,lenstr,lenstr_len);
+        c->bufpos += lenstr_len;
+        listDelNode(c->reply,ln);
+    } else if (prev && prev->size-prev->used >= lenstr_len) {
+        memcpy(prev->buf+prev->used,lenstr,lenstr_len);
+        prev->used += lenstr_len;
+        listDelNode(c->reply,ln);
+    } else if (next && next->size-next->used >= lenstr_len) {
+        memmove(next->buf+lenstr_len,next->buf,next->used);
+        memcpy(next->buf,lenstr,lenstr_len);
+        next->used += lenstr_len;
+        listDelNode(c->reply,ln);
+    } else {
+        b = createClientReplyBlock(lenstr_len);
+        memcpy(b->buf,lenstr,lenstr_len);
+        b->used = lenstr_len;
+        listNodeValue(ln) = b;
+        c->reply_bytes += b->size;
     }
     asyncCloseClientOnOutputBufferLimitReached(c);
 }
@@ -657,6 +613,26 @@ static void freeClientArgv(redisClient *c) {
     c->cmd = NULL;
 }
 
+/* Release the commands parsed ahead by the I/O threads and not yet
+ * executed, together with the pending protocol error if any. */
+static void freeClientParsedCommands(redisClient *c) {
+    int j, i;
+
+    for (j = c->pcmds_pos; j < c->pcmds_len; j++) {
+        parsedCommand *pc = c->pcmds+j;
+
+        for (i = 0; i < pc->argc; i++) decrRefCount(pc->argv[i]);
+        zfree(pc->argv);
+    }
+    zfree(c->pcmds);
+    c->pcmds = NULL;
+    c->pcmds_len = c->pcmds_pos = 0;
+    if (c->proto_err) {
+        sdsfree(c->proto_err);
+        c->proto_err = NULL;
+    }
+}
+
 /* Close all the slaves connections. This is useful in chained replication
  * when we resync with our own master and want to force all our slaves to
  * resync with us as well. */
@@ -698,6 +674,7 @@ void freeClient(redisClient *c) {
 
     /* Free the query buffer */
     sdsfree(c->querybuf);
+    sdsfree(c->pending_querybuf);
     c->querybuf = NULL;
 
     /* Deallocate structures used to block on blocking ops. */
@@ -723,6 +700,7 @@ void freeClient(redisClient *c) {
     }
     listRelease(c->reply);
     freeClientArgv(c);
+    freeClientParsedCommands(c);
 
     /* Remove from the list of clients */
     if (c->fd != -1) {
@@ -731,6 +709,20 @@ void freeClient(redisClient *c) {
         listDelNode(server.clients,ln);
     }
 
+    /* Remove from the list of pending writes if needed. */
+    if (c->flags & REDIS_PENDING_WRITE) {
+        ln = listSearchKey(server.clients_pending_write,c);
+        redisAssert(ln != NULL);
+        listDelNode(server.clients_pending_write,ln);
+    }
+
+    /* Remove from the list of pending reads if needed. */
+    if (c->flags & REDIS_PENDING_READ) {
+        ln = listSearchKey(server.clients_pending_read,c);
+        redisAssert(ln != NULL);
+        listDelNode(server.clients_pending_read,ln);
+    }
+
     /* When client was just unblocked because of a blocking operation,
      * remove it from the list of unblocked clients. */
     if (c->flags & REDIS_UNBLOCKED) {
@@ -782,11 +774,30 @@ void freeClient(redisClient *c) {
 /* Schedule a client to free it at a safe time in the serverCron() function.
  * This function is useful when we need to terminate a client but we are in
  * a context where calling freeClient() is not possible, because the client
- * should be valid for the continuation of the flow of the program. */
+ * should be valid for the continuation of the flow of the program.
+ *
+ * It is also the only way to close a client from the I/O threads, so when
+ * threaded I/O is in progress the queue is protected by a mutex. */
 void freeClientAsync(redisClient *c) {
     if (c->flags & REDIS_CLOSE_ASAP || c->flags & REDIS_LUA_CLIENT) return;
     c->flags |= REDIS_CLOSE_ASAP;
-    listAddNodeTail(server.clients_to_close,c);
+    if (server.io_threads_op == REDIS_IO_THREADS_OP_IDLE) {
+        listAddNodeTail(server.clients_to_close,c);
+    } else {
+        pthread_mutex_lock(&async_free_queue_mutex);
+        listAddNodeTail(server.clients_to_close,c);
+        pthread_mutex_unlock(&async_free_queue_mutex);
+    }
+}
+
+/* Free the client synchronously when called from the main thread, or
+ * schedule it for asynchronous freeing when the I/O threads are running,
+ * since in that context the client can't be released. */
+static void freeClientFromIOContext(redisClient *c) {
+    if (server.io_threads_op == REDIS_IO_THREADS_OP_IDLE)
+        freeClient(c);
+    else
+        freeClientAsync(c);
 }
 
 void freeClientsInAsyncFreeQueue(void) {
@@ -800,50 +811,91 @@ void freeClientsInAsyncFreeQueue(void) {
     }
 }
 
-void sendReplyToClient(aeEventLoop *el, int fd, void *privdata, int mask) {
-    redisClient *c = privdata;
-    int nwritten = 0, totwritten = 0, objlen;
-    size_t objmem;
-    robj *o;
-    REDIS_NOTUSED(el);
-    REDIS_NOTUSED(mask);
+/* Write the static buffer and the reply blocks in a single writev() call,
+ * up to REDIS_MAX_IOV_PER_WRITE buffers and 'limit' bytes, then consume the
+ * written bytes from the output buffers. Returns the writev() result. */
+static ssize_t writevToClient(int fd, redisClient *c, size_t limit) {
+    struct iovec iov[REDIS_MAX_IOV_PER_WRITE];
+    int iovcnt = 0, sentlen = c->sentlen;
+    size_t iovbytes = 0;
+    ssize_t nwritten, remaining;
+    listNode *ln;
+    listIter li;
 
-    while(c->bufpos > 0 || listLength(c->reply)) {
-        if (c->bufpos > 0) {
-            nwritten = write(fd,c->buf+c->sentlen,c->bufpos-c->sentlen);
-            if (nwritten <= 0) break;
-            c->sentlen += nwritten;
-            totwritten += nwritten;
-
-            /* If the buffer was sent, set bufpos to zero to continue with
-             * the remainder of the reply. */
-            if (c->sentlen == c->bufpos) {
-                c->bufpos = 0;
-                c->sentlen = 0;
-            }
-        } else {
-            o = listNodeValue(listFirst(c->reply));
-            objlen = sdslen(o->ptr);
-            objmem = getStringObjectSdsUsedMemory(o);
-
-            if (objlen == 0) {
-                listDelNode(c->reply,listFirst(c->reply));
-                c->reply_bytes -= objmem;
-                continue;
-            }
+    if (c->bufpos > 0) {
+        iov[iovcnt].iov_base = c->buf+sentlen;
+        iov[iovcnt].iov_len = c->bufpos-sentlen;
+        iovbytes += iov[iovcnt++].iov_len;
+        sentlen = 0;
+    }
+    listRewind(c->reply,&li);
+    while(iovcnt < REDIS_MAX_IOV_PER_WRITE && iovbytes < limit &&
+          (ln = listNext(&li)) != NULL)
+    {
+        clientReplyBlock *b = listNodeValue(ln);
 
-            nwritten = write(fd, ((char*)o->ptr)+c->sentlen,objlen-c->sentlen);
-            if (nwritten <= 0) break;
-            c->sentlen += nwritten;
-            totwritten += nwritten;
+        if (b->used == 0) continue;
+        iov[iovcnt].iov_base = b->buf+sentlen;
+        iov[iovcnt].iov_len = b->used-sentlen;
+        iovbytes += iov[iovcnt++].iov_len;
+        sentlen = 0;
+    }
+    if (iovcnt == 0) {
+        /* Only empty blocks are left. */
+        while(listLength(c->reply)) {
+            clientReplyBlock *b = listNodeValue(listFirst(c->reply));
+            c->reply_bytes -= b->size;
+            listDelNode(c->reply,listFirst(c->reply));
+        }
+        return 0;
+    }
 
-            /* If we fully sent the object on head go to the next one */
-            if (c->sentlen == objlen) {
-                listDelNode(c->reply,listFirst(c->reply));
-                c->sentlen = 0;
-                c->reply_bytes -= objmem;
-            }
+    nwritten = writev(fd,iov,iovcnt);
+    if (nwritten <= 0) return nwritten;
+
+    /* Release the buffers that were fully sent, and remember where to
+     * restart from in the one that was sent partially, if any. */
+    remaining = nwritten;
+    if (c->bufpos > 0) {
+        if ((size_t)remaining < (size_t)(c->bufpos-c->sentlen)) {
+            c->sentlen += remaining;
+            return nwritten;
+        }
+        remaining -= c->bufpos-c->sentlen;
+        c->bufpos = 0;
+        c->sentlen = 0;
+    }
+    while(listLength(c->reply)) {
+        clientReplyBlock *b = listNodeValue(listFirst(c->reply));
+
+        if ((size_t)remaining < b->used-c->sentlen) {
+            c->sentlen += remaining;
+            break;
         }
+        remaining -= b->used-c->sentlen;
+        c->sentlen = 0;
+        c->reply_bytes -= b->size;
+        listDelNode(c->reply,listFirst(c->reply));
+    }
+    return nwritten;
+}
+
+/* Write data in output buffers to client. Return REDIS_OK if the client
+ * is still valid after the call, REDIS_ERR if it was freed (or, when called
+ * from the I/O threads, scheduled to be freed ASAP). */
+int writeToClient(int fd, redisClient *c, int handler_installed) {
+    ssize_t nwritten = 0, totwritten = 0;
+
+    while(clientHasPendingReplies(c)) {
+        size_t limit = SIZE_MAX;
+
+        if (totwritten < REDIS_MAX_WRITE_PER_EVENT)
+            limit = REDIS_MAX_WRITE_PER_EVENT-totwritten;
+
+        nwritten = writevToClient(fd,c,limit);
+        if (nwritten <= 0) break;
+        totwritten += nwritten;
+
         /* Note that we avoid to send more than REDIS_MAX_WRITE_PER_EVENT
          * bytes, in a single threaded server it's a good idea to serve
          * other clients as well, even if a very large request comes from
@@ -852,19 +904,19 @@ void sendReplyToClient(aeEventLoop *el, int fd, void *privdata, int mask) {
          *
          * However if we are over the maxmemory limit we ignore that and
          * just deliver as much data as it is possible to deliver. */
-        server.stat_net_output_bytes += totwritten;
-        if (totwritten > REDIS_MAX_WRITE_PER_EVENT &&
+        if (totwritten >= REDIS_MAX_WRITE_PER_EVENT &&
             (server.maxmemory == 0 ||
              zmalloc_used_memory() < server.maxmemory)) break;
     }
+    atomicIncr(server.stat_net_output_bytes,totwritten);
     if (nwritten == -1) {
         if (errno == EAGAIN) {
             nwritten = 0;
         } else {
             redisLog(REDIS_VERBOSE,
                 "Error writing to client: %s", strerror(errno));
-            freeClient(c);
-            return;
+            freeClientFromIOContext(c);
+            return REDIS_ERR;
         }
     }
     if (totwritten > 0) {
@@ -874,13 +926,54 @@ void sendReplyToClient(aeEventLoop *el, int fd, void *privdata, int mask) {
          * We just rely on data / pings received for timeout detection. */
         if (!(c->flags & REDIS_MASTER)) c->lastinteraction = server.unixtime;
     }
-    if (c->bufpos == 0 && listLength(c->reply) == 0) {
+    if (!clientHasPendingReplies(c)) {
         c->sentlen = 0;
-        aeDeleteFileEvent(server.el,c->fd,AE_WRITABLE);
+        if (handler_installed) aeDeleteFileEvent(server.el,c->fd,AE_WRITABLE);
 
         /* Close connection after entire reply has been sent. */
-        if (c->flags & REDIS_CLOSE_AFTER_REPLY) freeClient(c);
+        if (c->flags & REDIS_CLOSE_AFTER_REPLY) {
+            freeClientFromIOContext(c);
+            return REDIS_ERR;
+        }
     }
+    return REDIS_OK;
+}
+
+/* Write event handler. Just send data to the client. */
+void sendReplyToClient(aeEventLoop *el, int fd, void *privdata, int mask) {
+    REDIS_NOTUSED(el);
+    REDIS_NOTUSED(mask);
+    writeToClient(fd,privdata,1);
+}
+
+/* This function is called just before entering the event loop, in the hope
+ * we can just write the replies to the client output buffer without any
+ * need to use a syscall in order to install the writable event handler,
+ * get it called, and so forth. */
+int handleClientsWithPendingWrites(void) {
+    listIter li;
+    listNode *ln;
+    int processed = listLength(server.clients_pending_write);
+
+    listRewind(server.clients_pending_write,&li);
+    while((ln = listNext(&li))) {
+        redisClient *c = listNodeValue(ln);
+        c->flags &= ~REDIS_PENDING_WRITE;
+        listDelNode(server.clients_pending_write,ln);
+
+        /* Try to write buffers to the client socket. */
+        if (writeToClient(c->fd,c,0) == REDIS_ERR) continue;
+
+        /* If there is nothing left, do nothing. Otherwise install
+         * the write handler. */
+        if (clientHasPendingReplies(c) &&
+            aeCreateFileEvent(server.el, c->fd, AE_WRITABLE,
+                sendReplyToClient, c) == AE_ERR)
+        {
+            freeClientAsync(c);
+        }
+    }
+    return processed;
 }
 
 /* resetClient prepare the client to process the next command */
@@ -909,8 +1002,7 @@ int processInlineBuffer(redisClient *c) {
     /* Nothing to do without a \r\n */
     if (newline == NULL) {
         if (sdslen(c->querybuf) > REDIS_INLINE_MAX_SIZE) {
-            addReplyError(c,"Protocol error: too big inline request");
-            setProtocolError(c,0);
+            setProtocolError("too big inline request",c,0);
         }
         return REDIS_ERR;
     }
@@ -925,8 +1017,7 @@ int processInlineBuffer(redisClient *c) {
     argv = sdssplitargs(aux,&argc);
     sdsfree(aux);
     if (argv == NULL) {
-        addReplyError(c,"Protocol error: unbalanced quotes in request");
-        setProtocolError(c,0);
+        setProtocolError("unbalanced quotes in request",c,0);
         return REDIS_ERR;
     }
 
@@ -958,16 +1049,24 @@ int processInlineBuffer(redisClient *c) {
     return REDIS_OK;
 }
 
-/* Helper function. Trims query buffer to make the function that processes
- * multi bulk requests idempotent. */
-static void setProtocolError(redisClient *c, int pos) {
+/* Helper function. Saves the protocol error 'errstr' in the client, to be
+ * replied by processInputBuffer() that then flags the client to be closed.
+ * Trims query buffer to make the function that processes multi bulk
+ * requests idempotent.
+ *
+ * No reply is emitted here since requests may be parsed ahead, by the I/O
+ * threads or the main thread itself: the error is only reported once the
+ * commands parsed before the error are executed. */
+static void setProtocolError(const char *errstr, redisClient *c, int pos) {
+    sds err = sdscatprintf(sdsempty(),"Protocol error: %s",errstr);
+
     if (server.verbosity <= REDIS_VERBOSE) {
         sds client = catClientInfoString(sdsempty(),c);
         redisLog(REDIS_VERBOSE,
-            "Protocol error from client: %s", client);
+            "Protocol error (%s) from client: %s", errstr, client);
         sdsfree(client);
     }
-    c->flags |= REDIS_CLOSE_AFTER_REPLY;
+    c->proto_err = err;
     sdsrange(c->querybuf,pos,-1);
 }
 
@@ -984,8 +1083,7 @@ int processMultibulkBuffer(redisClient *c) {
         newline = strchr(c->querybuf,'\r');
         if (newline == NULL) {
             if (sdslen(c->querybuf) > REDIS_INLINE_MAX_SIZE) {
-                addReplyError(c,"Protocol error: too big mbulk count string");
-                setProtocolError(c,0);
+                setProtocolError("too big mbulk count string",c,0);
             }
             return REDIS_ERR;
         }
@@ -999,8 +1097,7 @@ int processMultibulkBuffer(redisClient *c) {
         redisAssertWithInfo(c,NULL,c->querybuf[0] == '*');
         ok = string2ll(c->querybuf+1,newline-(c->querybuf+1),&ll);
         if (!ok || ll > 1024*1024) {
-            addReplyError(c,"Protocol error: invalid multibulk length");
-            setProtocolError(c,pos);
+            setProtocolError("invalid multibulk length",c,pos);
             return REDIS_ERR;
         }
 
@@ -1024,9 +1121,7 @@ int processMultibulkBuffer(redisClient *c) {
             newline = strchr(c->querybuf+pos,'\r');
             if (newline == NULL) {
                 if (sdslen(c->querybuf) > REDIS_INLINE_MAX_SIZE) {
-                    addReplyError(c,
-                        "Protocol error: too big bulk count string");
-                    setProtocolError(c,0);
+                    setProtocolError("too big bulk count string",c,0);
                     return REDIS_ERR;
                 }
                 break;
@@ -1037,17 +1132,17 @@ int processMultibulkBuffer(redisClient *c) {
                 break;
 
             if (c->querybuf[pos] != '$') {
-                addReplyErrorFormat(c,
-                    "Protocol error: expected '$', got '%c'",
+                char buf[32];
+
+                snprintf(buf,sizeof(buf),"expected '$', got '%c'",
                     c->querybuf[pos]);
-                setProtocolError(c,pos);
+                setProtocolError(buf,c,pos);
                 return REDIS_ERR;
             }
 
             ok = string2ll(c->querybuf+pos+1,newline-(c->querybuf+pos+1),&ll);
             if (!ok || ll < 0 || ll > 512*1024*1024) {
-                addReplyError(c,"Protocol error: invalid bulk length");
-                setProtocolError(c,pos);
+                setProtocolError("invalid bulk length",c,pos);
                 return REDIS_ERR;
             }
 
@@ -1109,9 +1204,148 @@ int processMultibulkBuffer(redisClient *c) {
     return REDIS_ERR;
 }
 
+/* Return true if the client has input to process: either commands parsed
+ * ahead by the I/O threads, or data in the query buffer. */
+int clientHasPendingInput(redisClient *c) {
+    return c->pcmds_pos < c->pcmds_len || c->proto_err ||
+           (c->querybuf && sdslen(c->querybuf));
+}
+
+/* Parse the next request found in the query buffer into c->argv / c->argc.
+ * Returns REDIS_OK when a full request was parsed, otherwise REDIS_ERR
+ * (more data is needed, or a protocol error was found). */
+static int parseNextRequest(redisClient *c) {
+    /* Determine request type when unknown. */
+    if (!c->reqtype) {
+        if (c->querybuf[0] == '*') {
+            c->reqtype = REDIS_REQ_MULTIBULK;
+        } else {
+            c->reqtype = REDIS_REQ_INLINE;
+        }
+    }
+
+    if (c->reqtype == REDIS_REQ_INLINE) {
+        return processInlineBuffer(c);
+    } else if (c->reqtype == REDIS_REQ_MULTIBULK) {
+        return processMultibulkBuffer(c);
+    } else {
+        redisPanic("Unknown request type");
+        return REDIS_ERR; /* Avoid warnings. */
+    }
+}
+
+/* Move the request just parsed in c->argv / c->argc at the end of the
+ * queue of the commands parsed ahead, leaving the client ready to parse the
+ * next request. Note that empty requests are queued as well, so that the
+ * client is reset exactly like it happens for the requests parsed and
+ * executed one at a time. */
+static void queueParsedCommand(redisClient *c) {
+    parsedCommand *pc;
+
+    if (c->pcmds == NULL)
+        c->pcmds = zmalloc(sizeof(parsedCommand)*REDIS_MAX_PARSED_AHEAD);
+    pc = c->pcmds+c->pcmds_len++;
+    pc->argc = c->argc;
+    pc->argv = c->argv;
+
+    c->argc = 0;
+    c->argv = NULL;
+    c->reqtype = 0;
+    c->multibulklen = 0;
+    c->bulklen = -1;
+}
+
+/* Parse the requests available in the query buffer and queue them in
+ * c->pcmds, without executing them. This is called by the I/O threads after
+ * reading from the socket, since command execution is only performed by
+ * the main thread, and by processInputBuffer() itself for pipelines, so
+ * that the keys of a batch of commands can be prefetched before executing
+ * them. At most REDIS_MAX_PARSED_AHEAD commands are queued, the rest of the
+ * query buffer is parsed later by processInputBuffer().
+ *
+ * A partially received request stays in c->argv and the other parsing
+ * fields as usually: processInputBuffer() preserves this state while
+ * executing the commands queued before it. */
+static void parseInputBufferAhead(redisClient *c) {
+    /* Nothing is going to be executed anyway. */
+    if (c->flags & (REDIS_CLOSE_AFTER_REPLY|REDIS_CLOSE_ASAP)) return;
+
+    /* Compact the queue if the main thread already consumed a part of it
+     * (this happens when the client blocked in the middle). */
+    if (c->pcmds_pos) {
+        c->pcmds_len -= c->pcmds_pos;
+        memmove(c->pcmds,c->pcmds+c->pcmds_pos,
+                sizeof(parsedCommand)*c->pcmds_len);
+        c->pcmds_pos = 0;
+    }
+
+    while(sdslen(c->querybuf) && !c->proto_err &&
+          c->pcmds_len < REDIS_MAX_PARSED_AHEAD)
+    {
+        if (parseNextRequest(c) != REDIS_OK) break;
+        queueParsedCommand(c);
+    }
+}
+
+/* Prefetch the keys of the commands parsed ahead and not yet executed, see
+ * dbPrefetchKeys(). Only the keys in the positions given by the command
+ * table are considered, and the commands are not checked for arity yet. */
+static void prefetchParsedCommandsKeys(redisClient *c) {
+    robj *keys[REDIS_MAX_PARSED_AHEAD];
+    int numkeys = 0, j;
+
+    for (j = c->pcmds_pos; j < c->pcmds_len; j++) {
+        parsedCommand *pc = c->pcmds+j;
+        struct redisCommand *cmd;
+        int k, last;
+
+        if (pc->argc == 0) continue;
+        cmd = lookupCommand(pc->argv[0]->ptr);
+        if (cmd == NULL || cmd->firstkey == 0 || cmd->getkeys_proc) continue;
+        last = cmd->lastkey < 0 ? pc->argc+cmd->lastkey : cmd->lastkey;
+        for (k = cmd->firstkey; k <= last && k < pc->argc; k += cmd->keystep) {
+            if (numkeys == REDIS_MAX_PARSED_AHEAD) break;
+            keys[numkeys++] = pc->argv[k];
+        }
+    }
+    dbPrefetchKeys(c->db,keys,numkeys);
+}
+
+/* Execute a command parsed ahead by the I/O threads. The parsing state of
+ * the client (that may contain a partially received request) is saved and
+ * restored around the execution. */
+static void processParsedCommand(redisClient *c) {
+    parsedCommand *pc = c->pcmds+c->pcmds_pos++;
+    robj **argv = c->argv;
+    int argc = c->argc, reqtype = c->reqtype, multibulklen = c->multibulklen;
+    long bulklen = c->bulklen;
+
+    c->argc = pc->argc;
+    c->argv = pc->argv;
+    if (c->pcmds_pos == c->pcmds_len) c->pcmds_pos = c->pcmds_len = 0;
+
+    /* Multibulk processing could see a <= 0 length. */
+    if (c->argc == 0) {
+        resetClient(c);
+    } else {
+        /* Only reset the client when the command was executed. */
+        if (processCommand(c) == REDIS_OK)
+            resetClient(c);
+        else
+            freeClientArgv(c);
+    }
+    zfree(c->argv);
+
+    c->argv = argv;
+    c->argc = argc;
+    c->reqtype = reqtype;
+    c->multibulklen = multibulklen;
+    c->bulklen = bulklen;
+}
+
 void processInputBuffer(redisClient *c) {
     /* Keep processing while there is something in the input buffer */
-    while(sdslen(c->querybuf)) {
+    while(clientHasPendingInput(c)) {
         /* Return if clients are paused. */
         if (!(c->flags & REDIS_SLAVE) && clientsArePaused()) return;
 
@@ -1123,21 +1357,38 @@ void processInputBuffer(redisClient *c) {
          * this flag has been set (i.e. don't process more commands). */
         if (c->flags & REDIS_CLOSE_AFTER_REPLY) return;
 
-        /* Determine request type when unknown. */
-        if (!c->reqtype) {
-            if (c->querybuf[0] == '*') {
-                c->reqtype = REDIS_REQ_MULTIBULK;
-            } else {
-                c->reqtype = REDIS_REQ_INLINE;
-            }
+        /* Commands already parsed ahead come first, then the protocol
+         * error found while parsing, if any. The keys of the batch are
+         * prefetched before executing its first command. */
+        if (c->pcmds_pos < c->pcmds_len) {
+            if (c->pcmds_pos == 0 && c->pcmds_len > 1)
+                prefetchParsedCommandsKeys(c);
+            processParsedCommand(c);
+            continue;
+        }
+        if (c->proto_err) {
+            addReplyErrorLength(c,c->proto_err,sdslen(c->proto_err));
+            sdsfree(c->proto_err);
+            c->proto_err = NULL;
+            c->flags |= REDIS_CLOSE_AFTER_REPLY;
+            return;
         }
 
-        if (c->reqtype == REDIS_REQ_INLINE) {
-            if (processInlineBuffer(c) != REDIS_OK) break;
-        } else if (c->reqtype == REDIS_REQ_MULTIBULK) {
-            if (processMultibulkBuffer(c) != REDIS_OK) break;
-        } else {
-            redisPanic("Unknown request type");
+        if (parseNextRequest(c) != REDIS_OK) {
+            if (c->proto_err) continue;
+            break;
+        }
+
+        /* More requests follow in the query buffer: parse them ahead as
+         * well, so that their keys are prefetched before executing them.
+         * Our master is excluded since its applied offset must be updated
+         * after every command. */
+        if (c->argc && sdslen(c->querybuf) &&
+            !(c->flags & (REDIS_MASTER|REDIS_SLAVE)))
+        {
+            queueParsedCommand(c);
+            parseInputBufferAhead(c);
+            continue;
         }
 
         /* Multibulk processing could see a <= 0 length. */
@@ -1145,12 +1396,39 @@ void processInputBuffer(redisClient *c) {
             resetClient(c);
         } else {
             /* Only reset the client when the command was executed. */
-            if (processCommand(c) == REDIS_OK)
+            if (processCommand(c) == REDIS_OK) {
+                /* Update the applied replication offset of our master:
+                 * a transaction is applied only once EXEC is executed. */
+                if (c->flags & REDIS_MASTER && !(c->flags & REDIS_MULTI))
+                    c->reploff = c->read_reploff - sdslen(c->querybuf);
                 resetClient(c);
+            }
         }
     }
 }
 
+/* Like processInputBuffer(), but if the client is our master, also proxy
+ * the part of the replication stream we applied to our own slaves and
+ * backlog, exactly as we received it, so that the whole replication
+ * chain shares the same offsets and can partially resynchronize with any
+ * of its members. */
+void processInputBufferAndReplicate(redisClient *c) {
+    long long prev_offset, applied;
+
+    if (!(c->flags & REDIS_MASTER)) {
+        processInputBuffer(c);
+        return;
+    }
+    prev_offset = c->reploff;
+    processInputBuffer(c);
+    applied = c->reploff - prev_offset;
+    if (applied) {
+        replicationFeedSlavesFromMasterStream(server.slaves,
+            c->pending_querybuf, applied);
+        sdsrange(c->pending_querybuf,applied,-1);
+    }
+}
+
 void readQueryFromClient(aeEventLoop *el, int fd, void *privdata, int mask) {
     redisClient *c = (redisClient*) privdata;
     int nread, readlen;
@@ -1158,7 +1436,10 @@ void readQueryFromClient(aeEventLoop *el, int fd, void *privdata, int mask) {
     REDIS_NOTUSED(el);
     REDIS_NOTUSED(mask);
 
-    server.current_client = c;
+    /* Check if we want to read from the client later, from the I/O threads,
+     * when exiting the event loop. */
+    if (postponeClientRead(c)) return;
+
     readlen = REDIS_IOBUF_LEN;
     /* If this is a multi bulk request, and we are processing a bulk reply
      * that is large enough, try to maximize the probability that the query
@@ -1183,21 +1464,24 @@ void readQueryFromClient(aeEventLoop *el, int fd, void *privdata, int mask) {
             nread = 0;
         } else {
             redisLog(REDIS_VERBOSE, "Reading from client: %s",strerror(errno));
-            freeClient(c);
+            freeClientFromIOContext(c);
             return;
         }
     } else if (nread == 0) {
         redisLog(REDIS_VERBOSE, "Client closed connection");
-        freeClient(c);
+        freeClientFromIOContext(c);
         return;
     }
     if (nread) {
         sdsIncrLen(c->querybuf,nread);
         c->lastinteraction = server.unixtime;
-        if (c->flags & REDIS_MASTER) c->reploff += nread;
-        server.stat_net_input_bytes += nread;
+        if (c->flags & REDIS_MASTER) {
+            c->read_reploff += nread;
+            c->pending_querybuf = sdscatlen(c->pending_querybuf,
+                c->querybuf+qblen,nread);
+        }
+        atomicIncr(server.stat_net_input_bytes,nread);
     } else {
-        server.current_client = NULL;
         return;
     }
     if (sdslen(c->querybuf) > server.client_max_querybuf_len) {
@@ -1207,10 +1491,18 @@ void readQueryFromClient(aeEventLoop *el, int fd, void *privdata, int mask) {
         redisLog(REDIS_WARNING,"Closing client that reached max query buffer length: %s (qbuf initial bytes: %s)", ci, bytes);
         sdsfree(ci);
         sdsfree(bytes);
-        freeClient(c);
+        freeClientFromIOContext(c);
         return;
     }
-    processInputBuffer(c);
+
+    /* When called from the I/O threads we can only parse the requests:
+     * the main thread will execute them. */
+    if (server.io_threads_op != REDIS_IO_THREADS_OP_IDLE) {
+        parseInputBufferAhead(c);
+        return;
+    }
+    server.current_client = c;
+    processInputBufferAndReplicate(c);
     server.current_client = NULL;
 }
 
@@ -1568,21 +1860,19 @@ void rewriteClientCommandArgument(redisClient *c, int i, robj *newval) {
     }
 }
 
-/* This function returns the number of bytes that Redis is virtually
- * using to store the reply still not read by the client.
- * It is "virtual" since the reply output list may contain objects that
- * are shared and are not really using additional memory.
+/* This function returns the number of bytes that Redis is using to store
+ * the reply still not read by the client.
  *
- * The function returns the total sum of the length of all the objects
- * stored in the output list, plus the memory used to allocate every
- * list node. The static reply buffer is not taken into account since it
- * is allocated anyway.
+ * The reply blocks are never shared, so the size is exact: the total
+ * allocated size of all the blocks stored in the output list, plus the
+ * memory used to allocate every list node. The static reply buffer is not
+ * taken into account since it is allocated anyway.
  *
  * Note: this function is very fast so can be called as many time as
  * the caller wishes. The main usage of this function currently is
  * enforcing the client output length limits. */
 unsigned long getClientOutputBufferMemoryUsage(redisClient *c) {
-    unsigned long list_item_size = sizeof(listNode)+sizeof(robj);
+    unsigned long list_item_size = sizeof(listNode)+sizeof(clientReplyBlock);
 
     return c->reply_bytes + (list_item_size*listLength(c->reply));
 }
@@ -1687,7 +1977,6 @@ void flushSlavesOutputBuffers(void) {
     listRewind(server.slaves,&li);
     while((ln = listNext(&li))) {
         redisClient *slave = listNodeValue(ln);
-        int events;
 
         /* Note that the following will not flush output buffers of slaves
          * in STATE_ONLINE but having put_online_on_ack set to true: in this
@@ -1695,12 +1984,11 @@ void flushSlavesOutputBuffers(void) {
          * of put_online_on_ack is to postpone the moment it is installed.
          * This is what we want since slaves in this state should not receive
          * writes before the first ACK. */
-        events = aeGetFileEvents(server.el,slave->fd);
-        if (events & AE_WRITABLE &&
-            slave->replstate == REDIS_REPL_ONLINE &&
-            listLength(slave->reply))
+        if (slave->replstate == REDIS_REPL_ONLINE &&
+            !slave->repl_put_online_on_ack &&
+            clientHasPendingReplies(slave))
         {
-            sendReplyToClient(server.el,slave->fd,slave,0);
+            writeToClient(slave->fd,slave,0);
         }
     }
 }
@@ -1771,10 +2059,299 @@ int clientsArePaused(void) {
 int processEventsWhileBlocked(void) {
     int iterations = 4; /* See the function top-comment. */
     int count = 0;
+
+    ProcessingEventsWhileBlocked = 1;
     while (iterations--) {
-        int events = aeProcessEvents(server.el, AE_FILE_EVENTS|AE_DONT_WAIT);
+        int events = 0;
+        events += aeProcessEvents(server.el, AE_FILE_EVENTS|AE_DONT_WAIT);
+        events += handleClientsWithPendingWrites();
         if (!events) break;
         count += events;
     }
+    ProcessingEventsWhileBlocked = 0;
     return count;
 }
+
+/* ==========================================================================
+ * Threaded I/O
+ *
+ * When io-threads is greater than one, the main thread uses a pool of
+ * threads in order to write the replies to the client sockets and, if
+ * io-threads-do-reads is enabled, to read and parse the client requests.
+ * Commands are always executed by the main thread.
+ *
+ * The I/O threads are only used in well defined phases of the event loop,
+ * from beforeSleep(): the main thread assigns the clients to the threads,
+ * processes its own share, and busy waits for the other threads to finish.
+ * So while a phase is in progress nothing else happens in the server, and
+ * every client is handled by a single thread: this is why the client
+ * handling code needs no locking, with the exception of the few global
+ * things touched by readQueryFromClient() and writeToClient(), that check
+ * server.io_threads_op in order to defer them to the main thread.
+ * ========================================================================== */
+
+#define IO_THREADS_SPIN_LOOPS 1000000
+
+static pthread_t io_threads[REDIS_IO_THREADS_MAX_NUM];
+static pthread_mutex_t io_threads_mutex[REDIS_IO_THREADS_MAX_NUM];
+static unsigned long io_threads_pending[REDIS_IO_THREADS_MAX_NUM];
+/* Clients assigned to every thread. Thread 0 is the main thread. */
+static list *io_threads_list[REDIS_IO_THREADS_MAX_NUM];
+
+static unsigned long getIOPendingCount(int i) {
+    unsigned long count;
+    atomicGetWithSync(io_threads_pending[i],count);
+    return count;
+}
+
+static void setIOPendingCount(int i, unsigned long count) {
+    atomicSetWithSync(io_threads_pending[i],count);
+}
+
+/* Perform the current I/O operation on all the clients of the list. */
+static void processIOThreadList(list *l) {
+    listIter li;
+    listNode *ln;
+
+    listRewind(l,&li);
+    while((ln = listNext(&li))) {
+        redisClient *c = listNodeValue(ln);
+
+        if (server.io_threads_op == REDIS_IO_THREADS_OP_WRITE) {
+            writeToClient(c->fd,c,0);
+        } else if (server.io_threads_op == REDIS_IO_THREADS_OP_READ) {
+            readQueryFromClient(server.el,c->fd,c,0);
+        } else {
+            redisPanic("io_threads_op value is unknown");
+        }
+    }
+    listEmpty(l);
+}
+
+static void *IOThreadMain(void *myid) {
+    /* The ID is the thread number (from 0 to server.io_threads_num-1), and is
+     * used by the thread to just manipulate a single sub-array of clients. */
+    long id = (unsigned long)myid;
+
+    while(1) {
+        int j;
+
+        /* Wait for start. */
+        for (j = 0; j < IO_THREADS_SPIN_LOOPS; j++) {
+            if (getIOPendingCount(id) != 0) break;
+        }
+
+        /* Give the main thread a chance to stop this thread: while stopped
+         * the main thread holds our mutex. */
+        if (getIOPendingCount(id) == 0) {
+            pthread_mutex_lock(&io_threads_mutex[id]);
+            pthread_mutex_unlock(&io_threads_mutex[id]);
+            continue;
+        }
+
+        processIOThreadList(io_threads_list[id]);
+        setIOPendingCount(id,0);
+    }
+    return NULL;
+}
+
+/* Initialize the data structures needed for threaded I/O, and create the
+ * threads. They are created stopped, see startThreadedIO(). */
+void initThreadedIO(void) {
+    int i;
+
+    server.io_threads_active = 0;
+    server.io_threads_op = REDIS_IO_THREADS_OP_IDLE;
+
+    /* Don't spawn any thread if the user selected a single thread:
+     * we'll handle I/O directly from the main thread. */
+    if (server.io_threads_num == 1) return;
+
+    for (i = 0; i < server.io_threads_num; i++) {
+        pthread_t tid;
+
+        io_threads_list[i] = listCreate();
+        if (i == 0) continue; /* Thread 0 is the main thread. */
+
+        pthread_mutex_init(&io_threads_mutex[i],NULL);
+        setIOPendingCount(i,0);
+        pthread_mutex_lock(&io_threads_mutex[i]); /* Thread will be stopped. */
+        if (pthread_create(&tid,NULL,IOThreadMain,(void*)(long)i) != 0) {
+            redisLog(REDIS_WARNING,"Fatal: Can't initialize I/O threads.");
+            exit(1);
+        }
+        io_threads[i] = tid;
+    }
+}
+
+static void startThreadedIO(void) {
+    int j;
+
+    for (j = 1; j < server.io_threads_num; j++)
+        pthread_mutex_unlock(&io_threads_mutex[j]);
+    server.io_threads_active = 1;
+}
+
+static void stopThreadedIO(void) {
+    int j;
+
+    /* We may have still clients with pending reads when this function
+     * is called: handle them before stopping the threads. */
+    handleClientsWithPendingReadsUsingThreads();
+    for (j = 1; j < server.io_threads_num; j++)
+        pthread_mutex_lock(&io_threads_mutex[j]);
+    server.io_threads_active = 0;
+}
+
+/* Spinning threads burn CPU, so when there are just a few clients to serve
+ * we stop them and perform the I/O from the main thread. Returns true if
+ * the I/O threads are (or were just) stopped. */
+static int stopThreadedIOIfNeeded(void) {
+    int pending = listLength(server.clients_pending_write);
+
+    if (server.io_threads_num == 1) return 1;
+    if (pending < (server.io_threads_num*2)) {
+        if (server.io_threads_active) stopThreadedIO();
+        return 1;
+    }
+    return 0;
+}
+
+/* Assign the clients of 'l' to the I/O threads in a round robin fashion,
+ * run 'op' on them, and wait for all the threads to finish. */
+static void runThreadedIO(list *l, int op) {
+    listIter li;
+    listNode *ln;
+    int item_id = 0, j;
+
+    listRewind(l,&li);
+    while((ln = listNext(&li))) {
+        redisClient *c = listNodeValue(ln);
+        int target_id = item_id % server.io_threads_num;
+
+        listAddNodeTail(io_threads_list[target_id],c);
+        item_id++;
+    }
+
+    /* Give the start condition to the waiting threads, by setting the
+     * operation and the count of clients to process. */
+    server.io_threads_op = op;
+    for (j = 1; j < server.io_threads_num; j++) {
+        int count = listLength(io_threads_list[j]);
+        setIOPendingCount(j,count);
+    }
+
+    /* Also use the main thread to process a slice of clients. */
+    processIOThreadList(io_threads_list[0]);
+
+    /* Wait for all the other threads to end their work. */
+    while(1) {
+        unsigned long pending = 0;
+
+        for (j = 1; j < server.io_threads_num; j++)
+            pending += getIOPendingCount(j);
+        if (pending == 0) break;
+    }
+    server.io_threads_op = REDIS_IO_THREADS_OP_IDLE;
+}
+
+/* Like handleClientsWithPendingWrites(), but spreads the writes across the
+ * I/O threads when there are enough clients to serve. */
+int handleClientsWithPendingWritesUsingThreads(void) {
+    listIter li;
+    listNode *ln;
+    int processed = listLength(server.clients_pending_write);
+
+    /* If I/O threads are disabled or we have few clients to serve, don't
+     * use I/O threads, but the boring synchronous code. */
+    if (stopThreadedIOIfNeeded()) return handleClientsWithPendingWrites();
+
+    /* Start threads if needed. */
+    if (!server.io_threads_active) startThreadedIO();
+
+    /* Clients scheduled to be closed ASAP don't need to be served. */
+    listRewind(server.clients_pending_write,&li);
+    while((ln = listNext(&li))) {
+        redisClient *c = listNodeValue(ln);
+
+        c->flags &= ~REDIS_PENDING_WRITE;
+        if (c->flags & REDIS_CLOSE_ASAP)
+            listDelNode(server.clients_pending_write,ln);
+    }
+    runThreadedIO(server.clients_pending_write,REDIS_IO_THREADS_OP_WRITE);
+
+    /* Install the write handler for the clients that still have data to
+     * send. The blocks sent by the threads were already released by them:
+     * unlike the objects they replace, blocks are owned by a single client. */
+    listRewind(server.clients_pending_write,&li);
+    while((ln = listNext(&li))) {
+        redisClient *c = listNodeValue(ln);
+
+        if (c->flags & REDIS_CLOSE_ASAP) continue;
+        if (clientHasPendingReplies(c) &&
+            aeCreateFileEvent(server.el, c->fd, AE_WRITABLE,
+                sendReplyToClient, c) == AE_ERR)
+        {
+            freeClientAsync(c);
+        }
+    }
+    listEmpty(server.clients_pending_write);
+
+    server.stat_io_writes_processed += processed;
+    return processed;
+}
+
+/* Return 1 if we want to handle the client read later using the I/O
+ * threads. This is called by the readable handler of the event loop.
+ * As a side effect of calling this function the client is put in the
+ * pending read clients and flagged as such. Clients are queued in the
+ * order their sockets became readable, so that the commands are executed
+ * in the same order as in the single threaded case. */
+static int postponeClientRead(redisClient *c) {
+    if (server.io_threads_active &&
+        server.io_threads_do_reads &&
+        !ProcessingEventsWhileBlocked &&
+        server.io_threads_op == REDIS_IO_THREADS_OP_IDLE &&
+        !(c->flags & (REDIS_MASTER|REDIS_SLAVE|REDIS_BLOCKED|
+                      REDIS_PENDING_READ)))
+    {
+        c->flags |= REDIS_PENDING_READ;
+        listAddNodeTail(server.clients_pending_read,c);
+        return 1;
+    }
+    return 0;
+}
+
+/* When threaded I/O is also enabled for the reading and parsing side, the
+ * readable handler will just put normal clients into a queue of clients to
+ * process (instead of serving them synchronously). This function runs the
+ * queue using the I/O threads, and executes the parsed commands in the
+ * main thread. */
+int handleClientsWithPendingReadsUsingThreads(void) {
+    int processed = listLength(server.clients_pending_read);
+
+    if (!server.io_threads_active || !server.io_threads_do_reads) return 0;
+    if (processed == 0) return 0;
+
+    runThreadedIO(server.clients_pending_read,REDIS_IO_THREADS_OP_READ);
+
+    /* Run the commands the threads parsed, in the same order the clients
+     * were queued. */
+    while(listLength(server.clients_pending_read)) {
+        listNode *ln = listFirst(server.clients_pending_read);
+        redisClient *c = listNodeValue(ln);
+
+        c->flags &= ~REDIS_PENDING_READ;
+        listDelNode(server.clients_pending_read,ln);
+
+        /* Clients that hit an error or EOF were scheduled to be closed. */
+        if (c->flags & REDIS_CLOSE_ASAP) continue;
+
+        server.current_client = c;
+        processInputBuffer(c);
+        server.current_client = NULL;
+    }
+
+    server.stat_io_reads_processed += processed;
+    return processed;
+}
@@ -43,8 +43,9 @@ robj *createObject(int type, void *ptr) {
     o->ptr = ptr;
     o->refcount = 1;
 
-    /* Set the LRU to the current lruclock (minutes resolution). */
-    o->lru = LRU_CLOCK();
+    /* Set the LRU to the current lruclock (minutes resolution), or
+     * alternatively the LFU counter. */
+    initObjectLRUOrLFU(o);
     return o;
 }
 
@@ -58,17 +59,18 @@ robj *createRawStringObject(char *ptr, size_t len) {
  * an object where the sds string is actually an unmodifiable string
  * allocated in the same chunk as the object itself. */
 robj *createEmbeddedStringObject(char *ptr, size_t len) {
-    robj *o = zmalloc(sizeof(robj)+sizeof(struct sdshdr)+len+1);
-    struct sdshdr *sh = (void*)(o+1);
+    robj *o = zmalloc(sizeof(robj)+sizeof(struct sdshdr8)+len+1);
+    struct sdshdr8 *sh = (void*)(o+1);
 
     o->type = REDIS_STRING;
     o->encoding = REDIS_ENCODING_EMBSTR;
     o->ptr = sh+1;
     o->refcount = 1;
-    o->lru = LRU_CLOCK();
+    initObjectLRUOrLFU(o);
 
     sh->len = len;
-    sh->free = 0;
+    sh->alloc = len;
+    sh->flags = SDS_TYPE_8;
     if (ptr) {
         memcpy(sh->buf,ptr,len);
         sh->buf[len] = '\0';
@@ -82,9 +84,11 @@ robj *createEmbeddedStringObject(char *ptr, size_t len) {
  * REIDS_ENCODING_EMBSTR_SIZE_LIMIT, otherwise the RAW encoding is
  * used.
  *
- * The current limit of 39 is chosen so that the biggest string object
- * we allocate as EMBSTR will still fit into the 64 byte arena of jemalloc. */
-#define REDIS_ENCODING_EMBSTR_SIZE_LIMIT 39
+ * The current limit of 44 is chosen so that the biggest string object
+ * we allocate as EMBSTR will still fit into the 64 byte arena of jemalloc:
+ * 16 bytes of robj, 3 bytes of sdshdr8, 44 bytes of string and the null
+ * term. */
+#define REDIS_ENCODING_EMBSTR_SIZE_LIMIT 44
 robj *createStringObject(char *ptr, size_t len) {
     if (len <= REDIS_ENCODING_EMBSTR_SIZE_LIMIT)
         return createEmbeddedStringObject(ptr,len);
@@ -180,11 +184,10 @@ robj *dupStringObject(robj *o) {
     }
 }
 
-robj *createListObject(void) {
-    list *l = listCreate();
+robj *createQuicklistObject(void) {
+    quicklist *l = quicklistCreate();
     robj *o = createObject(REDIS_LIST,l);
-    listSetFreeMethod(l,decrRefCountVoid);
-    o->encoding = REDIS_ENCODING_LINKEDLIST;
+    o->encoding = REDIS_ENCODING_QUICKLIST;
     return o;
 }
 
@@ -209,6 +212,13 @@ robj *createIntsetObject(void) {
     return o;
 }
 
+robj *createCtableSetObject(void) {
+    ctable *ct = ctableCreate(0);
+    robj *o = createObject(REDIS_SET,ct);
+    o->encoding = REDIS_ENCODING_CTABLE;
+    return o;
+}
+
 robj *createHashObject(void) {
     unsigned char *zl = ziplistNew();
     robj *o = createObject(REDIS_HASH, zl);
@@ -242,11 +252,8 @@ void freeStringObject(robj *o) {
 
 void freeListObject(robj *o) {
     switch (o->encoding) {
-    case REDIS_ENCODING_LINKEDLIST:
-        listRelease((list*) o->ptr);
-        break;
-    case REDIS_ENCODING_ZIPLIST:
-        zfree(o->ptr);
+    case REDIS_ENCODING_QUICKLIST:
+        quicklistRelease(o->ptr);
         break;
     default:
         redisPanic("Unknown list encoding type");
@@ -261,19 +268,18 @@ void freeSetObject(robj *o) {
     case REDIS_ENCODING_INTSET:
         zfree(o->ptr);
         break;
+    case REDIS_ENCODING_CTABLE:
+        ctableRelease(o->ptr);
+        break;
     default:
         redisPanic("Unknown set encoding type");
     }
 }
 
 void freeZsetObject(robj *o) {
-    zset *zs;
     switch (o->encoding) {
     case REDIS_ENCODING_SKIPLIST:
-        zs = o->ptr;
-        dictRelease(zs->dict);
-        zslFree(zs->zsl);
-        zfree(zs);
+        zsetFree(o->ptr);
         break;
     case REDIS_ENCODING_ZIPLIST:
         zfree(o->ptr);
@@ -291,14 +297,28 @@ void freeHashObject(robj *o) {
     case REDIS_ENCODING_ZIPLIST:
         zfree(o->ptr);
         break;
+    case REDIS_ENCODING_CTABLE:
+        ctableRelease(o->ptr);
+        break;
     default:
         redisPanic("Unknown hash encoding type");
         break;
     }
 }
 
+/* Make an object immortal: its reference count is set to
+ * REDIS_SHARED_REFCOUNT and never changes again, so the object can be
+ * referenced and released from any thread. This is the case of the shared
+ * integers, returned to the RDB loading threads by tryObjectEncoding() and
+ * found inside the values released by the lazy free thread. */
+robj *makeObjectShared(robj *o) {
+    redisAssert(o->refcount == 1);
+    o->refcount = REDIS_SHARED_REFCOUNT;
+    return o;
+}
+
 void incrRefCount(robj *o) {
-    o->refcount++;
+    if (o->refcount != REDIS_SHARED_REFCOUNT) o->refcount++;
 }
 
 void decrRefCount(robj *o) {
@@ -313,8 +333,17 @@ void decrRefCount(robj *o) {
         default: redisPanic("Unknown object type"); break;
         }
         zfree(o);
-    } else {
-        o->refcount--;
+    } else if (o->refcount != REDIS_SHARED_REFCOUNT) {
+        /* A value released by the lazy free thread references each of its
+         * elements once (see zsetFree() for sorted sets), so an element
+         * with other references is still reachable from the main thread,
+         * like a command argument also stored into another value or into
+         * the slow log: the thread never modifies it, and leaves the
+         * decrement to the main thread. */
+        if (lazyfree_thread)
+            lazyfreeDeferDecrRefCount(o);
+        else
+            o->refcount--;
     }
 }
 
@@ -393,7 +422,8 @@ robj *tryObjectEncoding(robj *o) {
          * algorithm to work well. */
         if ((server.maxmemory == 0 ||
              (server.maxmemory_policy != REDIS_MAXMEMORY_VOLATILE_LRU &&
-              server.maxmemory_policy != REDIS_MAXMEMORY_ALLKEYS_LRU)) &&
+              server.maxmemory_policy != REDIS_MAXMEMORY_ALLKEYS_LRU &&
+              !REDIS_MAXMEMORY_IS_LFU(server.maxmemory_policy))) &&
             value >= 0 &&
             value < REDIS_SHARED_INTEGERS)
         {
@@ -683,6 +713,8 @@ char *strEncoding(int encoding) {
     case REDIS_ENCODING_INTSET: return "intset";
     case REDIS_ENCODING_SKIPLIST: return "skiplist";
     case REDIS_ENCODING_EMBSTR: return "embstr";
+    case REDIS_ENCODING_QUICKLIST: return "quicklist";
+    case REDIS_ENCODING_CTABLE: return "ctable";
     default: return "unknown";
     }
 }
@@ -716,7 +748,7 @@ robj *objectCommandLookupOrReply(redisClient *c, robj *key, robj *reply) {
 }
 
 /* Object command allows to inspect the internals of an Redis Object.
- * Usage: OBJECT <refcount|encoding|idletime> <key> */
+ * Usage: OBJECT <refcount|encoding|idletime|freq> <key> */
 void objectCommand(redisClient *c) {
     robj *o;
 
@@ -731,9 +763,24 @@ void objectCommand(redisClient *c) {
     } else if (!strcasecmp(c->argv[1]->ptr,"idletime") && c->argc == 3) {
         if ((o = objectCommandLookupOrReply(c,c->argv[2],shared.nullbulk))
                 == NULL) return;
+        if (REDIS_MAXMEMORY_IS_LFU(server.maxmemory_policy)) {
+            addReplyError(c,"An LFU maxmemory policy is selected, idle time not tracked. Please note that when switching between policies at runtime LRU and LFU data will take some time to adjust.");
+            return;
+        }
         addReplyLongLong(c,estimateObjectIdleTime(o)/1000);
+    } else if (!strcasecmp(c->argv[1]->ptr,"freq") && c->argc == 3) {
+        if ((o = objectCommandLookupOrReply(c,c->argv[2],shared.nullbulk))
+                == NULL) return;
+        if (!REDIS_MAXMEMORY_IS_LFU(server.maxmemory_policy)) {
+            addReplyError(c,"An LFU maxmemory policy is not selected, access frequency not tracked. Please note that when switching between policies at runtime LRU and LFU data will take some time to adjust.");
+            return;
+        }
+        /* LFUDecrAndReturn should be called in case of the key has not
+         * been accessed for a long time, because we update the access
+         * time only when the key is read or overwritten. */
+        addReplyLongLong(c,LFUDecrAndReturn(o));
     } else {
-        addReplyError(c,"Syntax error. Try OBJECT (refcount|encoding|idletime)");
+        addReplyError(c,"Syntax error. Try OBJECT (refcount|encoding|idletime|freq)");
     }
 }
 
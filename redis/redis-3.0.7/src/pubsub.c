@@ -33,18 +33,214 @@
  * Pubsub low level API
  *----------------------------------------------------------------------------*/
 
-void freePubsubPattern(void *p) {
-    pubsubPattern *pat = p;
+/* Patterns subscriptions are indexed by a trie on the literal prefix of the
+ * pattern, so that PUBLISH only needs to match the channel against the
+ * patterns that could actually match it: the ones stored in the nodes found
+ * walking the trie with the channel name. Patterns starting with a glob
+ * special char are stored at the root, and are always tested.
+ *
+ * Every node maps its patterns to the list of subscribed clients, like
+ * server.pubsub_channels does for channels, so that the message for a
+ * given pattern is only created once regardless of the subscribers. */
+
+pubsubPatternNode *pubsubCreatePatternNode(char *label, size_t len) {
+    pubsubPatternNode *n = zmalloc(sizeof(*n));
+
+    n->label = sdsnewlen(label,len);
+    n->patterns = NULL;
+    n->numchildren = 0;
+    n->children = NULL;
+    return n;
+}
+
+static void pubsubFreePatternNode(pubsubPatternNode *n) {
+    sdsfree(n->label);
+    if (n->patterns) dictRelease(n->patterns);
+    zfree(n->children);
+    zfree(n);
+}
+
+/* Return the length of the literal prefix of 'pattern'. */
+static size_t pubsubPatternPrefixLen(sds pattern) {
+    return stringmatchPrefixLen(pattern,sdslen(pattern));
+}
+
+/* Return the index of the child of 'n' whose label starts with 'c', or the
+ * index where such a child should be inserted, setting *found to zero. */
+static int pubsubPatternChildIndex(pubsubPatternNode *n, unsigned char c,
+                                   int *found)
+{
+    int lo = 0, hi = (int)n->numchildren-1;
+
+    while (lo <= hi) {
+        int mid = (lo+hi)/2;
+        unsigned char m = n->children[mid]->label[0];
+
+        if (m == c) {
+            *found = 1;
+            return mid;
+        } else if (m < c) {
+            lo = mid+1;
+        } else {
+            hi = mid-1;
+        }
+    }
+    *found = 0;
+    return lo;
+}
 
-    decrRefCount(pat->pattern);
-    zfree(pat);
+/* Return the child of 'n' reached consuming the start of s[0..len-1], or
+ * NULL if there is none. The index of the child is stored in *idx. */
+static pubsubPatternNode *pubsubPatternNextNode(pubsubPatternNode *n,
+                                               char *s, size_t len, int *idx)
+{
+    pubsubPatternNode *child;
+    int found;
+
+    if (len == 0) return NULL;
+    *idx = pubsubPatternChildIndex(n,s[0],&found);
+    if (!found) return NULL;
+    child = n->children[*idx];
+    if (sdslen(child->label) > len ||
+        memcmp(child->label,s,sdslen(child->label)) != 0) return NULL;
+    return child;
 }
 
-int listMatchPubsubPattern(void *a, void *b) {
-    pubsubPattern *pa = a, *pb = b;
+/* Return the node of the trie for the literal prefix p[0..len-1], creating
+ * it if needed. */
+static pubsubPatternNode *pubsubPatternNodeForPrefix(char *p, size_t len) {
+    pubsubPatternNode *n = server.pubsub_patterns, *child;
+    size_t i = 0;
+
+    while (i < len) {
+        size_t llen, common = 1;
+        int idx, found;
+
+        idx = pubsubPatternChildIndex(n,p[i],&found);
+        if (!found) {
+            child = pubsubCreatePatternNode(p+i,len-i);
+            n->children = zrealloc(n->children,
+                                   sizeof(child)*(n->numchildren+1));
+            memmove(n->children+idx+1,n->children+idx,
+                    sizeof(child)*(n->numchildren-idx));
+            n->children[idx] = child;
+            n->numchildren++;
+            return child;
+        }
 
-    return (pa->client == pb->client) &&
-           (equalStringObjects(pa->pattern,pb->pattern));
+        child = n->children[idx];
+        llen = sdslen(child->label);
+        while (common < llen && i+common < len &&
+               child->label[common] == p[i+common]) common++;
+        if (common < llen) {
+            /* The prefix diverges from the label, or ends, in the middle of
+             * the edge: split it adding an intermediate node. */
+            pubsubPatternNode *mid;
+
+            mid = pubsubCreatePatternNode(child->label,common);
+            sdsrange(child->label,common,-1);
+            mid->children = zmalloc(sizeof(child));
+            mid->children[0] = child;
+            mid->numchildren = 1;
+            n->children[idx] = mid;
+            child = mid;
+        }
+        n = child;
+        i += common;
+    }
+    return n;
+}
+
+/* Remove from 'parent' the child at 'idx' if it is no longer needed, or
+ * merge it with its only child, to keep the trie compressed. */
+static void pubsubPatternCompactNode(pubsubPatternNode *parent, int idx) {
+    pubsubPatternNode *n = parent->children[idx];
+
+    if (n->patterns) return;
+    if (n->numchildren == 0) {
+        memmove(parent->children+idx,parent->children+idx+1,
+                sizeof(n)*(parent->numchildren-idx-1));
+        parent->numchildren--;
+        if (parent->numchildren == 0) {
+            zfree(parent->children);
+            parent->children = NULL;
+        }
+        pubsubFreePatternNode(n);
+    } else if (n->numchildren == 1) {
+        pubsubPatternNode *child = n->children[0];
+
+        n->label = sdscatsds(n->label,child->label);
+        sdsfree(child->label);
+        child->label = n->label;
+        n->label = NULL;
+        parent->children[idx] = child;
+        pubsubFreePatternNode(n);
+    }
+}
+
+/* Add client 'c' to the subscribers of 'pattern' in the trie. */
+static void pubsubPatternTrieAdd(robj *pattern, redisClient *c) {
+    pubsubPatternNode *n;
+    dictEntry *de;
+    list *clients;
+
+    n = pubsubPatternNodeForPrefix(pattern->ptr,
+                                   pubsubPatternPrefixLen(pattern->ptr));
+    if (n->patterns == NULL) n->patterns = dictCreate(&keylistDictType,NULL);
+    de = dictFind(n->patterns,pattern);
+    if (de == NULL) {
+        clients = listCreate();
+        dictAdd(n->patterns,pattern,clients);
+        incrRefCount(pattern);
+    } else {
+        clients = dictGetVal(de);
+    }
+    listAddNodeTail(clients,c);
+    server.pubsub_numpat++;
+}
+
+/* Remove client 'c' from the subscribers of 'pattern' in the trie, that
+ * must exist, releasing the nodes no longer needed. */
+static void pubsubPatternTrieDel(robj *pattern, redisClient *c) {
+    pubsubPatternNode *n = server.pubsub_patterns, *parent = NULL;
+    pubsubPatternNode *grandparent = NULL;
+    int idx = 0, parentidx = 0;
+    size_t i = 0, len = pubsubPatternPrefixLen(pattern->ptr);
+    char *p = pattern->ptr;
+    dictEntry *de;
+    list *clients;
+    listNode *ln;
+
+    while (i < len) {
+        grandparent = parent;
+        parentidx = idx;
+        parent = n;
+        n = pubsubPatternNextNode(n,p+i,len-i,&idx);
+        redisAssert(n != NULL);
+        i += sdslen(n->label);
+    }
+
+    redisAssert(n->patterns != NULL);
+    de = dictFind(n->patterns,pattern);
+    redisAssert(de != NULL);
+    clients = dictGetVal(de);
+    ln = listSearchKey(clients,c);
+    redisAssert(ln != NULL);
+    listDelNode(clients,ln);
+    server.pubsub_numpat--;
+    if (listLength(clients) != 0) return;
+
+    dictDelete(n->patterns,pattern);
+    if (dictSize(n->patterns) != 0) return;
+    dictRelease(n->patterns);
+    n->patterns = NULL;
+
+    /* The root is never removed. Otherwise removing the node may leave its
+     * parent with a single child and no patterns, so it is the parent that
+     * may need to be merged in turn. */
+    if (parent == NULL) return;
+    pubsubPatternCompactNode(parent,idx);
+    if (grandparent) pubsubPatternCompactNode(grandparent,parentidx);
 }
 
 /* Return the number of channels + patterns a client is subscribed to. */
@@ -128,14 +324,13 @@ int pubsubSubscribePattern(redisClient *c, robj *pattern) {
     int retval = 0;
 
     if (listSearchKey(c->pubsub_patterns,pattern) == NULL) {
+        robj *decoded = getDecodedObject(pattern);
+
         retval = 1;
-        pubsubPattern *pat;
         listAddNodeTail(c->pubsub_patterns,pattern);
         incrRefCount(pattern);
-        pat = zmalloc(sizeof(*pat));
-        pat->pattern = getDecodedObject(pattern);
-        pat->client = c;
-        listAddNodeTail(server.pubsub_patterns,pat);
+        pubsubPatternTrieAdd(decoded,c);
+        decrRefCount(decoded);
     }
     /* Notify the client */
     addReply(c,shared.mbulkhdr[3]);
@@ -149,17 +344,16 @@ int pubsubSubscribePattern(redisClient *c, robj *pattern) {
  * 0 if the client was not subscribed to the specified channel. */
 int pubsubUnsubscribePattern(redisClient *c, robj *pattern, int notify) {
     listNode *ln;
-    pubsubPattern pat;
     int retval = 0;
 
     incrRefCount(pattern); /* Protect the object. May be the same we remove */
     if ((ln = listSearchKey(c->pubsub_patterns,pattern)) != NULL) {
+        robj *decoded = getDecodedObject(pattern);
+
         retval = 1;
         listDelNode(c->pubsub_patterns,ln);
-        pat.client = c;
-        pat.pattern = pattern;
-        ln = listSearchKey(server.pubsub_patterns,&pat);
-        listDelNode(server.pubsub_patterns,ln);
+        pubsubPatternTrieDel(decoded,c);
+        decrRefCount(decoded);
     }
     /* Notify the client */
     if (notify) {
@@ -221,52 +415,94 @@ int pubsubUnsubscribeAllPatterns(redisClient *c, int notify) {
     return count;
 }
 
-/* Publish a message */
+/* Send the already serialized message 'msg' to all the clients of the
+ * list. Return the number of clients. */
+static int pubsubSendToClients(list *clients, sds msg) {
+    listNode *ln;
+    listIter li;
+
+    listRewind(clients,&li);
+    while ((ln = listNext(&li)) != NULL) {
+        redisClient *c = ln->value;
+
+        addReplyString(c,msg,sdslen(msg));
+    }
+    return listLength(clients);
+}
+
+/* Send the message to the clients subscribed to the patterns of 'patterns'
+ * matching 'channel'. 'tail' is the serialized channel and message, that
+ * are the same for every pattern. */
+static int pubsubSendToPatterns(dict *patterns, robj *channel, sds tail) {
+    dictIterator *di = dictGetIterator(patterns);
+    dictEntry *de;
+    int receivers = 0;
+
+    while ((de = dictNext(di)) != NULL) {
+        robj *pattern = dictGetKey(de);
+        sds msg;
+
+        if (!stringmatchlen((char*)pattern->ptr,sdslen(pattern->ptr),
+                            (char*)channel->ptr,sdslen(channel->ptr),0))
+            continue;
+        msg = sdscatprintf(sdsempty(),"*4\r\n$8\r\npmessage\r\n$%zu\r\n",
+                           sdslen(pattern->ptr));
+        msg = sdscatlen(msg,pattern->ptr,sdslen(pattern->ptr));
+        msg = sdscatlen(msg,"\r\n",2);
+        msg = sdscatsds(msg,tail);
+        receivers += pubsubSendToClients(dictGetVal(de),msg);
+        sdsfree(msg);
+    }
+    dictReleaseIterator(di);
+    return receivers;
+}
+
+/* Append the protocol for the bulk string 'o' to 's'. */
+static sds pubsubCatBulk(sds s, robj *o) {
+    s = sdscatprintf(s,"$%zu\r\n",sdslen(o->ptr));
+    s = sdscatlen(s,o->ptr,sdslen(o->ptr));
+    return sdscatlen(s,"\r\n",2);
+}
+
+/* Publish a message. The message is serialized only once, and then copied
+ * in the output buffer of every subscriber. */
 int pubsubPublishMessage(robj *channel, robj *message) {
     int receivers = 0;
     dictEntry *de;
-    listNode *ln;
-    listIter li;
+    sds tail;
+
+    channel = getDecodedObject(channel);
+    message = getDecodedObject(message);
+    tail = pubsubCatBulk(sdsempty(),channel);
+    tail = pubsubCatBulk(tail,message);
 
     /* Send to clients listening for that channel */
     de = dictFind(server.pubsub_channels,channel);
     if (de) {
-        list *list = dictGetVal(de);
-        listNode *ln;
-        listIter li;
-
-        listRewind(list,&li);
-        while ((ln = listNext(&li)) != NULL) {
-            redisClient *c = ln->value;
-
-            addReply(c,shared.mbulkhdr[3]);
-            addReply(c,shared.messagebulk);
-            addReplyBulk(c,channel);
-            addReplyBulk(c,message);
-            receivers++;
-        }
+        sds msg = sdsnew("*3\r\n$7\r\nmessage\r\n");
+
+        msg = sdscatsds(msg,tail);
+        receivers += pubsubSendToClients(dictGetVal(de),msg);
+        sdsfree(msg);
     }
-    /* Send to clients listening to matching channels */
-    if (listLength(server.pubsub_patterns)) {
-        listRewind(server.pubsub_patterns,&li);
-        channel = getDecodedObject(channel);
-        while ((ln = listNext(&li)) != NULL) {
-            pubsubPattern *pat = ln->value;
-
-            if (stringmatchlen((char*)pat->pattern->ptr,
-                                sdslen(pat->pattern->ptr),
-                                (char*)channel->ptr,
-                                sdslen(channel->ptr),0)) {
-                addReply(pat->client,shared.mbulkhdr[4]);
-                addReply(pat->client,shared.pmessagebulk);
-                addReplyBulk(pat->client,pat->pattern);
-                addReplyBulk(pat->client,channel);
-                addReplyBulk(pat->client,message);
-                receivers++;
-            }
+    /* Send to clients listening to matching channels: only the patterns
+     * whose literal prefix is a prefix of the channel can match it. */
+    if (server.pubsub_numpat) {
+        pubsubPatternNode *n = server.pubsub_patterns;
+        char *p = channel->ptr;
+        size_t i = 0, len = sdslen(channel->ptr);
+        int idx;
+
+        while (n) {
+            if (n->patterns)
+                receivers += pubsubSendToPatterns(n->patterns,channel,tail);
+            n = pubsubPatternNextNode(n,p+i,len-i,&idx);
+            if (n) i += sdslen(n->label);
         }
-        decrRefCount(channel);
     }
+    sdsfree(tail);
+    decrRefCount(channel);
+    decrRefCount(message);
     return receivers;
 }
 
@@ -362,7 +598,7 @@ void pubsubCommand(redisClient *c) {
         }
     } else if (!strcasecmp(c->argv[1]->ptr,"numpat") && c->argc == 2) {
         /* PUBSUB NUMPAT */
-        addReplyLongLong(c,listLength(server.pubsub_patterns));
+        addReplyLongLong(c,server.pubsub_numpat);
     } else {
         addReplyErrorFormat(c,
             "Unknown PUBSUB subcommand or wrong number of arguments for '%s'",
@@ -209,41 +209,47 @@ int rdbTryIntegerEncoding(char *s, size_t len, unsigned char *enc) {
     return rdbEncodeInteger(value,enc);
 }
 
-int rdbSaveLzfStringObject(rio *rdb, unsigned char *s, size_t len) {
-    size_t comprlen, outlen;
+/* Save an already LZF compressed blob of 'compress_len' bytes, that
+ * decompresses to 'original_len' bytes, as an LZF encoded string. */
+int rdbSaveLzfBlob(rio *rdb, void *data, size_t compress_len,
+                   size_t original_len) {
     unsigned char byte;
     int n, nwritten = 0;
-    void *out;
 
-    /* We require at least four bytes compression for this to be worth it */
-    if (len <= 4) return 0;
-    outlen = len-4;
-    if ((out = zmalloc(outlen+1)) == NULL) return 0;
-    comprlen = lzf_compress(s, len, out, outlen);
-    if (comprlen == 0) {
-        zfree(out);
-        return 0;
-    }
     /* Data compressed! Let's save it on disk */
     byte = (REDIS_RDB_ENCVAL<<6)|REDIS_RDB_ENC_LZF;
-    if ((n = rdbWriteRaw(rdb,&byte,1)) == -1) goto writeerr;
+    if ((n = rdbWriteRaw(rdb,&byte,1)) == -1) return -1;
     nwritten += n;
 
-    if ((n = rdbSaveLen(rdb,comprlen)) == -1) goto writeerr;
+    if ((n = rdbSaveLen(rdb,compress_len)) == -1) return -1;
     nwritten += n;
 
-    if ((n = rdbSaveLen(rdb,len)) == -1) goto writeerr;
+    if ((n = rdbSaveLen(rdb,original_len)) == -1) return -1;
     nwritten += n;
 
-    if ((n = rdbWriteRaw(rdb,out,comprlen)) == -1) goto writeerr;
+    if ((n = rdbWriteRaw(rdb,data,compress_len)) == -1) return -1;
     nwritten += n;
 
-    zfree(out);
     return nwritten;
+}
 
-writeerr:
+int rdbSaveLzfStringObject(rio *rdb, unsigned char *s, size_t len) {
+    size_t comprlen, outlen;
+    int nwritten;
+    void *out;
+
+    /* We require at least four bytes compression for this to be worth it */
+    if (len <= 4) return 0;
+    outlen = len-4;
+    if ((out = zmalloc(outlen+1)) == NULL) return 0;
+    comprlen = lzf_compress(s, len, out, outlen);
+    if (comprlen == 0) {
+        zfree(out);
+        return 0;
+    }
+    nwritten = rdbSaveLzfBlob(rdb,out,comprlen,len);
     zfree(out);
-    return -1;
+    return nwritten;
 }
 
 robj *rdbLoadLzfStringObject(rio *rdb) {
@@ -433,16 +439,15 @@ int rdbSaveObjectType(rio *rdb, robj *o) {
     case REDIS_STRING:
         return rdbSaveType(rdb,REDIS_RDB_TYPE_STRING);
     case REDIS_LIST:
-        if (o->encoding == REDIS_ENCODING_ZIPLIST)
-            return rdbSaveType(rdb,REDIS_RDB_TYPE_LIST_ZIPLIST);
-        else if (o->encoding == REDIS_ENCODING_LINKEDLIST)
-            return rdbSaveType(rdb,REDIS_RDB_TYPE_LIST);
+        if (o->encoding == REDIS_ENCODING_QUICKLIST)
+            return rdbSaveType(rdb,REDIS_RDB_TYPE_LIST_QUICKLIST);
         else
             redisPanic("Unknown list encoding");
     case REDIS_SET:
         if (o->encoding == REDIS_ENCODING_INTSET)
             return rdbSaveType(rdb,REDIS_RDB_TYPE_SET_INTSET);
-        else if (o->encoding == REDIS_ENCODING_HT)
+        else if (o->encoding == REDIS_ENCODING_HT ||
+                 o->encoding == REDIS_ENCODING_CTABLE)
             return rdbSaveType(rdb,REDIS_RDB_TYPE_SET);
         else
             redisPanic("Unknown set encoding");
@@ -456,7 +461,8 @@ int rdbSaveObjectType(rio *rdb, robj *o) {
     case REDIS_HASH:
         if (o->encoding == REDIS_ENCODING_ZIPLIST)
             return rdbSaveType(rdb,REDIS_RDB_TYPE_HASH_ZIPLIST);
-        else if (o->encoding == REDIS_ENCODING_HT)
+        else if (o->encoding == REDIS_ENCODING_HT ||
+                 o->encoding == REDIS_ENCODING_CTABLE)
             return rdbSaveType(rdb,REDIS_RDB_TYPE_HASH);
         else
             redisPanic("Unknown hash encoding");
@@ -484,25 +490,27 @@ int rdbSaveObject(rio *rdb, robj *o) {
         if ((n = rdbSaveStringObject(rdb,o)) == -1) return -1;
         nwritten += n;
     } else if (o->type == REDIS_LIST) {
-        /* Save a list value */
-        if (o->encoding == REDIS_ENCODING_ZIPLIST) {
-            size_t l = ziplistBlobLen((unsigned char*)o->ptr);
-
-            if ((n = rdbSaveRawString(rdb,o->ptr,l)) == -1) return -1;
+        /* Save a list value: the number of nodes, then every node ziplist
+         * as a string. Compressed nodes are saved as they are in memory,
+         * as LZF encoded strings, with no need to decompress them. */
+        if (o->encoding == REDIS_ENCODING_QUICKLIST) {
+            quicklist *ql = o->ptr;
+            quicklistNode *node = ql->head;
+
+            if ((n = rdbSaveLen(rdb,ql->len)) == -1) return -1;
             nwritten += n;
-        } else if (o->encoding == REDIS_ENCODING_LINKEDLIST) {
-            list *list = o->ptr;
-            listIter li;
-            listNode *ln;
 
-            if ((n = rdbSaveLen(rdb,listLength(list))) == -1) return -1;
-            nwritten += n;
-
-            listRewind(list,&li);
-            while((ln = listNext(&li))) {
-                robj *eleobj = listNodeValue(ln);
-                if ((n = rdbSaveStringObject(rdb,eleobj)) == -1) return -1;
-                nwritten += n;
+            while(node) {
+                if (quicklistNodeIsCompressed(node)) {
+                    void *data;
+                    size_t compress_len = quicklistGetLzf(node, &data);
+                    if ((n = rdbSaveLzfBlob(rdb,data,compress_len,node->sz)) == -1) return -1;
+                    nwritten += n;
+                } else {
+                    if ((n = rdbSaveRawString(rdb,node->zl,node->sz)) == -1) return -1;
+                    nwritten += n;
+                }
+                node = node->next;
             }
         } else {
             redisPanic("Unknown list encoding");
@@ -523,6 +531,19 @@ int rdbSaveObject(rio *rdb, robj *o) {
                 nwritten += n;
             }
             dictReleaseIterator(di);
+        } else if (o->encoding == REDIS_ENCODING_CTABLE) {
+            ctable *ct = o->ptr;
+            unsigned long pos = 0;
+            sds ele;
+
+            if ((n = rdbSaveLen(rdb,ctableLen(ct))) == -1) return -1;
+            nwritten += n;
+
+            while((ele = ctableNext(ct,&pos)) != NULL) {
+                if ((n = rdbSaveRawString(rdb,(unsigned char*)ele,
+                                          sdslen(ele))) == -1) return -1;
+                nwritten += n;
+            }
         } else if (o->encoding == REDIS_ENCODING_INTSET) {
             size_t l = intsetBlobLen((intset*)o->ptr);
 
@@ -585,6 +606,26 @@ int rdbSaveObject(rio *rdb, robj *o) {
             }
             dictReleaseIterator(di);
 
+        } else if (o->encoding == REDIS_ENCODING_CTABLE) {
+            ctable *ct = o->ptr;
+            unsigned long pos = 0;
+            sds field;
+
+            if ((n = rdbSaveLen(rdb,ctableLen(ct))) == -1) return -1;
+            nwritten += n;
+
+            while((field = ctableNext(ct,&pos)) != NULL) {
+                size_t vlen;
+                char *val = ctableEntryValue(field,&vlen);
+
+                if ((n = rdbSaveRawString(rdb,(unsigned char*)field,
+                                          sdslen(field))) == -1) return -1;
+                nwritten += n;
+                if ((n = rdbSaveRawString(rdb,(unsigned char*)val,
+                                          vlen)) == -1) return -1;
+                nwritten += n;
+            }
+
         } else {
             redisPanic("Unknown hash encoding");
         }
@@ -634,14 +675,19 @@ int rdbSaveKeyValuePair(rio *rdb, robj *key, robj *val,
  *
  * When the function returns REDIS_ERR and if 'error' is not NULL, the
  * integer pointed by 'error' is set to the value of errno just after the I/O
- * error. */
-int rdbSaveRio(rio *rdb, int *error) {
+ * error.
+ *
+ * When REDIS_RDB_SAVE_AOF_PREAMBLE is set in 'flags' the dump is the base
+ * section of an AOF rewrite, so from time to time we read the accumulated
+ * diff from the parent, exactly like the plain AOF rewrite loop does. */
+int rdbSaveRio(rio *rdb, int *error, int flags) {
     dictIterator *di = NULL;
     dictEntry *de;
     char magic[10];
     int j;
     long long now = mstime();
     uint64_t cksum;
+    size_t processed = 0;
 
     if (server.rdb_checksum)
         rdb->update_cksum = rioGenericUpdateChecksum;
@@ -668,6 +714,14 @@ int rdbSaveRio(rio *rdb, int *error) {
             initStaticStringObject(key,keystr);
             expire = getExpire(db,&key);
             if (rdbSaveKeyValuePair(rdb,&key,o,expire,now) == -1) goto werr;
+
+            if (flags & REDIS_RDB_SAVE_AOF_PREAMBLE &&
+                rdb->processed_bytes >
+                    processed+REDIS_AOF_READ_DIFF_INTERVAL_BYTES)
+            {
+                processed = rdb->processed_bytes;
+                aofReadDiffFromParent();
+            }
         }
         dictReleaseIterator(di);
     }
@@ -705,7 +759,7 @@ int rdbSaveRioWithEOFMark(rio *rdb, int *error) {
     if (rioWrite(rdb,"$EOF:",5) == 0) goto werr;
     if (rioWrite(rdb,eofmark,REDIS_EOF_MARK_SIZE) == 0) goto werr;
     if (rioWrite(rdb,"\r\n",2) == 0) goto werr;
-    if (rdbSaveRio(rdb,error) == REDIS_ERR) goto werr;
+    if (rdbSaveRio(rdb,error,REDIS_RDB_SAVE_NONE) == REDIS_ERR) goto werr;
     if (rioWrite(rdb,eofmark,REDIS_EOF_MARK_SIZE) == 0) goto werr;
     return REDIS_OK;
 
@@ -731,7 +785,7 @@ int rdbSave(char *filename) {
     }
 
     rioInitWithFile(&rdb,fp);
-    if (rdbSaveRio(&rdb,&error) == REDIS_ERR) {
+    if (rdbSaveRio(&rdb,&error,REDIS_RDB_SAVE_NONE) == REDIS_ERR) {
         errno = error;
         goto werr;
     }
@@ -761,15 +815,297 @@ werr:
     return REDIS_ERR;
 }
 
+/*-----------------------------------------------------------------------------
+ * Forkless background saving
+ *
+ * When rdb-forkless is enabled BGSAVE does not fork a child: the snapshot is
+ * instead produced by the server itself, a small slice of work at a time
+ * from a timer, while clients continue to be served. This avoids both the
+ * fork() latency and the copy-on-write memory overhead of huge instances,
+ * at the cost of a slower save. The output is a standard RDB file, so
+ * everything using BGSAVE (save points, replication) works unmodified.
+ *
+ * Every DB is visited with dictScan(). Since the scan cursor progresses
+ * in reversed bits order, whatever happens to the table, a key hashing to
+ * 'h' was already saved if dictScanVisited(cursor,h) is true (or if the
+ * key belongs to a DB already scanned), and will be saved by the scan
+ * later otherwise. To obtain a point-in-time snapshot we do copy before
+ * write: just before a key that the scan did not reach yet is modified or
+ * deleted, its old value is saved ahead of time and the key is put in the
+ * 'saved' set, so that the scan skips it once reached. Keys created after
+ * the save started are added to the same set, since they must never be
+ * part of the snapshot. The set only holds keys beyond the cursor: the
+ * scan removes every key it passes, so memory usage is proportional to
+ * the number of keys written during the save, not to the dataset size.
+ *
+ * Keys in the RDB file are thus not grouped by DB: a SELECTDB opcode is
+ * emitted every time the DB changes, that the loader handles just fine.
+ *----------------------------------------------------------------------------*/
+
+struct rdbForklessState {
+    FILE *fp;                   /* Temp file we are writing. */
+    rio rdb;                    /* rio writing to 'fp'. */
+    char tmpfile[256];          /* Temp file name. */
+    sds filename;               /* Final name of the RDB file. */
+    int dbid;                   /* DB being scanned. */
+    unsigned long cursor;       /* dictScan() cursor inside 'dbid'. */
+    int selected_db;            /* DB of the last key written, or -1. */
+    dict *saved;                /* Keys not to save when reached by scan. */
+    long long now;              /* Snapshot time, to skip expired keys. */
+    int error;                  /* errno of the first write error, or 0. */
+    int cancelled;              /* rdbForklessCancel() was called. */
+};
+
+static struct rdbForklessState *forkless = NULL;
+
+/* Return true if the snapshot is still accepting keys. */
+static int rdbForklessActive(void) {
+    return server.rdb_forkless_in_progress &&
+           !forkless->cancelled && !forkless->error;
+}
+
+/* Return true if the scan already went past 'keystr' in 'db'. */
+static int rdbForklessKeyVisited(redisDb *db, sds keystr) {
+    if (db->id < forkless->dbid) return 1;
+    if (db->id > forkless->dbid) return 0;
+    return dictScanVisited(forkless->cursor,dictHashKey(db->dict,keystr));
+}
+
+/* Append the key with its current value and expire to the snapshot. */
+static void rdbForklessSaveKey(redisDb *db, sds keystr, robj *val) {
+    robj key;
+    long long expire;
+
+    initStaticStringObject(key,keystr);
+    expire = getExpire(db,&key);
+    if (forkless->selected_db != db->id) {
+        if (rdbSaveType(&forkless->rdb,REDIS_RDB_OPCODE_SELECTDB) == -1)
+            goto werr;
+        if (rdbSaveLen(&forkless->rdb,db->id) == -1) goto werr;
+        forkless->selected_db = db->id;
+    }
+    if (rdbSaveKeyValuePair(&forkless->rdb,&key,val,expire,
+                            forkless->now) == -1) goto werr;
+    return;
+
+werr:
+    forkless->error = errno ? errno : EIO;
+}
+
+static void rdbForklessScanCallback(void *privdata, const dictEntry *de) {
+    redisDb *db = privdata;
+    sds keystr = dictGetKey(de);
+
+    if (forkless->error) return;
+    /* Already emitted by a previous call: dictScan() may return the same
+     * element multiple times if the table shrinks. */
+    if (dictScanVisited(forkless->cursor,dictHashKey(db->dict,keystr)))
+        return;
+    /* Saved by a write hook, or created after the save started. */
+    if (dictSize(forkless->saved) &&
+        dictDelete(forkless->saved,keystr) == DICT_OK) return;
+    rdbForklessSaveKey(db,keystr,dictGetVal(de));
+}
+
+/* Called before the value or the expire of 'key' is modified, or before
+ * the key is deleted if 'deleted' is true, while a forkless BGSAVE is in
+ * progress: if the scan did not reach the key yet, the value it had when
+ * the save started is written now. */
+void rdbForklessTouchKey(redisDb *db, robj *key, int deleted) {
+    dictEntry *de;
+    sds keystr;
+
+    if (!rdbForklessActive()) return;
+    if ((de = dictFind(db->dict,key->ptr)) == NULL) return;
+    keystr = dictGetKey(de);
+    if (rdbForklessKeyVisited(db,keystr)) return;
+
+    if (deleted) {
+        /* The sds is about to be released: it can't stay in the set. */
+        if (dictDelete(forkless->saved,keystr) == DICT_OK) return;
+        rdbForklessSaveKey(db,keystr,dictGetVal(de));
+    } else if (dictAdd(forkless->saved,keystr,NULL) == DICT_OK) {
+        rdbForklessSaveKey(db,keystr,dictGetVal(de));
+    }
+}
+
+/* Called when a new key is added to 'db' while a forkless BGSAVE is in
+ * progress, so that the scan will not include it in the snapshot. */
+void rdbForklessAddKey(redisDb *db, sds keystr) {
+    if (!rdbForklessActive()) return;
+    if (!rdbForklessKeyVisited(db,keystr))
+        dictAdd(forkless->saved,keystr,NULL);
+}
+
+/* Stop the forkless BGSAVE in progress, if any, removing its temp file.
+ * This is the equivalent of killing the saving child: it is used when
+ * the dataset is flushed, since there is no longer a way to complete the
+ * snapshot, and on shutdown. Slaves waiting for the BGSAVE are handled at
+ * the next timer call, as it happens when a child terminates. */
+void rdbForklessCancel(void) {
+    if (!server.rdb_forkless_in_progress || forkless->cancelled) return;
+    forkless->cancelled = 1;
+    if (forkless->fp) {
+        fclose(forkless->fp);
+        forkless->fp = NULL;
+        unlink(forkless->tmpfile);
+    }
+}
+
+/* Write the trailer of the RDB file and move it to its final name. */
+static int rdbForklessFinish(void) {
+    uint64_t cksum;
+    FILE *fp = forkless->fp;
+
+    if (rdbSaveType(&forkless->rdb,REDIS_RDB_OPCODE_EOF) == -1) goto werr;
+    cksum = forkless->rdb.cksum;
+    memrev64ifbe(&cksum);
+    if (rioWrite(&forkless->rdb,&cksum,8) == 0) goto werr;
+
+    if (fflush(fp) == EOF) goto werr;
+    if (fsync(fileno(fp)) == -1) goto werr;
+    forkless->fp = NULL;
+    if (fclose(fp) == EOF) goto werr;
+    if (rename(forkless->tmpfile,forkless->filename) == -1) {
+        redisLog(REDIS_WARNING,"Error moving temp DB file on the final destination: %s", strerror(errno));
+        unlink(forkless->tmpfile);
+        forkless->error = errno;
+        return REDIS_ERR;
+    }
+    return REDIS_OK;
+
+werr:
+    forkless->error = errno ? errno : EIO;
+    return REDIS_ERR;
+}
+
+/* Terminate the forkless BGSAVE, like backgroundSaveDoneHandlerDisk() does
+ * when the saving child exits. */
+static void rdbForklessDone(void) {
+    int ok = !forkless->cancelled && !forkless->error;
+
+    if (ok) {
+        redisLog(REDIS_NOTICE,
+            "Background saving terminated with success");
+        server.dirty = server.dirty - server.dirty_before_bgsave;
+        server.lastsave = time(NULL);
+        server.lastbgsave_status = REDIS_OK;
+    } else if (forkless->error) {
+        redisLog(REDIS_WARNING,"Background saving error: %s",
+            strerror(forkless->error));
+        server.lastbgsave_status = REDIS_ERR;
+    } else {
+        redisLog(REDIS_WARNING,"Background saving cancelled");
+    }
+    if (forkless->fp) {
+        fclose(forkless->fp);
+        unlink(forkless->tmpfile);
+    }
+    dictRelease(forkless->saved);
+    sdsfree(forkless->filename);
+    zfree(forkless);
+    forkless = NULL;
+
+    server.rdb_forkless_in_progress = 0;
+    server.rdb_child_type = REDIS_RDB_CHILD_TYPE_NONE;
+    server.rdb_save_time_last = time(NULL)-server.rdb_save_time_start;
+    server.rdb_save_time_start = -1;
+    updateSlavesWaitingBgsave(ok ? REDIS_OK : REDIS_ERR,
+                              REDIS_RDB_CHILD_TYPE_DISK);
+}
+
+/* Timer performing the forkless BGSAVE for up to
+ * REDIS_RDB_FORKLESS_SLICE_US microseconds every millisecond. */
+static int rdbForklessTimeProc(struct aeEventLoop *eventLoop, long long id,
+                               void *clientData)
+{
+    long long start = ustime();
+    int iterations = 0;
+    REDIS_NOTUSED(eventLoop);
+    REDIS_NOTUSED(id);
+    REDIS_NOTUSED(clientData);
+
+    while (rdbForklessActive() && forkless->dbid < server.dbnum) {
+        redisDb *db = server.db+forkless->dbid;
+
+        forkless->cursor = dictScan(db->dict,forkless->cursor,
+                                    rdbForklessScanCallback,db);
+        if (forkless->cursor == 0) {
+            forkless->dbid++;
+        } else if ((++iterations & 15) == 0 &&
+                   ustime()-start > REDIS_RDB_FORKLESS_SLICE_US)
+        {
+            return 1;
+        }
+    }
+    if (rdbForklessActive()) rdbForklessFinish();
+    rdbForklessDone();
+    return AE_NOMORE;
+}
+
+/* BGSAVE implementation used when rdb-forkless is enabled. */
+static int rdbSaveBackgroundForkless(char *filename) {
+    char magic[10];
+
+    forkless = zcalloc(sizeof(*forkless));
+    snprintf(forkless->tmpfile,sizeof(forkless->tmpfile),
+        "temp-forkless-%d.rdb", (int) getpid());
+    forkless->fp = fopen(forkless->tmpfile,"w");
+    if (!forkless->fp) {
+        redisLog(REDIS_WARNING,"Failed opening .rdb for saving: %s",
+            strerror(errno));
+        goto err;
+    }
+    rioInitWithFile(&forkless->rdb,forkless->fp);
+    rioSetAutoSync(&forkless->rdb,REDIS_AOF_AUTOSYNC_BYTES);
+    if (server.rdb_checksum)
+        forkless->rdb.update_cksum = rioGenericUpdateChecksum;
+    snprintf(magic,sizeof(magic),"REDIS%04d",REDIS_RDB_VERSION);
+    if (rdbWriteRaw(&forkless->rdb,magic,9) == -1) {
+        redisLog(REDIS_WARNING,"Write error saving DB on disk: %s",
+            strerror(errno));
+        goto err;
+    }
+    if (aeCreateTimeEvent(server.el,1,rdbForklessTimeProc,NULL,NULL) ==
+        AE_ERR)
+    {
+        redisLog(REDIS_WARNING,"Can't create the forkless BGSAVE timer");
+        goto err;
+    }
+    forkless->filename = sdsnew(filename);
+    forkless->selected_db = -1;
+    forkless->saved = dictCreate(&rdbForklessKeysDictType,NULL);
+    forkless->now = mstime();
+
+    redisLog(REDIS_NOTICE,"Background saving started without fork");
+    server.rdb_save_time_start = time(NULL);
+    server.rdb_forkless_in_progress = 1;
+    server.rdb_child_type = REDIS_RDB_CHILD_TYPE_DISK;
+    return REDIS_OK;
+
+err:
+    if (forkless->fp) {
+        fclose(forkless->fp);
+        unlink(forkless->tmpfile);
+    }
+    zfree(forkless);
+    forkless = NULL;
+    server.lastbgsave_status = REDIS_ERR;
+    return REDIS_ERR;
+}
+
 int rdbSaveBackground(char *filename) {
     pid_t childpid;
     long long start;
 
-    if (server.rdb_child_pid != -1) return REDIS_ERR;
+    if (server.rdb_child_pid != -1 || server.rdb_forkless_in_progress)
+        return REDIS_ERR;
 
     server.dirty_before_bgsave = server.dirty;
     server.lastbgsave_try = time(NULL);
 
+    if (server.rdb_forkless) return rdbSaveBackgroundForkless(filename);
+
     start = ustime();
     if ((childpid = fork()) == 0) {
         int retval;
@@ -828,36 +1164,21 @@ robj *rdbLoadObject(int rdbtype, rio *rdb) {
         if ((o = rdbLoadEncodedStringObject(rdb)) == NULL) return NULL;
         o = tryObjectEncoding(o);
     } else if (rdbtype == REDIS_RDB_TYPE_LIST) {
-        /* Read list value */
+        /* Read list value: this is the format used for linked list encoded
+         * lists by Redis versions older than the quicklist encoding. */
         if ((len = rdbLoadLen(rdb,NULL)) == REDIS_RDB_LENERR) return NULL;
 
-        /* Use a real list when there are too many entries */
-        if (len > server.list_max_ziplist_entries) {
-            o = createListObject();
-        } else {
-            o = createZiplistObject();
-        }
+        o = createQuicklistObject();
+        quicklistSetOptions(o->ptr, server.list_max_ziplist_size,
+                            server.list_compress_depth);
 
         /* Load every single element of the list */
         while(len--) {
             if ((ele = rdbLoadEncodedStringObject(rdb)) == NULL) return NULL;
-
-            /* If we are using a ziplist and the value is too big, convert
-             * the object to a real list. */
-            if (o->encoding == REDIS_ENCODING_ZIPLIST &&
-                sdsEncodedObject(ele) &&
-                sdslen(ele->ptr) > server.list_max_ziplist_value)
-                    listTypeConvert(o,REDIS_ENCODING_LINKEDLIST);
-
-            if (o->encoding == REDIS_ENCODING_ZIPLIST) {
-                dec = getDecodedObject(ele);
-                o->ptr = ziplistPush(o->ptr,dec->ptr,sdslen(dec->ptr),REDIS_TAIL);
-                decrRefCount(dec);
-                decrRefCount(ele);
-            } else {
-                ele = tryObjectEncoding(ele);
-                listAddNodeTail(o->ptr,ele);
-            }
+            dec = getDecodedObject(ele);
+            quicklistPushTail(o->ptr,dec->ptr,sdslen(dec->ptr));
+            decrRefCount(dec);
+            decrRefCount(ele);
         }
     } else if (rdbtype == REDIS_RDB_TYPE_SET) {
         /* Read list/set value */
@@ -865,11 +1186,16 @@ robj *rdbLoadObject(int rdbtype, rio *rdb) {
 
         /* Use a regular set when there are too many entries. */
         if (len > server.set_max_intset_entries) {
-            o = createSetObject();
-            /* It's faster to expand the dict to the right size asap in order
-             * to avoid rehashing */
-            if (len > DICT_HT_INITIAL_SIZE)
-                dictExpand(o->ptr,len);
+            if (setTypeTableEncoding(len) == REDIS_ENCODING_CTABLE) {
+                o = createCtableSetObject();
+                ctableExpand(o->ptr,len);
+            } else {
+                o = createSetObject();
+                /* It's faster to expand the dict to the right size asap in
+                 * order to avoid rehashing */
+                if (len > DICT_HT_INITIAL_SIZE)
+                    dictExpand(o->ptr,len);
+            }
         } else {
             o = createIntsetObject();
         }
@@ -885,16 +1211,20 @@ robj *rdbLoadObject(int rdbtype, rio *rdb) {
                 if (isObjectRepresentableAsLongLong(ele,&llval) == REDIS_OK) {
                     o->ptr = intsetAdd(o->ptr,llval,NULL);
                 } else {
-                    setTypeConvert(o,REDIS_ENCODING_HT);
-                    dictExpand(o->ptr,len);
+                    setTypeConvert(o,setTypeTableEncoding(len));
+                    if (o->encoding == REDIS_ENCODING_HT)
+                        dictExpand(o->ptr,len);
+                    else
+                        ctableExpand(o->ptr,len);
                 }
             }
 
             /* This will also be called when the set was just converted
-             * to a regular hash table encoded set */
+             * to a regular hash table or compact table encoded set */
             if (o->encoding == REDIS_ENCODING_HT) {
                 dictAdd((dict*)o->ptr,ele,NULL);
             } else {
+                if (o->encoding == REDIS_ENCODING_CTABLE) setTypeAdd(o,ele);
                 decrRefCount(ele);
             }
         }
@@ -924,7 +1254,6 @@ robj *rdbLoadObject(int rdbtype, rio *rdb) {
 
             znode = zslInsert(zs->zsl,score,ele);
             dictAdd(zs->dict,ele,&znode->score);
-            incrRefCount(ele); /* added to skiplist */
         }
 
         /* Convert *after* loading, since sorted sets are not stored ordered. */
@@ -940,9 +1269,9 @@ robj *rdbLoadObject(int rdbtype, rio *rdb) {
 
         o = createHashObject();
 
-        /* Too many entries? Use a hash table. */
+        /* Too many entries? Use a hash table or a compact table. */
         if (len > server.hash_max_ziplist_entries)
-            hashTypeConvert(o, REDIS_ENCODING_HT);
+            hashTypeConvert(o, hashTypeTableEncoding(len));
 
         /* Load every field and value into the ziplist */
         while (o->encoding == REDIS_ENCODING_ZIPLIST && len > 0) {
@@ -966,13 +1295,34 @@ robj *rdbLoadObject(int rdbtype, rio *rdb) {
             {
                 decrRefCount(field);
                 decrRefCount(value);
-                hashTypeConvert(o, REDIS_ENCODING_HT);
+                hashTypeConvert(o, hashTypeTableEncoding(hashTypeLength(o)+len));
                 break;
             }
             decrRefCount(field);
             decrRefCount(value);
         }
 
+        /* Load remaining fields and values into the compact table */
+        if (o->encoding == REDIS_ENCODING_CTABLE)
+            ctableExpand(o->ptr, hashTypeLength(o)+len);
+        while (o->encoding == REDIS_ENCODING_CTABLE && len > 0) {
+            robj *field, *value;
+
+            len--;
+            /* Load raw strings */
+            field = rdbLoadStringObject(rdb);
+            if (field == NULL) return NULL;
+            value = rdbLoadStringObject(rdb);
+            if (value == NULL) return NULL;
+
+            /* Add pair to compact table */
+            ret = ctableSet(o->ptr, field->ptr, sdslen(field->ptr),
+                            value->ptr, sdslen(value->ptr));
+            redisAssert(ret == 1);
+            decrRefCount(field);
+            decrRefCount(value);
+        }
+
         /* Load remaining fields and values into the hash table */
         while (o->encoding == REDIS_ENCODING_HT && len > 0) {
             robj *field, *value;
@@ -995,6 +1345,22 @@ robj *rdbLoadObject(int rdbtype, rio *rdb) {
         /* All pairs should be read by now */
         redisAssert(len == 0);
 
+    } else if (rdbtype == REDIS_RDB_TYPE_LIST_QUICKLIST) {
+        if ((len = rdbLoadLen(rdb,NULL)) == REDIS_RDB_LENERR) return NULL;
+        o = createQuicklistObject();
+        quicklistSetOptions(o->ptr, server.list_max_ziplist_size,
+                            server.list_compress_depth);
+
+        while (len--) {
+            robj *aux = rdbLoadStringObject(rdb);
+            unsigned char *zl;
+
+            if (aux == NULL) return NULL;
+            zl = zmalloc(sdslen(aux->ptr));
+            memcpy(zl,aux->ptr,sdslen(aux->ptr));
+            decrRefCount(aux);
+            quicklistAppendZiplist(o->ptr, zl);
+        }
     } else if (rdbtype == REDIS_RDB_TYPE_HASH_ZIPMAP  ||
                rdbtype == REDIS_RDB_TYPE_LIST_ZIPLIST ||
                rdbtype == REDIS_RDB_TYPE_SET_INTSET   ||
@@ -1041,21 +1407,21 @@ robj *rdbLoadObject(int rdbtype, rio *rdb) {
                     if (hashTypeLength(o) > server.hash_max_ziplist_entries ||
                         maxlen > server.hash_max_ziplist_value)
                     {
-                        hashTypeConvert(o, REDIS_ENCODING_HT);
+                        hashTypeConvert(o,
+                            hashTypeTableEncoding(hashTypeLength(o)));
                     }
                 }
                 break;
             case REDIS_RDB_TYPE_LIST_ZIPLIST:
                 o->type = REDIS_LIST;
                 o->encoding = REDIS_ENCODING_ZIPLIST;
-                if (ziplistLen(o->ptr) > server.list_max_ziplist_entries)
-                    listTypeConvert(o,REDIS_ENCODING_LINKEDLIST);
+                listTypeConvert(o,REDIS_ENCODING_QUICKLIST);
                 break;
             case REDIS_RDB_TYPE_SET_INTSET:
                 o->type = REDIS_SET;
                 o->encoding = REDIS_ENCODING_INTSET;
                 if (intsetLen(o->ptr) > server.set_max_intset_entries)
-                    setTypeConvert(o,REDIS_ENCODING_HT);
+                    setTypeConvert(o,setTypeTableEncoding(intsetLen(o->ptr)));
                 break;
             case REDIS_RDB_TYPE_ZSET_ZIPLIST:
                 o->type = REDIS_ZSET;
@@ -1067,7 +1433,8 @@ robj *rdbLoadObject(int rdbtype, rio *rdb) {
                 o->type = REDIS_HASH;
                 o->encoding = REDIS_ENCODING_ZIPLIST;
                 if (hashTypeLength(o) > server.hash_max_ziplist_entries)
-                    hashTypeConvert(o, REDIS_ENCODING_HT);
+                    hashTypeConvert(o,
+                        hashTypeTableEncoding(hashTypeLength(o)));
                 break;
             default:
                 redisPanic("Unknown encoding");
@@ -1126,56 +1493,552 @@ void rdbLoadProgressCallback(rio *r, const void *buf, size_t len) {
     }
 }
 
-int rdbLoad(char *filename) {
+/*-----------------------------------------------------------------------------
+ * Threaded loading
+ *
+ * When rdb-load-threads is greater than zero rdbLoadRio() spreads the work
+ * of loading over a pipeline of threads:
+ *
+ * 1) A reader thread reads the stream and updates the checksum. It parses
+ *    only enough of every record to find where it ends, and copies the raw
+ *    key and value bytes into a batch.
+ * 2) rdb-load-threads worker threads take whole batches and turn the raw
+ *    bytes into ready objects with rdbLoadStringObject() and rdbLoadObject():
+ *    LZF decompression, ziplist / intset validation and conversions, and the
+ *    creation of the objects all happen here.
+ * 3) The main thread takes the decoded batches in file order and just adds
+ *    the keys to the keyspace, serving events from time to time as the
+ *    serial loader does.
+ *
+ * The number of batches is fixed, so the memory used by the pipeline is
+ * bounded: the reader blocks when all the batches are in flight.
+ *----------------------------------------------------------------------------*/
+
+#define RDB_LOAD_BATCH_BYTES (1024*256)     /* Flush a batch at this size. */
+#define RDB_LOAD_BATCH_RECORDS 1024         /* Max records in a batch. */
+#define RDB_LOAD_BATCHES_PER_THREAD 4       /* Batches in flight per worker. */
+#define RDB_LOAD_EVENTS_MS 100              /* Serve events at least so often. */
+
+/* Reader thread exit status. */
+#define RDB_LOAD_OK 0           /* EOF reached, checksum verified if any. */
+#define RDB_LOAD_EOFERR 1       /* Short read or malformed record. */
+#define RDB_LOAD_NOCKSUM 2      /* EOF reached, file saved without checksum. */
+#define RDB_LOAD_BADCKSUM 3     /* Checksum mismatch. */
+#define RDB_LOAD_BADDBID 4      /* SELECTDB out of range. */
+
+typedef struct rdbLoadRecord {
+    int dbid;
+    int type;                   /* RDB type of the value. */
+    long long expiretime;       /* Milliseconds unix time, or -1. */
+    robj *key, *val;            /* Set by the worker decoding the batch. */
+} rdbLoadRecord;
+
+typedef struct rdbLoadBatch {
+    long long seq;              /* Position of the batch in the stream. */
+    sds raw;                    /* Key and value bytes of all the records. */
+    int numrecords;
+    int error;                  /* A record could not be decoded. */
+    rdbLoadRecord records[RDB_LOAD_BATCH_RECORDS];
+    struct rdbLoadBatch *next;  /* Link in the free / todo / done lists. */
+} rdbLoadBatch;
+
+static struct rdbLoadPipeline {
+    pthread_mutex_t mutex;
+    pthread_cond_t reader_cond;     /* A batch was released by main. */
+    pthread_cond_t worker_cond;     /* A batch is ready to be decoded. */
+    pthread_cond_t main_cond;       /* A batch was decoded or reader exited. */
+    rdbLoadBatch *free;             /* Batches available to the reader. */
+    rdbLoadBatch *todo, *todo_tail; /* Batches to decode, FIFO. */
+    rdbLoadBatch *done;             /* Decoded batches, in any order. */
+    long long batches;              /* Batches submitted by the reader. */
+    off_t processed;                /* Bytes read by the reader. */
+    int reader_done;                /* The reader thread exited. */
+    int reader_status;              /* RDB_LOAD_* exit status. */
+    int stop;                       /* Ask workers to exit. */
+    /* The following fields are only accessed by the reader thread. */
+    rio *rdb;
+    int rdbver;
+    rdbLoadBatch *filling;          /* Batch the reader is filling. */
+    int tee;                        /* Append bytes read to 'filling'. */
+} pipeline;
+
+/* rio checksum callback of the reader thread: besides the checksum it
+ * appends to the current batch every byte read while copying a record. */
+static void rdbLoadReaderCallback(rio *r, const void *buf, size_t len) {
+    if (server.rdb_checksum) rioGenericUpdateChecksum(r,buf,len);
+    if (pipeline.tee)
+        pipeline.filling->raw = sdscatlen(pipeline.filling->raw,buf,len);
+}
+
+/* Read 'len' bytes of payload straight into the current batch. */
+static int rdbLoadReaderCopy(rio *rdb, size_t len) {
+    sds raw = sdsMakeRoomFor(pipeline.filling->raw,len);
+    int ok;
+
+    pipeline.filling->raw = raw;
+    pipeline.tee = 0;
+    ok = rioRead(rdb,raw+sdslen(raw),len);
+    pipeline.tee = 1;
+    if (!ok) return -1;
+    sdsIncrLen(raw,len);
+    return 0;
+}
+
+/* Copy a string as saved by rdbSaveRawString() without decoding it. */
+static int rdbLoadReaderCopyString(rio *rdb) {
+    int isencoded;
+    uint32_t len, clen;
+
+    len = rdbLoadLen(rdb,&isencoded);
+    if (isencoded) {
+        switch(len) {
+        case REDIS_RDB_ENC_INT8: return rdbLoadReaderCopy(rdb,1);
+        case REDIS_RDB_ENC_INT16: return rdbLoadReaderCopy(rdb,2);
+        case REDIS_RDB_ENC_INT32: return rdbLoadReaderCopy(rdb,4);
+        case REDIS_RDB_ENC_LZF:
+            if ((clen = rdbLoadLen(rdb,NULL)) == REDIS_RDB_LENERR) return -1;
+            if (rdbLoadLen(rdb,NULL) == REDIS_RDB_LENERR) return -1;
+            return rdbLoadReaderCopy(rdb,clen);
+        default:
+            return -1;
+        }
+    }
+    if (len == REDIS_RDB_LENERR) return -1;
+    return rdbLoadReaderCopy(rdb,len);
+}
+
+/* Copy a value of the specified RDB type without decoding it. This must
+ * mirror the layout read by rdbLoadObject(). */
+static int rdbLoadReaderCopyObject(rio *rdb, int rdbtype) {
+    uint32_t len, j;
+    double score;
+
+    switch(rdbtype) {
+    case REDIS_RDB_TYPE_STRING:
+    case REDIS_RDB_TYPE_HASH_ZIPMAP:
+    case REDIS_RDB_TYPE_LIST_ZIPLIST:
+    case REDIS_RDB_TYPE_SET_INTSET:
+    case REDIS_RDB_TYPE_ZSET_ZIPLIST:
+    case REDIS_RDB_TYPE_HASH_ZIPLIST:
+        return rdbLoadReaderCopyString(rdb);
+    case REDIS_RDB_TYPE_LIST:
+    case REDIS_RDB_TYPE_SET:
+    case REDIS_RDB_TYPE_ZSET:
+    case REDIS_RDB_TYPE_HASH:
+    case REDIS_RDB_TYPE_LIST_QUICKLIST:
+        if ((len = rdbLoadLen(rdb,NULL)) == REDIS_RDB_LENERR) return -1;
+        for (j = 0; j < len; j++) {
+            if (rdbLoadReaderCopyString(rdb) == -1) return -1;
+            if (rdbtype == REDIS_RDB_TYPE_HASH &&
+                rdbLoadReaderCopyString(rdb) == -1) return -1;
+            if (rdbtype == REDIS_RDB_TYPE_ZSET &&
+                rdbLoadDoubleValue(rdb,&score) == -1) return -1;
+        }
+        return 0;
+    default:
+        redisLog(REDIS_WARNING,"Unknown RDB object type %d",rdbtype);
+        return -1;
+    }
+}
+
+static rdbLoadBatch *rdbLoadGetFreeBatch(void) {
+    rdbLoadBatch *b;
+
+    pthread_mutex_lock(&pipeline.mutex);
+    while(pipeline.free == NULL)
+        pthread_cond_wait(&pipeline.reader_cond,&pipeline.mutex);
+    b = pipeline.free;
+    pipeline.free = b->next;
+    pthread_mutex_unlock(&pipeline.mutex);
+    return b;
+}
+
+/* Hand the batch the reader is filling to the workers. */
+static void rdbLoadSubmitBatch(void) {
+    rdbLoadBatch *b = pipeline.filling;
+
+    pipeline.filling = NULL;
+    pthread_mutex_lock(&pipeline.mutex);
+    b->seq = pipeline.batches++;
+    b->next = NULL;
+    if (pipeline.todo_tail)
+        pipeline.todo_tail->next = b;
+    else
+        pipeline.todo = b;
+    pipeline.todo_tail = b;
+    pipeline.processed = pipeline.rdb->processed_bytes;
+    pthread_cond_signal(&pipeline.worker_cond);
+    pthread_mutex_unlock(&pipeline.mutex);
+}
+
+static void *rdbLoadReaderMain(void *arg) {
+    rio *rdb = pipeline.rdb;
+    int type, status = RDB_LOAD_EOFERR;
+    uint32_t dbid = 0;
+    long long expiretime;
+    REDIS_NOTUSED(arg);
+
+    while(1) {
+        rdbLoadRecord *rec;
+
+        if (pipeline.filling == NULL) pipeline.filling = rdbLoadGetFreeBatch();
+
+        /* Opcodes are not copied: the batch only holds keys and values. */
+        expiretime = -1;
+        if ((type = rdbLoadType(rdb)) == -1) goto done;
+        if (type == REDIS_RDB_OPCODE_EXPIRETIME) {
+            if ((expiretime = rdbLoadTime(rdb)) == -1) goto done;
+            if ((type = rdbLoadType(rdb)) == -1) goto done;
+            expiretime *= 1000;
+        } else if (type == REDIS_RDB_OPCODE_EXPIRETIME_MS) {
+            if ((expiretime = rdbLoadMillisecondTime(rdb)) == -1) goto done;
+            if ((type = rdbLoadType(rdb)) == -1) goto done;
+        }
+        if (type == REDIS_RDB_OPCODE_EOF) break;
+        if (type == REDIS_RDB_OPCODE_SELECTDB) {
+            if ((dbid = rdbLoadLen(rdb,NULL)) == REDIS_RDB_LENERR) goto done;
+            if (dbid >= (unsigned)server.dbnum) {
+                status = RDB_LOAD_BADDBID;
+                goto done;
+            }
+            continue;
+        }
+
+        rec = pipeline.filling->records+pipeline.filling->numrecords;
+        rec->dbid = dbid;
+        rec->type = type;
+        rec->expiretime = expiretime;
+        pipeline.tee = 1;
+        if (rdbLoadReaderCopyString(rdb) == -1 ||
+            rdbLoadReaderCopyObject(rdb,type) == -1) goto done;
+        pipeline.tee = 0;
+        pipeline.filling->numrecords++;
+        if (pipeline.filling->numrecords == RDB_LOAD_BATCH_RECORDS ||
+            sdslen(pipeline.filling->raw) >= RDB_LOAD_BATCH_BYTES)
+            rdbLoadSubmitBatch();
+    }
+
+    /* Submit the last batch before reading the checksum, that is not part
+     * of any record. */
+    if (pipeline.filling->numrecords) rdbLoadSubmitBatch();
+    status = RDB_LOAD_OK;
+    if (pipeline.rdbver >= 5 && server.rdb_checksum) {
+        uint64_t cksum, expected = rdb->cksum;
+
+        if (rioRead(rdb,&cksum,8) == 0) {
+            status = RDB_LOAD_EOFERR;
+        } else {
+            memrev64ifbe(&cksum);
+            if (cksum == 0)
+                status = RDB_LOAD_NOCKSUM;
+            else if (cksum != expected)
+                status = RDB_LOAD_BADCKSUM;
+        }
+    }
+
+done:
+    pipeline.tee = 0;
+    pthread_mutex_lock(&pipeline.mutex);
+    /* On error the batch being filled may end with a partial record: it is
+     * never submitted, the load is aborted anyway. */
+    if (pipeline.filling) {
+        pipeline.filling->next = pipeline.free;
+        pipeline.free = pipeline.filling;
+        pipeline.filling = NULL;
+    }
+    pipeline.processed = rdb->processed_bytes;
+    pipeline.reader_status = status;
+    pipeline.reader_done = 1;
+    pthread_cond_signal(&pipeline.main_cond);
+    pthread_mutex_unlock(&pipeline.mutex);
+    return NULL;
+}
+
+/* Decode all the records of a batch. On error the batch is truncated to
+ * the records decoded so far and the 'error' flag is set. */
+static void rdbLoadDecodeBatch(rdbLoadBatch *b) {
+    rio r;
+    int j;
+
+    rioInitWithBuffer(&r,b->raw);
+    for (j = 0; j < b->numrecords; j++) {
+        rdbLoadRecord *rec = b->records+j;
+
+        if ((rec->key = rdbLoadStringObject(&r)) == NULL) break;
+        if ((rec->val = rdbLoadObject(rec->type,&r)) == NULL) {
+            decrRefCount(rec->key);
+            break;
+        }
+    }
+    if (j != b->numrecords) {
+        b->numrecords = j;
+        b->error = 1;
+    }
+}
+
+static void *rdbLoadWorkerMain(void *arg) {
+    rdbLoadBatch *b;
+    REDIS_NOTUSED(arg);
+
+    while(1) {
+        pthread_mutex_lock(&pipeline.mutex);
+        while(pipeline.todo == NULL && !pipeline.stop)
+            pthread_cond_wait(&pipeline.worker_cond,&pipeline.mutex);
+        if (pipeline.todo == NULL) {
+            pthread_mutex_unlock(&pipeline.mutex);
+            break;
+        }
+        b = pipeline.todo;
+        pipeline.todo = b->next;
+        if (pipeline.todo == NULL) pipeline.todo_tail = NULL;
+        pthread_mutex_unlock(&pipeline.mutex);
+
+        rdbLoadDecodeBatch(b);
+
+        pthread_mutex_lock(&pipeline.mutex);
+        b->next = pipeline.done;
+        pipeline.done = b;
+        pthread_cond_signal(&pipeline.main_cond);
+        pthread_mutex_unlock(&pipeline.mutex);
+    }
+    return NULL;
+}
+
+/* Wait up to RDB_LOAD_EVENTS_MS for the decoded batch number 'seq'. Returns
+ * NULL on timeout, or once the reader exited and 'seq' will never come.
+ * Called with the pipeline mutex locked. */
+static rdbLoadBatch *rdbLoadWaitBatch(long long seq) {
+    struct timeval tv;
+    struct timespec deadline;
+    rdbLoadBatch *b, **bp;
+
+    gettimeofday(&tv,NULL);
+    deadline.tv_sec = tv.tv_sec;
+    deadline.tv_nsec = (tv.tv_usec+RDB_LOAD_EVENTS_MS*1000)*1000L;
+    deadline.tv_sec += deadline.tv_nsec/1000000000L;
+    deadline.tv_nsec %= 1000000000L;
+    while(1) {
+        for (bp = &pipeline.done; *bp; bp = &(*bp)->next) {
+            if ((*bp)->seq == seq) {
+                b = *bp;
+                *bp = b->next;
+                return b;
+            }
+        }
+        if (pipeline.reader_done && seq == pipeline.batches) return NULL;
+        if (pthread_cond_timedwait(&pipeline.main_cond,&pipeline.mutex,
+                                   &deadline) == ETIMEDOUT) return NULL;
+    }
+}
+
+/* Add the records of a decoded batch to the keyspace, then give the batch
+ * back to the reader. Returns REDIS_ERR if the batch failed to decode. */
+static int rdbLoadInsertBatch(rdbLoadBatch *b, long long now) {
+    int j, retval = b->error ? REDIS_ERR : REDIS_OK;
+
+    for (j = 0; j < b->numrecords; j++) {
+        rdbLoadRecord *rec = b->records+j;
+        redisDb *db = server.db+rec->dbid;
+
+        /* See rdbLoadRio() about expired keys. */
+        if (server.masterhost == NULL && rec->expiretime != -1 &&
+            rec->expiretime < now)
+        {
+            decrRefCount(rec->key);
+            decrRefCount(rec->val);
+            continue;
+        }
+        dbAdd(db,rec->key,rec->val);
+        if (rec->expiretime != -1) setExpire(db,rec->key,rec->expiretime);
+        decrRefCount(rec->key);
+    }
+
+    /* Don't keep around the memory of a batch that held a huge value. */
+    if (sdsalloc(b->raw) > RDB_LOAD_BATCH_BYTES*4) {
+        sdsfree(b->raw);
+        b->raw = sdsempty();
+    } else {
+        sdsclear(b->raw);
+    }
+    b->numrecords = 0;
+    b->error = 0;
+
+    pthread_mutex_lock(&pipeline.mutex);
+    b->next = pipeline.free;
+    pipeline.free = b;
+    pthread_cond_signal(&pipeline.reader_cond);
+    pthread_mutex_unlock(&pipeline.mutex);
+    return retval;
+}
+
+/* Load the rest of the stream with the threads pipeline, after rdbLoadRio()
+ * verified the signature. Same return value and fatal errors as the serial
+ * loader. */
+static int rdbLoadRioThreaded(rio *rdb, int rdbver) {
+    int j, numbatches, status, numworkers = server.rdb_load_threads;
+    long long seq = 0, now = mstime();
+    off_t processed, reported = rdb->processed_bytes;
+    size_t interval = server.loading_process_events_interval_bytes;
+    pthread_t reader, *workers;
+    rdbLoadBatch *b;
+
+    pthread_mutex_init(&pipeline.mutex,NULL);
+    pthread_cond_init(&pipeline.reader_cond,NULL);
+    pthread_cond_init(&pipeline.worker_cond,NULL);
+    pthread_cond_init(&pipeline.main_cond,NULL);
+    pipeline.free = pipeline.todo = pipeline.todo_tail = pipeline.done = NULL;
+    pipeline.batches = 0;
+    pipeline.processed = rdb->processed_bytes;
+    pipeline.reader_done = 0;
+    pipeline.reader_status = RDB_LOAD_OK;
+    pipeline.stop = 0;
+    pipeline.rdb = rdb;
+    pipeline.rdbver = rdbver;
+    pipeline.filling = NULL;
+    pipeline.tee = 0;
+
+    numbatches = numworkers*RDB_LOAD_BATCHES_PER_THREAD+2;
+    for (j = 0; j < numbatches; j++) {
+        b = zmalloc(sizeof(*b));
+        b->raw = sdsempty();
+        b->numrecords = 0;
+        b->error = 0;
+        b->next = pipeline.free;
+        pipeline.free = b;
+    }
+
+    /* From now on the stream belongs to the reader thread. */
+    rdb->update_cksum = rdbLoadReaderCallback;
+    rdb->max_processing_chunk = 0;
+    workers = zmalloc(sizeof(pthread_t)*numworkers);
+    if (pthread_create(&reader,NULL,rdbLoadReaderMain,NULL) != 0) {
+        redisLog(REDIS_WARNING,"Fatal: Can't initialize the RDB reader thread.");
+        exit(1);
+    }
+    for (j = 0; j < numworkers; j++) {
+        if (pthread_create(&workers[j],NULL,rdbLoadWorkerMain,NULL) != 0) {
+            redisLog(REDIS_WARNING,"Fatal: Can't initialize the RDB loading threads.");
+            exit(1);
+        }
+    }
+
+    while(1) {
+        int finished;
+
+        pthread_mutex_lock(&pipeline.mutex);
+        b = rdbLoadWaitBatch(seq);
+        finished = (b == NULL && pipeline.reader_done &&
+                    seq == pipeline.batches);
+        processed = pipeline.processed;
+        pthread_mutex_unlock(&pipeline.mutex);
+
+        if (b) {
+            if (rdbLoadInsertBatch(b,now) == REDIS_ERR) goto eoferr;
+            seq++;
+        }
+        if (finished) break;
+
+        /* Serve clients every loading-process-events-interval-bytes of
+         * stream like the serial loader, and anyway when we had to wait. */
+        if (b == NULL || (interval &&
+            (size_t)processed/interval > (size_t)reported/interval))
+        {
+            reported = processed;
+            updateCachedTime();
+            if (server.masterhost && server.repl_state == REDIS_REPL_TRANSFER)
+                replicationSendNewlineToMaster();
+            loadingProgress(processed);
+            processEventsWhileBlocked();
+        }
+    }
+
+    pthread_join(reader,NULL);
+    pthread_mutex_lock(&pipeline.mutex);
+    pipeline.stop = 1;
+    pthread_cond_broadcast(&pipeline.worker_cond);
+    pthread_mutex_unlock(&pipeline.mutex);
+    for (j = 0; j < numworkers; j++) pthread_join(workers[j],NULL);
+    zfree(workers);
+    while((b = pipeline.free) != NULL) {
+        pipeline.free = b->next;
+        sdsfree(b->raw);
+        zfree(b);
+    }
+    pthread_cond_destroy(&pipeline.reader_cond);
+    pthread_cond_destroy(&pipeline.worker_cond);
+    pthread_cond_destroy(&pipeline.main_cond);
+    pthread_mutex_destroy(&pipeline.mutex);
+    rdb->update_cksum = rdbLoadProgressCallback;
+    rdb->max_processing_chunk = server.loading_process_events_interval_bytes;
+
+    status = pipeline.reader_status;
+    if (status == RDB_LOAD_BADDBID) {
+        redisLog(REDIS_WARNING,"FATAL: Data file was created with a Redis server configured to handle more than %d databases. Exiting\n", server.dbnum);
+        exit(1);
+    } else if (status == RDB_LOAD_NOCKSUM) {
+        redisLog(REDIS_WARNING,"RDB file was saved with checksum disabled: no check performed.");
+    } else if (status == RDB_LOAD_BADCKSUM) {
+        redisLog(REDIS_WARNING,"Wrong RDB checksum. Aborting now.");
+        exit(1);
+    } else if (status == RDB_LOAD_EOFERR) {
+        goto eoferr;
+    }
+    return REDIS_OK;
+
+eoferr: /* unexpected end of file is handled here with a fatal exit */
+    redisLog(REDIS_WARNING,"Short read or OOM loading DB. Unrecoverable error, aborting now.");
+    exit(1);
+    return REDIS_ERR; /* Just to avoid warning */
+}
+
+/* Load an RDB file from the rio stream 'rdb'. On success REDIS_OK is
+ * returned, otherwise REDIS_ERR is returned and 'errno' is set accordingly.
+ * The caller is responsible for startLoading() / stopLoading(): this way
+ * the same function loads the RDB preamble of an AOF file, leaving the
+ * stream positioned at the first byte of the AOF tail. */
+int rdbLoadRio(rio *rdb) {
     uint32_t dbid;
     int type, rdbver;
     redisDb *db = server.db+0;
     char buf[1024];
     long long expiretime, now = mstime();
-    FILE *fp;
-    rio rdb;
 
-    if ((fp = fopen(filename,"r")) == NULL) return REDIS_ERR;
-
-    rioInitWithFile(&rdb,fp);
-    rdb.update_cksum = rdbLoadProgressCallback;
-    rdb.max_processing_chunk = server.loading_process_events_interval_bytes;
-    if (rioRead(&rdb,buf,9) == 0) goto eoferr;
+    rdb->update_cksum = rdbLoadProgressCallback;
+    rdb->max_processing_chunk = server.loading_process_events_interval_bytes;
+    if (rioRead(rdb,buf,9) == 0) goto eoferr;
     buf[9] = '\0';
     if (memcmp(buf,"REDIS",5) != 0) {
-        fclose(fp);
         redisLog(REDIS_WARNING,"Wrong signature trying to load DB from file");
         errno = EINVAL;
         return REDIS_ERR;
     }
     rdbver = atoi(buf+5);
     if (rdbver < 1 || rdbver > REDIS_RDB_VERSION) {
-        fclose(fp);
         redisLog(REDIS_WARNING,"Can't handle RDB format version %d",rdbver);
         errno = EINVAL;
         return REDIS_ERR;
     }
+    if (server.rdb_load_threads > 0) return rdbLoadRioThreaded(rdb,rdbver);
 
-    startLoading(fp);
     while(1) {
         robj *key, *val;
         expiretime = -1;
 
         /* Read type. */
-        if ((type = rdbLoadType(&rdb)) == -1) goto eoferr;
+        if ((type = rdbLoadType(rdb)) == -1) goto eoferr;
         if (type == REDIS_RDB_OPCODE_EXPIRETIME) {
-            if ((expiretime = rdbLoadTime(&rdb)) == -1) goto eoferr;
+            if ((expiretime = rdbLoadTime(rdb)) == -1) goto eoferr;
             /* We read the time so we need to read the object type again. */
-            if ((type = rdbLoadType(&rdb)) == -1) goto eoferr;
+            if ((type = rdbLoadType(rdb)) == -1) goto eoferr;
             /* the EXPIRETIME opcode specifies time in seconds, so convert
              * into milliseconds. */
             expiretime *= 1000;
         } else if (type == REDIS_RDB_OPCODE_EXPIRETIME_MS) {
             /* Milliseconds precision expire times introduced with RDB
              * version 3. */
-            if ((expiretime = rdbLoadMillisecondTime(&rdb)) == -1) goto eoferr;
+            if ((expiretime = rdbLoadMillisecondTime(rdb)) == -1) goto eoferr;
             /* We read the time so we need to read the object type again. */
-            if ((type = rdbLoadType(&rdb)) == -1) goto eoferr;
+            if ((type = rdbLoadType(rdb)) == -1) goto eoferr;
         }
 
         if (type == REDIS_RDB_OPCODE_EOF)
@@ -1183,7 +2046,7 @@ int rdbLoad(char *filename) {
 
         /* Handle SELECT DB opcode as a special case */
         if (type == REDIS_RDB_OPCODE_SELECTDB) {
-            if ((dbid = rdbLoadLen(&rdb,NULL)) == REDIS_RDB_LENERR)
+            if ((dbid = rdbLoadLen(rdb,NULL)) == REDIS_RDB_LENERR)
                 goto eoferr;
             if (dbid >= (unsigned)server.dbnum) {
                 redisLog(REDIS_WARNING,"FATAL: Data file was created with a Redis server configured to handle more than %d databases. Exiting\n", server.dbnum);
@@ -1193,9 +2056,9 @@ int rdbLoad(char *filename) {
             continue;
         }
         /* Read key */
-        if ((key = rdbLoadStringObject(&rdb)) == NULL) goto eoferr;
+        if ((key = rdbLoadStringObject(rdb)) == NULL) goto eoferr;
         /* Read value */
-        if ((val = rdbLoadObject(type,&rdb)) == NULL) goto eoferr;
+        if ((val = rdbLoadObject(type,rdb)) == NULL) goto eoferr;
         /* Check if the key already expired. This function is used when loading
          * an RDB file from disk, either at startup, or when an RDB was
          * received from the master. In the latter case, the master is
@@ -1216,9 +2079,9 @@ int rdbLoad(char *filename) {
     }
     /* Verify the checksum if RDB version is >= 5 */
     if (rdbver >= 5 && server.rdb_checksum) {
-        uint64_t cksum, expected = rdb.cksum;
+        uint64_t cksum, expected = rdb->cksum;
 
-        if (rioRead(&rdb,&cksum,8) == 0) goto eoferr;
+        if (rioRead(rdb,&cksum,8) == 0) goto eoferr;
         memrev64ifbe(&cksum);
         if (cksum == 0) {
             redisLog(REDIS_WARNING,"RDB file was saved with checksum disabled: no check performed.");
@@ -1228,8 +2091,6 @@ int rdbLoad(char *filename) {
         }
     }
 
-    fclose(fp);
-    stopLoading();
     return REDIS_OK;
 
 eoferr: /* unexpected end of file is handled here with a fatal exit */
@@ -1238,6 +2099,24 @@ eoferr: /* unexpected end of file is handled here with a fatal exit */
     return REDIS_ERR; /* Just to avoid warning */
 }
 
+/* Load the RDB file 'filename' into the dataset. Like rdbLoadRio() returns
+ * REDIS_OK on success and REDIS_ERR setting 'errno' on failure. */
+int rdbLoad(char *filename) {
+    FILE *fp;
+    rio rdb;
+    int retval;
+
+    if ((fp = fopen(filename,"r")) == NULL) return REDIS_ERR;
+    /* Read in big chunks: stdio would use the file system block size. */
+    setvbuf(fp,NULL,_IOFBF,REDIS_RDB_LOAD_BUFFER_SIZE);
+    startLoading(fp);
+    rioInitWithFile(&rdb,fp);
+    retval = rdbLoadRio(&rdb);
+    fclose(fp);
+    stopLoading();
+    return retval;
+}
+
 /* A background saving child (BGSAVE) terminated its work. Handle this.
  * This function covers the case of actual BGSAVEs. */
 void backgroundSaveDoneHandlerDisk(int exitcode, int bysignal) {
@@ -1395,7 +2274,8 @@ int rdbSaveToSlavesSockets(void) {
     long long start;
     int pipefds[2];
 
-    if (server.rdb_child_pid != -1) return REDIS_ERR;
+    if (server.rdb_child_pid != -1 || server.rdb_forkless_in_progress)
+        return REDIS_ERR;
 
     /* Before to fork, create a pipe that will be used in order to
      * send back to the parent the IDs of the slaves that successfully
@@ -1420,7 +2300,8 @@ int rdbSaveToSlavesSockets(void) {
         if (slave->replstate == REDIS_REPL_WAIT_BGSAVE_START) {
             clientids[numfds] = slave->id;
             fds[numfds++] = slave->fd;
-            replicationSetupSlaveForFullResync(slave,getPsyncInitialOffset());
+            replicationSetupSlaveForFullResync(slave,getPsyncInitialOffset(),
+                getPsyncInitialDb());
             /* Put the socket in non-blocking mode to simplify RDB transfer.
              * We'll restore it when the children returns (since duped socket
              * will share the O_NONBLOCK attribute with the parent). */
@@ -1538,7 +2419,7 @@ int rdbSaveToSlavesSockets(void) {
 }
 
 void saveCommand(redisClient *c) {
-    if (server.rdb_child_pid != -1) {
+    if (server.rdb_child_pid != -1 || server.rdb_forkless_in_progress) {
         addReplyError(c,"Background save already in progress");
         return;
     }
@@ -1550,7 +2431,7 @@ void saveCommand(redisClient *c) {
 }
 
 void bgsaveCommand(redisClient *c) {
-    if (server.rdb_child_pid != -1) {
+    if (server.rdb_child_pid != -1 || server.rdb_forkless_in_progress) {
         addReplyError(c,"Background save already in progress");
     } else if (server.aof_child_pid != -1) {
         addReplyError(c,"Can't BGSAVE while AOF log rewriting is in progress");
@@ -38,7 +38,7 @@
 
 /* The current RDB version. When the format changes in a way that is no longer
  * backward compatible this number gets incremented. */
-#define REDIS_RDB_VERSION 6
+#define REDIS_RDB_VERSION 7
 
 /* Defines related to the dump file format. To store 32 bits lengths for short
  * keys requires a lot of space, so we check the most significant 2 bits of
@@ -81,9 +81,10 @@
 #define REDIS_RDB_TYPE_SET_INTSET    11
 #define REDIS_RDB_TYPE_ZSET_ZIPLIST  12
 #define REDIS_RDB_TYPE_HASH_ZIPLIST  13
+#define REDIS_RDB_TYPE_LIST_QUICKLIST 14
 
 /* Test if a type is an object type. */
-#define rdbIsObjectType(t) ((t >= 0 && t <= 4) || (t >= 9 && t <= 13))
+#define rdbIsObjectType(t) ((t >= 0 && t <= 4) || (t >= 9 && t <= 14))
 
 /* Special RDB opcodes (saved/loaded with rdbSaveType/rdbLoadType). */
 #define REDIS_RDB_OPCODE_EXPIRETIME_MS 252
@@ -91,6 +92,13 @@
 #define REDIS_RDB_OPCODE_SELECTDB   254
 #define REDIS_RDB_OPCODE_EOF        255
 
+/* stdio buffer used by rdbLoad() to read the file. */
+#define REDIS_RDB_LOAD_BUFFER_SIZE (1024*1024)
+
+/* rdbSaveRio() flags. */
+#define REDIS_RDB_SAVE_NONE 0
+#define REDIS_RDB_SAVE_AOF_PREAMBLE (1<<0) /* Base of a rewritten AOF. */
+
 int rdbSaveType(rio *rdb, unsigned char type);
 int rdbLoadType(rio *rdb);
 int rdbSaveTime(rio *rdb, time_t t);
@@ -100,9 +108,14 @@ uint32_t rdbLoadLen(rio *rdb, int *isencoded);
 int rdbSaveObjectType(rio *rdb, robj *o);
 int rdbLoadObjectType(rio *rdb);
 int rdbLoad(char *filename);
+int rdbLoadRio(rio *rdb);
+int rdbSaveRio(rio *rdb, int *error, int flags);
 int rdbSaveBackground(char *filename);
 int rdbSaveToSlavesSockets(void);
 void rdbRemoveTempFile(pid_t childpid);
+void rdbForklessTouchKey(redisDb *db, robj *key, int deleted);
+void rdbForklessAddKey(redisDb *db, sds keystr);
+void rdbForklessCancel(void);
 int rdbSave(char *filename);
 int rdbSaveObject(rio *rdb, robj *o);
 off_t rdbSavedObjectLen(robj *o);
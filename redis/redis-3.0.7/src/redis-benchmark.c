@@ -33,59 +33,111 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <unistd.h>
 #include <errno.h>
 #include <time.h>
 #include <sys/time.h>
 #include <signal.h>
 #include <assert.h>
+#include <math.h>
+#include <pthread.h>
 
 #include "ae.h"
 #include "hiredis.h"
 #include "sds.h"
 #include "adlist.h"
 #include "zmalloc.h"
+#include "atomicvar.h"
+#include "hdrhistogram.h"
 
 #define REDIS_NOTUSED(V) ((void) V)
 #define RANDPTR_INITIAL_SIZE 8
+#define MAX_THREADS 256
+
+/* Latencies are recorded in microseconds, from 1 usec to 100 seconds, with
+ * three significant digits. */
+#define LATENCY_HIST_MIN 1
+#define LATENCY_HIST_MAX 100000000
+#define LATENCY_HIST_SIGFIGS 3
+
+#define CLUSTER_SLOTS 16384
+#define CLUSTER_TAG_LEN 3       /* Bytes replaced inside every {tag}. */
+
+/* A master node of the cluster benchmarked in --cluster mode. */
+typedef struct clusterNode {
+    char *ip;
+    int port;
+    int tag_slot;   /* Slot used for the {tag} of the node clients, or -1
+                       if it must be computed again. */
+} clusterNode;
+
+/* Every thread serves its own clients with its own event loop. Without the
+ * --threads option a single one is used, served by the main thread. */
+typedef struct benchmarkThread {
+    int index;
+    pthread_t thread;
+    aeEventLoop *el;
+    list *clients;
+    hdrHistogram *latency;  /* Latencies of the current test, in usecs. */
+    uint64_t rand_state;    /* State of the generator of random keys. */
+} benchmarkThread;
 
 static struct config {
-    aeEventLoop *el;
     const char *hostip;
     int hostport;
     const char *hostsocket;
     int numclients;
-    int liveclients;
-    int requests;
-    int requests_issued;
+    int numthreads;
+    benchmarkThread **threads;
+    int liveclients;        /* The following counters are shared by all */
+    int requests;           /* the threads: only access them using the */
+    int requests_issued;    /* atomic*() macros. */
     int requests_finished;
     int keysize;
     int datasize;
     int randomkeys;
     int randomkeys_keyspacelen;
+    double zipf_theta;      /* Zipf skew of random keys, 0 for uniform. */
+    double zipf_zetan;      /* Precomputed terms of the Zipf generator. */
+    double zipf_eta;
+    long long nil_replies;  /* Replies of the current test that were nil. */
+    long long moved;        /* MOVED redirections of the current test. */
+    int bitmap_size;        /* Bytes of the bitmaps tests keys, 0 = no tests. */
+    int bitmap_keys;        /* Number of source keys of the BITOP test. */
+    long long bytes_per_request; /* Bitmap bytes processed by each request. */
     int keepalive;
     int pipeline;
     long long start;
     long long totlatency;
-    long long *latency;
+    hdrHistogram *latency;  /* Latencies of all the threads, merged. */
     const char *title;
-    list *clients;
     int quiet;
     int csv;
+    int json;
     int loop;
     int idlemode;
     int dbnum;
     sds dbnumstr;
     char *tests;
     char *auth;
+    int cluster_mode;
+    int cluster_num_nodes;
+    clusterNode **cluster_nodes;
+    clusterNode *cluster_slots[CLUSTER_SLOTS]; /* Slot -> master node. */
+    char cluster_tags[CLUSTER_SLOTS][CLUSTER_TAG_LEN]; /* Slot -> hash tag. */
+    pthread_mutex_t cluster_mutex; /* Protects the cluster nodes and slots. */
 } config;
 
 typedef struct _client {
     redisContext *context;
+    benchmarkThread *thread; /* Thread serving the client. */
+    clusterNode *node;      /* Node the client is connected to (--cluster). */
     sds obuf;
     char **randptr;         /* Pointers to :rand: strings inside the command buf */
     size_t randlen;         /* Number of pointers in client->randptr */
-    size_t randfree;        /* Number of unused pointers in client->randptr */
+    char **tagptr;          /* Pointers to {tag} strings inside the command buf */
+    size_t taglen;          /* Number of pointers in client->tagptr */
     unsigned int written;   /* Bytes of 'obuf' already written */
     long long start;        /* Start time of a request */
     long long latency;      /* Request latency */
@@ -98,7 +150,10 @@ typedef struct _client {
 
 /* Prototypes */
 static void writeHandler(aeEventLoop *el, int fd, void *privdata, int mask);
-static void createMissingClients(client c);
+static client createClient(char *cmd, size_t len, client from,
+                           benchmarkThread *thread, clusterNode *node);
+int test_is_selected(char *name);
+uint16_t crc16(const char *buf, int len);
 
 /* Implementation */
 static long long ustime(void) {
@@ -122,44 +177,108 @@ static long long mstime(void) {
 }
 
 static void freeClient(client c) {
+    benchmarkThread *t = c->thread;
     listNode *ln;
-    aeDeleteFileEvent(config.el,c->context->fd,AE_WRITABLE);
-    aeDeleteFileEvent(config.el,c->context->fd,AE_READABLE);
+
+    aeDeleteFileEvent(t->el,c->context->fd,AE_WRITABLE);
+    aeDeleteFileEvent(t->el,c->context->fd,AE_READABLE);
     redisFree(c->context);
     sdsfree(c->obuf);
     zfree(c->randptr);
-    zfree(c);
-    config.liveclients--;
-    ln = listSearchKey(config.clients,c);
+    zfree(c->tagptr);
+    ln = listSearchKey(t->clients,c);
     assert(ln != NULL);
-    listDelNode(config.clients,ln);
+    listDelNode(t->clients,ln);
+    zfree(c);
+    atomicDecr(config.liveclients,1);
+
+    /* Nothing more to do for this thread in the current test. */
+    if (listLength(t->clients) == 0) aeStop(t->el);
 }
 
 static void freeAllClients(void) {
-    listNode *ln = config.clients->head, *next;
+    int j;
 
-    while(ln) {
-        next = ln->next;
-        freeClient(ln->value);
-        ln = next;
+    for (j = 0; j < config.numthreads; j++) {
+        listNode *ln = config.threads[j]->clients->head, *next;
+
+        while(ln) {
+            next = ln->next;
+            freeClient(ln->value);
+            ln = next;
+        }
     }
 }
 
 static void resetClient(client c) {
-    aeDeleteFileEvent(config.el,c->context->fd,AE_WRITABLE);
-    aeDeleteFileEvent(config.el,c->context->fd,AE_READABLE);
-    aeCreateFileEvent(config.el,c->context->fd,AE_WRITABLE,writeHandler,c);
+    aeEventLoop *el = c->thread->el;
+
+    aeDeleteFileEvent(el,c->context->fd,AE_WRITABLE);
+    aeDeleteFileEvent(el,c->context->fd,AE_READABLE);
+    aeCreateFileEvent(el,c->context->fd,AE_WRITABLE,writeHandler,c);
     c->written = 0;
     c->pending = config.pipeline;
 }
 
+/* Random numbers for the keys of the clients of a thread, using the
+ * xorshift64* generator, so that threads don't contend on the lock of the
+ * random() state. */
+static uint64_t threadRandom(benchmarkThread *t) {
+    uint64_t x = t->rand_state;
+
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    t->rand_state = x;
+    return x * 2685821657736338717ULL;
+}
+
+/* Zipfian distributed random integers in the range 0..keyspacelen-1, where
+ * 0 is the most popular value, 1 the second most popular and so forth.
+ * This is the algorithm from Gray et al., "Quickly generating billion-record
+ * synthetic databases", also used by YCSB: after computing the zeta constant
+ * once in O(keyspacelen), every number is generated in constant time. */
+static double zipfZeta(long n, double theta) {
+    double sum = 0;
+    long i;
+
+    for (i = 1; i <= n; i++) sum += 1/pow((double)i,theta);
+    return sum;
+}
+
+static void zipfInit(void) {
+    long n = config.randomkeys_keyspacelen;
+    double theta = config.zipf_theta;
+
+    config.zipf_zetan = zipfZeta(n,theta);
+    config.zipf_eta = (1-pow(2.0/n,1-theta)) /
+                      (1-zipfZeta(2,theta)/config.zipf_zetan);
+}
+
+static size_t zipfRandom(benchmarkThread *t) {
+    long n = config.randomkeys_keyspacelen;
+    double theta = config.zipf_theta;
+    double u = (threadRandom(t) >> 11) * (1.0/9007199254740992.0);
+    double uz = u*config.zipf_zetan;
+    size_t r;
+
+    if (uz < 1) return 0;
+    if (uz < 1+pow(0.5,theta)) return 1;
+    r = n*pow(config.zipf_eta*u-config.zipf_eta+1,1/(1-theta));
+    return (r >= (size_t)n) ? (size_t)n-1 : r;
+}
+
 static void randomizeClientKey(client c) {
     size_t i;
 
     for (i = 0; i < c->randlen; i++) {
         char *p = c->randptr[i]+11;
-        size_t r = random() % config.randomkeys_keyspacelen;
-        size_t j;
+        size_t r, j;
+
+        if (config.zipf_theta > 0)
+            r = zipfRandom(c->thread);
+        else
+            r = threadRandom(c->thread) % config.randomkeys_keyspacelen;
 
         for (j = 0; j < 12; j++) {
             *p = '0'+r%10;
@@ -169,18 +288,95 @@ static void randomizeClientKey(client c) {
     }
 }
 
+/* Return the master node serving 'ip':'port', creating it if it is not
+ * known yet. Must be called with the cluster mutex locked, or before the
+ * threads are started. */
+static clusterNode *clusterGetNode(const char *ip, int port) {
+    clusterNode *node;
+    int j;
+
+    for (j = 0; j < config.cluster_num_nodes; j++) {
+        node = config.cluster_nodes[j];
+        if (node->port == port && !strcmp(node->ip,ip)) return node;
+    }
+    node = zmalloc(sizeof(*node));
+    node->ip = zstrdup(ip);
+    node->port = port;
+    node->tag_slot = -1;
+    config.cluster_nodes = zrealloc(config.cluster_nodes,
+        sizeof(clusterNode*)*(config.cluster_num_nodes+1));
+    config.cluster_nodes[config.cluster_num_nodes++] = node;
+    return node;
+}
+
+/* Write in every {tag} of the client command a hash tag of one of the slots
+ * served by its node, so that all the keys of the client are served by the
+ * node it is connected to. The first slot of the node is used, so that the
+ * clients of different tests (for instance LPUSH and LRANGE) use the same
+ * keys. */
+static void clientSetTag(client c) {
+    clusterNode *node = c->node;
+    int slot, j;
+    size_t i;
+
+    if (c->taglen == 0) return;
+    pthread_mutex_lock(&config.cluster_mutex);
+    if (node->tag_slot == -1) {
+        for (j = 0; j < CLUSTER_SLOTS; j++) {
+            if (config.cluster_slots[j] == node) {
+                node->tag_slot = j;
+                break;
+            }
+        }
+    }
+    slot = node->tag_slot;
+    pthread_mutex_unlock(&config.cluster_mutex);
+
+    /* A node serving no slots: the requests will be redirected. */
+    if (slot == -1) return;
+    for (i = 0; i < c->taglen; i++)
+        memcpy(c->tagptr[i],config.cluster_tags[slot],CLUSTER_TAG_LEN);
+}
+
+/* Update the slots configuration according to a "MOVED <slot> <ip>:<port>"
+ * error, and return the node now serving the slot. */
+static clusterNode *clusterHandleMoved(char *err) {
+    char *p = strchr(err+6,' '), *colon = p ? strrchr(p,':') : NULL;
+    int slot = atoi(err+6), j;
+    clusterNode *node;
+    sds ip;
+
+    if (colon == NULL || slot < 0 || slot >= CLUSTER_SLOTS) {
+        fprintf(stderr,"Unexpected redirection: %s\n",err);
+        exit(1);
+    }
+    ip = sdsnewlen(p+1,colon-p-1);
+    pthread_mutex_lock(&config.cluster_mutex);
+    node = clusterGetNode(ip,atoi(colon+1));
+    config.cluster_slots[slot] = node;
+    /* The tag slots of the nodes may have changed ownership. */
+    for (j = 0; j < config.cluster_num_nodes; j++)
+        config.cluster_nodes[j]->tag_slot = -1;
+    pthread_mutex_unlock(&config.cluster_mutex);
+    sdsfree(ip);
+    return node;
+}
+
 static void clientDone(client c) {
-    if (config.requests_finished == config.requests) {
+    int finished;
+
+    atomicGet(config.requests_finished,finished);
+    if (finished >= config.requests) {
+        aeStop(c->thread->el);
         freeClient(c);
-        aeStop(config.el);
         return;
     }
     if (config.keepalive) {
         resetClient(c);
     } else {
-        config.liveclients--;
-        createMissingClients(c);
-        config.liveclients++;
+        /* Replace the client with a new connection, created before freeing
+         * the old one so that the thread keeps running. */
+        createClient(NULL,0,c,c->thread,c->node);
         freeClient(c);
     }
 }
@@ -207,11 +403,34 @@ static void readHandler(aeEventLoop *el, int fd, void *privdata, int mask) {
                 exit(1);
             }
             if (reply != NULL) {
+                redisReply *r = reply;
+                int finished;
+
                 if (reply == (void*)REDIS_REPLY_ERROR) {
                     fprintf(stderr,"Unexpected error reply, exiting...\n");
                     exit(1);
                 }
 
+                /* In cluster mode follow the slot to its new node: the
+                 * client is replaced with one connected to the node, and
+                 * the other pending replies are discarded. */
+                if (config.cluster_mode && r->type == REDIS_REPLY_ERROR &&
+                    !strncmp(r->str,"MOVED ",6))
+                {
+                    clusterNode *node = clusterHandleMoved(r->str);
+
+                    freeReplyObject(reply);
+                    atomicIncr(config.moved,1);
+                    createClient(NULL,0,c,c->thread,node);
+                    freeClient(c);
+                    return;
+                }
+
+                atomicGet(config.requests_finished,finished);
+                if (finished < config.requests &&
+                    c->prefix_pending == 0 &&
+                    r->type == REDIS_REPLY_NIL)
+                    atomicIncr(config.nil_replies,1);
                 freeReplyObject(reply);
                 /* This is an OK for prefix commands such as auth and select.*/
                 if (c->prefix_pending > 0) {
@@ -225,13 +444,16 @@ static void readHandler(aeEventLoop *el, int fd, void *privdata, int mask) {
                         * we need to randomize. */
                         for (j = 0; j < c->randlen; j++)
                             c->randptr[j] -= c->prefixlen;
+                        for (j = 0; j < c->taglen; j++)
+                            c->tagptr[j] -= c->prefixlen;
                         c->prefixlen = 0;
                     }
-                    continue;                
+                    continue;
                 }
 
-                if (config.requests_finished < config.requests)
-                    config.latency[config.requests_finished++] = c->latency;
+                atomicGetIncr(config.requests_finished,finished,1);
+                if (finished < config.requests)
+                    hdrRecordValue(c->thread->latency,c->latency);
                 c->pending--;
                 if (c->pending == 0) {
                     clientDone(c);
@@ -252,8 +474,11 @@ static void writeHandler(aeEventLoop *el, int fd, void *privdata, int mask) {
 
     /* Initialize request when nothing was written. */
     if (c->written == 0) {
+        int issued;
+
         /* Enforce upper bound to number of requests. */
-        if (config.requests_issued++ >= config.requests) {
+        atomicGetIncr(config.requests_issued,issued,1);
+        if (issued >= config.requests) {
             freeClient(c);
             return;
         }
@@ -275,12 +500,49 @@ static void writeHandler(aeEventLoop *el, int fd, void *privdata, int mask) {
         }
         c->written += nwritten;
         if (sdslen(c->obuf) == c->written) {
-            aeDeleteFileEvent(config.el,c->context->fd,AE_WRITABLE);
-            aeCreateFileEvent(config.el,c->context->fd,AE_READABLE,readHandler,c);
+            aeDeleteFileEvent(el,c->context->fd,AE_WRITABLE);
+            aeCreateFileEvent(el,c->context->fd,AE_READABLE,readHandler,c);
         }
     }
 }
 
+/* Store in '*ptrs' the pointers to all the occurrences of 'pattern' inside
+ * 'buf', plus 'skip' bytes, and return their number. */
+static size_t findPatternPointers(char *buf, const char *pattern, int skip,
+                                  char ***ptrs)
+{
+    size_t len = 0, avail = RANDPTR_INITIAL_SIZE, patlen = strlen(pattern);
+    char *p = buf;
+
+    *ptrs = zmalloc(sizeof(char*)*avail);
+    while ((p = strstr(p,pattern)) != NULL) {
+        if (avail == 0) {
+            *ptrs = zrealloc(*ptrs,sizeof(char*)*len*2);
+            avail += len;
+        }
+        (*ptrs)[len++] = p+skip;
+        avail--;
+        p += patlen;
+    }
+    return len;
+}
+
+/* Return a copy of the pointers 'ptrs' inside the command buffer of the
+ * client 'from', relocated inside the command buffer of 'c'. */
+static char **clonePatternPointers(client c, client from, char **ptrs,
+                                   size_t len)
+{
+    char **copy = zmalloc(sizeof(char*)*len);
+    size_t j;
+
+    for (j = 0; j < len; j++) {
+        copy[j] = c->obuf + (ptrs[j]-from->obuf);
+        /* Adjust for the different select prefix length. */
+        copy[j] += c->prefixlen - from->prefixlen;
+    }
+    return copy;
+}
+
 /* Create a benchmark client, configured to send the command passed as 'cmd' of
  * 'len' bytes.
  *
@@ -298,22 +560,31 @@ static void writeHandler(aeEventLoop *el, int fd, void *privdata, int mask) {
  * information is take from the 'from' client:
  *
  * 1) The command line to use.
- * 2) The offsets of the __rand_int__ elements inside the command line, used
- *    for arguments randomization.
+ * 2) The offsets of the __rand_int__ and {tag} elements inside the command
+ *    line, used for arguments randomization and cluster routing.
+ *
+ * Even when cloning another client, prefix commands are applied if needed.
  *
- * Even when cloning another client, prefix commands are applied if needed.*/
-static client createClient(char *cmd, size_t len, client from) {
+ * The client is served by the thread 'thread', and in cluster mode it is
+ * connected to the master 'node'. */
+static client createClient(char *cmd, size_t len, client from,
+                           benchmarkThread *thread, clusterNode *node)
+{
     int j;
     client c = zmalloc(sizeof(struct _client));
 
-    if (config.hostsocket == NULL) {
+    if (node) {
+        c->context = redisConnectNonBlock(node->ip,node->port);
+    } else if (config.hostsocket == NULL) {
         c->context = redisConnectNonBlock(config.hostip,config.hostport);
     } else {
         c->context = redisConnectUnixNonBlock(config.hostsocket);
     }
     if (c->context->err) {
         fprintf(stderr,"Could not connect to Redis at ");
-        if (config.hostsocket == NULL)
+        if (node)
+            fprintf(stderr,"%s:%d: %s\n",node->ip,node->port,c->context->errstr);
+        else if (config.hostsocket == NULL)
             fprintf(stderr,"%s:%d: %s\n",config.hostip,config.hostport,c->context->errstr);
         else
             fprintf(stderr,"%s: %s\n",config.hostsocket,c->context->errstr);
@@ -321,6 +592,8 @@ static client createClient(char *cmd, size_t len, client from) {
     }
     /* Suppress hiredis cleanup of unused buffers for max speed. */
     c->context->reader->maxbuf = 0;
+    c->thread = thread;
+    c->node = node;
 
     /* Build the request buffer:
      * Queue N requests accordingly to the pipeline size, or simply clone
@@ -362,48 +635,51 @@ static client createClient(char *cmd, size_t len, client from) {
     c->pending = config.pipeline+c->prefix_pending;
     c->randptr = NULL;
     c->randlen = 0;
+    c->tagptr = NULL;
+    c->taglen = 0;
 
     /* Find substrings in the output buffer that need to be randomized. */
     if (config.randomkeys) {
         if (from) {
             c->randlen = from->randlen;
-            c->randfree = 0;
-            c->randptr = zmalloc(sizeof(char*)*c->randlen);
-            /* copy the offsets. */
-            for (j = 0; j < (int)c->randlen; j++) {
-                c->randptr[j] = c->obuf + (from->randptr[j]-from->obuf);
-                /* Adjust for the different select prefix length. */
-                c->randptr[j] += c->prefixlen - from->prefixlen;
-            }
+            c->randptr = clonePatternPointers(c,from,from->randptr,
+                                              from->randlen);
         } else {
-            char *p = c->obuf;
-
-            c->randlen = 0;
-            c->randfree = RANDPTR_INITIAL_SIZE;
-            c->randptr = zmalloc(sizeof(char*)*c->randfree);
-            while ((p = strstr(p,"__rand_int__")) != NULL) {
-                if (c->randfree == 0) {
-                    c->randptr = zrealloc(c->randptr,sizeof(char*)*c->randlen*2);
-                    c->randfree += c->randlen;
-                }
-                c->randptr[c->randlen++] = p;
-                c->randfree--;
-                p += 12; /* 12 is strlen("__rand_int__). */
-            }
+            c->randlen = findPatternPointers(c->obuf,"__rand_int__",0,
+                                             &c->randptr);
         }
     }
+
+    /* Find the {tag} substrings to replace with the hash tag of the node. */
+    if (config.cluster_mode) {
+        if (from) {
+            c->taglen = from->taglen;
+            c->tagptr = clonePatternPointers(c,from,from->tagptr,
+                                             from->taglen);
+        } else {
+            c->taglen = findPatternPointers(c->obuf,"{tag}",1,&c->tagptr);
+        }
+        clientSetTag(c);
+    }
     if (config.idlemode == 0)
-        aeCreateFileEvent(config.el,c->context->fd,AE_WRITABLE,writeHandler,c);
-    listAddNodeTail(config.clients,c);
-    config.liveclients++;
+        aeCreateFileEvent(thread->el,c->context->fd,AE_WRITABLE,writeHandler,c);
+    listAddNodeTail(thread->clients,c);
+    atomicIncr(config.liveclients,1);
     return c;
 }
 
+/* Create the clients up to the configured number, cloning 'c', spreading
+ * them across the threads and, in cluster mode, across the master nodes.
+ * This is called before the threads are started. */
 static void createMissingClients(client c) {
     int n = 0;
 
     while(config.liveclients < config.numclients) {
-        createClient(NULL,0,c);
+        int id = config.liveclients;
+        clusterNode *node = config.cluster_mode ?
+            config.cluster_nodes[id % config.cluster_num_nodes] : NULL;
+
+        createClient(NULL,0,c,config.threads[id % config.numthreads],node);
 
         /* Listen backlog is quite limited on most systems */
         if (++n > 64) {
@@ -413,58 +689,334 @@ static void createMissingClients(client c) {
     }
 }
 
-static int compareLatency(const void *a, const void *b) {
-    return (*(long long*)a)-(*(long long*)b);
+/* Append 's' to the JSON output 'o' as a quoted string. */
+static sds catJsonString(sds o, const char *s) {
+    o = sdscatlen(o,"\"",1);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\')
+            o = sdscatprintf(o,"\\%c",*s);
+        else if ((unsigned char)*s < 0x20)
+            o = sdscatprintf(o,"\\u%04x",(unsigned char)*s);
+        else
+            o = sdscatlen(o,s,1);
+    }
+    return sdscatlen(o,"\"",1);
 }
 
 static void showLatencyReport(void) {
-    int i, curlat = 0;
-    float perc, reqpersec;
-
-    reqpersec = (float)config.requests_finished/((float)config.totlatency/1000);
-    if (!config.quiet && !config.csv) {
+    int finished = config.requests_finished;
+    float reqpersec, hitrate;
+    hdrHistogram *h = config.latency;
+    double avg = hdrMean(h)/1000, min = (double)hdrMin(h)/1000,
+           max = (double)hdrMax(h)/1000,
+           p50 = (double)hdrValueAtPercentile(h,50)/1000,
+           p99 = (double)hdrValueAtPercentile(h,99)/1000,
+           p999 = (double)hdrValueAtPercentile(h,99.9)/1000,
+           p9999 = (double)hdrValueAtPercentile(h,99.99)/1000;
+    static int csv_header = 0;
+
+    if (finished > config.requests) finished = config.requests;
+    reqpersec = (float)finished/((float)config.totlatency/1000);
+    hitrate = finished ?
+        100-((float)config.nil_replies*100/finished) : 0;
+    if (config.json) {
+        sds o = sdsnew("{\"test\":");
+
+        o = catJsonString(o,config.title);
+        o = sdscatprintf(o,",\"requests\":%d,\"seconds\":%.3f,"
+            "\"clients\":%d,\"threads\":%d,\"pipeline\":%d,"
+            "\"data_size\":%d,\"rps\":%.2f,\"latency_ms\":{"
+            "\"avg\":%.3f,\"min\":%.3f,\"p50\":%.3f,\"p99\":%.3f,"
+            "\"p99.9\":%.3f,\"p99.99\":%.3f,\"max\":%.3f}",
+            finished,(float)config.totlatency/1000,
+            config.numclients,config.numthreads,config.pipeline,
+            config.datasize,reqpersec,avg,min,p50,p99,p999,p9999,max);
+        if (config.zipf_theta > 0)
+            o = sdscatprintf(o,",\"hit_rate\":%.2f",hitrate);
+        if (config.bytes_per_request)
+            o = sdscatprintf(o,",\"mb_per_sec\":%.2f",
+                reqpersec*config.bytes_per_request/(1024*1024));
+        if (config.cluster_mode)
+            o = sdscatprintf(o,",\"moved\":%lld",config.moved);
+        printf("%s}\n",o);
+        sdsfree(o);
+    } else if (!config.quiet && !config.csv) {
         printf("====== %s ======\n", config.title);
-        printf("  %d requests completed in %.2f seconds\n", config.requests_finished,
+        printf("  %d requests completed in %.2f seconds\n", finished,
             (float)config.totlatency/1000);
         printf("  %d parallel clients\n", config.numclients);
         printf("  %d bytes payload\n", config.datasize);
         printf("  keep alive: %d\n", config.keepalive);
+        if (config.numthreads > 1)
+            printf("  threads: %d\n", config.numthreads);
+        if (config.cluster_mode)
+            printf("  cluster mode: %d master nodes, %lld MOVED redirections\n",
+                config.cluster_num_nodes, config.moved);
         printf("\n");
 
-        qsort(config.latency,config.requests,sizeof(long long),compareLatency);
-        for (i = 0; i < config.requests; i++) {
-            if (config.latency[i]/1000 != curlat || i == (config.requests-1)) {
-                curlat = config.latency[i]/1000;
-                perc = ((float)(i+1)*100)/config.requests;
-                printf("%.2f%% <= %d milliseconds\n", perc, curlat);
-            }
-        }
-        printf("%.2f requests per second\n\n", reqpersec);
+        printf("Latency by percentile distribution:\n");
+        printf("%8.3f%% <= %.3f milliseconds\n", 50.0, p50);
+        printf("%8.3f%% <= %.3f milliseconds\n", 99.0, p99);
+        printf("%8.3f%% <= %.3f milliseconds\n", 99.9, p999);
+        printf("%8.3f%% <= %.3f milliseconds\n", 99.99, p9999);
+        printf("%8.3f%% <= %.3f milliseconds\n", 100.0, max);
+        printf("Latency avg %.3f, min %.3f milliseconds\n", avg, min);
+        printf("%.2f requests per second\n", reqpersec);
+        if (config.bytes_per_request)
+            printf("%.2f MB/s of bitmap data\n",
+                reqpersec*config.bytes_per_request/(1024*1024));
+        if (config.zipf_theta > 0)
+            printf("%.2f%% hit rate (%lld nil replies)\n",
+                hitrate, config.nil_replies);
+        printf("\n");
     } else if (config.csv) {
-        printf("\"%s\",\"%.2f\"\n", config.title, reqpersec);
+        if (!csv_header) {
+            printf("\"test\",\"rps\",\"avg_latency_ms\",\"min_latency_ms\","
+                   "\"p50_latency_ms\",\"p99_latency_ms\","
+                   "\"p99.9_latency_ms\",\"p99.99_latency_ms\","
+                   "\"max_latency_ms\"\n");
+            csv_header = 1;
+        }
+        printf("\"%s\",\"%.2f\",\"%.3f\",\"%.3f\",\"%.3f\",\"%.3f\","
+               "\"%.3f\",\"%.3f\",\"%.3f\"\n", config.title, reqpersec,
+               avg, min, p50, p99, p999, p9999, max);
+    } else if (config.zipf_theta > 0) {
+        printf("%s: %.2f requests per second, p50=%.3f msec, %.2f%% hit rate\n",
+            config.title, reqpersec, p50, hitrate);
+    } else if (config.bytes_per_request) {
+        printf("%s: %.2f requests per second, p50=%.3f msec, %.2f MB/s\n",
+            config.title, reqpersec, p50,
+            reqpersec*config.bytes_per_request/(1024*1024));
     } else {
-        printf("%s: %.2f requests per second\n", config.title, reqpersec);
+        printf("%s: %.2f requests per second, p50=%.3f msec\n",
+            config.title, reqpersec, p50);
+    }
+}
+
+static void *benchmarkThreadMain(void *arg) {
+    benchmarkThread *t = arg;
+
+    aeMain(t->el);
+    return NULL;
+}
+
+/* Run the event loops of all the threads until the current test is done.
+ * A single thread is served directly by the main thread. */
+static void runThreads(void) {
+    int j;
+
+    if (config.numthreads == 1) {
+        aeMain(config.threads[0]->el);
+        return;
     }
+    for (j = 0; j < config.numthreads; j++) {
+        benchmarkThread *t = config.threads[j];
+
+        if (pthread_create(&t->thread,NULL,benchmarkThreadMain,t) != 0) {
+            fprintf(stderr,"Can't create benchmark thread: %s\n",
+                strerror(errno));
+            exit(1);
+        }
+    }
+    for (j = 0; j < config.numthreads; j++)
+        pthread_join(config.threads[j]->thread,NULL);
 }
 
 static void benchmark(char *title, char *cmd, int len) {
     client c;
+    int j;
 
     config.title = title;
     config.requests_issued = 0;
     config.requests_finished = 0;
+    config.nil_replies = 0;
+    config.moved = 0;
+    for (j = 0; j < config.numthreads; j++)
+        hdrReset(config.threads[j]->latency);
 
-    c = createClient(cmd,len,NULL);
+    c = createClient(cmd,len,NULL,config.threads[0],
+        config.cluster_mode ? config.cluster_nodes[0] : NULL);
     createMissingClients(c);
 
     config.start = mstime();
-    aeMain(config.el);
+    runThreads();
     config.totlatency = mstime()-config.start;
 
+    hdrReset(config.latency);
+    for (j = 0; j < config.numthreads; j++)
+        hdrAdd(config.latency,config.threads[j]->latency);
     showLatencyReport();
     freeAllClients();
 }
 
+/* Return a blocking connection to the server, authenticated and with the
+ * selected DB, used to prepare the data of a few tests. Exits on error. */
+static redisContext *connectSync(void) {
+    redisContext *ctx;
+    redisReply *reply;
+
+    if (config.hostsocket == NULL)
+        ctx = redisConnect(config.hostip,config.hostport);
+    else
+        ctx = redisConnectUnix(config.hostsocket);
+    if (ctx->err) {
+        fprintf(stderr,"Could not connect to Redis: %s\n",ctx->errstr);
+        exit(1);
+    }
+    if (config.auth) {
+        reply = redisCommand(ctx,"AUTH %s",config.auth);
+        if (reply) freeReplyObject(reply);
+    }
+    if (config.dbnum) {
+        reply = redisCommand(ctx,"SELECT %d",config.dbnum);
+        if (reply) freeReplyObject(reply);
+    }
+    return ctx;
+}
+
+/* Load the slots configuration of the cluster from the server with
+ * CLUSTER SLOTS, and compute a hash tag for every slot, so that the clients
+ * can route their keys to the master they are connected to. */
+static void clusterInit(void) {
+    static const char *charset =
+        "0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ";
+    redisContext *ctx = connectSync();
+    redisReply *reply = redisCommand(ctx,"CLUSTER SLOTS");
+    int tagged = 0, i, j, k;
+    size_t e;
+
+    if (reply == NULL || reply->type != REDIS_REPLY_ARRAY) {
+        fprintf(stderr,"Cluster mode requires a Redis Cluster node: %s\n",
+            reply ? reply->str : ctx->errstr);
+        exit(1);
+    }
+    for (e = 0; e < reply->elements; e++) {
+        redisReply *r = reply->element[e], *master;
+        const char *ip;
+        clusterNode *node;
+        long long slot;
+
+        if (r->elements < 3) continue;
+        master = r->element[2];
+        /* A node that doesn't know its own address reports an empty one. */
+        ip = master->element[0]->len ? master->element[0]->str : config.hostip;
+        node = clusterGetNode(ip,(int)master->element[1]->integer);
+        for (slot = r->element[0]->integer; slot <= r->element[1]->integer;
+             slot++)
+            config.cluster_slots[slot] = node;
+    }
+    freeReplyObject(reply);
+    redisFree(ctx);
+    if (config.cluster_num_nodes == 0) {
+        fprintf(stderr,"No slots are assigned in the cluster\n");
+        exit(1);
+    }
+
+    /* Three alphanumeric characters hash to every one of the 16384 slots. */
+    for (i = 0; i < 62 && tagged < CLUSTER_SLOTS; i++) {
+        for (j = 0; j < 62; j++) {
+            for (k = 0; k < 62; k++) {
+                char tag[CLUSTER_TAG_LEN] = {charset[i],charset[j],charset[k]};
+                int slot = crc16(tag,CLUSTER_TAG_LEN) & (CLUSTER_SLOTS-1);
+
+                if (config.cluster_tags[slot][0] == '\0') {
+                    memcpy(config.cluster_tags[slot],tag,CLUSTER_TAG_LEN);
+                    tagged++;
+                }
+            }
+        }
+    }
+}
+
+/* Benchmark BITCOUNT, BITPOS and BITOP against keys of --bitmap bytes.
+ * Servers supporting DEBUG BITOPS-KERNEL are benchmarked with every
+ * bitmap kernel the CPU supports, so that they can be compared. */
+static void benchmarkBitmaps(void) {
+    char *kernels[] = {"scalar","popcnt","avx2",NULL};
+    const char **argv = zmalloc(sizeof(char*)*(config.bitmap_keys+3));
+    char *data = zmalloc(config.bitmap_size);
+    redisContext *ctx = connectSync();
+    redisReply *reply;
+    sds title;
+    char *cmd;
+    int j, k, len;
+
+    /* Random bitmaps for BITCOUNT and BITOP, and a bitmap with just the
+     * last bit set for BITPOS, that must scan it all. */
+    argv[0] = "BITOP";
+    argv[1] = "AND";
+    argv[2] = "bitmap:dest";
+    for (j = 0; j < config.bitmap_keys; j++) {
+        for (k = 0; k < config.bitmap_size; k++) data[k] = random();
+        argv[j+3] = sdscatprintf(sdsempty(),"bitmap:%d",j);
+        reply = redisCommand(ctx,"SET %s %b",argv[j+3],data,
+                             (size_t)config.bitmap_size);
+        if (reply) freeReplyObject(reply);
+    }
+    reply = redisCommand(ctx,"DEL bitmap:sparse");
+    if (reply) freeReplyObject(reply);
+    reply = redisCommand(ctx,"SETBIT bitmap:sparse %lld 1",
+                         (long long)config.bitmap_size*8-1);
+    if (reply) freeReplyObject(reply);
+
+    for (k = 0; kernels[k]; k++) {
+        char *kernel = kernels[k];
+
+        reply = redisCommand(ctx,"DEBUG BITOPS-KERNEL %s",kernel);
+        if (reply == NULL) {
+            fprintf(stderr,"Error talking with the server: %s\n",ctx->errstr);
+            exit(1);
+        }
+        if (reply->type == REDIS_REPLY_ERROR) {
+            int unsupported = strstr(reply->str,"Unknown DEBUG") != NULL;
+
+            freeReplyObject(reply);
+            /* Old server: run the tests once with the default kernel. */
+            if (unsupported && k == 0) kernel = "default";
+            else continue;
+        } else {
+            freeReplyObject(reply);
+        }
+        config.bytes_per_request = config.bitmap_size;
+
+        if (test_is_selected("bitcount")) {
+            title = sdscatprintf(sdsempty(),"BITCOUNT (%s)",kernel);
+            len = redisFormatCommand(&cmd,"BITCOUNT bitmap:0");
+            benchmark(title,cmd,len);
+            free(cmd);
+            sdsfree(title);
+        }
+
+        if (test_is_selected("bitpos")) {
+            title = sdscatprintf(sdsempty(),"BITPOS (%s)",kernel);
+            len = redisFormatCommand(&cmd,"BITPOS bitmap:sparse 1");
+            benchmark(title,cmd,len);
+            free(cmd);
+            sdsfree(title);
+        }
+
+        if (test_is_selected("bitop")) {
+            title = sdscatprintf(sdsempty(),"BITOP AND %d keys (%s)",
+                config.bitmap_keys,kernel);
+            config.bytes_per_request =
+                (long long)config.bitmap_size*config.bitmap_keys;
+            len = redisFormatCommandArgv(&cmd,config.bitmap_keys+3,argv,NULL);
+            benchmark(title,cmd,len);
+            free(cmd);
+            sdsfree(title);
+        }
+        config.bytes_per_request = 0;
+        if (!strcmp(kernel,"default")) break;
+    }
+
+    reply = redisCommand(ctx,"DEBUG BITOPS-KERNEL auto");
+    if (reply) freeReplyObject(reply);
+    redisFree(ctx);
+    for (j = 0; j < config.bitmap_keys; j++) sdsfree((sds)argv[j+3]);
+    zfree(argv);
+    zfree(data);
+}
+
 /* Returns number of consumed options. */
 int parseOptions(int argc, const char **argv) {
     int i;
@@ -510,10 +1062,37 @@ int parseOptions(int argc, const char **argv) {
             config.randomkeys_keyspacelen = atoi(argv[++i]);
             if (config.randomkeys_keyspacelen < 0)
                 config.randomkeys_keyspacelen = 0;
+        } else if (!strcmp(argv[i],"--bitmap")) {
+            if (lastarg) goto invalid;
+            config.bitmap_size = atoi(argv[++i]);
+            if (config.bitmap_size < 0) config.bitmap_size = 0;
+            if (config.bitmap_size > 512*1024*1024)
+                config.bitmap_size = 512*1024*1024;
+        } else if (!strcmp(argv[i],"--bitmap-keys")) {
+            if (lastarg) goto invalid;
+            config.bitmap_keys = atoi(argv[++i]);
+            if (config.bitmap_keys < 1) config.bitmap_keys = 1;
+        } else if (!strcmp(argv[i],"--zipf")) {
+            if (lastarg) goto invalid;
+            config.zipf_theta = strtod(argv[++i],NULL);
+            if (config.zipf_theta <= 0 || config.zipf_theta >= 1) {
+                fprintf(stderr,"--zipf skew must be > 0 and < 1\n");
+                exit(1);
+            }
         } else if (!strcmp(argv[i],"-q")) {
             config.quiet = 1;
         } else if (!strcmp(argv[i],"--csv")) {
             config.csv = 1;
+        } else if (!strcmp(argv[i],"--json")) {
+            config.json = 1;
+        } else if (!strcmp(argv[i],"--threads")) {
+            if (lastarg) goto invalid;
+            config.numthreads = atoi(argv[++i]);
+            if (config.numthreads < 1) config.numthreads = 1;
+            if (config.numthreads > MAX_THREADS)
+                config.numthreads = MAX_THREADS;
+        } else if (!strcmp(argv[i],"--cluster")) {
+            config.cluster_mode = 1;
         } else if (!strcmp(argv[i],"-l")) {
             config.loop = 1;
         } else if (!strcmp(argv[i],"-I")) {
@@ -568,9 +1147,24 @@ usage:
 "  from 0 to keyspacelen-1. The substitution changes every time a command\n"
 "  is executed. Default tests use this to hit random keys in the\n"
 "  specified range.\n"
+" --zipf <skew>      Pick the -r random keys with a Zipfian distribution\n"
+"  instead of a uniform one: key 0 is the most popular, key 1 the second\n"
+"  and so forth. The skew must be > 0 and < 1, 0.99 is a typical value for\n"
+"  caches. The percentage of non-nil replies (hit rate) is reported too.\n"
+" --bitmap <bytes>   Also benchmark BITCOUNT, BITPOS and BITOP against\n"
+"  bitmaps of the specified size, with every bitmap kernel the server\n"
+"  supports on this CPU. Throughput is reported in MB/s as well.\n"
+" --bitmap-keys <n>  Number of source keys of the BITOP test (default 4)\n"
+" --threads <num>    Serve the clients with <num> threads, every one with\n"
+"  its own event loop (default 1).\n"
+" --cluster          Benchmark a Redis Cluster: the slots configuration is\n"
+"  loaded from the given node, the clients are spread across the masters,\n"
+"  and the {tag} string inside the keys is replaced with a hash tag served\n"
+"  by the client node. MOVED redirections are followed.\n"
 " -P <numreq>        Pipeline <numreq> requests. Default 1 (no pipeline).\n"
-" -q                 Quiet. Just show query/sec values\n"
+" -q                 Quiet. Just show query/sec and median latency values\n"
 " --csv              Output in CSV format\n"
+" --json             Output one JSON object per test\n"
 " -l                 Loop. Run the tests forever\n"
 " -t <tests>         Only run the comma separated list of tests. The test\n"
 "                    names are the same as the ones produced as output.\n"
@@ -586,6 +1180,13 @@ usage:
 "   $ redis-benchmark -t ping,set,get -n 100000 --csv\n\n"
 " Benchmark a specific command line:\n"
 "   $ redis-benchmark -r 10000 -n 10000 eval 'return redis.call(\"ping\")' 0\n\n"
+" Compare the hit rate of eviction policies, with a cache smaller than the\n"
+" keyspace, by running this after a CONFIG SET maxmemory-policy:\n"
+"   $ redis-benchmark -t set,get -n 1000000 -r 1000000 --zipf 0.99\n\n"
+" Benchmark a cluster with 8 threads, exporting the latency percentiles:\n"
+"   $ redis-benchmark --cluster --threads 8 -c 400 -t set,get -r 1000000 --json\n\n"
+" Compare the bitmap kernels with 1 MB bitmaps and BITOP across 30 keys:\n"
+"   $ redis-benchmark -t bitcount,bitpos,bitop -n 2000 --bitmap 1048576 --bitmap-keys 30\n\n"
 " Fill a list with 10000 random elements:\n"
 "   $ redis-benchmark -r 10000 -n 10000 lpush mylist __rand_int__\n\n"
 " On user specified command lines __rand_int__ is replaced with a random integer\n"
@@ -595,27 +1196,45 @@ usage:
 }
 
 int showThroughput(struct aeEventLoop *eventLoop, long long id, void *clientData) {
+    benchmarkThread *t = clientData;
+    int liveclients, finished;
     REDIS_NOTUSED(eventLoop);
     REDIS_NOTUSED(id);
-    REDIS_NOTUSED(clientData);
 
-    if (config.liveclients == 0) {
+    atomicGet(config.liveclients,liveclients);
+    atomicGet(config.requests_finished,finished);
+    if (liveclients == 0 && finished < config.requests) {
         fprintf(stderr,"All clients disconnected... aborting.\n");
         exit(1);
-    } 
-    if (config.csv) return 250;
+    }
+    /* Just the first thread reports the progress. */
+    if (config.csv || config.json || t->index != 0) return 250;
     if (config.idlemode == 1) {
-        printf("clients: %d\r", config.liveclients);
+        printf("clients: %d\r", liveclients);
         fflush(stdout);
 	return 250;
     }
     float dt = (float)(mstime()-config.start)/1000.0;
-    float rps = (float)config.requests_finished/dt;
+    float rps = (float)finished/dt;
     printf("%s: %.2f\r", config.title, rps);
     fflush(stdout);
     return 250; /* every 250ms */
 }
 
+static benchmarkThread *createBenchmarkThread(int index) {
+    benchmarkThread *t = zmalloc(sizeof(*t));
+
+    t->index = index;
+    t->el = aeCreateEventLoop(1024*10);
+    aeCreateTimeEvent(t->el,1,showThroughput,t,NULL);
+    t->clients = listCreate();
+    t->latency = hdrCreate(LATENCY_HIST_MIN,LATENCY_HIST_MAX,
+                           LATENCY_HIST_SIGFIGS);
+    t->rand_state = ((uint64_t)random() << 32) ^ random() ^ (index+1);
+    if (t->rand_state == 0) t->rand_state = 1;
+    return t;
+}
+
 /* Return true if the named test was selected using the -t command line
  * switch, or if all the tests are selected (no -t passed by user). */
 int test_is_selected(char *name) {
@@ -632,7 +1251,7 @@ int test_is_selected(char *name) {
 
 int main(int argc, const char **argv) {
     int i;
-    char *data, *cmd;
+    char *data, *cmd, *tag, msetkey[32];
     int len;
 
     client c;
@@ -642,21 +1261,29 @@ int main(int argc, const char **argv) {
     signal(SIGPIPE, SIG_IGN);
 
     config.numclients = 50;
+    config.numthreads = 1;
     config.requests = 100000;
     config.liveclients = 0;
-    config.el = aeCreateEventLoop(1024*10);
-    aeCreateTimeEvent(config.el,1,showThroughput,NULL,NULL);
     config.keepalive = 1;
     config.datasize = 3;
     config.pipeline = 1;
     config.randomkeys = 0;
     config.randomkeys_keyspacelen = 0;
+    config.zipf_theta = 0;
+    config.nil_replies = 0;
+    config.bitmap_size = 0;
+    config.bitmap_keys = 4;
+    config.bytes_per_request = 0;
     config.quiet = 0;
     config.csv = 0;
+    config.json = 0;
     config.loop = 0;
     config.idlemode = 0;
     config.latency = NULL;
-    config.clients = listCreate();
+    config.cluster_mode = 0;
+    config.cluster_num_nodes = 0;
+    config.cluster_nodes = NULL;
+    pthread_mutex_init(&config.cluster_mutex,NULL);
     config.hostip = "127.0.0.1";
     config.hostport = 6379;
     config.hostsocket = NULL;
@@ -668,7 +1295,30 @@ int main(int argc, const char **argv) {
     argc -= i;
     argv += i;
 
-    config.latency = zmalloc(sizeof(long long)*config.requests);
+    config.latency = hdrCreate(LATENCY_HIST_MIN,LATENCY_HIST_MAX,
+                               LATENCY_HIST_SIGFIGS);
+    if (config.numthreads > config.numclients)
+        config.numthreads = config.numclients;
+    if (config.numthreads > 1) zmalloc_enable_thread_safeness();
+    config.threads = zmalloc(sizeof(benchmarkThread*)*config.numthreads);
+    for (i = 0; i < config.numthreads; i++)
+        config.threads[i] = createBenchmarkThread(i);
+
+    if (config.cluster_mode) {
+        if (config.hostsocket || config.dbnum || config.bitmap_size) {
+            fprintf(stderr,"--cluster can't be used with -s, --dbnum and --bitmap\n");
+            exit(1);
+        }
+        clusterInit();
+    }
+
+    if (config.zipf_theta > 0) {
+        if (config.randomkeys_keyspacelen < 2) {
+            fprintf(stderr,"--zipf requires -r with a keyspace of at least 2 keys\n");
+            exit(1);
+        }
+        zipfInit();
+    }
 
     if (config.keepalive == 0) {
         printf("WARNING: keepalive disabled, you probably need 'echo 1 > /proc/sys/net/ipv4/tcp_tw_reuse' for Linux and 'sudo sysctl -w net.inet.tcp.msl=1000' for Mac OS X in order to use a lot of clients/requests\n");
@@ -676,9 +1326,10 @@ int main(int argc, const char **argv) {
 
     if (config.idlemode) {
         printf("Creating %d idle connections and waiting forever (Ctrl+C when done)\n", config.numclients);
-        c = createClient("",0,NULL); /* will never receive a reply */
+        c = createClient("",0,NULL,config.threads[0], /* will never receive a reply */
+            config.cluster_mode ? config.cluster_nodes[0] : NULL);
         createMissingClients(c);
-        aeMain(config.el);
+        runThreads();
         /* and will wait for every */
     }
 
@@ -699,7 +1350,10 @@ int main(int argc, const char **argv) {
         return 0;
     }
 
-    /* Run default benchmark suite. */
+    /* Run default benchmark suite. In cluster mode every key includes a
+     * {tag}, so that the keys of a client are served by its node. */
+    tag = config.cluster_mode ? "{tag}" : "";
+    snprintf(msetkey,sizeof(msetkey),"key%s:__rand_int__",tag);
     data = zmalloc(config.datasize+1);
     do {
         memset(data,'x',config.datasize);
@@ -715,44 +1369,44 @@ int main(int argc, const char **argv) {
         }
 
         if (test_is_selected("set")) {
-            len = redisFormatCommand(&cmd,"SET key:__rand_int__ %s",data);
+            len = redisFormatCommand(&cmd,"SET key%s:__rand_int__ %s",tag,data);
             benchmark("SET",cmd,len);
             free(cmd);
         }
 
         if (test_is_selected("get")) {
-            len = redisFormatCommand(&cmd,"GET key:__rand_int__");
+            len = redisFormatCommand(&cmd,"GET key%s:__rand_int__",tag);
             benchmark("GET",cmd,len);
             free(cmd);
         }
 
         if (test_is_selected("incr")) {
-            len = redisFormatCommand(&cmd,"INCR counter:__rand_int__");
+            len = redisFormatCommand(&cmd,"INCR counter%s:__rand_int__",tag);
             benchmark("INCR",cmd,len);
             free(cmd);
         }
 
         if (test_is_selected("lpush")) {
-            len = redisFormatCommand(&cmd,"LPUSH mylist %s",data);
+            len = redisFormatCommand(&cmd,"LPUSH mylist%s %s",tag,data);
             benchmark("LPUSH",cmd,len);
             free(cmd);
         }
 
         if (test_is_selected("lpop")) {
-            len = redisFormatCommand(&cmd,"LPOP mylist");
+            len = redisFormatCommand(&cmd,"LPOP mylist%s",tag);
             benchmark("LPOP",cmd,len);
             free(cmd);
         }
 
         if (test_is_selected("sadd")) {
             len = redisFormatCommand(&cmd,
-                "SADD myset element:__rand_int__");
+                "SADD myset%s element:__rand_int__",tag);
             benchmark("SADD",cmd,len);
             free(cmd);
         }
 
         if (test_is_selected("spop")) {
-            len = redisFormatCommand(&cmd,"SPOP myset");
+            len = redisFormatCommand(&cmd,"SPOP myset%s",tag);
             benchmark("SPOP",cmd,len);
             free(cmd);
         }
@@ -763,31 +1417,31 @@ int main(int argc, const char **argv) {
             test_is_selected("lrange_500") ||
             test_is_selected("lrange_600"))
         {
-            len = redisFormatCommand(&cmd,"LPUSH mylist %s",data);
+            len = redisFormatCommand(&cmd,"LPUSH mylist%s %s",tag,data);
             benchmark("LPUSH (needed to benchmark LRANGE)",cmd,len);
             free(cmd);
         }
 
         if (test_is_selected("lrange") || test_is_selected("lrange_100")) {
-            len = redisFormatCommand(&cmd,"LRANGE mylist 0 99");
+            len = redisFormatCommand(&cmd,"LRANGE mylist%s 0 99",tag);
             benchmark("LRANGE_100 (first 100 elements)",cmd,len);
             free(cmd);
         }
 
         if (test_is_selected("lrange") || test_is_selected("lrange_300")) {
-            len = redisFormatCommand(&cmd,"LRANGE mylist 0 299");
+            len = redisFormatCommand(&cmd,"LRANGE mylist%s 0 299",tag);
             benchmark("LRANGE_300 (first 300 elements)",cmd,len);
             free(cmd);
         }
 
         if (test_is_selected("lrange") || test_is_selected("lrange_500")) {
-            len = redisFormatCommand(&cmd,"LRANGE mylist 0 449");
+            len = redisFormatCommand(&cmd,"LRANGE mylist%s 0 449",tag);
             benchmark("LRANGE_500 (first 450 elements)",cmd,len);
             free(cmd);
         }
 
         if (test_is_selected("lrange") || test_is_selected("lrange_600")) {
-            len = redisFormatCommand(&cmd,"LRANGE mylist 0 599");
+            len = redisFormatCommand(&cmd,"LRANGE mylist%s 0 599",tag);
             benchmark("LRANGE_600 (first 600 elements)",cmd,len);
             free(cmd);
         }
@@ -796,7 +1450,7 @@ int main(int argc, const char **argv) {
             const char *argv[21];
             argv[0] = "MSET";
             for (i = 1; i < 21; i += 2) {
-                argv[i] = "key:__rand_int__";
+                argv[i] = msetkey;
                 argv[i+1] = data;
             }
             len = redisFormatCommandArgv(&cmd,21,argv,NULL);
@@ -804,7 +1458,11 @@ int main(int argc, const char **argv) {
             free(cmd);
         }
 
-        if (!config.csv) printf("\n");
+        if (config.bitmap_size &&
+            (test_is_selected("bitcount") || test_is_selected("bitpos") ||
+             test_is_selected("bitop"))) benchmarkBitmaps();
+
+        if (!config.csv && !config.json) printf("\n");
     } while(config.loop);
 
     return 0;
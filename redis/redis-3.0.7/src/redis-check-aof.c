@@ -185,6 +185,16 @@ int main(int argc, char **argv) {
         exit(1);
     }
 
+    /* AOF files rewritten with aof-use-rdb-preamble start with an RDB
+     * payload, that this tool is not able to parse. */
+    char sig[5];
+    if (fread(sig,1,5,fp) == 5 && memcmp(sig,"REDIS",5) == 0) {
+        printf("The AOF starts with an RDB preamble: checking it is not "
+               "supported, the server verifies the RDB checksum on load.\n");
+        exit(1);
+    }
+    rewind(fp);
+
     off_t pos = process(fp);
     off_t diff = size-pos;
     printf("AOF analyzed: size=%lld, ok_up_to=%lld, diff=%lld\n",
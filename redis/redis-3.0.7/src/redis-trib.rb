@@ -905,6 +905,38 @@ class RedisTrib
         }
     end
 
+    # Move all the keys of a slot in MIGRATING state to the target node with
+    # CLUSTER MIGRATESLOT, waiting for the source node to complete the
+    # migration. Returns false if the source node does not support it.
+    def migrate_slot_keys(source,target,slot,o)
+        args = ["migrateslot",slot,"batch",o[:pipeline]]
+        args << "replace" if o[:fix]
+        begin
+            source.r.cluster(*args)
+        rescue => e
+            return false if e.to_s =~ /Wrong CLUSTER subcommand/
+            puts ""
+            xputs "[ERR] #{e}"
+            exit 1
+        end
+        while true
+            status = {}
+            source.r.cluster("migrateslot","status").split("\r\n").each{|l|
+                k,v = l.split(":",2)
+                status[k] = v
+            }
+            break if status["state"] == "done"
+            if status["state"] != "running" && status["state"] != "connecting"
+                puts ""
+                xputs "[ERR] Migration of slot #{slot} #{status["state"]}: #{status["error"]}"
+                exit 1
+            end
+            sleep 0.1
+        end
+        print "."*status["keys_migrated"].to_i if o[:dots]
+        true
+    end
+
     # Move slots between source and target nodes using MIGRATE.
     #
     # Options:
@@ -929,8 +961,11 @@ class RedisTrib
             target.r.cluster("setslot",slot,"importing",source.info[:name])
             source.r.cluster("setslot",slot,"migrating",target.info[:name])
         end
-        # Migrate all the keys from source to target using the MIGRATE command
-        while true
+        # Migrate all the keys from source to target. Nodes supporting
+        # CLUSTER MIGRATESLOT stream the keys by themselves, otherwise
+        # we use the MIGRATE command.
+        use_migrate = o[:cold] || !migrate_slot_keys(source,target,slot,o)
+        while use_migrate
             keys = source.r.cluster("getkeysinslot",slot,o[:pipeline])
             break if keys.length == 0
             begin
@@ -32,6 +32,7 @@
 #include "slowlog.h"
 #include "bio.h"
 #include "latency.h"
+#include "atomicvar.h"
 
 #include <time.h>
 #include <signal.h>
@@ -129,6 +130,7 @@ struct redisCommand redisCommandTable[] = {
     {"append",appendCommand,3,"wm",0,NULL,1,1,1,0,0},
     {"strlen",strlenCommand,2,"rF",0,NULL,1,1,1,0,0},
     {"del",delCommand,-2,"w",0,NULL,1,-1,1,0,0},
+    {"unlink",unlinkCommand,-2,"wF",0,NULL,1,-1,1,0,0},
     {"exists",existsCommand,-2,"rF",0,NULL,1,-1,1,0,0},
     {"setbit",setbitCommand,4,"wm",0,NULL,1,1,1,0,0},
     {"getbit",getbitCommand,3,"rF",0,NULL,1,1,1,0,0},
@@ -238,8 +240,8 @@ struct redisCommand redisCommandTable[] = {
     {"sync",syncCommand,1,"ars",0,NULL,0,0,0,0,0},
     {"psync",syncCommand,3,"ars",0,NULL,0,0,0,0,0},
     {"replconf",replconfCommand,-1,"arslt",0,NULL,0,0,0,0,0},
-    {"flushdb",flushdbCommand,1,"w",0,NULL,0,0,0,0,0},
-    {"flushall",flushallCommand,1,"w",0,NULL,0,0,0,0,0},
+    {"flushdb",flushdbCommand,-1,"w",0,NULL,0,0,0,0,0},
+    {"flushall",flushallCommand,-1,"w",0,NULL,0,0,0,0,0},
     {"sort",sortCommand,-2,"wm",0,sortGetKeys,1,1,1,0,0},
     {"info",infoCommand,-1,"rlt",0,NULL,0,0,0,0,0},
     {"monitor",monitorCommand,1,"ars",0,NULL,0,0,0,0,0},
@@ -476,6 +478,11 @@ unsigned int dictSdsHash(const void *key) {
     return dictGenHashFunction((unsigned char*)key, sdslen((char*)key));
 }
 
+/* Hash the pointer itself, not the object it points to. */
+unsigned int dictPtrHash(const void *key) {
+    return dictGenHashFunction((unsigned char*)&key, sizeof(key));
+}
+
 unsigned int dictSdsCaseHash(const void *key) {
     return dictGenCaseHashFunction((unsigned char*)key, sdslen((char*)key));
 }
@@ -528,19 +535,24 @@ dictType setDictType = {
     NULL,                      /* val dup */
     dictEncObjKeyCompare,      /* key compare */
     dictRedisObjectDestructor, /* key destructor */
-    NULL                       /* val destructor */
+    NULL,                      /* val destructor */
+    NULL                       /* allow expand */
 };
 
-/* Sorted sets hash (note: a skiplist is used in addition to the hash table) */
+/* Sorted sets hash (note: a skiplist is used in addition to the hash table).
+ * The elements are owned by the skiplist, so they are not released here. */
 dictType zsetDictType = {
     dictEncObjHash,            /* hash function */
     NULL,                      /* key dup */
     NULL,                      /* val dup */
     dictEncObjKeyCompare,      /* key compare */
-    dictRedisObjectDestructor, /* key destructor */
-    NULL                       /* val destructor */
+    NULL,                      /* key destructor */
+    NULL,                      /* val destructor */
+    NULL                       /* allow expand */
 };
 
+int dictExpandAllowedAsync(dict *d, unsigned long size);
+
 /* Db->dict, keys are sds strings, vals are Redis objects. */
 dictType dbDictType = {
     dictSdsHash,                /* hash function */
@@ -548,7 +560,8 @@ dictType dbDictType = {
     NULL,                       /* val dup */
     dictSdsKeyCompare,          /* key compare */
     dictSdsDestructor,          /* key destructor */
-    dictRedisObjectDestructor   /* val destructor */
+    dictRedisObjectDestructor,  /* val destructor */
+    dictExpandAllowedAsync      /* allow expand */
 };
 
 /* server.lua_scripts sha (as sds string) -> scripts (as robj) cache. */
@@ -558,7 +571,8 @@ dictType shaScriptObjectDictType = {
     NULL,                       /* val dup */
     dictSdsKeyCaseCompare,      /* key compare */
     dictSdsDestructor,          /* key destructor */
-    dictRedisObjectDestructor   /* val destructor */
+    dictRedisObjectDestructor,  /* val destructor */
+    NULL                        /* allow expand */
 };
 
 /* Db->expires */
@@ -568,7 +582,8 @@ dictType keyptrDictType = {
     NULL,                      /* val dup */
     dictSdsKeyCompare,         /* key compare */
     NULL,                      /* key destructor */
-    NULL                       /* val destructor */
+    NULL,                      /* val destructor */
+    dictExpandAllowedAsync     /* allow expand */
 };
 
 /* Command table. sds string -> command struct pointer. */
@@ -578,7 +593,8 @@ dictType commandTableDictType = {
     NULL,                      /* val dup */
     dictSdsKeyCaseCompare,     /* key compare */
     dictSdsDestructor,         /* key destructor */
-    NULL                       /* val destructor */
+    NULL,                      /* val destructor */
+    NULL                       /* allow expand */
 };
 
 /* Hash type hash table (note that small hashes are represented with ziplists) */
@@ -588,7 +604,8 @@ dictType hashDictType = {
     NULL,                       /* val dup */
     dictEncObjKeyCompare,       /* key compare */
     dictRedisObjectDestructor,  /* key destructor */
-    dictRedisObjectDestructor   /* val destructor */
+    dictRedisObjectDestructor,  /* val destructor */
+    NULL                        /* allow expand */
 };
 
 /* Keylist hash table type has unencoded redis objects as keys and
@@ -600,7 +617,8 @@ dictType keylistDictType = {
     NULL,                       /* val dup */
     dictObjKeyCompare,          /* key compare */
     dictRedisObjectDestructor,  /* key destructor */
-    dictListDestructor          /* val destructor */
+    dictListDestructor,         /* val destructor */
+    NULL                        /* allow expand */
 };
 
 /* Cluster nodes hash table, mapping nodes addresses 1.2.3.4:6379 to
@@ -611,7 +629,8 @@ dictType clusterNodesDictType = {
     NULL,                       /* val dup */
     dictSdsKeyCompare,          /* key compare */
     dictSdsDestructor,          /* key destructor */
-    NULL                        /* val destructor */
+    NULL,                       /* val destructor */
+    NULL                        /* allow expand */
 };
 
 /* Cluster re-addition blacklist. This maps node IDs to the time
@@ -623,7 +642,46 @@ dictType clusterNodesBlackListDictType = {
     NULL,                       /* val dup */
     dictSdsKeyCaseCompare,      /* key compare */
     dictSdsDestructor,          /* key destructor */
-    NULL                        /* val destructor */
+    NULL,                       /* val destructor */
+    NULL                        /* allow expand */
+};
+
+/* Redis Cluster slot -> keys index. Keys are the very same sds strings used
+ * by the main dictionary of the DB, so they are hashed and compared by
+ * pointer, and are never freed by this dictionary. */
+dictType slotToKeyDictType = {
+    dictPtrHash,                /* hash function */
+    NULL,                       /* key dup */
+    NULL,                       /* val dup */
+    NULL,                       /* key compare */
+    NULL,                       /* key destructor */
+    NULL,                       /* val destructor */
+    NULL                        /* allow expand */
+};
+
+/* CLUSTER MIGRATESLOT keys dict type: sds key copies -> zmalloc()ed
+ * migration state of the key. */
+dictType migrateSlotKeysDictType = {
+    dictSdsHash,                /* hash function */
+    NULL,                       /* key dup */
+    NULL,                       /* val dup */
+    dictSdsKeyCompare,          /* key compare */
+    dictSdsDestructor,          /* key destructor */
+    dictVanillaFree,            /* val destructor */
+    NULL                        /* allow expand */
+};
+
+/* Keys already written by a forkless BGSAVE ahead of its scan cursor.
+ * Like in slotToKeyDictType the keys are the sds strings owned by the main
+ * dictionary of the DB, so they are hashed and compared by pointer. */
+dictType rdbForklessKeysDictType = {
+    dictPtrHash,                /* hash function */
+    NULL,                       /* key dup */
+    NULL,                       /* val dup */
+    NULL,                       /* key compare */
+    NULL,                       /* key destructor */
+    NULL,                       /* val destructor */
+    NULL                        /* allow expand */
 };
 
 /* Migrate cache dict type. */
@@ -633,7 +691,8 @@ dictType migrateCacheDictType = {
     NULL,                       /* val dup */
     dictSdsKeyCompare,          /* key compare */
     dictSdsDestructor,          /* key destructor */
-    NULL                        /* val destructor */
+    NULL,                       /* val destructor */
+    NULL                        /* allow expand */
 };
 
 /* Replication cached script dict (server.repl_scriptcache_dict).
@@ -645,7 +704,8 @@ dictType replScriptCacheDictType = {
     NULL,                       /* val dup */
     dictSdsKeyCaseCompare,      /* key compare */
     dictSdsDestructor,          /* key destructor */
-    NULL                        /* val destructor */
+    NULL,                       /* val destructor */
+    NULL                        /* allow expand */
 };
 
 int htNeedsResize(dict *dict) {
@@ -666,25 +726,170 @@ void tryResizeHashTables(int dbid) {
         dictResize(server.db[dbid].expires);
 }
 
+/* ------------------- Background hash table allocation ---------------------
+ *
+ * When the keyspace grows (or shrinks) dict.c needs a new bucket array of
+ * 2^n pointers. For big databases this is hundreds of megabytes of memory that
+ * zcalloc() has to fault in and zero while the server is blocked, so for
+ * tables of at least 'dict-async-alloc-threshold' buckets the allocation is
+ * performed by a bio.c thread instead. In the meantime the dictionary keeps
+ * using its current table with a higher load factor, and once the new table
+ * is ready the main thread installs it and the usual incremental rehashing
+ * starts. */
+
+typedef struct dictAllocRequest {
+    dict *d;                /* Dictionary the table is for. */
+    unsigned long size;     /* Number of buckets. */
+    dictEntry **table;      /* The table, set by the bio thread. */
+    int done;               /* Set to 1 by the bio thread when ready. */
+} dictAllocRequest;
+
+/* Allocate and zero the table in a bio.c thread. Writing every page here
+ * is the whole point: the main thread will never take the page faults. */
+void dictAllocTableFromBioThread(void *ptr) {
+    dictAllocRequest *req = ptr;
+    dictEntry **table = zmalloc(req->size*sizeof(dictEntry*));
+
+    memset(table,0,req->size*sizeof(dictEntry*));
+    req->table = table;
+    atomicSetWithSync(req->done,1);
+}
+
+/* Return the list node of the pending request for 'd', or NULL. */
+static listNode *dictAllocRequestLookup(dict *d) {
+    listIter li;
+    listNode *ln;
+
+    listRewind(server.dict_alloc_requests,&li);
+    while((ln = listNext(&li))) {
+        dictAllocRequest *req = ln->value;
+        if (req->d == d) return ln;
+    }
+    return NULL;
+}
+
+/* Try to install the table of a completed request into its dictionary.
+ * The dictionary may no longer exist (FLUSHALL, SWAPDB-like operations)
+ * or may have changed so much that the table is no longer useful: in such
+ * cases the table is just released. The request is always freed. */
+static void dictAllocRequestComplete(dictAllocRequest *req) {
+    int j, installed = 0;
+
+    for (j = 0; j < server.dbnum; j++) {
+        if (req->d != server.db[j].dict && req->d != server.db[j].expires)
+            continue;
+        /* Don't install a table much larger than what the dictionary
+         * currently needs, for instance after it was emptied. */
+        if (req->size/4 <= dictSize(req->d) &&
+            dictExpandWithTable(req->d,req->table,req->size) == DICT_OK)
+        {
+            installed = 1;
+            server.stat_dict_async_allocs++;
+        }
+        break;
+    }
+    if (!installed) zfree(req->table);
+    zfree(req);
+}
+
+/* The 'expandAllowed' callback of the keyspace dictionaries. Small tables
+ * are allocated inline as usual, big ones are requested to a bio thread and
+ * the resize is deferred until the table is ready. */
+int dictExpandAllowedAsync(dict *d, unsigned long size) {
+    dictAllocRequest *req;
+    listNode *ln;
+    int done;
+
+    /* While loading there is no event loop to complete the request: resize
+     * synchronously as usual. */
+    if (server.dict_async_alloc_threshold == 0 ||
+        size < server.dict_async_alloc_threshold ||
+        server.loading) return 1;
+
+    /* A request for this dictionary is already in progress. If it is ready
+     * (for instance we are in the middle of a long MULTI or script, so
+     * beforeSleep() did not run yet) install it right now. */
+    if ((ln = dictAllocRequestLookup(d)) != NULL) {
+        req = ln->value;
+        atomicGetWithSync(req->done,done);
+        if (done) {
+            listDelNode(server.dict_alloc_requests,ln);
+            dictAllocRequestComplete(req);
+        }
+        return 0;
+    }
+
+    req = zmalloc(sizeof(*req));
+    req->d = d;
+    req->size = size;
+    req->table = NULL;
+    req->done = 0;
+    listAddNodeTail(server.dict_alloc_requests,req);
+    bioCreateBackgroundJob(REDIS_BIO_ALLOC_TABLE,req,NULL,NULL);
+    return 0;
+}
+
+/* Install the tables allocated by the bio thread so far. Called by
+ * beforeSleep() and databasesCron(). */
+void handleDictAllocRequests(void) {
+    listIter li;
+    listNode *ln;
+
+    listRewind(server.dict_alloc_requests,&li);
+    while((ln = listNext(&li))) {
+        dictAllocRequest *req = ln->value;
+        int done;
+
+        atomicGetWithSync(req->done,done);
+        if (!done) continue;
+        listDelNode(server.dict_alloc_requests,ln);
+        dictAllocRequestComplete(req);
+    }
+}
+
 /* Our hash table implementation performs rehashing incrementally while
  * we write/read from the hash table. Still if the server is idle, the hash
- * table will use two tables for a long time. So we try to use 1 millisecond
- * of CPU time at every call of this function to perform some rehahsing.
+ * table will use two tables for a long time. So we try to use some CPU time
+ * at every call of this function to perform some rehahsing.
+ *
+ * The amount of time is server.rehash_budget_us, that adapts to the
+ * latency the server is experiencing: it is halved every time serverCron()
+ * ran more than REDIS_REHASH_MAX_LAG microseconds late, because the event
+ * loop was busy serving clients, or the previous run took much more than
+ * expected, and otherwise slowly grows back up to REDIS_REHASH_BUDGET_MAX,
+ * so that rehashing a huge table never causes stalls of several
+ * milliseconds.
  *
  * The function returns 1 if some rehashing was performed, otherwise 0
  * is returned. */
 int incrementallyRehash(int dbid) {
-    /* Keys dictionary */
-    if (dictIsRehashing(server.db[dbid].dict)) {
-        dictRehashMilliseconds(server.db[dbid].dict,1);
-        return 1; /* already used our millisecond for this loop... */
-    }
-    /* Expires */
-    if (dictIsRehashing(server.db[dbid].expires)) {
-        dictRehashMilliseconds(server.db[dbid].expires,1);
-        return 1; /* already used our millisecond for this loop... */
+    dict *d;
+    long long start, elapsed;
+
+    if (dictIsRehashing(server.db[dbid].dict))
+        d = server.db[dbid].dict;       /* Keys dictionary */
+    else if (dictIsRehashing(server.db[dbid].expires))
+        d = server.db[dbid].expires;    /* Expires */
+    else
+        return 0;
+
+    start = ustime();
+    dictRehashMicroseconds(d,server.rehash_budget_us);
+    elapsed = ustime()-start;
+    latencyAddSampleIfNeeded("active-rehash",elapsed/1000);
+
+    if (elapsed > server.rehash_budget_us*2 ||
+        server.cron_lag_us > REDIS_REHASH_MAX_LAG)
+    {
+        server.rehash_budget_us /= 2;
+        if (server.rehash_budget_us < REDIS_REHASH_BUDGET_MIN)
+            server.rehash_budget_us = REDIS_REHASH_BUDGET_MIN;
+    } else if (server.rehash_budget_us < REDIS_REHASH_BUDGET_MAX) {
+        server.rehash_budget_us += server.rehash_budget_us/2;
+        if (server.rehash_budget_us > REDIS_REHASH_BUDGET_MAX)
+            server.rehash_budget_us = REDIS_REHASH_BUDGET_MAX;
     }
-    return 0;
+    return 1; /* already used our time budget for this loop... */
 }
 
 /* This function is called once a background process of some kind terminates,
@@ -720,7 +925,10 @@ int activeExpireCycleTryExpire(redisDb *db, dictEntry *de, long long now) {
         robj *keyobj = createStringObject(key,sdslen(key));
 
         propagateExpire(db,keyobj);
-        dbDelete(db,keyobj);
+        if (server.lazyfree_lazy_expire)
+            dbAsyncDelete(db,keyobj);
+        else
+            dbSyncDelete(db,keyobj);
         notifyKeyspaceEvent(REDIS_NOTIFY_EXPIRED,
             "expired",keyobj,db->id);
         decrRefCount(keyobj);
@@ -731,6 +939,57 @@ int activeExpireCycleTryExpire(redisDb *db, dictEntry *de, long long now) {
     }
 }
 
+/* Helper function for the activeExpireCycle() function, used when the
+ * expire index is enabled. Reclaims the keys of 'db' that are due, in expire
+ * time order, until the first key that is not due is found, or the time
+ * limit of the cycle is reached: in this case 1 is returned. */
+static int activeExpireIndexCycle(redisDb *db, long long start, long long timelimit) {
+    long long now = mstime(), ttl_sum = 0;
+    int iteration = 0, ttl_samples = 0;
+    unsigned long num;
+    expireIndexNode *n;
+
+    /* Keys are expired only when their time is already elapsed: stop at the
+     * first key that is due in the current millisecond, or later. */
+    while((n = expireIndexFirst(db->expire_index)) != NULL && n->when < now) {
+        dictEntry *de = dictFind(db->expires,n->key);
+
+        redisAssert(de != NULL && dictGetKey(de) == n->key);
+        if (!activeExpireCycleTryExpire(db,de,now)) break;
+
+        /* Check the time limit once every 16 keys. */
+        if ((++iteration & 0xf) == 0) {
+            long long elapsed = ustime()-start;
+
+            latencyAddSampleIfNeeded("expire-cycle",elapsed/1000);
+            if (elapsed > timelimit) return 1;
+        }
+    }
+
+    /* Update the average TTL stats sampling random keys, as the default
+     * algorithm does. */
+    num = dictSize(db->expires);
+    if (num > ACTIVE_EXPIRE_CYCLE_LOOKUPS_PER_LOOP)
+        num = ACTIVE_EXPIRE_CYCLE_LOOKUPS_PER_LOOP;
+    while (num--) {
+        dictEntry *de = dictGetRandomKey(db->expires);
+        long long ttl = dictGetSignedIntegerVal(de)-now;
+
+        if (ttl < 0) ttl = 0;
+        ttl_sum += ttl;
+        ttl_samples++;
+    }
+    if (ttl_samples) {
+        long long avg_ttl = ttl_sum/ttl_samples;
+
+        if (db->avg_ttl == 0) db->avg_ttl = avg_ttl;
+        db->avg_ttl = (db->avg_ttl+avg_ttl)/2;
+    } else {
+        db->avg_ttl = 0;
+    }
+    return 0;
+}
+
 /* Try to expire a few timed out keys. The algorithm used is adaptive and
  * will use few CPU cycles if there are few expiring keys, otherwise
  * it will get more aggressive to avoid that too much memory is used by
@@ -803,6 +1062,16 @@ void activeExpireCycle(int type) {
          * distribute the time evenly across DBs. */
         current_db++;
 
+        /* With the expire index the keys are reclaimed in expire order:
+         * only the keys actually due are visited. */
+        if (db->expire_index) {
+            if (activeExpireIndexCycle(db,start,timelimit)) {
+                timelimit_exit = 1;
+                return;
+            }
+            continue;
+        }
+
         /* Continue to expire if at the end of the cycle more than 25%
          * of the keys were expired. */
         do {
@@ -1008,6 +1277,13 @@ void databasesCron(void) {
     if (server.active_expire_enabled && server.masterhost == NULL)
         activeExpireCycle(ACTIVE_EXPIRE_CYCLE_SLOW);
 
+    /* Install the hash tables allocated in background, if any. */
+    handleDictAllocRequests();
+
+    /* Defrag keys gradually. */
+    if (server.active_defrag_enabled || server.active_defrag_running)
+        activeDefragCycle();
+
     /* Perform hash tables rehashing if needed, but only if there are no
      * other processes saving the DB on disk. Otherwise rehashing is bad
      * as will cause a lot of copy-on-write of memory pages. */
@@ -1085,6 +1361,13 @@ int serverCron(struct aeEventLoop *eventLoop, long long id, void *clientData) {
     /* Update the time cache. */
     updateCachedTime();
 
+    /* Measure how late we are running: the time the event loop spent doing
+     * other work once the cron period elapsed. */
+    if (server.cron_end_us) {
+        server.cron_lag_us = ustime()-server.cron_end_us-(1000/server.hz)*1000;
+        if (server.cron_lag_us < 0) server.cron_lag_us = 0;
+    }
+
     run_with_period(100) {
         trackInstantaneousMetric(REDIS_METRIC_COMMAND,server.stat_numcommands);
         trackInstantaneousMetric(REDIS_METRIC_NET_INPUT,
@@ -1199,7 +1482,8 @@ int serverCron(struct aeEventLoop *eventLoop, long long id, void *clientData) {
              * the given amount of seconds, and if the latest bgsave was
              * successful or if, in case of an error, at least
              * REDIS_BGSAVE_RETRY_DELAY seconds already elapsed. */
-            if (server.dirty >= sp->changes &&
+            if (!server.rdb_forkless_in_progress &&
+                server.dirty >= sp->changes &&
                 server.unixtime-server.lastsave > sp->seconds &&
                 (server.unixtime-server.lastbgsave_try >
                  REDIS_BGSAVE_RETRY_DELAY ||
@@ -1268,6 +1552,7 @@ int serverCron(struct aeEventLoop *eventLoop, long long id, void *clientData) {
     }
 
     server.cronloops++;
+    server.cron_end_us = ustime();
     return 1000/server.hz;
 }
 
@@ -1277,6 +1562,11 @@ int serverCron(struct aeEventLoop *eventLoop, long long id, void *clientData) {
 void beforeSleep(struct aeEventLoop *eventLoop) {
     REDIS_NOTUSED(eventLoop);
 
+    /* Read and parse the requests of the clients queued by the readable
+     * handler, when reads are performed by the I/O threads. This must
+     * happen ASAP after the event loop processing. */
+    handleClientsWithPendingReadsUsingThreads();
+
     /* Call the Redis Cluster before sleep function. Note that this function
      * may change the state of Redis Cluster (from ok to fail or vice versa),
      * so it's a good idea to call it before serving the unblocked clients
@@ -1288,6 +1578,13 @@ void beforeSleep(struct aeEventLoop *eventLoop) {
     if (server.active_expire_enabled && server.masterhost == NULL)
         activeExpireCycle(ACTIVE_EXPIRE_CYCLE_FAST);
 
+    /* Install the hash tables allocated in background, so that the
+     * incremental rehashing can start ASAP. */
+    if (listLength(server.dict_alloc_requests)) handleDictAllocRequests();
+
+    /* Drop the references the lazy free thread could not release. */
+    lazyfreeReleaseDeferred();
+
     /* Send all the slaves an ACK request if at least one client blocked
      * during the previous event loop iteration. */
     if (server.get_ack_from_slaves) {
@@ -1314,6 +1611,14 @@ void beforeSleep(struct aeEventLoop *eventLoop) {
 
     /* Write the AOF buffer on disk */
     flushAppendOnlyFile(0);
+
+    /* Handle writes with pending output buffers. This is performed after
+     * the AOF buffer is written so that replies are never sent before the
+     * related writes reached the AOF. */
+    handleClientsWithPendingWritesUsingThreads();
+
+    /* Close clients that need to be closed asynchronous. */
+    freeClientsInAsyncFreeQueue();
 }
 
 /* =========================== Server initialization ======================== */
@@ -1391,7 +1696,8 @@ void createSharedObjects(void) {
     shared.lpop = createStringObject("LPOP",4);
     shared.lpush = createStringObject("LPUSH",5);
     for (j = 0; j < REDIS_SHARED_INTEGERS; j++) {
-        shared.integers[j] = createObject(REDIS_STRING,(void*)(long)j);
+        shared.integers[j] =
+            makeObjectShared(createObject(REDIS_STRING,(void*)(long)j));
         shared.integers[j]->encoding = REDIS_ENCODING_INT;
     }
     for (j = 0; j < REDIS_SHARED_BULKHDR_LEN; j++) {
@@ -1453,25 +1759,49 @@ void initServerConfig(void) {
     server.aof_flush_postponed_start = 0;
     server.aof_rewrite_incremental_fsync = REDIS_DEFAULT_AOF_REWRITE_INCREMENTAL_FSYNC;
     server.aof_load_truncated = REDIS_DEFAULT_AOF_LOAD_TRUNCATED;
+    server.aof_use_rdb_preamble = REDIS_DEFAULT_AOF_USE_RDB_PREAMBLE;
     server.pidfile = zstrdup(REDIS_DEFAULT_PID_FILE);
     server.rdb_filename = zstrdup(REDIS_DEFAULT_RDB_FILENAME);
     server.aof_filename = zstrdup(REDIS_DEFAULT_AOF_FILENAME);
     server.requirepass = NULL;
     server.rdb_compression = REDIS_DEFAULT_RDB_COMPRESSION;
     server.rdb_checksum = REDIS_DEFAULT_RDB_CHECKSUM;
+    server.rdb_forkless = REDIS_DEFAULT_RDB_FORKLESS;
+    server.rdb_load_threads = REDIS_DEFAULT_RDB_LOAD_THREADS;
     server.stop_writes_on_bgsave_err = REDIS_DEFAULT_STOP_WRITES_ON_BGSAVE_ERROR;
     server.activerehashing = REDIS_DEFAULT_ACTIVE_REHASHING;
+    server.active_expire_index = REDIS_DEFAULT_ACTIVE_EXPIRE_INDEX;
+    server.key_index = REDIS_DEFAULT_KEY_INDEX;
+    server.rehash_budget_us = REDIS_REHASH_BUDGET_DEFAULT;
+    server.cron_end_us = 0;
+    server.cron_lag_us = 0;
+    server.dict_async_alloc_threshold = REDIS_DEFAULT_DICT_ASYNC_ALLOC_THRESHOLD;
     server.notify_keyspace_events = 0;
     server.maxclients = REDIS_MAX_CLIENTS;
     server.bpop_blocked_clients = 0;
     server.maxmemory = REDIS_DEFAULT_MAXMEMORY;
     server.maxmemory_policy = REDIS_DEFAULT_MAXMEMORY_POLICY;
     server.maxmemory_samples = REDIS_DEFAULT_MAXMEMORY_SAMPLES;
+    server.lfu_log_factor = REDIS_DEFAULT_LFU_LOG_FACTOR;
+    server.lfu_decay_time = REDIS_DEFAULT_LFU_DECAY_TIME;
+    server.lazyfree_lazy_eviction = REDIS_DEFAULT_LAZYFREE_LAZY_EVICTION;
+    server.lazyfree_lazy_expire = REDIS_DEFAULT_LAZYFREE_LAZY_EXPIRE;
+    server.lazyfree_lazy_server_del = REDIS_DEFAULT_LAZYFREE_LAZY_SERVER_DEL;
+    server.active_defrag_enabled = REDIS_DEFAULT_ACTIVE_DEFRAG;
+    server.active_defrag_ignore_bytes = REDIS_DEFAULT_ACTIVE_DEFRAG_IGNORE_BYTES;
+    server.active_defrag_threshold_lower = REDIS_DEFAULT_ACTIVE_DEFRAG_THRESHOLD_LOWER;
+    server.active_defrag_threshold_upper = REDIS_DEFAULT_ACTIVE_DEFRAG_THRESHOLD_UPPER;
+    server.active_defrag_cycle_min = REDIS_DEFAULT_ACTIVE_DEFRAG_CYCLE_MIN;
+    server.active_defrag_cycle_max = REDIS_DEFAULT_ACTIVE_DEFRAG_CYCLE_MAX;
+    server.active_defrag_max_scan_fields = REDIS_DEFAULT_ACTIVE_DEFRAG_MAX_SCAN_FIELDS;
+    server.active_defrag_running = 0;
     server.hash_max_ziplist_entries = REDIS_HASH_MAX_ZIPLIST_ENTRIES;
     server.hash_max_ziplist_value = REDIS_HASH_MAX_ZIPLIST_VALUE;
-    server.list_max_ziplist_entries = REDIS_LIST_MAX_ZIPLIST_ENTRIES;
-    server.list_max_ziplist_value = REDIS_LIST_MAX_ZIPLIST_VALUE;
+    server.hash_max_ctable_entries = REDIS_HASH_MAX_CTABLE_ENTRIES;
+    server.list_max_ziplist_size = REDIS_LIST_MAX_ZIPLIST_SIZE;
+    server.list_compress_depth = REDIS_LIST_COMPRESS_DEPTH;
     server.set_max_intset_entries = REDIS_SET_MAX_INTSET_ENTRIES;
+    server.set_max_ctable_entries = REDIS_SET_MAX_CTABLE_ENTRIES;
     server.zset_max_ziplist_entries = REDIS_ZSET_MAX_ZIPLIST_ENTRIES;
     server.zset_max_ziplist_value = REDIS_ZSET_MAX_ZIPLIST_VALUE;
     server.hll_sparse_max_bytes = REDIS_DEFAULT_HLL_SPARSE_MAX_BYTES;
@@ -1485,6 +1815,7 @@ void initServerConfig(void) {
     server.cluster_migration_barrier = REDIS_CLUSTER_DEFAULT_MIGRATION_BARRIER;
     server.cluster_slave_validity_factor = REDIS_CLUSTER_DEFAULT_SLAVE_VALIDITY;
     server.cluster_require_full_coverage = REDIS_CLUSTER_DEFAULT_REQUIRE_FULL_COVERAGE;
+    server.cluster_compact_bus = REDIS_CLUSTER_DEFAULT_COMPACT_BUS;
     server.cluster_configfile = zstrdup(REDIS_DEFAULT_CLUSTER_CONFIG_FILE);
     server.lua_caller = NULL;
     server.lua_time_limit = REDIS_LUA_TIME_LIMIT;
@@ -1507,15 +1838,19 @@ void initServerConfig(void) {
     server.master = NULL;
     server.cached_master = NULL;
     server.repl_master_initial_offset = -1;
+    server.repl_master_initial_db = -1;
     server.repl_state = REDIS_REPL_NONE;
     server.repl_syncio_timeout = REDIS_REPL_SYNCIO_TIMEOUT;
     server.repl_serve_stale_data = REDIS_DEFAULT_SLAVE_SERVE_STALE_DATA;
     server.repl_slave_ro = REDIS_DEFAULT_SLAVE_READ_ONLY;
+    server.repl_slave_lazy_flush = REDIS_DEFAULT_SLAVE_LAZY_FLUSH;
     server.repl_down_since = 0; /* Never connected, repl is down since EVER. */
     server.repl_disable_tcp_nodelay = REDIS_DEFAULT_REPL_DISABLE_TCP_NODELAY;
     server.repl_diskless_sync = REDIS_DEFAULT_REPL_DISKLESS_SYNC;
     server.repl_diskless_sync_delay = REDIS_DEFAULT_REPL_DISKLESS_SYNC_DELAY;
     server.slave_priority = REDIS_DEFAULT_SLAVE_PRIORITY;
+    changeReplicationId();
+    clearReplicationId2();
     server.master_repl_offset = 0;
 
     /* Replication partial resync backlog */
@@ -1555,6 +1890,8 @@ void initServerConfig(void) {
 
     /* Latency monitor */
     server.latency_monitor_threshold = REDIS_DEFAULT_LATENCY_MONITOR_THRESHOLD;
+    server.io_threads_num = REDIS_DEFAULT_IO_THREADS_NUM;
+    server.io_threads_do_reads = REDIS_DEFAULT_IO_THREADS_DO_READS;
 
     /* Debugging */
     server.assert_failed = "<no assertion failed>";
@@ -1736,6 +2073,11 @@ void resetServerStats(void) {
     server.stat_numcommands = 0;
     server.stat_numconnections = 0;
     server.stat_expiredkeys = 0;
+    server.stat_dict_async_allocs = 0;
+    server.stat_active_defrag_hits = 0;
+    server.stat_active_defrag_misses = 0;
+    server.stat_active_defrag_key_hits = 0;
+    server.stat_active_defrag_key_misses = 0;
     server.stat_evictedkeys = 0;
     server.stat_keyspace_misses = 0;
     server.stat_keyspace_hits = 0;
@@ -1754,6 +2096,8 @@ void resetServerStats(void) {
     }
     server.stat_net_input_bytes = 0;
     server.stat_net_output_bytes = 0;
+    server.stat_io_reads_processed = 0;
+    server.stat_io_writes_processed = 0;
     server.aof_delayed_fsync = 0;
 }
 
@@ -1773,10 +2117,13 @@ void initServer(void) {
     server.current_client = NULL;
     server.clients = listCreate();
     server.clients_to_close = listCreate();
+    server.clients_pending_write = listCreate();
+    server.clients_pending_read = listCreate();
     server.slaves = listCreate();
     server.monitors = listCreate();
     server.slaveseldb = -1; /* Force to emit the first SELECT command. */
     server.unblocked_clients = listCreate();
+    server.dict_alloc_requests = listCreate();
     server.ready_keys = listCreate();
     server.clients_waiting_acks = listCreate();
     server.get_ack_from_slaves = 0;
@@ -1814,6 +2161,9 @@ void initServer(void) {
     for (j = 0; j < server.dbnum; j++) {
         server.db[j].dict = dictCreate(&dbDictType,NULL);
         server.db[j].expires = dictCreate(&keyptrDictType,NULL);
+        server.db[j].expire_index = server.active_expire_index ?
+                                    expireIndexCreate() : NULL;
+        server.db[j].key_index = server.key_index ? keyIndexCreate() : NULL;
         server.db[j].blocking_keys = dictCreate(&keylistDictType,NULL);
         server.db[j].ready_keys = dictCreate(&setDictType,NULL);
         server.db[j].watched_keys = dictCreate(&keylistDictType,NULL);
@@ -1822,13 +2172,13 @@ void initServer(void) {
         server.db[j].avg_ttl = 0;
     }
     server.pubsub_channels = dictCreate(&keylistDictType,NULL);
-    server.pubsub_patterns = listCreate();
-    listSetFreeMethod(server.pubsub_patterns,freePubsubPattern);
-    listSetMatchMethod(server.pubsub_patterns,listMatchPubsubPattern);
+    server.pubsub_patterns = pubsubCreatePatternNode("",0);
+    server.pubsub_numpat = 0;
     server.cronloops = 0;
     server.rdb_child_pid = -1;
     server.aof_child_pid = -1;
     server.rdb_child_type = REDIS_RDB_CHILD_TYPE_NONE;
+    server.rdb_forkless_in_progress = 0;
     aofRewriteBufferReset();
     server.aof_buf = sdsempty();
     server.lastsave = time(NULL); /* At startup we consider the DB saved. */
@@ -1894,6 +2244,7 @@ void initServer(void) {
     slowlogInit();
     latencyMonitorInit();
     bioInit();
+    initThreadedIO();
 }
 
 /* Populates the Redis Command Table starting from the hard coded list
@@ -2355,6 +2706,10 @@ int prepareForShutdown(int flags) {
         kill(server.rdb_child_pid,SIGUSR1);
         rdbRemoveTempFile(server.rdb_child_pid);
     }
+    if (server.rdb_forkless_in_progress) {
+        redisLog(REDIS_WARNING,"There is a forkless BGSAVE in progress. Stopping it!");
+        rdbForklessCancel();
+    }
     if (server.aof_state != REDIS_AOF_OFF) {
         /* Kill the AOF saving child as the AOF we already have may be longer
          * but contains the full dataset anyway. */
@@ -2662,6 +3017,7 @@ sds genRedisInfoString(char *section) {
             "os:%s %s %s\r\n"
             "arch_bits:%d\r\n"
             "multiplexing_api:%s\r\n"
+            "bitops_kernel:%s\r\n"
             "gcc_version:%d.%d.%d\r\n"
             "process_id:%ld\r\n"
             "run_id:%s\r\n"
@@ -2679,6 +3035,7 @@ sds genRedisInfoString(char *section) {
             name.sysname, name.release, name.machine,
             server.arch_bits,
             aeGetApiName(),
+            bitopsGetKernelName(),
 #ifdef __GNUC__
             __GNUC__,__GNUC_MINOR__,__GNUC_PATCHLEVEL__,
 #else
@@ -2713,6 +3070,10 @@ sds genRedisInfoString(char *section) {
         char hmem[64];
         char peak_hmem[64];
         size_t zmalloc_used = zmalloc_used_memory();
+        size_t allocator_allocated, allocator_active, allocator_resident;
+
+        zmalloc_get_allocator_info(&allocator_allocated,&allocator_active,
+                                   &allocator_resident);
 
         /* Peak memory is updated from time to time by serverCron() so it
          * may happen that the instantaneous value is slightly bigger than
@@ -2733,7 +3094,19 @@ sds genRedisInfoString(char *section) {
             "used_memory_peak_human:%s\r\n"
             "used_memory_lua:%lld\r\n"
             "mem_fragmentation_ratio:%.2f\r\n"
-            "mem_allocator:%s\r\n",
+            "mem_allocator:%s\r\n"
+            "lazyfree_pending_objects:%zu\r\n"
+            "used_memory_expire_index:%zu\r\n"
+            "used_memory_key_index:%zu\r\n"
+            "allocator_allocated:%zu\r\n"
+            "allocator_active:%zu\r\n"
+            "allocator_frag_ratio:%.2f\r\n"
+            "allocator_frag_bytes:%zu\r\n"
+            "active_defrag_running:%d\r\n"
+            "active_defrag_hits:%lld\r\n"
+            "active_defrag_misses:%lld\r\n"
+            "active_defrag_key_hits:%lld\r\n"
+            "active_defrag_key_misses:%lld\r\n",
             zmalloc_used,
             hmem,
             server.resident_set_size,
@@ -2741,7 +3114,21 @@ sds genRedisInfoString(char *section) {
             peak_hmem,
             ((long long)lua_gc(server.lua,LUA_GCCOUNT,0))*1024LL,
             zmalloc_get_fragmentation_ratio(server.resident_set_size),
-            ZMALLOC_LIB
+            ZMALLOC_LIB,
+            lazyfreeGetPendingObjectsCount(),
+            expireIndexMemory(),
+            keyIndexMemory(),
+            allocator_allocated,
+            allocator_active,
+            allocator_allocated ?
+                (float)allocator_active/allocator_allocated : 0,
+            allocator_active > allocator_allocated ?
+                allocator_active-allocator_allocated : 0,
+            server.active_defrag_running,
+            server.stat_active_defrag_hits,
+            server.stat_active_defrag_misses,
+            server.stat_active_defrag_key_hits,
+            server.stat_active_defrag_key_misses
             );
     }
 
@@ -2766,11 +3153,12 @@ sds genRedisInfoString(char *section) {
             "aof_last_write_status:%s\r\n",
             server.loading,
             server.dirty,
-            server.rdb_child_pid != -1,
+            server.rdb_child_pid != -1 || server.rdb_forkless_in_progress,
             (intmax_t)server.lastsave,
             (server.lastbgsave_status == REDIS_OK) ? "ok" : "err",
             (intmax_t)server.rdb_save_time_last,
-            (intmax_t)((server.rdb_child_pid == -1) ?
+            (intmax_t)((server.rdb_child_pid == -1 &&
+                        !server.rdb_forkless_in_progress) ?
                 -1 : time(NULL)-server.rdb_save_time_start),
             server.aof_state != REDIS_AOF_OFF,
             server.aof_child_pid != -1,
@@ -2854,7 +3242,12 @@ sds genRedisInfoString(char *section) {
             "pubsub_channels:%ld\r\n"
             "pubsub_patterns:%lu\r\n"
             "latest_fork_usec:%lld\r\n"
-            "migrate_cached_sockets:%ld\r\n",
+            "migrate_cached_sockets:%ld\r\n"
+            "io_threads_active:%d\r\n"
+            "io_threaded_reads_processed:%lld\r\n"
+            "io_threaded_writes_processed:%lld\r\n"
+            "dict_async_allocs:%lld\r\n"
+            "active_rehash_budget_usec:%lld\r\n",
             server.stat_numconnections,
             server.stat_numcommands,
             getInstantaneousMetric(REDIS_METRIC_COMMAND),
@@ -2871,9 +3264,14 @@ sds genRedisInfoString(char *section) {
             server.stat_keyspace_hits,
             server.stat_keyspace_misses,
             dictSize(server.pubsub_channels),
-            listLength(server.pubsub_patterns),
+            server.pubsub_numpat,
             server.stat_fork_time,
-            dictSize(server.migrate_cached_sockets));
+            dictSize(server.migrate_cached_sockets),
+            server.io_threads_active,
+            server.stat_io_reads_processed,
+            server.stat_io_writes_processed,
+            server.stat_dict_async_allocs,
+            server.rehash_budget_us);
     }
 
     /* Replication */
@@ -2982,12 +3380,18 @@ sds genRedisInfoString(char *section) {
             }
         }
         info = sdscatprintf(info,
+            "master_replid:%s\r\n"
+            "master_replid2:%s\r\n"
             "master_repl_offset:%lld\r\n"
+            "second_repl_offset:%lld\r\n"
             "repl_backlog_active:%d\r\n"
             "repl_backlog_size:%lld\r\n"
             "repl_backlog_first_byte_offset:%lld\r\n"
             "repl_backlog_histlen:%lld\r\n",
+            server.replid,
+            server.replid2,
             server.master_repl_offset,
+            server.second_replid_offset,
             server.repl_backlog != NULL,
             server.repl_backlog_size,
             server.repl_backlog_off,
@@ -3116,6 +3520,97 @@ void monitorCommand(redisClient *c) {
  * one key that can be evicted, if there is at least one key that can be
  * evicted in the whole database. */
 
+/* ----------------------------------------------------------------------------
+ * LFU (Least Frequently Used) implementation.
+ *
+ * With the LFU policies the 24 bits of robj->lru are split in two fields:
+ *
+ *          16 bits      8 bits
+ *     +----------------+--------+
+ *     + Last decr time | LOG_C  |
+ *     +----------------+--------+
+ *
+ * LOG_C is a logarithmic counter of the accesses to the key: the greater
+ * the counter, the less likely it is incremented again, so that 8 bits are
+ * enough to tell apart keys accessed a few times from keys accessed millions
+ * of times (see lfu-log-factor). New keys start at REDIS_LFU_INIT_VAL, so
+ * that they have a chance to accumulate hits before being evicted.
+ *
+ * The last decrement time is the time, in minutes (only the least
+ * significant 16 bits), the counter was last decremented. The counter is
+ * halved (or decremented, when small) once every lfu-decay-time minutes
+ * the key is not accessed, so that keys that were hot in the past but
+ * are no longer accessed eventually become good candidates for eviction.
+ * The decrement is lazy: it is performed when the key is accessed or
+ * sampled for eviction.
+ * --------------------------------------------------------------------------*/
+
+/* Return the current time in minutes, just taking the least significant
+ * 16 bits. The returned time is suitable to be stored as LDT (last decrement
+ * time) for the LFU implementation. */
+unsigned int LFUGetTimeInMinutes(void) {
+    return (server.unixtime/60) & 65535;
+}
+
+/* Given an object last decrement time, compute the minimum number of minutes
+ * that elapsed since the last decrement. Handle overflow (ldt greater than
+ * the current 16 bits minutes time) considering the time as wrapping
+ * exactly once. */
+static unsigned long LFUTimeElapsed(unsigned long ldt) {
+    unsigned long now = LFUGetTimeInMinutes();
+    if (now >= ldt) return now-ldt;
+    return 65535-ldt+now;
+}
+
+/* Logarithmically increment a counter. The greater is the current counter
+ * value the less likely is that it gets really incremented. Saturate it
+ * at 255. */
+static uint8_t LFULogIncr(uint8_t counter) {
+    double r, baseval, p;
+
+    if (counter == 255) return 255;
+    r = (double)rand()/RAND_MAX;
+    baseval = counter - REDIS_LFU_INIT_VAL;
+    if (baseval < 0) baseval = 0;
+    p = 1.0/(baseval*server.lfu_log_factor+1);
+    if (r < p) counter++;
+    return counter;
+}
+
+/* If the object decrement time is reached, decrement the LFU counter and
+ * update the decrement time field. Return the object frequency counter.
+ *
+ * This function is used in order to scan the dataset for the best object
+ * to fit: as we check for the candidate, we incrementally decrement the
+ * counter of the scanned objects if needed. */
+unsigned long LFUDecrAndReturn(robj *o) {
+    unsigned long ldt = o->lru >> 8;
+    unsigned long counter = o->lru & 255;
+    unsigned long periods;
+
+    if (server.lfu_decay_time == 0) return counter;
+    periods = LFUTimeElapsed(ldt) / server.lfu_decay_time;
+    if (periods) {
+        if (counter > REDIS_LFU_INIT_VAL*2 && periods == 1) {
+            counter /= 2;
+            if (counter < REDIS_LFU_INIT_VAL*2) counter = REDIS_LFU_INIT_VAL*2;
+        } else {
+            counter = (periods > counter) ? 0 : counter - periods;
+        }
+        o->lru = (LFUGetTimeInMinutes()<<8) | counter;
+    }
+    return counter;
+}
+
+/* Update the LFU data of an object that was just accessed: decay the
+ * counter if needed and then increment it logarithmically. */
+void updateLFU(robj *o) {
+    unsigned long counter = LFUDecrAndReturn(o);
+
+    counter = LFULogIncr(counter);
+    o->lru = (LFUGetTimeInMinutes()<<8) | counter;
+}
+
 /* Create a new eviction pool. */
 struct evictionPoolEntry *evictionPoolAlloc(void) {
     struct evictionPoolEntry *ep;
@@ -3166,7 +3661,14 @@ void evictionPoolPopulate(dict *sampledict, dict *keydict, struct evictionPoolEn
          * again in the key dictionary to obtain the value object. */
         if (sampledict != keydict) de = dictFind(keydict, key);
         o = dictGetVal(de);
-        idle = estimateObjectIdleTime(o);
+
+        /* With the LFU policies we use the inverted frequency as score,
+         * so that the pool keeps the least frequently used keys on the
+         * right, exactly like the keys with the greatest idle time. */
+        if (REDIS_MAXMEMORY_IS_LFU(server.maxmemory_policy))
+            idle = 255-LFUDecrAndReturn(o);
+        else
+            idle = estimateObjectIdleTime(o);
 
         /* Insert the element inside the pool.
          * First, find the first empty bucket or the first populated
@@ -3204,15 +3706,13 @@ void evictionPoolPopulate(dict *sampledict, dict *keydict, struct evictionPoolEn
     if (samples != _samples) zfree(samples);
 }
 
-int freeMemoryIfNeeded(void) {
-    size_t mem_used, mem_tofree, mem_freed;
-    int slaves = listLength(server.slaves);
-    mstime_t latency, eviction_latency;
+/* Return the amount of used memory to compare with maxmemory: the size of
+ * slaves output buffers and AOF buffers is not counted, since evicting keys
+ * would make them grow because of the DELs to propagate. */
+static size_t freeMemoryGetUsedMemory(void) {
+    size_t mem_used = zmalloc_used_memory();
 
-    /* Remove the size of slaves output buffers and AOF buffer from the
-     * count of used memory. */
-    mem_used = zmalloc_used_memory();
-    if (slaves) {
+    if (listLength(server.slaves)) {
         listIter li;
         listNode *ln;
 
@@ -3227,9 +3727,19 @@ int freeMemoryIfNeeded(void) {
         }
     }
     if (server.aof_state != REDIS_AOF_OFF) {
-        mem_used -= sdslen(server.aof_buf);
-        mem_used -= aofRewriteBufferSize();
+        size_t aof_bytes = sdslen(server.aof_buf)+aofRewriteBufferSize();
+        mem_used = (aof_bytes > mem_used) ? 0 : mem_used-aof_bytes;
     }
+    return mem_used;
+}
+
+int freeMemoryIfNeeded(void) {
+    size_t mem_used, mem_tofree, mem_freed;
+    int slaves = listLength(server.slaves);
+    mstime_t latency, eviction_latency;
+    unsigned long keys_evicted = 0;
+
+    mem_used = freeMemoryGetUsedMemory();
 
     /* Check if we are over the memory limit. */
     if (mem_used <= server.maxmemory) return REDIS_OK;
@@ -3252,6 +3762,7 @@ int freeMemoryIfNeeded(void) {
             dict *dict;
 
             if (server.maxmemory_policy == REDIS_MAXMEMORY_ALLKEYS_LRU ||
+                server.maxmemory_policy == REDIS_MAXMEMORY_ALLKEYS_LFU ||
                 server.maxmemory_policy == REDIS_MAXMEMORY_ALLKEYS_RANDOM)
             {
                 dict = server.db[j].dict;
@@ -3268,9 +3779,10 @@ int freeMemoryIfNeeded(void) {
                 bestkey = dictGetKey(de);
             }
 
-            /* volatile-lru and allkeys-lru policy */
+            /* volatile-lru, allkeys-lru, volatile-lfu and allkeys-lfu */
             else if (server.maxmemory_policy == REDIS_MAXMEMORY_ALLKEYS_LRU ||
-                server.maxmemory_policy == REDIS_MAXMEMORY_VOLATILE_LRU)
+                server.maxmemory_policy == REDIS_MAXMEMORY_VOLATILE_LRU ||
+                REDIS_MAXMEMORY_IS_LFU(server.maxmemory_policy))
             {
                 struct evictionPoolEntry *pool = db->eviction_pool;
 
@@ -3339,7 +3851,10 @@ int freeMemoryIfNeeded(void) {
                  * we only care about memory used by the key space. */
                 delta = (long long) zmalloc_used_memory();
                 latencyStartMonitor(eviction_latency);
-                dbDelete(db,keyobj);
+                if (server.lazyfree_lazy_eviction)
+                    dbAsyncDelete(db,keyobj);
+                else
+                    dbSyncDelete(db,keyobj);
                 latencyEndMonitor(eviction_latency);
                 latencyAddSampleIfNeeded("eviction-del",eviction_latency);
                 latencyRemoveNestedEvent(latency,eviction_latency);
@@ -3350,23 +3865,50 @@ int freeMemoryIfNeeded(void) {
                     keyobj, db->id);
                 decrRefCount(keyobj);
                 keys_freed++;
+                keys_evicted++;
 
                 /* When the memory to free starts to be big enough, we may
                  * start spending so much time here that is impossible to
                  * deliver data to the slaves fast enough, so we force the
                  * transmission here inside the loop. */
                 if (slaves) flushSlavesOutputBuffers();
+
+                /* Normally our stop condition is the ability to release
+                 * a fixed, pre-computed amount of memory. However when we
+                 * are deleting objects in another thread, it's better to
+                 * check, from time to time, if we already reached our target
+                 * memory, since the "mem_freed" amount is computed only
+                 * across the dbAsyncDelete() call, while the thread can
+                 * release the memory all the time. */
+                if (server.lazyfree_lazy_eviction && !(keys_evicted % 16)) {
+                    if (freeMemoryGetUsedMemory() <= server.maxmemory) {
+                        /* Let's satisfy our stop condition. */
+                        mem_freed = mem_tofree;
+                        break;
+                    }
+                }
             }
         }
         if (!keys_freed) {
             latencyEndMonitor(latency);
             latencyAddSampleIfNeeded("eviction-cycle",latency);
-            return REDIS_ERR; /* nothing to free... */
+            goto cant_free; /* nothing to free... */
         }
     }
     latencyEndMonitor(latency);
     latencyAddSampleIfNeeded("eviction-cycle",latency);
     return REDIS_OK;
+
+cant_free:
+    /* We are here if we are not able to reclaim memory. There is only one
+     * last thing we can try: check if the lazyfree thread has jobs in queue
+     * and wait for the memory they hold to be released. */
+    while(bioPendingJobsOfType(REDIS_BIO_LAZY_FREE)) {
+        if (freeMemoryGetUsedMemory() <= server.maxmemory) return REDIS_OK;
+        usleep(1000);
+    }
+    return (freeMemoryGetUsedMemory() <= server.maxmemory) ? REDIS_OK :
+                                                             REDIS_ERR;
 }
 
 /* =================================== Main! ================================ */
@@ -58,6 +58,8 @@ typedef long long mstime_t; /* millisecond time type. */
 #include "anet.h"    /* Networking the easy way */
 #include "ziplist.h" /* Compact list data structure */
 #include "intset.h"  /* Compact integer set structure */
+#include "quicklist.h" /* Lists are encoded as linked lists of ziplists */
+#include "ctable.h"  /* Compact hash table for sets and hashes */
 #include "version.h" /* Version macro */
 #include "util.h"    /* Misc functions useful in many places */
 #include "latency.h" /* Latency monitor API */
@@ -78,6 +80,7 @@ typedef long long mstime_t; /* millisecond time type. */
 #define REDIS_CONFIGLINE_MAX    1024
 #define REDIS_DBCRON_DBS_PER_CALL 16
 #define REDIS_MAX_WRITE_PER_EVENT (1024*64)
+#define REDIS_MAX_IOV_PER_WRITE 16  /* Max buffers written by one writev(). */
 #define REDIS_SHARED_SELECT_CMDS 10
 #define REDIS_SHARED_INTEGERS 10000
 #define REDIS_SHARED_BULKHDR_LEN 32
@@ -109,6 +112,10 @@ typedef long long mstime_t; /* millisecond time type. */
 #define REDIS_DEFAULT_STOP_WRITES_ON_BGSAVE_ERROR 1
 #define REDIS_DEFAULT_RDB_COMPRESSION 1
 #define REDIS_DEFAULT_RDB_CHECKSUM 1
+#define REDIS_DEFAULT_RDB_FORKLESS 0
+#define REDIS_RDB_FORKLESS_SLICE_US 1000 /* Forkless BGSAVE work per call. */
+#define REDIS_DEFAULT_RDB_LOAD_THREADS 0 /* RDB decoding on the main thread. */
+#define REDIS_RDB_LOAD_THREADS_MAX 64
 #define REDIS_DEFAULT_RDB_FILENAME "dump.rdb"
 #define REDIS_DEFAULT_REPL_DISKLESS_SYNC 0
 #define REDIS_DEFAULT_REPL_DISKLESS_SYNC_DELAY 5
@@ -117,11 +124,21 @@ typedef long long mstime_t; /* millisecond time type. */
 #define REDIS_DEFAULT_REPL_DISABLE_TCP_NODELAY 0
 #define REDIS_DEFAULT_MAXMEMORY 0
 #define REDIS_DEFAULT_MAXMEMORY_SAMPLES 5
+#define REDIS_DEFAULT_LFU_LOG_FACTOR 10
+#define REDIS_DEFAULT_LFU_DECAY_TIME 1
 #define REDIS_DEFAULT_AOF_FILENAME "appendonly.aof"
 #define REDIS_DEFAULT_AOF_NO_FSYNC_ON_REWRITE 0
 #define REDIS_DEFAULT_AOF_LOAD_TRUNCATED 1
 #define REDIS_DEFAULT_ACTIVE_REHASHING 1
+#define REDIS_DEFAULT_ACTIVE_EXPIRE_INDEX 0
+#define REDIS_DEFAULT_KEY_INDEX 0
+#define REDIS_DEFAULT_DICT_ASYNC_ALLOC_THRESHOLD (1024*1024) /* Buckets. */
+#define REDIS_REHASH_BUDGET_MIN 250     /* Active rehash budget, microseconds. */
+#define REDIS_REHASH_BUDGET_DEFAULT 1000
+#define REDIS_REHASH_BUDGET_MAX 4000
+#define REDIS_REHASH_MAX_LAG 2000       /* Cron lag that shrinks the budget. */
 #define REDIS_DEFAULT_AOF_REWRITE_INCREMENTAL_FSYNC 1
+#define REDIS_DEFAULT_AOF_USE_RDB_PREAMBLE 0
 #define REDIS_DEFAULT_MIN_SLAVES_TO_WRITE 0
 #define REDIS_DEFAULT_MIN_SLAVES_MAX_LAG 10
 #define REDIS_IP_STR_LEN 46 /* INET6_ADDRSTRLEN is 46, but we need to be sure */
@@ -129,6 +146,20 @@ typedef long long mstime_t; /* millisecond time type. */
 #define REDIS_BINDADDR_MAX 16
 #define REDIS_MIN_RESERVED_FDS 32
 #define REDIS_DEFAULT_LATENCY_MONITOR_THRESHOLD 0
+#define REDIS_DEFAULT_IO_THREADS_NUM 1          /* Single threaded by default */
+#define REDIS_DEFAULT_IO_THREADS_DO_READS 0     /* Only offload writes */
+#define REDIS_IO_THREADS_MAX_NUM 128
+#define REDIS_DEFAULT_LAZYFREE_LAZY_EVICTION 0
+#define REDIS_DEFAULT_LAZYFREE_LAZY_EXPIRE 0
+#define REDIS_DEFAULT_LAZYFREE_LAZY_SERVER_DEL 0
+#define REDIS_DEFAULT_SLAVE_LAZY_FLUSH 0
+#define REDIS_DEFAULT_ACTIVE_DEFRAG 0
+#define REDIS_DEFAULT_ACTIVE_DEFRAG_IGNORE_BYTES (100<<20) /* 100MB */
+#define REDIS_DEFAULT_ACTIVE_DEFRAG_THRESHOLD_LOWER 10  /* Percentage. */
+#define REDIS_DEFAULT_ACTIVE_DEFRAG_THRESHOLD_UPPER 100 /* Percentage. */
+#define REDIS_DEFAULT_ACTIVE_DEFRAG_CYCLE_MIN 25 /* CPU percentage. */
+#define REDIS_DEFAULT_ACTIVE_DEFRAG_CYCLE_MAX 75 /* CPU percentage. */
+#define REDIS_DEFAULT_ACTIVE_DEFRAG_MAX_SCAN_FIELDS 1000
 
 #define ACTIVE_EXPIRE_CYCLE_LOOKUPS_PER_LOOP 20 /* Loopkups per loop. */
 #define ACTIVE_EXPIRE_CYCLE_FAST_DURATION 1000 /* Microseconds */
@@ -149,8 +180,10 @@ typedef long long mstime_t; /* millisecond time type. */
 #define REDIS_REPLY_CHUNK_BYTES (16*1024) /* 16k output buffer */
 #define REDIS_INLINE_MAX_SIZE   (1024*64) /* Max size of inline reads */
 #define REDIS_MBULK_BIG_ARG     (1024*32)
+#define REDIS_MAX_PARSED_AHEAD  64 /* Max commands parsed by I/O threads. */
 #define REDIS_LONGSTR_SIZE      21          /* Bytes needed for long -> str */
 #define REDIS_AOF_AUTOSYNC_BYTES (1024*1024*32) /* fdatasync every 32MB */
+#define REDIS_AOF_READ_DIFF_INTERVAL_BYTES (1024*10) /* Rewrite child reads. */
 /* When configuring the Redis eventloop, we setup it so that the total number
  * of file descriptors we can handle are server.maxclients + RESERVED_FDS + FDSET_INCR
  * that is our safety margin. */
@@ -190,11 +223,13 @@ typedef long long mstime_t; /* millisecond time type. */
 #define REDIS_ENCODING_INT 1     /* Encoded as integer */
 #define REDIS_ENCODING_HT 2      /* Encoded as hash table */
 #define REDIS_ENCODING_ZIPMAP 3  /* Encoded as zipmap */
-#define REDIS_ENCODING_LINKEDLIST 4 /* Encoded as regular linked list */
+#define REDIS_ENCODING_LINKEDLIST 4 /* No longer used: old list encoding */
 #define REDIS_ENCODING_ZIPLIST 5 /* Encoded as ziplist */
 #define REDIS_ENCODING_INTSET 6  /* Encoded as intset */
 #define REDIS_ENCODING_SKIPLIST 7  /* Encoded as skiplist */
 #define REDIS_ENCODING_EMBSTR 8  /* Embedded sds string encoding */
+#define REDIS_ENCODING_QUICKLIST 9 /* Encoded as linked list of ziplists */
+#define REDIS_ENCODING_CTABLE 10 /* Encoded as compact hash table */
 
 /* Defines related to the dump file format. To store 32 bits lengths for short
  * keys requires a lot of space, so we check the most significant 2 bits of
@@ -249,6 +284,11 @@ typedef long long mstime_t; /* millisecond time type. */
 #define REDIS_PRE_PSYNC (1<<16)   /* Instance don't understand PSYNC. */
 #define REDIS_READONLY (1<<17)    /* Cluster client is in read-only state. */
 #define REDIS_PUBSUB (1<<18)      /* Client is in Pub/Sub mode. */
+#define REDIS_PENDING_WRITE (1<<19) /* Client has output to send but a write
+                                       handler is yet not installed. */
+#define REDIS_PENDING_READ (1<<20)  /* The client has pending reads and was
+                                       put in the list of clients we can
+                                       read from using the I/O threads. */
 
 /* Client block type (btype field in client structure)
  * if REDIS_BLOCKED flag is set. */
@@ -260,6 +300,12 @@ typedef long long mstime_t; /* millisecond time type. */
 #define REDIS_REQ_INLINE 1
 #define REDIS_REQ_MULTIBULK 2
 
+/* Operation the I/O threads are performing, see networking.c. While it is
+ * not IDLE the client handling code must not touch global state. */
+#define REDIS_IO_THREADS_OP_IDLE 0
+#define REDIS_IO_THREADS_OP_READ 1
+#define REDIS_IO_THREADS_OP_WRITE 2
+
 /* Client classes for client limits, currently used only for
  * the max-client-output-buffer limit implementation. */
 #define REDIS_CLIENT_TYPE_NORMAL 0 /* Normal req-reply clients + MONITORs */
@@ -298,6 +344,7 @@ typedef long long mstime_t; /* millisecond time type. */
 /* Slave capabilities. */
 #define SLAVE_CAPA_NONE 0
 #define SLAVE_CAPA_EOF (1<<0)   /* Can parse the RDB EOF streaming format. */
+#define SLAVE_CAPA_PSYNC2 (1<<1) /* Understands +CONTINUE <new repl ID>. */
 
 /* Synchronous read timeout - slave side */
 #define REDIS_REPL_SYNCIO_TIMEOUT 5
@@ -325,6 +372,9 @@ typedef long long mstime_t; /* millisecond time type. */
 
 #define ZSKIPLIST_MAXLEVEL 32 /* Should be enough for 2^32 elements */
 #define ZSKIPLIST_P 0.25      /* Skiplist P = 1/4 */
+#define ZSKIPLIST_SLAB_LEVELS 4 /* Nodes up to this level live in slabs. */
+#define ZSKIPLIST_SLAB_MIN 8      /* Slots of the first slab of a level. */
+#define ZSKIPLIST_SLAB_MAX 1024   /* Max slots of a slab. */
 
 /* Append only defines */
 #define AOF_FSYNC_NO 0
@@ -335,9 +385,11 @@ typedef long long mstime_t; /* millisecond time type. */
 /* Zip structure related defaults */
 #define REDIS_HASH_MAX_ZIPLIST_ENTRIES 512
 #define REDIS_HASH_MAX_ZIPLIST_VALUE 64
-#define REDIS_LIST_MAX_ZIPLIST_ENTRIES 512
-#define REDIS_LIST_MAX_ZIPLIST_VALUE 64
+#define REDIS_HASH_MAX_CTABLE_ENTRIES 0
+#define REDIS_LIST_MAX_ZIPLIST_SIZE -2
+#define REDIS_LIST_COMPRESS_DEPTH 0
 #define REDIS_SET_MAX_INTSET_ENTRIES 512
+#define REDIS_SET_MAX_CTABLE_ENTRIES 0
 #define REDIS_ZSET_MAX_ZIPLIST_ENTRIES 128
 #define REDIS_ZSET_MAX_ZIPLIST_VALUE 64
 
@@ -356,6 +408,10 @@ typedef long long mstime_t; /* millisecond time type. */
 #define REDIS_MAXMEMORY_ALLKEYS_LRU 3
 #define REDIS_MAXMEMORY_ALLKEYS_RANDOM 4
 #define REDIS_MAXMEMORY_NO_EVICTION 5
+#define REDIS_MAXMEMORY_VOLATILE_LFU 6
+#define REDIS_MAXMEMORY_ALLKEYS_LFU 7
+#define REDIS_MAXMEMORY_IS_LFU(p) ((p) == REDIS_MAXMEMORY_VOLATILE_LFU || \
+                                   (p) == REDIS_MAXMEMORY_ALLKEYS_LFU)
 #define REDIS_DEFAULT_MAXMEMORY_POLICY REDIS_MAXMEMORY_NO_EVICTION
 
 /* Scripting */
@@ -424,20 +480,37 @@ typedef long long mstime_t; /* millisecond time type. */
 #define REDIS_LRU_BITS 24
 #define REDIS_LRU_CLOCK_MAX ((1<<REDIS_LRU_BITS)-1) /* Max value of obj->lru */
 #define REDIS_LRU_CLOCK_RESOLUTION 1000 /* LRU clock resolution in ms */
+/* When an LFU maxmemory policy is used, the same REDIS_LRU_BITS are split
+ * into a 16 bits "last decrement time" in minutes and an 8 bits logarithmic
+ * access counter. See the LFU section in redis.c. */
+#define REDIS_LFU_INIT_VAL 5    /* Counter of newly created objects. */
 typedef struct redisObject {
     unsigned type:4;
     unsigned encoding:4;
-    unsigned lru:REDIS_LRU_BITS; /* lru time (relative to server.lruclock) */
+    unsigned lru:REDIS_LRU_BITS; /* LRU time (relative to server.lruclock) or
+                                  * LFU data (see above). */
     int refcount;
     void *ptr;
 } robj;
 
+/* Reference count of immortal objects, see makeObjectShared(). */
+#define REDIS_SHARED_REFCOUNT INT_MAX
+
 /* Macro used to obtain the current LRU clock.
  * If the current resolution is lower than the frequency we refresh the
  * LRU clock (as it should be in production servers) we return the
  * precomputed value, otherwise we need to resort to a function call. */
 #define LRU_CLOCK() ((1000/server.hz <= REDIS_LRU_CLOCK_RESOLUTION) ? server.lruclock : getLRUClock())
 
+/* Initialize the lru field of a new object, that holds the access time or
+ * the access frequency depending on the maxmemory policy. */
+#define initObjectLRUOrLFU(o) do { \
+    if (REDIS_MAXMEMORY_IS_LFU(server.maxmemory_policy)) \
+        (o)->lru = (LFUGetTimeInMinutes()<<8) | REDIS_LFU_INIT_VAL; \
+    else \
+        (o)->lru = LRU_CLOCK(); \
+} while(0)
+
 /* Macro used to initialize a Redis object allocated on the stack.
  * Note that this macro is taken near the structure definition to make sure
  * we'll update it when the structure is changed, to avoid bugs like
@@ -465,9 +538,47 @@ struct evictionPoolEntry {
 /* Redis database representation. There are multiple databases identified
  * by integers from 0 (the default database) up to the max configured
  * database. The database number is the 'id' field in the structure. */
+/* Time ordered index of the volatile keys of a DB, see expireindex.c */
+#define EXPIRE_INDEX_MAXLEVEL 32 /* Should be enough for 2^64 elements */
+#define EXPIRE_INDEX_P 0.25      /* Skiplist P = 1/4 */
+
+typedef struct expireIndexNode {
+    long long when;             /* Unix time in milliseconds. */
+    sds key;                    /* Key sds owned by the main dictionary. */
+    struct expireIndexNode *forward[];
+} expireIndexNode;
+
+typedef struct expireIndex {
+    expireIndexNode *header;
+    unsigned long length;
+    int level;
+    size_t bytes;               /* Memory used by the index. */
+} expireIndex;
+
+/* Index of the keys of a DB ordered by type and name, see keyindex.c */
+#define KEY_INDEX_MAXLEVEL 32   /* Should be enough for 2^64 elements */
+#define KEY_INDEX_P 0.25        /* Skiplist P = 1/4 */
+
+typedef struct keyIndexNode {
+    sds key;                    /* Key sds owned by the main dictionary. */
+    int type;                   /* Type of the value, REDIS_STRING, ... */
+    struct keyIndexNode *forward[];
+} keyIndexNode;
+
+typedef struct keyIndex {
+    keyIndexNode *header;
+    unsigned long length;
+    int level;
+    size_t bytes;               /* Memory used by the index. */
+} keyIndex;
+
 typedef struct redisDb {
     dict *dict;                 /* The keyspace for this DB */
     dict *expires;              /* Timeout of keys with a timeout set */
+    expireIndex *expire_index;  /* Keys with a timeout in expire order, or
+                                   NULL if active-expire-index is off. */
+    keyIndex *key_index;        /* Keys ordered by type and name, or NULL if
+                                   key-index is off. */
     dict *blocking_keys;        /* Keys with clients waiting for data (BLPOP) */
     dict *ready_keys;           /* Blocked keys that received a PUSH */
     dict *watched_keys;         /* WATCHED keys for MULTI/EXEC CAS */
@@ -524,8 +635,27 @@ typedef struct readyList {
     robj *key;
 } readyList;
 
+/* When the reply of a client doesn't fit in the static buffer c->buf, it is
+ * accumulated in c->reply as a list of blocks of at least
+ * REDIS_REPLY_CHUNK_BYTES bytes (more for a bigger single write), so that
+ * large replies are built with a few allocations and written to the socket
+ * with a single writev() call. */
+typedef struct clientReplyBlock {
+    size_t size, used;      /* Usable and used bytes of 'buf'. */
+    char buf[];
+} clientReplyBlock;
+
 /* With multiplexing we need to take per-client state.
  * Clients are taken in a linked list. */
+/* A command already parsed from the query buffer, but not yet executed.
+ * When I/O threads read and parse the client input they can't call
+ * processCommand(), so they queue the parsed commands in the client for
+ * the main thread to execute them in order. */
+typedef struct parsedCommand {
+    int argc;
+    robj **argv;
+} parsedCommand;
+
 typedef struct redisClient {
     uint64_t id;            /* Client incremental unique ID. */
     int fd;
@@ -541,9 +671,9 @@ typedef struct redisClient {
     int multibulklen;       /* number of multi bulk arguments left to read */
     long bulklen;           /* length of bulk argument in multi bulk request */
     list *reply;
-    unsigned long reply_bytes; /* Tot bytes of objects in reply list */
+    unsigned long reply_bytes; /* Tot bytes of the blocks in reply list */
     int sentlen;            /* Amount of bytes already sent in the current
-                               buffer or object being sent. */
+                               buffer or reply block being sent. */
     time_t ctime;           /* Client creation time */
     time_t lastinteraction; /* time of the last interaction, used for timeout */
     time_t obuf_soft_limit_reached_time;
@@ -555,13 +685,17 @@ typedef struct redisClient {
     off_t repldboff;        /* replication DB file offset */
     off_t repldbsize;       /* replication DB file size */
     sds replpreamble;       /* replication DB preamble. */
-    long long reploff;      /* replication offset if this is our master */
+    long long read_reploff; /* Read replication offset if this is a master. */
+    long long reploff;      /* Applied replication offset if this is a master. */
     long long repl_ack_off; /* replication ack offset, if this is a slave */
     long long repl_ack_time;/* replication ack time, if this is a slave */
     long long psync_initial_offset; /* FULLRESYNC reply offset other slaves
                                        copying this slave output buffer
                                        should use. */
-    char replrunid[REDIS_RUN_ID_SIZE+1]; /* master run id if this is a master */
+    int psync_initial_db;   /* FULLRESYNC reply stream DB, same as above. */
+    char replid[REDIS_RUN_ID_SIZE+1]; /* Master replication ID (if master). */
+    sds pending_querybuf;   /* If this is a master, the part of the querybuf
+                               applied but not yet proxied to our slaves. */
     int slave_listening_port; /* As configured with: SLAVECONF listening-port */
     int slave_capa;         /* Slave capabilities: SLAVE_CAPA_* bitwise OR. */
     multiState mstate;      /* MULTI/EXEC state */
@@ -572,6 +706,11 @@ typedef struct redisClient {
     dict *pubsub_channels;  /* channels a client is interested in (SUBSCRIBE) */
     list *pubsub_patterns;  /* patterns a client is interested in (SUBSCRIBE) */
     sds peerid;             /* Cached peer ID. */
+    parsedCommand *pcmds;   /* Commands parsed ahead by the I/O threads. */
+    int pcmds_len;          /* Number of commands in pcmds. */
+    int pcmds_pos;          /* Next command in pcmds to execute. */
+    sds proto_err;          /* Protocol error found by the I/O threads, to
+                               report after the parsed commands run. */
 
     /* Response buffer */
     int bufpos;
@@ -609,10 +748,29 @@ typedef struct zskiplistNode {
     } level[];
 } zskiplistNode;
 
+/* Skiplist nodes up to level ZSKIPLIST_SLAB_LEVELS, that are all but one
+ * every 256 nodes, are allocated from slabs owned by the skiplist. Every
+ * slab holds nodes of a single level, packed without allocator size class
+ * rounding. Free slots are reused by the next insertions of the same level,
+ * and a slab is released as soon as none of its slots is in use. Higher
+ * level nodes are allocated with zmalloc(). */
+typedef struct zskiplistSlab {
+    struct zskiplistSlab *prev, *next; /* Slabs of the level with free slots. */
+    struct zskiplistNode *free; /* Free slots, linked via their backward ptr. */
+    unsigned int slots;         /* Number of slots of the slab. */
+    unsigned int used;          /* Slots handed out at least once. */
+    unsigned int live;          /* Slots holding a node. */
+    int level;                  /* Level of the nodes of the slab. */
+    char buf[];
+} zskiplistSlab;
+
 typedef struct zskiplist {
     struct zskiplistNode *header, *tail;
     unsigned long length;
     int level;
+    zskiplistSlab **slabs;      /* All the slabs, sorted by address. */
+    unsigned long numslabs;
+    zskiplistSlab *partial[ZSKIPLIST_SLAB_LEVELS]; /* Slabs with free slots. */
 } zskiplist;
 
 typedef struct zset {
@@ -652,6 +810,17 @@ typedef struct redisOpArray {
     int numops;
 } redisOpArray;
 
+/* Node of the trie indexing the pattern subscriptions by the literal prefix
+ * of the pattern, that is, the bytes before the first special glob char.
+ * The trie is path compressed: every node but the root has either some
+ * patterns or at least two children. */
+typedef struct pubsubPatternNode {
+    sds label;                  /* Bytes of the edge leading to this node. */
+    dict *patterns;             /* Pattern -> list of clients, or NULL. */
+    unsigned int numchildren;
+    struct pubsubPatternNode **children; /* Sorted by first label byte. */
+} pubsubPatternNode;
+
 /*-----------------------------------------------------------------------------
  * Global server state
  *----------------------------------------------------------------------------*/
@@ -676,6 +845,14 @@ struct redisServer {
     unsigned lruclock:REDIS_LRU_BITS; /* Clock for LRU eviction */
     int shutdown_asap;          /* SHUTDOWN needed ASAP */
     int activerehashing;        /* Incremental rehash in serverCron() */
+    int active_expire_index;    /* Reclaim expired keys in expire order */
+    int key_index;              /* Keep the keys ordered by type and name */
+    long long rehash_budget_us; /* Current incremental rehash time budget. */
+    long long cron_end_us;      /* Time serverCron() last returned. */
+    long long cron_lag_us;      /* How late the last serverCron() ran. */
+    unsigned long dict_async_alloc_threshold; /* Allocate tables of this
+                                                 many buckets in background. */
+    list *dict_alloc_requests;  /* Background table allocations in progress. */
     char *requirepass;          /* Pass for AUTH command, or NULL */
     char *pidfile;              /* PID file path */
     int arch_bits;              /* 32 or 64 depending on sizeof(long) */
@@ -696,6 +873,8 @@ struct redisServer {
     int cfd_count;              /* Used slots in cfd[] */
     list *clients;              /* List of active clients */
     list *clients_to_close;     /* Clients to close asynchronously */
+    list *clients_pending_write; /* There is to write or install handler. */
+    list *clients_pending_read; /* Clients with reads for the I/O threads. */
     list *slaves, *monitors;    /* List of slaves and MONITORs */
     redisClient *current_client; /* Current client, only used on crash report */
     int clients_paused;         /* True if clients are currently paused */
@@ -703,6 +882,10 @@ struct redisServer {
     char neterr[ANET_ERR_LEN];   /* Error buffer for anet.c */
     dict *migrate_cached_sockets;/* MIGRATE cached sockets */
     uint64_t next_client_id;    /* Next client unique ID. Incremental. */
+    int io_threads_num;         /* Number of I/O threads to use. */
+    int io_threads_do_reads;    /* Read and parse from I/O threads? */
+    int io_threads_active;      /* Are the threads currently spinning? */
+    int io_threads_op;          /* REDIS_IO_THREADS_OP_* in progress. */
     /* RDB / AOF loading information */
     int loading;                /* We are loading data from disk if true */
     off_t loading_total_bytes;
@@ -734,6 +917,14 @@ struct redisServer {
     size_t resident_set_size;       /* RSS sampled in serverCron(). */
     long long stat_net_input_bytes; /* Bytes read from network. */
     long long stat_net_output_bytes; /* Bytes written to network. */
+    long long stat_io_reads_processed; /* Reads processed by I/O threads. */
+    long long stat_io_writes_processed; /* Writes processed by I/O threads. */
+    long long stat_dict_async_allocs; /* Tables installed after background
+                                         allocation. */
+    long long stat_active_defrag_hits;   /* Allocations moved by defrag. */
+    long long stat_active_defrag_misses; /* Allocations not worth moving. */
+    long long stat_active_defrag_key_hits;   /* Keys with moved allocations. */
+    long long stat_active_defrag_key_misses; /* Keys scanned, nothing moved. */
     /* The following two are used to track instantaneous metrics, like
      * number of operations per second, network traffic. */
     struct {
@@ -776,6 +967,7 @@ struct redisServer {
     int aof_last_write_status;      /* REDIS_OK or REDIS_ERR */
     int aof_last_write_errno;       /* Valid if aof_last_write_status is ERR */
     int aof_load_truncated;         /* Don't stop on unexpected AOF EOF. */
+    int aof_use_rdb_preamble;       /* Use RDB preamble on AOF rewrites. */
     /* AOF pipes used to communicate between parent and child during rewrite. */
     int aof_pipe_write_data_to_child;
     int aof_pipe_read_data_from_parent;
@@ -795,11 +987,14 @@ struct redisServer {
     char *rdb_filename;             /* Name of RDB file */
     int rdb_compression;            /* Use compression in RDB? */
     int rdb_checksum;               /* Use RDB checksum? */
+    int rdb_forkless;               /* BGSAVE without fork? (rdb-forkless) */
+    int rdb_load_threads;           /* RDB decoding threads, 0 = serial. */
     time_t lastsave;                /* Unix time of last successful save */
     time_t lastbgsave_try;          /* Unix time of last attempted bgsave */
     time_t rdb_save_time_last;      /* Time used by last RDB save run. */
     time_t rdb_save_time_start;     /* Current RDB save start time. */
     int rdb_child_type;             /* Type of save by active child. */
+    int rdb_forkless_in_progress;   /* Forkless BGSAVE in progress. */
     int lastbgsave_status;          /* REDIS_OK or REDIS_ERR */
     int stop_writes_on_bgsave_err;  /* Don't allow writes if can't BGSAVE */
     int rdb_pipe_write_result_to_parent; /* RDB pipes used to return the state */
@@ -812,8 +1007,11 @@ struct redisServer {
     char *syslog_ident;             /* Syslog ident */
     int syslog_facility;            /* Syslog facility */
     /* Replication (master) */
-    int slaveseldb;                 /* Last SELECTed DB in replication output */
+    char replid[REDIS_RUN_ID_SIZE+1];  /* My current replication ID. */
+    char replid2[REDIS_RUN_ID_SIZE+1]; /* replid inherited from master. */
     long long master_repl_offset;   /* Global replication offset */
+    long long second_replid_offset; /* Accept offsets up to this for replid2. */
+    int slaveseldb;                 /* Last SELECTed DB in replication output */
     int repl_ping_slave_period;     /* Master pings the slave every N seconds */
     char *repl_backlog;             /* Replication backlog for partial syncs */
     long long repl_backlog_size;    /* Backlog circular buffer size */
@@ -848,11 +1046,13 @@ struct redisServer {
     time_t repl_transfer_lastio; /* Unix time of the latest read, for timeout */
     int repl_serve_stale_data; /* Serve stale data when link is down? */
     int repl_slave_ro;          /* Slave is read only? */
+    int repl_slave_lazy_flush;  /* Lazy FLUSHALL before loading the RDB? */
     time_t repl_down_since; /* Unix time at which link with master went down */
     int repl_disable_tcp_nodelay;   /* Disable TCP_NODELAY after SYNC? */
     int slave_priority;             /* Reported in INFO and used by Sentinel. */
-    char repl_master_runid[REDIS_RUN_ID_SIZE+1];  /* Master run id for PSYNC. */
+    char repl_master_replid[REDIS_RUN_ID_SIZE+1]; /* Master repl ID for PSYNC. */
     long long repl_master_initial_offset;         /* Master PSYNC offset. */
+    int repl_master_initial_db;   /* Master stream DB at that offset, or -1. */
     /* Replication script cache. */
     dict *repl_scriptcache_dict;        /* SHA1 all slaves are aware of. */
     list *repl_scriptcache_fifo;        /* First in, first out LRU eviction. */
@@ -865,6 +1065,22 @@ struct redisServer {
     unsigned long long maxmemory;   /* Max number of memory bytes to use */
     int maxmemory_policy;           /* Policy for key eviction */
     int maxmemory_samples;          /* Pricision of random sampling */
+    int lfu_log_factor;             /* LFU logarithmic counter factor. */
+    int lfu_decay_time;             /* LFU counter decay time in minutes. */
+    /* Lazy free */
+    int lazyfree_lazy_eviction;     /* Evict keys in a background thread? */
+    int lazyfree_lazy_expire;       /* Expire keys in a background thread? */
+    int lazyfree_lazy_server_del;   /* Implicit deletes/overwrites freed lazily */
+    /* Active defragmentation */
+    int active_defrag_enabled;      /* Is active defrag enabled? */
+    size_t active_defrag_ignore_bytes; /* Min wasted bytes to start defrag. */
+    int active_defrag_threshold_lower; /* Min fragmentation % to start. */
+    int active_defrag_threshold_upper; /* Fragmentation % for max effort. */
+    int active_defrag_cycle_min;    /* Min CPU % used by the defrag scan. */
+    int active_defrag_cycle_max;    /* Max CPU % used by the defrag scan. */
+    unsigned long active_defrag_max_scan_fields; /* Bigger values are
+                                                    processed incrementally. */
+    int active_defrag_running;      /* CPU % of the running scan, 0 if none. */
     /* Blocked clients */
     unsigned int bpop_blocked_clients; /* Number of clients blocked by lists */
     list *unblocked_clients; /* list of clients to unblock before next loop */
@@ -878,9 +1094,12 @@ struct redisServer {
     /* Zip structure config, see redis.conf for more information  */
     size_t hash_max_ziplist_entries;
     size_t hash_max_ziplist_value;
-    size_t list_max_ziplist_entries;
-    size_t list_max_ziplist_value;
+    size_t hash_max_ctable_entries;
+    /* List parameters */
+    int list_max_ziplist_size;
+    int list_compress_depth;
     size_t set_max_intset_entries;
+    size_t set_max_ctable_entries;
     size_t zset_max_ziplist_entries;
     size_t zset_max_ziplist_value;
     size_t hll_sparse_max_bytes;
@@ -888,7 +1107,8 @@ struct redisServer {
     long long mstime;       /* Like 'unixtime' but with milliseconds resolution. */
     /* Pubsub */
     dict *pubsub_channels;  /* Map channels to list of subscribed clients */
-    list *pubsub_patterns;  /* A list of pubsub_patterns */
+    pubsubPatternNode *pubsub_patterns; /* Root of the patterns trie */
+    unsigned long pubsub_numpat; /* Number of client pattern subscriptions */
     int notify_keyspace_events; /* Events to propagate via Pub/Sub. This is an
                                    xor of REDIS_NOTIFY... flags. */
     /* Cluster */
@@ -900,6 +1120,7 @@ struct redisServer {
     int cluster_slave_validity_factor; /* Slave max data age for failover. */
     int cluster_require_full_coverage; /* If true, put the cluster down if
                                           there is at least an uncovered slot. */
+    int cluster_compact_bus;  /* Use compact PING / PONG when possible. */
     /* Scripting */
     lua_State *lua; /* The Lua interpreter. We use just one for all clients */
     redisClient *lua_client;   /* The "fake client" to query Redis from Lua */
@@ -925,11 +1146,6 @@ struct redisServer {
     int watchdog_period;  /* Software watchdog period in ms. 0 = off */
 };
 
-typedef struct pubsubPattern {
-    redisClient *client;
-    robj *pattern;
-} pubsubPattern;
-
 typedef void redisCommandProc(redisClient *c);
 typedef int *redisGetKeysProc(struct redisCommand *cmd, robj **argv, int argc, int *numkeys);
 struct redisCommand {
@@ -971,15 +1187,13 @@ typedef struct {
     robj *subject;
     unsigned char encoding;
     unsigned char direction; /* Iteration direction */
-    unsigned char *zi;
-    listNode *ln;
+    quicklistIter *iter;
 } listTypeIterator;
 
 /* Structure for an entry while iterating over a list. */
 typedef struct {
     listTypeIterator *li;
-    unsigned char *zi;  /* Entry in ziplist */
-    listNode *ln;       /* Entry in linked list */
+    quicklistEntry entry; /* Entry in quicklist */
 } listTypeEntry;
 
 /* Structure to hold set iteration abstraction. */
@@ -988,6 +1202,8 @@ typedef struct {
     int encoding;
     int ii; /* intset iterator */
     dictIterator *di;
+    unsigned long ctpos; /* ctable iterator */
+    robj ctele; /* Object returned by setTypeNext() for ctable entries */
 } setTypeIterator;
 
 /* Structure to hold hash iteration abstraction. Note that iteration over
@@ -1002,6 +1218,9 @@ typedef struct {
 
     dictIterator *di;
     dictEntry *de;
+
+    unsigned long ctpos;
+    sds entry;
 } hashTypeIterator;
 
 #define REDIS_HASH_KEY 1
@@ -1018,10 +1237,15 @@ extern dictType zsetDictType;
 extern dictType clusterNodesDictType;
 extern dictType clusterNodesBlackListDictType;
 extern dictType dbDictType;
+extern dictType keyptrDictType;
+extern dictType keylistDictType;
 extern dictType shaScriptObjectDictType;
 extern double R_Zero, R_PosInf, R_NegInf, R_Nan;
 extern dictType hashDictType;
 extern dictType replScriptCacheDictType;
+extern dictType slotToKeyDictType;
+extern dictType migrateSlotKeysDictType;
+extern dictType rdbForklessKeysDictType;
 
 /*-----------------------------------------------------------------------------
  * Functions prototypes
@@ -1034,6 +1258,8 @@ void getRandomHexChars(char *p, unsigned int len);
 uint64_t crc64(uint64_t crc, const unsigned char *s, uint64_t l);
 void exitFromChild(int retcode);
 size_t redisPopcount(void *s, long count);
+char *bitopsGetKernelName(void);
+int bitopsSetKernel(char *name);
 void redisSetProcTitle(char *title);
 
 /* networking.c -- Networking and Client related operations */
@@ -1043,9 +1269,17 @@ void freeClient(redisClient *c);
 void freeClientAsync(redisClient *c);
 void resetClient(redisClient *c);
 void sendReplyToClient(aeEventLoop *el, int fd, void *privdata, int mask);
+int writeToClient(int fd, redisClient *c, int handler_installed);
+int clientHasPendingReplies(redisClient *c);
+int clientHasPendingInput(redisClient *c);
+int handleClientsWithPendingWrites(void);
+int handleClientsWithPendingWritesUsingThreads(void);
+int handleClientsWithPendingReadsUsingThreads(void);
+void initThreadedIO(void);
 void *addDeferredMultiBulkLength(redisClient *c);
 void setDeferredMultiBulkLength(redisClient *c, void *node, long length);
 void processInputBuffer(redisClient *c);
+void processInputBufferAndReplicate(redisClient *c);
 void acceptHandler(aeEventLoop *el, int fd, void *privdata, int mask);
 void acceptTcpHandler(aeEventLoop *el, int fd, void *privdata, int mask);
 void acceptUnixHandler(aeEventLoop *el, int fd, void *privdata, int mask);
@@ -1056,6 +1290,7 @@ void addReplyBulkCBuffer(redisClient *c, void *p, size_t len);
 void addReplyBulkLongLong(redisClient *c, long long ll);
 void addReply(redisClient *c, robj *obj);
 void addReplySds(redisClient *c, sds s);
+void addReplyString(redisClient *c, char *s, size_t len);
 void addReplyError(redisClient *c, char *err);
 void addReplyStatus(redisClient *c, char *status);
 void addReplyDouble(redisClient *c, double d);
@@ -1063,6 +1298,7 @@ void addReplyLongLong(redisClient *c, long long ll);
 void addReplyMultiBulkLen(redisClient *c, long length);
 void copyClientOutputBuffer(redisClient *dst, redisClient *src);
 void *dupClientReplyValue(void *o);
+void freeClientReplyValue(void *o);
 void getClientsMaxBuffers(unsigned long *longest_output_list,
                           unsigned long *biggest_input_buffer);
 void formatPeerId(char *peerid, size_t peerid_len, char *ip, int port);
@@ -1096,7 +1332,6 @@ void addReplyStatusFormat(redisClient *c, const char *fmt, ...);
 #endif
 
 /* List data type */
-void listTypeTryConversion(robj *subject, robj *value);
 void listTypePush(robj *subject, robj *value, int where);
 robj *listTypePop(robj *subject, int where);
 unsigned long listTypeLength(robj *subject);
@@ -1128,6 +1363,7 @@ void decrRefCount(robj *o);
 void decrRefCountVoid(void *o);
 void incrRefCount(robj *o);
 robj *resetRefCount(robj *obj);
+robj *makeObjectShared(robj *o);
 void freeStringObject(robj *o);
 void freeListObject(robj *o);
 void freeSetObject(robj *o);
@@ -1144,10 +1380,11 @@ robj *getDecodedObject(robj *o);
 size_t stringObjectLen(robj *o);
 robj *createStringObjectFromLongLong(long long value);
 robj *createStringObjectFromLongDouble(long double value, int humanfriendly);
-robj *createListObject(void);
+robj *createQuicklistObject(void);
 robj *createZiplistObject(void);
 robj *createSetObject(void);
 robj *createIntsetObject(void);
+robj *createCtableSetObject(void);
 robj *createHashObject(void);
 robj *createZsetObject(void);
 robj *createZsetZiplistObject(void);
@@ -1172,6 +1409,7 @@ ssize_t syncReadLine(int fd, char *ptr, ssize_t size, long long timeout);
 
 /* Replication */
 void replicationFeedSlaves(list *slaves, int dictid, robj **argv, int argc);
+void replicationFeedSlavesFromMasterStream(list *slaves, char *buf, size_t buflen);
 void replicationFeedMonitors(redisClient *c, list *monitors, int dictid, robj **argv, int argc);
 void updateSlavesWaitingBgsave(int bgsaveerr, int type);
 void replicationCron(void);
@@ -1192,7 +1430,10 @@ void replicationSendNewlineToMaster(void);
 long long replicationGetSlaveOffset(void);
 char *replicationGetSlaveName(redisClient *c);
 long long getPsyncInitialOffset(void);
-int replicationSetupSlaveForFullResync(redisClient *slave, long long offset);
+int getPsyncInitialDb(void);
+int replicationSetupSlaveForFullResync(redisClient *slave, long long offset, int dbid);
+void changeReplicationId(void);
+void clearReplicationId2(void);
 
 /* Generic persistence functions */
 void startLoading(FILE *fp);
@@ -1213,6 +1454,7 @@ int startAppendOnly(void);
 void backgroundRewriteDoneHandler(int exitcode, int bysignal);
 void aofRewriteBufferReset(void);
 unsigned long aofRewriteBufferSize(void);
+ssize_t aofReadDiffFromParent(void);
 
 /* Sorted sets data type */
 
@@ -1229,7 +1471,7 @@ typedef struct {
 } zlexrangespec;
 
 zskiplist *zslCreate(void);
-void zslFree(zskiplist *zsl);
+void zsetFree(zset *zs);
 zskiplistNode *zslInsert(zskiplist *zsl, double score, robj *obj);
 unsigned char *zzlInsert(unsigned char *zl, robj *ele, double score);
 int zslDelete(zskiplist *zsl, double score, robj *obj);
@@ -1241,6 +1483,8 @@ void zzlPrev(unsigned char *zl, unsigned char **eptr, unsigned char **sptr);
 unsigned int zsetLength(robj *zobj);
 void zsetConvert(robj *zobj, int encoding);
 unsigned long zslGetRank(zskiplist *zsl, double score, robj *o);
+zskiplistSlab *zslNodeSlab(zskiplist *zsl, zskiplistNode *x);
+zskiplistNode *zslEvacuateNode(zskiplist *zsl, zskiplistNode *x);
 
 /* Core functions */
 int freeMemoryIfNeeded(void);
@@ -1265,6 +1509,8 @@ void redisLogFromHandler(int level, const char *msg);
 void usage(void);
 void updateDictResizePolicy(void);
 int htNeedsResize(dict *dict);
+void dictAllocTableFromBioThread(void *req);
+void handleDictAllocRequests(void);
 void oom(const char *msg);
 void populateCommandTable(void);
 void resetCommandTableStats(void);
@@ -1273,6 +1519,9 @@ void closeListeningSockets(int unlink_unix_socket);
 void updateCachedTime(void);
 void resetServerStats(void);
 unsigned int getLRUClock(void);
+unsigned int LFUGetTimeInMinutes(void);
+unsigned long LFUDecrAndReturn(robj *o);
+void updateLFU(robj *o);
 
 /* Set data type */
 robj *setTypeCreate(robj *value);
@@ -1285,9 +1534,11 @@ int setTypeNext(setTypeIterator *si, robj **objele, int64_t *llele);
 robj *setTypeNextObject(setTypeIterator *si);
 int setTypeRandomElement(robj *setobj, robj **objele, int64_t *llele);
 unsigned long setTypeSize(robj *subject);
+int setTypeTableEncoding(unsigned long len);
 void setTypeConvert(robj *subject, int enc);
 
 /* Hash data type */
+int hashTypeTableEncoding(unsigned long len);
 void hashTypeConvert(robj *o, int enc);
 void hashTypeTryConversion(robj *subject, robj **argv, int start, int end);
 void hashTypeTryObjectEncoding(robj *subject, robj **o1, robj **o2);
@@ -1304,14 +1555,15 @@ void hashTypeCurrentFromZiplist(hashTypeIterator *hi, int what,
                                 unsigned int *vlen,
                                 long long *vll);
 void hashTypeCurrentFromHashTable(hashTypeIterator *hi, int what, robj **dst);
+void hashTypeCurrentFromCtable(hashTypeIterator *hi, int what,
+                               char **vstr, size_t *vlen);
 robj *hashTypeCurrentObject(hashTypeIterator *hi, int what);
 robj *hashTypeLookupWriteOrCreate(redisClient *c, robj *key);
 
 /* Pub / Sub */
 int pubsubUnsubscribeAllChannels(redisClient *c, int notify);
 int pubsubUnsubscribeAllPatterns(redisClient *c, int notify);
-void freePubsubPattern(void *p);
-int listMatchPubsubPattern(void *a, void *b);
+pubsubPatternNode *pubsubCreatePatternNode(char *label, size_t len);
 int pubsubPublishMessage(robj *channel, robj *message);
 
 /* Keyspace events notification */
@@ -1329,12 +1581,14 @@ int rewriteConfig(char *path);
 
 /* db.c -- Keyspace access API */
 int removeExpire(redisDb *db, robj *key);
+int dbDeleteExpire(redisDb *db, sds key);
 void propagateExpire(redisDb *db, robj *key);
 int expireIfNeeded(redisDb *db, robj *key);
 long long getExpire(redisDb *db, robj *key);
 void setExpire(redisDb *db, robj *key, long long when);
 robj *lookupKey(redisDb *db, robj *key);
 robj *lookupKeyRead(redisDb *db, robj *key);
+void dbPrefetchKeys(redisDb *db, robj **keys, int numkeys);
 robj *lookupKeyWrite(redisDb *db, robj *key);
 robj *lookupKeyReadOrReply(redisClient *c, robj *key, robj *reply);
 robj *lookupKeyWriteOrReply(redisClient *c, robj *key, robj *reply);
@@ -1344,17 +1598,66 @@ void setKey(redisDb *db, robj *key, robj *val);
 int dbExists(redisDb *db, robj *key);
 robj *dbRandomKey(redisDb *db);
 int dbDelete(redisDb *db, robj *key);
+int dbSyncDelete(redisDb *db, robj *key);
 robj *dbUnshareStringValue(redisDb *db, robj *key, robj *o);
-long long emptyDb(void(callback)(void*));
+
+#define EMPTYDB_NO_FLAGS 0      /* No flags. */
+#define EMPTYDB_ASYNC (1<<0)    /* Reclaim memory in another thread. */
+long long emptyDb(int dbnum, int flags, void(callback)(void*));
 int selectDb(redisClient *c, int id);
 void signalModifiedKey(redisDb *db, robj *key);
 void signalFlushedDb(int dbid);
-unsigned int getKeysInSlot(unsigned int hashslot, robj **keys, unsigned int count);
+dict **slotToKeyCreate(void);
+void slotToKeyRelease(dict **slots);
+void slotToKeyAdd(sds key);
+void slotToKeyDel(sds key);
+void slotToKeyReplace(sds oldkey, sds newkey);
+void slotToKeyFlush(void);
+unsigned int getKeysInSlot(unsigned int hashslot, sds *keys, unsigned int count);
 unsigned int countKeysInSlot(unsigned int hashslot);
 unsigned int delKeysInSlot(unsigned int hashslot);
 int verifyClusterConfigWithData(void);
-void scanGenericCommand(redisClient *c, robj *o, unsigned long cursor);
-int parseScanCursorOrReply(redisClient *c, robj *o, unsigned long *cursor);
+void scanGenericCommand(redisClient *c, robj *o, unsigned long long cursor);
+int parseScanCursorOrReply(redisClient *c, robj *o,
+                           unsigned long long *cursor);
+
+/* lazyfree.c -- Lazy freeing of keys and databases */
+extern __thread int lazyfree_thread;
+int dbAsyncDelete(redisDb *db, robj *key);
+void emptyDbAsync(redisDb *db);
+void slotToKeyFlushAsync(void);
+void freeObjAsync(robj *o);
+size_t lazyfreeGetPendingObjectsCount(void);
+void lazyfreeFreeObjectFromBioThread(robj *o);
+void lazyfreeFreeDatabaseFromBioThread(dict *ht1, dict *ht2, keyIndex *ki);
+void lazyfreeFreeExpireIndexFromBioThread(expireIndex *ei);
+void lazyfreeFreeSlotsMapFromBioThread(dict **slots);
+void lazyfreeDeferDecrRefCount(robj *o);
+void lazyfreeReleaseDeferred(void);
+
+/* expireindex.c -- Time ordered index of volatile keys */
+expireIndex *expireIndexCreate(void);
+void expireIndexRelease(expireIndex *ei);
+void expireIndexInsert(expireIndex *ei, long long when, sds key);
+int expireIndexDelete(expireIndex *ei, long long when, sds key);
+expireIndexNode *expireIndexFirst(expireIndex *ei);
+void expireIndexUpdateConfig(void);
+size_t expireIndexMemory(void);
+
+/* keyindex.c -- Index of the keys ordered by type and name */
+keyIndex *keyIndexCreate(void);
+void keyIndexRelease(keyIndex *ki);
+void keyIndexInsert(keyIndex *ki, int type, sds key);
+int keyIndexDelete(keyIndex *ki, int type, sds key);
+void keyIndexReplace(keyIndex *ki, int type, sds newkey);
+int keyIndexMoveNode(keyIndex *ki, int type, sds key,
+                     void *(*moveptr)(void*));
+keyIndexNode *keyIndexSeek(keyIndex *ki, int type, char *key, size_t len);
+void keyIndexUpdateConfig(void);
+size_t keyIndexMemory(void);
+
+/* defrag.c -- Active memory defragmentation */
+void activeDefragCycle(void);
 
 /* API to get key arguments from commands */
 int *getKeysFromCommand(struct redisCommand *cmd, robj **argv, int argc, int *numkeys);
@@ -1372,6 +1675,7 @@ void clusterCron(void);
 void clusterPropagatePublish(robj *channel, robj *message);
 void migrateCloseTimedoutSockets(void);
 void clusterBeforeSleep(void);
+void clusterSlotMigrationTouchKey(robj *key);
 
 /* Sentinel */
 void initSentinelConfig(void);
@@ -1407,6 +1711,7 @@ void setexCommand(redisClient *c);
 void psetexCommand(redisClient *c);
 void getCommand(redisClient *c);
 void delCommand(redisClient *c);
+void unlinkCommand(redisClient *c);
 void existsCommand(redisClient *c);
 void setbitCommand(redisClient *c);
 void getbitCommand(redisClient *c);
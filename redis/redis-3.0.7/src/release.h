@@ -0,0 +1,3 @@
+#define REDIS_GIT_SHA1 "5eab855e"
+#define REDIS_GIT_DIRTY "235"
+#define REDIS_BUILD_ID "vm-1792244741"
@@ -37,6 +37,7 @@
 #include <sys/socket.h>
 #include <sys/stat.h>
 
+static void replicationCacheMasterUsingMyself(void);
 void replicationDiscardCachedMaster(void);
 void replicationResurrectCachedMaster(int newfd);
 void replicationSendAck(void);
@@ -66,6 +67,44 @@ char *replicationGetSlaveName(redisClient *c) {
     return buf;
 }
 
+/* ----------------------------- REPLICATION ID ----------------------------- */
+
+/* The replication ID identifies a given history of the data set: two
+ * instances with the same replication ID and offset hold exactly the same
+ * data. Slaves inherit the replication ID of their master, and a slave
+ * promoted to master remembers the ID of its old master as replid2 (up to
+ * the offset it reached, second_replid_offset), so that its former
+ * siblings can continue the replication with it incrementally. */
+
+/* Generate a new replication ID, used every time the history of the
+ * data set starts to diverge from what any other instance may know. */
+void changeReplicationId(void) {
+    getRandomHexChars(server.replid,REDIS_RUN_ID_SIZE);
+    server.replid[REDIS_RUN_ID_SIZE] = '\0';
+}
+
+/* Forget the secondary replication ID: no slave of the previous history
+ * can be partially resynchronized anymore. */
+void clearReplicationId2(void) {
+    memset(server.replid2,'0',REDIS_RUN_ID_SIZE);
+    server.replid2[REDIS_RUN_ID_SIZE] = '\0';
+    server.second_replid_offset = -1;
+}
+
+/* Use the current replication ID as secondary ID valid up to the current
+ * offset, and generate a new primary ID. This is used when a slave is
+ * turned into a master: slaves of our old master are able to PSYNC with
+ * us up to the offset we reached. */
+static void shiftReplicationId(void) {
+    memcpy(server.replid2,server.replid,sizeof(server.replid));
+    /* The +1 is because the slave asks for the next byte it has not
+     * received: a slave that got all the data we got asks for offset+1. */
+    server.second_replid_offset = server.master_repl_offset+1;
+    changeReplicationId();
+    redisLog(REDIS_NOTICE,"Setting secondary replication ID to %s, valid up to offset: %lld. New replication ID is %s",
+        server.replid2, server.second_replid_offset, server.replid);
+}
+
 /* ---------------------------------- MASTER -------------------------------- */
 
 void createReplicationBacklog(void) {
@@ -73,11 +112,6 @@ void createReplicationBacklog(void) {
     server.repl_backlog = zmalloc(server.repl_backlog_size);
     server.repl_backlog_histlen = 0;
     server.repl_backlog_idx = 0;
-    /* When a new backlog buffer is created, we increment the replication
-     * offset by one to make sure we'll not be able to PSYNC with any
-     * previous slave. This is needed because we avoid incrementing the
-     * master_repl_offset if no backlog exists nor slaves are attached. */
-    server.master_repl_offset++;
 
     /* We don't have any data inside our buffer, but virtually the first
      * byte we have is the next byte that will be generated for the
@@ -170,6 +204,11 @@ void replicationFeedSlaves(list *slaves, int dictid, robj **argv, int argc) {
     int j, len;
     char llstr[REDIS_LONGSTR_SIZE];
 
+    /* If the instance is a slave, the replication stream of its own slaves
+     * is proxied verbatim from its master, see
+     * replicationFeedSlavesFromMasterStream(). */
+    if (server.masterhost != NULL) return;
+
     /* If there aren't slaves, and there is no backlog buffer to populate,
      * we can return ASAP. */
     if (server.repl_backlog == NULL && listLength(slaves) == 0) return;
@@ -259,6 +298,24 @@ void replicationFeedSlaves(list *slaves, int dictid, robj **argv, int argc) {
     }
 }
 
+/* Feed our slaves and the backlog with a part of the replication stream
+ * received from our master, exactly as it was received, so that our slaves
+ * and backlog share the offsets of our master stream. */
+void replicationFeedSlavesFromMasterStream(list *slaves, char *buf, size_t buflen) {
+    listNode *ln;
+    listIter li;
+
+    if (server.repl_backlog) feedReplicationBacklog(buf,buflen);
+    listRewind(slaves,&li);
+    while((ln = listNext(&li))) {
+        redisClient *slave = ln->value;
+
+        /* Don't feed slaves that are still waiting for BGSAVE to start */
+        if (slave->replstate == REDIS_REPL_WAIT_BGSAVE_START) continue;
+        addReplyString(slave,buf,buflen);
+    }
+}
+
 void replicationFeedMonitors(redisClient *c, list *monitors, int dictid, robj **argv, int argc) {
     listNode *ln;
     listIter li;
@@ -355,11 +412,16 @@ long long addReplyReplicationBacklog(redisClient *c, long long offset) {
  * the BGSAVE process started and before executing any other command
  * from clients. */
 long long getPsyncInitialOffset(void) {
-    long long psync_offset = server.master_repl_offset;
-    /* Add 1 to psync_offset if it the replication backlog does not exists
-     * as when it will be created later we'll increment the offset by one. */
-    if (server.repl_backlog == NULL) psync_offset++;
-    return psync_offset;
+    return server.master_repl_offset;
+}
+
+/* Return the DB selected by the replication stream at the offset returned
+ * by getPsyncInitialOffset(). A master returns -1 since it will emit a
+ * SELECT anyway (see replicationSetupSlaveForFullResync()), while a slave
+ * proxying the stream of its master returns the DB its master selected. */
+int getPsyncInitialDb(void) {
+    if (server.masterhost && server.master) return server.master->db->id;
+    return -1;
 }
 
 /* Send a FULLRESYNC reply in the specific case of a full resynchronization,
@@ -378,11 +440,12 @@ long long getPsyncInitialOffset(void) {
  * Normally this function should be called immediately after a successful
  * BGSAVE for replication was started, or when there is one already in
  * progress that we attached our slave to. */
-int replicationSetupSlaveForFullResync(redisClient *slave, long long offset) {
+int replicationSetupSlaveForFullResync(redisClient *slave, long long offset, int dbid) {
     char buf[128];
     int buflen;
 
     slave->psync_initial_offset = offset;
+    slave->psync_initial_db = dbid;
     slave->replstate = REDIS_REPL_WAIT_BGSAVE_END;
     /* We are going to accumulate the incremental changes for this
      * slave as well. Set slaveseldb to -1 in order to force to re-emit
@@ -392,8 +455,15 @@ int replicationSetupSlaveForFullResync(redisClient *slave, long long offset) {
     /* Don't send this reply to slaves that approached us with
      * the old SYNC command. */
     if (!(slave->flags & REDIS_PRE_PSYNC)) {
-        buflen = snprintf(buf,sizeof(buf),"+FULLRESYNC %s %lld\r\n",
-                          server.runid,offset);
+        /* The stream DB is only sent when the stream will not start with
+         * a SELECT, that is, when we proxy the stream of our master. */
+        if (dbid != -1 && (slave->slave_capa & SLAVE_CAPA_PSYNC2)) {
+            buflen = snprintf(buf,sizeof(buf),"+FULLRESYNC %s %lld %d\r\n",
+                              server.replid,offset,dbid);
+        } else {
+            buflen = snprintf(buf,sizeof(buf),"+FULLRESYNC %s %lld\r\n",
+                              server.replid,offset);
+        }
         if (write(slave->fd,buf,buflen) != buflen) {
             freeClientAsync(slave);
             return REDIS_ERR;
@@ -409,19 +479,38 @@ int replicationSetupSlaveForFullResync(redisClient *slave, long long offset) {
  * with the usual full resync. */
 int masterTryPartialResynchronization(redisClient *c) {
     long long psync_offset, psync_len;
-    char *master_runid = c->argv[1]->ptr;
+    char *master_replid = c->argv[1]->ptr;
     char buf[128];
     int buflen;
 
-    /* Is the runid of this master the same advertised by the wannabe slave
-     * via PSYNC? If runid changed this master is a different instance and
-     * there is no way to continue. */
-    if (strcasecmp(master_runid, server.runid)) {
-        /* Run id "?" is used by slaves that want to force a full resync. */
-        if (master_runid[0] != '?') {
-            redisLog(REDIS_NOTICE,"Partial resynchronization not accepted: "
-                "Runid mismatch (Client asked for runid '%s', my runid is '%s')",
-                master_runid, server.runid);
+    /* Parse the replication offset asked by the slave. */
+    if (getLongLongFromObjectOrReply(c,c->argv[2],&psync_offset,NULL) !=
+       REDIS_OK) goto need_full_resync;
+
+    /* Is the replication ID of this master the same advertised by the
+     * wannabe slave via PSYNC? If the ID changed this master has a different
+     * history and there is no way to continue, unless the slave was
+     * replicating from our previous master and asks for an offset we
+     * reached as well before being turned into a master. */
+    if (strcasecmp(master_replid, server.replid) &&
+        (strcasecmp(master_replid, server.replid2) ||
+         psync_offset > server.second_replid_offset))
+    {
+        /* Replication ID "?" is used by slaves that want to force a full
+         * resync. */
+        if (master_replid[0] != '?') {
+            if (strcasecmp(master_replid, server.replid) &&
+                strcasecmp(master_replid, server.replid2))
+            {
+                redisLog(REDIS_NOTICE,"Partial resynchronization not accepted: "
+                    "Replication ID mismatch (Slave asked for '%s', my "
+                    "replication IDs are '%s' and '%s')",
+                    master_replid, server.replid, server.replid2);
+            } else {
+                redisLog(REDIS_NOTICE,"Partial resynchronization not accepted: "
+                    "Requested offset for second ID was %lld, but I can reply "
+                    "up to %lld", psync_offset, server.second_replid_offset);
+            }
         } else {
             redisLog(REDIS_NOTICE,"Full resync requested by slave %s",
                 replicationGetSlaveName(c));
@@ -430,8 +519,6 @@ int masterTryPartialResynchronization(redisClient *c) {
     }
 
     /* We still have the data our slave is asking for? */
-    if (getLongLongFromObjectOrReply(c,c->argv[2],&psync_offset,NULL) !=
-       REDIS_OK) goto need_full_resync;
     if (!server.repl_backlog ||
         psync_offset < server.repl_backlog_off ||
         psync_offset > (server.repl_backlog_off + server.repl_backlog_histlen))
@@ -457,7 +544,11 @@ int masterTryPartialResynchronization(redisClient *c) {
     /* We can't use the connection buffers since they are used to accumulate
      * new commands at this stage. But we are sure the socket send buffer is
      * empty so this write will never fail actually. */
-    buflen = snprintf(buf,sizeof(buf),"+CONTINUE\r\n");
+    if (c->slave_capa & SLAVE_CAPA_PSYNC2) {
+        buflen = snprintf(buf,sizeof(buf),"+CONTINUE %s\r\n", server.replid);
+    } else {
+        buflen = snprintf(buf,sizeof(buf),"+CONTINUE\r\n");
+    }
     if (write(c->fd,buf,buflen) != buflen) {
         freeClientAsync(c);
         return REDIS_OK;
@@ -543,7 +634,7 @@ int startBgsaveForReplication(int mincapa) {
 
             if (slave->replstate == REDIS_REPL_WAIT_BGSAVE_START) {
                     replicationSetupSlaveForFullResync(slave,
-                            getPsyncInitialOffset());
+                            getPsyncInitialOffset(),getPsyncInitialDb());
             }
         }
     }
@@ -583,22 +674,22 @@ void syncCommand(redisClient *c) {
      * when this happens masterTryPartialResynchronization() already
      * replied with:
      *
-     * +FULLRESYNC <runid> <offset>
+     * +FULLRESYNC <replid> <offset>
      *
-     * So the slave knows the new runid and offset to try a PSYNC later
+     * So the slave knows the new replid and offset to try a PSYNC later
      * if the connection with the master is lost. */
     if (!strcasecmp(c->argv[0]->ptr,"psync")) {
         if (masterTryPartialResynchronization(c) == REDIS_OK) {
             server.stat_sync_partial_ok++;
             return; /* No full resync needed, return. */
         } else {
-            char *master_runid = c->argv[1]->ptr;
+            char *master_replid = c->argv[1]->ptr;
 
             /* Increment stats for failed PSYNCs, but only if the
-             * runid is not "?", as this is used by slaves to force a full
-             * resync on purpose when they are not albe to partially
+             * replication ID is not "?", as this is used by slaves to force
+             * a full resync on purpose when they are not albe to partially
              * resync. */
-            if (master_runid[0] != '?') server.stat_sync_partial_err++;
+            if (master_replid[0] != '?') server.stat_sync_partial_err++;
         }
     } else {
         /* If a slave uses SYNC, we are dealing with an old implementation
@@ -619,8 +710,20 @@ void syncCommand(redisClient *c) {
     c->flags |= REDIS_SLAVE;
     listAddNodeTail(server.slaves,c);
 
-    /* CASE 1: BGSAVE is in progress, with disk target. */
-    if (server.rdb_child_pid != -1 &&
+    /* Create the replication backlog if needed. A master without backlog
+     * did not track its offset, so it starts a new replication history:
+     * no slave of the old one is allowed to PSYNC. */
+    if (listLength(server.slaves) == 1 && server.repl_backlog == NULL) {
+        if (server.masterhost == NULL) {
+            changeReplicationId();
+            clearReplicationId2();
+        }
+        createReplicationBacklog();
+    }
+
+    /* CASE 1: BGSAVE is in progress, with disk target. A forkless BGSAVE
+     * is handled just the same: the snapshot is point-in-time as well. */
+    if ((server.rdb_child_pid != -1 || server.rdb_forkless_in_progress) &&
         server.rdb_child_type == REDIS_RDB_CHILD_TYPE_DISK)
     {
         /* Ok a background save is in progress. Let's check if it is a good
@@ -641,7 +744,8 @@ void syncCommand(redisClient *c) {
             /* Perfect, the server is already registering differences for
              * another slave. Set the right state, and copy the buffer. */
             copyClientOutputBuffer(c,slave);
-            replicationSetupSlaveForFullResync(c,slave->psync_initial_offset);
+            replicationSetupSlaveForFullResync(c,slave->psync_initial_offset,
+                slave->psync_initial_db);
             redisLog(REDIS_NOTICE,"Waiting for end of BGSAVE for SYNC");
         } else {
             /* No way, we need to wait for the next BGSAVE in order to
@@ -674,8 +778,6 @@ void syncCommand(redisClient *c) {
         }
     }
 
-    if (listLength(server.slaves) == 1 && server.repl_backlog == NULL)
-        createReplicationBacklog();
     return;
 }
 
@@ -714,6 +816,8 @@ void replconfCommand(redisClient *c) {
             /* Ignore capabilities not understood by this master. */
             if (!strcasecmp(c->argv[j+1]->ptr,"eof"))
                 c->slave_capa |= SLAVE_CAPA_EOF;
+            else if (!strcasecmp(c->argv[j+1]->ptr,"psync2"))
+                c->slave_capa |= SLAVE_CAPA_PSYNC2;
         } else if (!strcasecmp(c->argv[j]->ptr,"ack")) {
             /* REPLCONF ACK is used by slave to inform the master the amount
              * of replication stream that it processed so far. It is an
@@ -1101,7 +1205,12 @@ void readSyncBulkPayload(aeEventLoop *el, int fd, void *privdata, int mask) {
         }
         redisLog(REDIS_NOTICE, "MASTER <-> SLAVE sync: Flushing old data");
         signalFlushedDb(-1);
-        emptyDb(replicationEmptyDbCallback);
+        /* Asynchronously flush the old data set when slave-lazy-flush is
+         * enabled: the callback is not needed since no time is spent. */
+        emptyDb(
+            -1,
+            server.repl_slave_lazy_flush ? EMPTYDB_ASYNC : EMPTYDB_NO_FLAGS,
+            replicationEmptyDbCallback);
         /* Before loading the DB into memory we need to delete the readable
          * handler, otherwise it will get called recursively since
          * rdbLoad() will call the event loop to process events from time to
@@ -1121,12 +1230,23 @@ void readSyncBulkPayload(aeEventLoop *el, int fd, void *privdata, int mask) {
         server.master->authenticated = 1;
         server.repl_state = REDIS_REPL_CONNECTED;
         server.master->reploff = server.repl_master_initial_offset;
-        memcpy(server.master->replrunid, server.repl_master_runid,
-            sizeof(server.repl_master_runid));
+        server.master->read_reploff = server.master->reploff;
+        memcpy(server.master->replid, server.repl_master_replid,
+            sizeof(server.repl_master_replid));
+        if (server.repl_master_initial_db != -1)
+            selectDb(server.master,server.repl_master_initial_db);
         /* If master offset is set to -1, this master is old and is not
          * PSYNC capable, so we flag it accordingly. */
         if (server.master->reploff == -1)
             server.master->flags |= REDIS_PRE_PSYNC;
+
+        /* From now on we share the replication history of our master, and
+         * proxy its stream to our slaves and backlog: start from the
+         * master offset with a new backlog. */
+        memcpy(server.replid,server.master->replid,sizeof(server.replid));
+        server.master_repl_offset = server.master->reploff;
+        clearReplicationId2();
+        if (server.repl_backlog == NULL) createReplicationBacklog();
         redisLog(REDIS_NOTICE, "MASTER <-> SLAVE sync: Finished with success");
         /* Restart the AOF subsystem now that we finished the sync. This
          * will trigger an AOF rewrite, and when done will start appending
@@ -1262,7 +1382,7 @@ char *sendSynchronousCommand(int flags, int fd, ...) {
 #define PSYNC_FULLRESYNC 3
 #define PSYNC_NOT_SUPPORTED 4
 int slaveTryPartialResynchronization(int fd, int read_reply) {
-    char *psync_runid;
+    char *psync_replid;
     char psync_offset[32];
     sds reply;
 
@@ -1274,19 +1394,20 @@ int slaveTryPartialResynchronization(int fd, int read_reply) {
          * right value, so that this information will be propagated to the
          * client structure representing the master into server.master. */
         server.repl_master_initial_offset = -1;
+        server.repl_master_initial_db = -1;
 
         if (server.cached_master) {
-            psync_runid = server.cached_master->replrunid;
+            psync_replid = server.cached_master->replid;
             snprintf(psync_offset,sizeof(psync_offset),"%lld", server.cached_master->reploff+1);
-            redisLog(REDIS_NOTICE,"Trying a partial resynchronization (request %s:%s).", psync_runid, psync_offset);
+            redisLog(REDIS_NOTICE,"Trying a partial resynchronization (request %s:%s).", psync_replid, psync_offset);
         } else {
             redisLog(REDIS_NOTICE,"Partial resynchronization not possible (no cached master)");
-            psync_runid = "?";
+            psync_replid = "?";
             memcpy(psync_offset,"-1",3);
         }
 
         /* Issue the PSYNC command */
-        reply = sendSynchronousCommand(SYNC_CMD_WRITE,fd,"PSYNC",psync_runid,psync_offset,NULL);
+        reply = sendSynchronousCommand(SYNC_CMD_WRITE,fd,"PSYNC",psync_replid,psync_offset,NULL);
         if (reply != NULL) {
             redisLog(REDIS_WARNING,"Unable to send PSYNC to master: %s",reply);
             sdsfree(reply);
@@ -1308,30 +1429,32 @@ int slaveTryPartialResynchronization(int fd, int read_reply) {
     aeDeleteFileEvent(server.el,fd,AE_READABLE);
 
     if (!strncmp(reply,"+FULLRESYNC",11)) {
-        char *runid = NULL, *offset = NULL;
-
-        /* FULL RESYNC, parse the reply in order to extract the run id
-         * and the replication offset. */
-        runid = strchr(reply,' ');
-        if (runid) {
-            runid++;
-            offset = strchr(runid,' ');
+        char *replid = NULL, *offset = NULL, *dbid;
+
+        /* FULL RESYNC, parse the reply in order to extract the replication
+         * ID and offset, and the stream DB if our master is a slave. */
+        replid = strchr(reply,' ');
+        if (replid) {
+            replid++;
+            offset = strchr(replid,' ');
             if (offset) offset++;
         }
-        if (!runid || !offset || (offset-runid-1) != REDIS_RUN_ID_SIZE) {
+        if (!replid || !offset || (offset-replid-1) != REDIS_RUN_ID_SIZE) {
             redisLog(REDIS_WARNING,
                 "Master replied with wrong +FULLRESYNC syntax.");
             /* This is an unexpected condition, actually the +FULLRESYNC
              * reply means that the master supports PSYNC, but the reply
              * format seems wrong. To stay safe we blank the master
-             * runid to make sure next PSYNCs will fail. */
-            memset(server.repl_master_runid,0,REDIS_RUN_ID_SIZE+1);
+             * replid to make sure next PSYNCs will fail. */
+            memset(server.repl_master_replid,0,REDIS_RUN_ID_SIZE+1);
         } else {
-            memcpy(server.repl_master_runid, runid, offset-runid-1);
-            server.repl_master_runid[REDIS_RUN_ID_SIZE] = '\0';
+            memcpy(server.repl_master_replid, replid, offset-replid-1);
+            server.repl_master_replid[REDIS_RUN_ID_SIZE] = '\0';
             server.repl_master_initial_offset = strtoll(offset,NULL,10);
+            dbid = strchr(offset,' ');
+            if (dbid) server.repl_master_initial_db = atoi(dbid+1);
             redisLog(REDIS_NOTICE,"Full resync from master: %s:%lld",
-                server.repl_master_runid,
+                server.repl_master_replid,
                 server.repl_master_initial_offset);
         }
         /* We are going to full resync, discard the cached master structure. */
@@ -1341,10 +1464,35 @@ int slaveTryPartialResynchronization(int fd, int read_reply) {
     }
 
     if (!strncmp(reply,"+CONTINUE",9)) {
-        /* Partial resync was accepted, set the replication state accordingly */
+        /* Partial resync was accepted. */
         redisLog(REDIS_NOTICE,
             "Successful partial resynchronization with master.");
+
+        /* Check the new replication ID advertised by the master. If it
+         * changed, we need to set the new ID as primary ID, and set our
+         * old ID as secondary ID valid up to the current offset, so that
+         * our own slaves can PSYNC with us as well. They are disconnected
+         * to learn the new ID. */
+        char *start = reply+10, *end = reply+9;
+        while(end[0] != '\r' && end[0] != '\n' && end[0] != '\0') end++;
+        if (end-start == REDIS_RUN_ID_SIZE &&
+            memcmp(start,server.cached_master->replid,REDIS_RUN_ID_SIZE))
+        {
+            memcpy(server.replid2,server.cached_master->replid,
+                sizeof(server.replid2));
+            server.second_replid_offset = server.master_repl_offset+1;
+            memcpy(server.replid,start,REDIS_RUN_ID_SIZE);
+            server.replid[REDIS_RUN_ID_SIZE] = '\0';
+            memcpy(server.cached_master->replid,server.replid,
+                sizeof(server.replid));
+            redisLog(REDIS_WARNING,"Master replication ID changed to %s",
+                server.replid);
+            disconnectSlaves();
+        }
         sdsfree(reply);
+
+        /* A demoted master may have no backlog yet. */
+        if (server.repl_backlog == NULL) createReplicationBacklog();
         replicationResurrectCachedMaster(fd);
         return PSYNC_CONTINUE;
     }
@@ -1480,13 +1628,12 @@ void syncWithMaster(aeEventLoop *el, int fd, void *privdata, int mask) {
         server.repl_state = REDIS_REPL_SEND_CAPA;
     }
 
-    /* Inform the master of our capabilities. While we currently send
-     * just one capability, it is possible to chain new capabilities here
-     * in the form of REPLCONF capa X capa Y capa Z ...
+    /* Inform the master of our capabilities, in the form of
+     * REPLCONF capa X capa Y capa Z ...
      * The master will ignore capabilities it does not understand. */
     if (server.repl_state == REDIS_REPL_SEND_CAPA) {
         err = sendSynchronousCommand(SYNC_CMD_WRITE,fd,"REPLCONF",
-                "capa","eof",NULL);
+                "capa","eof","capa","psync2",NULL);
         if (err) goto write_error;
         sdsfree(err);
         server.repl_state = REDIS_REPL_RECEIVE_CAPA;
@@ -1547,7 +1694,7 @@ void syncWithMaster(aeEventLoop *el, int fd, void *privdata, int mask) {
     freeReplicationBacklog(); /* Don't allow our chained slaves to PSYNC. */
 
     /* Fall back to SYNC if needed. Otherwise psync_result == PSYNC_FULLRESYNC
-     * and the server.repl_master_runid and repl_master_initial_offset are
+     * and the server.repl_master_replid and repl_master_initial_offset are
      * already populated. */
     if (psync_result == PSYNC_NOT_SUPPORTED) {
         redisLog(REDIS_NOTICE,"Retrying with SYNC...");
@@ -1662,19 +1809,27 @@ int cancelReplicationHandshake(void) {
     return 1;
 }
 
-/* Set replication to the specified master address and port. */
+/* Set replication to the specified master address and port.
+ *
+ * The state of our current (or cached) master is kept so that we can try a
+ * partial resynchronization with the new master: it succeeds if the new
+ * master was a slave of the same master and got at least the data we got,
+ * which is the common case after a failover. */
 void replicationSetMaster(char *ip, int port) {
+    int was_master = server.masterhost == NULL;
+
     sdsfree(server.masterhost);
     server.masterhost = sdsnew(ip);
     server.masterport = port;
-    if (server.master) freeClient(server.master);
+    if (server.master) freeClient(server.master); /* Cached for PSYNC. */
     disconnectAllBlockedClients(); /* Clients blocked in master, now slave. */
     disconnectSlaves(); /* Force our slaves to resync with us as well. */
-    replicationDiscardCachedMaster(); /* Don't try a PSYNC. */
-    freeReplicationBacklog(); /* Don't allow our chained slaves to PSYNC. */
     cancelReplicationHandshake();
+    /* A master turned into a slave can PSYNC with a new master that was
+     * its slave, using its own replication ID and offset. Without a
+     * backlog no other instance knows our replication history. */
+    if (was_master && server.repl_backlog) replicationCacheMasterUsingMyself();
     server.repl_state = REDIS_REPL_CONNECT;
-    server.master_repl_offset = 0;
     server.repl_down_since = 0;
 }
 
@@ -1683,20 +1838,23 @@ void replicationUnsetMaster(void) {
     if (server.masterhost == NULL) return; /* Nothing to do. */
     sdsfree(server.masterhost);
     server.masterhost = NULL;
-    if (server.master) {
-        if (listLength(server.slaves) == 0) {
-            /* If this instance is turned into a master and there are no
-             * slaves, it inherits the replication offset from the master.
-             * Under certain conditions this makes replicas comparable by
-             * replication offset to understand what is the most updated. */
-            server.master_repl_offset = server.master->reploff;
-            freeReplicationBacklog();
-        }
-        freeClient(server.master);
-    }
+
+    /* Remember the replication ID and offset of our master: our slaves and
+     * the other slaves of our old master can continue replicating from us
+     * with a partial resynchronization, using the data in our backlog. */
+    shiftReplicationId();
+    if (server.master) freeClient(server.master);
     replicationDiscardCachedMaster();
     cancelReplicationHandshake();
+
+    /* Our slaves must learn the new replication ID: disconnect them so that
+     * they PSYNC again. */
+    disconnectSlaves();
     server.repl_state = REDIS_REPL_NONE;
+
+    /* Our stream continues the one of our old master, that may have a
+     * different DB selected: make sure to emit a SELECT first. */
+    server.slaveseldb = -1;
 }
 
 /* This function is called when the slave lose the connection with the
@@ -1857,6 +2015,20 @@ void replicationCacheMaster(redisClient *c) {
      * replicationHandleMasterDisconnection(). */
     server.cached_master = server.master;
 
+    /* Discard what was received but not applied, that is a partial command
+     * or the commands of a transaction not yet executed, and what we
+     * were about to send: the replication will continue from the applied
+     * offset, and the new link starts with empty buffers. */
+    sdsclear(c->querybuf);
+    sdsclear(c->pending_querybuf);
+    c->read_reploff = c->reploff;
+    if (c->flags & REDIS_MULTI) discardTransaction(c);
+    resetClient(c);
+    listEmpty(c->reply);
+    c->reply_bytes = 0;
+    c->bufpos = 0;
+    c->sentlen = 0;
+
     /* Remove the event handlers and close the socket. We'll later reuse
      * the socket of the new connection with the master during PSYNC. */
     aeDeleteFileEvent(server.el,c->fd,AE_READABLE);
@@ -1878,6 +2050,21 @@ void replicationCacheMaster(redisClient *c) {
     replicationHandleMasterDisconnection();
 }
 
+/* Create a cached master from our own replication state, so that a master
+ * turned into a slave can try a partial resynchronization with its new
+ * master, using its own replication ID and offset. */
+static void replicationCacheMasterUsingMyself(void) {
+    /* The cached master has no socket: createClient(-1) does not link it
+     * to the server clients list, replicationResurrectCachedMaster() will. */
+    server.cached_master = createClient(-1);
+    server.cached_master->flags |= REDIS_MASTER;
+    server.cached_master->authenticated = 1;
+    server.cached_master->reploff = server.master_repl_offset;
+    server.cached_master->read_reploff = server.master_repl_offset;
+    memcpy(server.cached_master->replid,server.replid,sizeof(server.replid));
+    redisLog(REDIS_NOTICE,"Before turning into a slave, using my master parameters to synthesize a cached master: I may be able to synchronize with the new master with just a partial transfer.");
+}
+
 /* Free a cached master, called when there are no longer the conditions for
  * a partial resync on reconnection. */
 void replicationDiscardCachedMaster(void) {
@@ -2287,11 +2474,17 @@ void replicationCron(void) {
     /* If we have no attached slaves and there is a replication backlog
      * using memory, free it after some (configured) time. */
     if (listLength(server.slaves) == 0 && server.repl_backlog_time_limit &&
-        server.repl_backlog)
+        server.repl_backlog && server.masterhost == NULL)
     {
         time_t idle = server.unixtime - server.repl_no_slaves_since;
 
         if (idle > server.repl_backlog_time_limit) {
+            /* Without a backlog our offset no longer tracks the stream:
+             * start a new replication history so that no slave can PSYNC
+             * with an offset we can no longer serve. Slaves always keep
+             * their backlog, since they may be promoted to masters. */
+            changeReplicationId();
+            clearReplicationId2();
             freeReplicationBacklog();
             redisLog(REDIS_NOTICE,
                 "Replication backlog freed after %d seconds "
@@ -2317,7 +2510,9 @@ void replicationCron(void) {
      * This code is also useful to trigger a BGSAVE if the diskless
      * replication was turned off with CONFIG SET, while there were already
      * slaves in WAIT_BGSAVE_START state. */
-    if (server.rdb_child_pid == -1 && server.aof_child_pid == -1) {
+    if (server.rdb_child_pid == -1 && !server.rdb_forkless_in_progress &&
+        server.aof_child_pid == -1)
+    {
         time_t idle, max_idle = 0;
         int slaves_waiting = 0;
         int mincapa = -1;
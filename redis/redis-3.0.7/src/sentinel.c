@@ -363,7 +363,8 @@ dictType instancesDictType = {
     NULL,                      /* val dup */
     dictSdsKeyCompare,         /* key compare */
     NULL,                      /* key destructor */
-    dictInstancesValDestructor /* val destructor */
+    dictInstancesValDestructor, /* val destructor */
+    NULL                       /* allow expand */
 };
 
 /* Instance runid (sds) -> votes (long casted to void*)
@@ -376,7 +377,8 @@ dictType leaderVotesDictType = {
     NULL,                      /* val dup */
     dictSdsKeyCompare,         /* key compare */
     NULL,                      /* key destructor */
-    NULL                       /* val destructor */
+    NULL,                      /* val destructor */
+    NULL                       /* allow expand */
 };
 
 /* =========================== Initialization =============================== */
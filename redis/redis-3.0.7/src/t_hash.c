@@ -34,6 +34,14 @@
  * Hash type API
  *----------------------------------------------------------------------------*/
 
+/* Return the encoding for a hash of 'len' fields that can't be a ziplist:
+ * a compact table, unless compact tables are disabled or 'len' is over
+ * the limit set by hash-max-ctable-entries. */
+int hashTypeTableEncoding(unsigned long len) {
+    return len <= server.hash_max_ctable_entries ?
+           REDIS_ENCODING_CTABLE : REDIS_ENCODING_HT;
+}
+
 /* Check the length of a number of objects to see if we need to convert a
  * ziplist to a real hash. Note that we only check string encoded objects
  * as their string length can be queried in constant time. */
@@ -46,7 +54,7 @@ void hashTypeTryConversion(robj *o, robj **argv, int start, int end) {
         if (sdsEncodedObject(argv[i]) &&
             sdslen(argv[i]->ptr) > server.hash_max_ziplist_value)
         {
-            hashTypeConvert(o, REDIS_ENCODING_HT);
+            hashTypeConvert(o, hashTypeTableEncoding(hashTypeLength(o)+1));
             break;
         }
     }
@@ -109,6 +117,37 @@ int hashTypeGetFromHashTable(robj *o, robj *field, robj **value) {
     return 0;
 }
 
+/* Set 'field' to 'value' in the compact table 'ct', storing the string
+ * representation of integer encoded objects.
+ * Return 1 on insert and 0 on update. */
+static int hashTypeCtableSet(ctable *ct, robj *field, robj *value) {
+    int ret;
+
+    field = getDecodedObject(field);
+    value = getDecodedObject(value);
+    ret = ctableSet(ct, field->ptr, sdslen(field->ptr),
+                    value->ptr, sdslen(value->ptr));
+    decrRefCount(field);
+    decrRefCount(value);
+    return ret;
+}
+
+/* Get the value from a compact table encoded hash, identified by field.
+ * Returns -1 when the field cannot be found. */
+int hashTypeGetFromCtable(robj *o, robj *field, char **vstr, size_t *vlen) {
+    sds entry;
+
+    redisAssert(o->encoding == REDIS_ENCODING_CTABLE);
+
+    field = getDecodedObject(field);
+    entry = ctableFind(o->ptr, field->ptr, sdslen(field->ptr));
+    decrRefCount(field);
+
+    if (entry == NULL) return -1;
+    *vstr = ctableEntryValue(entry, vlen);
+    return 0;
+}
+
 /* Higher level function of hashTypeGet*() that always returns a Redis
  * object (either new or with refcount incremented), so that the caller
  * can retain a reference or call decrRefCount after the usage.
@@ -138,6 +177,12 @@ robj *hashTypeGetObject(robj *o, robj *field) {
             incrRefCount(aux);
             value = aux;
         }
+    } else if (o->encoding == REDIS_ENCODING_CTABLE) {
+        char *vstr;
+        size_t vlen;
+
+        if (hashTypeGetFromCtable(o, field, &vstr, &vlen) == 0)
+            value = createStringObject(vstr, vlen);
     } else {
         redisPanic("Unknown hash encoding");
     }
@@ -157,6 +202,11 @@ int hashTypeExists(robj *o, robj *field) {
         robj *aux;
 
         if (hashTypeGetFromHashTable(o, field, &aux) == 0) return 1;
+    } else if (o->encoding == REDIS_ENCODING_CTABLE) {
+        char *vstr;
+        size_t vlen;
+
+        if (hashTypeGetFromCtable(o, field, &vstr, &vlen) == 0) return 1;
     } else {
         redisPanic("Unknown hash encoding");
     }
@@ -205,7 +255,7 @@ int hashTypeSet(robj *o, robj *field, robj *value) {
 
         /* Check if the ziplist needs to be converted to a hash table */
         if (hashTypeLength(o) > server.hash_max_ziplist_entries)
-            hashTypeConvert(o, REDIS_ENCODING_HT);
+            hashTypeConvert(o, hashTypeTableEncoding(hashTypeLength(o)));
     } else if (o->encoding == REDIS_ENCODING_HT) {
         if (dictReplace(o->ptr, field, value)) { /* Insert */
             incrRefCount(field);
@@ -213,6 +263,12 @@ int hashTypeSet(robj *o, robj *field, robj *value) {
             update = 1;
         }
         incrRefCount(value);
+    } else if (o->encoding == REDIS_ENCODING_CTABLE) {
+        update = !hashTypeCtableSet(o->ptr, field, value);
+
+        /* Check if the table grew too big for this encoding */
+        if (hashTypeLength(o) > server.hash_max_ctable_entries)
+            hashTypeConvert(o, REDIS_ENCODING_HT);
     } else {
         redisPanic("Unknown hash encoding");
     }
@@ -251,6 +307,11 @@ int hashTypeDelete(robj *o, robj *field) {
             if (htNeedsResize(o->ptr)) dictResize(o->ptr);
         }
 
+    } else if (o->encoding == REDIS_ENCODING_CTABLE) {
+        field = getDecodedObject(field);
+        deleted = ctableDelete(o->ptr, field->ptr, sdslen(field->ptr));
+        decrRefCount(field);
+
     } else {
         redisPanic("Unknown hash encoding");
     }
@@ -266,6 +327,8 @@ unsigned long hashTypeLength(robj *o) {
         length = ziplistLen(o->ptr) / 2;
     } else if (o->encoding == REDIS_ENCODING_HT) {
         length = dictSize((dict*)o->ptr);
+    } else if (o->encoding == REDIS_ENCODING_CTABLE) {
+        length = ctableLen((ctable*)o->ptr);
     } else {
         redisPanic("Unknown hash encoding");
     }
@@ -283,6 +346,9 @@ hashTypeIterator *hashTypeInitIterator(robj *subject) {
         hi->vptr = NULL;
     } else if (hi->encoding == REDIS_ENCODING_HT) {
         hi->di = dictGetIterator(subject->ptr);
+    } else if (hi->encoding == REDIS_ENCODING_CTABLE) {
+        hi->ctpos = 0;
+        hi->entry = NULL;
     } else {
         redisPanic("Unknown hash encoding");
     }
@@ -329,6 +395,9 @@ int hashTypeNext(hashTypeIterator *hi) {
         hi->vptr = vptr;
     } else if (hi->encoding == REDIS_ENCODING_HT) {
         if ((hi->de = dictNext(hi->di)) == NULL) return REDIS_ERR;
+    } else if (hi->encoding == REDIS_ENCODING_CTABLE) {
+        hi->entry = ctableNext(hi->subject->ptr, &hi->ctpos);
+        if (hi->entry == NULL) return REDIS_ERR;
     } else {
         redisPanic("Unknown hash encoding");
     }
@@ -367,6 +436,21 @@ void hashTypeCurrentFromHashTable(hashTypeIterator *hi, int what, robj **dst) {
     }
 }
 
+/* Get the field or value at iterator cursor, for an iterator on a hash value
+ * encoded as a compact table. The returned string is owned by the table. */
+void hashTypeCurrentFromCtable(hashTypeIterator *hi, int what,
+                               char **vstr, size_t *vlen)
+{
+    redisAssert(hi->encoding == REDIS_ENCODING_CTABLE);
+
+    if (what & REDIS_HASH_KEY) {
+        *vstr = hi->entry;
+        *vlen = sdslen(hi->entry);
+    } else {
+        *vstr = ctableEntryValue(hi->entry, vlen);
+    }
+}
+
 /* A non copy-on-write friendly but higher level version of hashTypeCurrent*()
  * that returns an object with incremented refcount (or a new object). It is up
  * to the caller to decrRefCount() the object if no reference is retained. */
@@ -387,6 +471,12 @@ robj *hashTypeCurrentObject(hashTypeIterator *hi, int what) {
     } else if (hi->encoding == REDIS_ENCODING_HT) {
         hashTypeCurrentFromHashTable(hi, what, &dst);
         incrRefCount(dst);
+    } else if (hi->encoding == REDIS_ENCODING_CTABLE) {
+        char *vstr;
+        size_t vlen;
+
+        hashTypeCurrentFromCtable(hi, what, &vstr, &vlen);
+        dst = createStringObject(vstr, vlen);
     } else {
         redisPanic("Unknown hash encoding");
     }
@@ -413,6 +503,36 @@ void hashTypeConvertZiplist(robj *o, int enc) {
     if (enc == REDIS_ENCODING_ZIPLIST) {
         /* Nothing to do... */
 
+    } else if (enc == REDIS_ENCODING_CTABLE) {
+        hashTypeIterator *hi;
+        ctable *ct;
+        int ret;
+
+        hi = hashTypeInitIterator(o);
+        ct = ctableCreate(1);
+        ctableExpand(ct, hashTypeLength(o));
+
+        while (hashTypeNext(hi) != REDIS_ERR) {
+            robj *field, *value;
+
+            field = hashTypeCurrentObject(hi, REDIS_HASH_KEY);
+            value = hashTypeCurrentObject(hi, REDIS_HASH_VALUE);
+            ret = hashTypeCtableSet(ct, field, value);
+            decrRefCount(field);
+            decrRefCount(value);
+            if (ret != 1) {
+                redisLogHexDump(REDIS_WARNING,"ziplist with dup elements dump",
+                    o->ptr,ziplistBlobLen(o->ptr));
+                redisAssert(ret == 1);
+            }
+        }
+
+        hashTypeReleaseIterator(hi);
+        zfree(o->ptr);
+
+        o->encoding = REDIS_ENCODING_CTABLE;
+        o->ptr = ct;
+
     } else if (enc == REDIS_ENCODING_HT) {
         hashTypeIterator *hi;
         dict *dict;
@@ -447,9 +567,45 @@ void hashTypeConvertZiplist(robj *o, int enc) {
     }
 }
 
+void hashTypeConvertCtable(robj *o, int enc) {
+    redisAssert(o->encoding == REDIS_ENCODING_CTABLE);
+
+    if (enc == REDIS_ENCODING_HT) {
+        hashTypeIterator *hi;
+        dict *dict;
+        int ret;
+
+        hi = hashTypeInitIterator(o);
+        dict = dictCreate(&hashDictType, NULL);
+        dictExpand(dict, hashTypeLength(o));
+
+        while (hashTypeNext(hi) != REDIS_ERR) {
+            robj *field, *value;
+
+            field = hashTypeCurrentObject(hi, REDIS_HASH_KEY);
+            field = tryObjectEncoding(field);
+            value = hashTypeCurrentObject(hi, REDIS_HASH_VALUE);
+            value = tryObjectEncoding(value);
+            ret = dictAdd(dict, field, value);
+            redisAssert(ret == DICT_OK);
+        }
+
+        hashTypeReleaseIterator(hi);
+        ctableRelease(o->ptr);
+
+        o->encoding = REDIS_ENCODING_HT;
+        o->ptr = dict;
+
+    } else {
+        redisPanic("Unknown hash encoding");
+    }
+}
+
 void hashTypeConvert(robj *o, int enc) {
     if (o->encoding == REDIS_ENCODING_ZIPLIST) {
         hashTypeConvertZiplist(o, enc);
+    } else if (o->encoding == REDIS_ENCODING_CTABLE) {
+        hashTypeConvertCtable(o, enc);
     } else if (o->encoding == REDIS_ENCODING_HT) {
         redisPanic("Not implemented");
     } else {
@@ -617,6 +773,17 @@ static void addHashFieldToReply(redisClient *c, robj *o, robj *field) {
             addReplyBulk(c, value);
         }
 
+    } else if (o->encoding == REDIS_ENCODING_CTABLE) {
+        char *vstr;
+        size_t vlen;
+
+        ret = hashTypeGetFromCtable(o, field, &vstr, &vlen);
+        if (ret < 0) {
+            addReply(c, shared.nullbulk);
+        } else {
+            addReplyBulkCBuffer(c, vstr, vlen);
+        }
+
     } else {
         redisPanic("Unknown hash encoding");
     }
@@ -643,6 +810,10 @@ void hmgetCommand(redisClient *c) {
         return;
     }
 
+    /* Overlap the lookups of the fields of big hashes. */
+    if (o != NULL && o->encoding == REDIS_ENCODING_HT)
+        dictPrefetch(o->ptr, (void**)(c->argv+2), c->argc-2, 1);
+
     addReplyMultiBulkLen(c, c->argc-2);
     for (i = 2; i < c->argc; i++) {
         addHashFieldToReply(c, o, c->argv[i]);
@@ -704,6 +875,13 @@ static void addHashIteratorCursorToReply(redisClient *c, hashTypeIterator *hi, i
         hashTypeCurrentFromHashTable(hi, what, &value);
         addReplyBulk(c, value);
 
+    } else if (hi->encoding == REDIS_ENCODING_CTABLE) {
+        char *vstr;
+        size_t vlen;
+
+        hashTypeCurrentFromCtable(hi, what, &vstr, &vlen);
+        addReplyBulkCBuffer(c, vstr, vlen);
+
     } else {
         redisPanic("Unknown hash encoding");
     }
@@ -762,7 +940,7 @@ void hexistsCommand(redisClient *c) {
 
 void hscanCommand(redisClient *c) {
     robj *o;
-    unsigned long cursor;
+    unsigned long long cursor;
 
     if (parseScanCursorOrReply(c,c->argv[2],&cursor) == REDIS_ERR) return;
     if ((o = lookupKeyReadOrReply(c,c->argv[1],shared.emptyscan)) == NULL ||
@@ -35,12 +35,36 @@
 
 void sunionDiffGenericCommand(redisClient *c, robj **setkeys, int setnum, robj *dstkey, int op);
 
+/* Object returned by setTypeRandomElement() for compact table entries. */
+static robj setTypeCtableElement;
+
+/* Return the encoding for a set of 'len' elements that can't be an intset:
+ * a compact table, unless compact tables are disabled or 'len' is over
+ * the limit set by set-max-ctable-entries. */
+int setTypeTableEncoding(unsigned long len) {
+    return len <= server.set_max_ctable_entries ?
+           REDIS_ENCODING_CTABLE : REDIS_ENCODING_HT;
+}
+
+/* Return the string representation of the object 'value', that is written
+ * in 'buf' for integer encoded objects. Compact tables store strings. */
+static char *setTypeObjectString(robj *value, char *buf, size_t *len) {
+    if (sdsEncodedObject(value)) {
+        *len = sdslen(value->ptr);
+        return value->ptr;
+    }
+    *len = ll2string(buf,REDIS_LONGSTR_SIZE,(long)value->ptr);
+    return buf;
+}
+
 /* Factory method to return a set that *can* hold "value". When the object has
  * an integer-encodable value, an intset will be returned. Otherwise a regular
- * hash table. */
+ * hash table, or a compact table if enabled. */
 robj *setTypeCreate(robj *value) {
     if (isObjectRepresentableAsLongLong(value,NULL) == REDIS_OK)
         return createIntsetObject();
+    if (setTypeTableEncoding(1) == REDIS_ENCODING_CTABLE)
+        return createCtableSetObject();
     return createSetObject();
 }
 
@@ -51,6 +75,18 @@ int setTypeAdd(robj *subject, robj *value) {
             incrRefCount(value);
             return 1;
         }
+    } else if (subject->encoding == REDIS_ENCODING_CTABLE) {
+        char buf[REDIS_LONGSTR_SIZE], *str;
+        size_t len;
+
+        str = setTypeObjectString(value,buf,&len);
+        if (ctableSet(subject->ptr,str,len,NULL,0)) {
+            /* Convert to regular set when the table contains
+             * too many entries. */
+            if (setTypeSize(subject) > server.set_max_ctable_entries)
+                setTypeConvert(subject,REDIS_ENCODING_HT);
+            return 1;
+        }
     } else if (subject->encoding == REDIS_ENCODING_INTSET) {
         if (isObjectRepresentableAsLongLong(value,&llval) == REDIS_OK) {
             uint8_t success = 0;
@@ -59,17 +95,18 @@ int setTypeAdd(robj *subject, robj *value) {
                 /* Convert to regular set when the intset contains
                  * too many entries. */
                 if (intsetLen(subject->ptr) > server.set_max_intset_entries)
-                    setTypeConvert(subject,REDIS_ENCODING_HT);
+                    setTypeConvert(subject,
+                        setTypeTableEncoding(intsetLen(subject->ptr)));
                 return 1;
             }
         } else {
             /* Failed to get integer from object, convert to regular set. */
-            setTypeConvert(subject,REDIS_ENCODING_HT);
+            setTypeConvert(subject,
+                setTypeTableEncoding(intsetLen(subject->ptr)+1));
 
             /* The set *was* an intset and this value is not integer
-             * encodable, so dictAdd should always work. */
-            redisAssertWithInfo(NULL,value,dictAdd(subject->ptr,value,NULL) == DICT_OK);
-            incrRefCount(value);
+             * encodable, so the add should always work. */
+            redisAssertWithInfo(NULL,value,setTypeAdd(subject,value) == 1);
             return 1;
         }
     } else {
@@ -85,6 +122,12 @@ int setTypeRemove(robj *setobj, robj *value) {
             if (htNeedsResize(setobj->ptr)) dictResize(setobj->ptr);
             return 1;
         }
+    } else if (setobj->encoding == REDIS_ENCODING_CTABLE) {
+        char buf[REDIS_LONGSTR_SIZE], *str;
+        size_t len;
+
+        str = setTypeObjectString(value,buf,&len);
+        return ctableDelete(setobj->ptr,str,len);
     } else if (setobj->encoding == REDIS_ENCODING_INTSET) {
         if (isObjectRepresentableAsLongLong(value,&llval) == REDIS_OK) {
             int success;
@@ -101,6 +144,12 @@ int setTypeIsMember(robj *subject, robj *value) {
     long long llval;
     if (subject->encoding == REDIS_ENCODING_HT) {
         return dictFind((dict*)subject->ptr,value) != NULL;
+    } else if (subject->encoding == REDIS_ENCODING_CTABLE) {
+        char buf[REDIS_LONGSTR_SIZE], *str;
+        size_t len;
+
+        str = setTypeObjectString(value,buf,&len);
+        return ctableFind(subject->ptr,str,len) != NULL;
     } else if (subject->encoding == REDIS_ENCODING_INTSET) {
         if (isObjectRepresentableAsLongLong(value,&llval) == REDIS_OK) {
             return intsetFind((intset*)subject->ptr,llval);
@@ -119,6 +168,8 @@ setTypeIterator *setTypeInitIterator(robj *subject) {
         si->di = dictGetIterator(subject->ptr);
     } else if (si->encoding == REDIS_ENCODING_INTSET) {
         si->ii = 0;
+    } else if (si->encoding == REDIS_ENCODING_CTABLE) {
+        si->ctpos = 0;
     } else {
         redisPanic("Unknown set encoding");
     }
@@ -141,12 +192,19 @@ void setTypeReleaseIterator(setTypeIterator *si) {
  *
  * When there are no longer elements -1 is returned.
  * Returned objects ref count is not incremented, so this function is
- * copy on write friendly. */
+ * copy on write friendly. For compact tables the object is owned by the
+ * iterator and only valid until the next call: it must be duplicated in
+ * order to retain it. */
 int setTypeNext(setTypeIterator *si, robj **objele, int64_t *llele) {
     if (si->encoding == REDIS_ENCODING_HT) {
         dictEntry *de = dictNext(si->di);
         if (de == NULL) return -1;
         *objele = dictGetKey(de);
+    } else if (si->encoding == REDIS_ENCODING_CTABLE) {
+        sds ele = ctableNext(si->subject->ptr,&si->ctpos);
+        if (ele == NULL) return -1;
+        initStaticStringObject(si->ctele,ele);
+        *objele = &si->ctele;
     } else if (si->encoding == REDIS_ENCODING_INTSET) {
         if (!intsetGet(si->subject->ptr,si->ii++,llele))
             return -1;
@@ -174,6 +232,8 @@ robj *setTypeNextObject(setTypeIterator *si) {
         case REDIS_ENCODING_HT:
             incrRefCount(objele);
             return objele;
+        case REDIS_ENCODING_CTABLE:
+            return dupStringObject(objele);
         default:
             redisPanic("Unsupported encoding");
     }
@@ -192,11 +252,16 @@ robj *setTypeNextObject(setTypeIterator *si) {
  *
  * When an object is returned (the set was a real set) the ref count
  * of the object is not incremented so this function can be considered
- * copy on write friendly. */
+ * copy on write friendly. As with setTypeNext(), the object returned for
+ * compact tables is only valid until the next call. */
 int setTypeRandomElement(robj *setobj, robj **objele, int64_t *llele) {
     if (setobj->encoding == REDIS_ENCODING_HT) {
         dictEntry *de = dictGetRandomKey(setobj->ptr);
         *objele = dictGetKey(de);
+    } else if (setobj->encoding == REDIS_ENCODING_CTABLE) {
+        initStaticStringObject(setTypeCtableElement,
+                               ctableRandomEntry(setobj->ptr));
+        *objele = &setTypeCtableElement;
     } else if (setobj->encoding == REDIS_ENCODING_INTSET) {
         *llele = intsetRandom(setobj->ptr);
     } else {
@@ -208,6 +273,8 @@ int setTypeRandomElement(robj *setobj, robj **objele, int64_t *llele) {
 unsigned long setTypeSize(robj *subject) {
     if (subject->encoding == REDIS_ENCODING_HT) {
         return dictSize((dict*)subject->ptr);
+    } else if (subject->encoding == REDIS_ENCODING_CTABLE) {
+        return ctableLen((ctable*)subject->ptr);
     } else if (subject->encoding == REDIS_ENCODING_INTSET) {
         return intsetLen((intset*)subject->ptr);
     } else {
@@ -217,13 +284,46 @@ unsigned long setTypeSize(robj *subject) {
 
 /* Convert the set to specified encoding. The resulting dict (when converting
  * to a hash table) is presized to hold the number of elements in the original
- * set. */
+ * set. Intsets can be converted to compact tables or hash tables, compact
+ * tables to hash tables. */
 void setTypeConvert(robj *setobj, int enc) {
     setTypeIterator *si;
     redisAssertWithInfo(NULL,setobj,setobj->type == REDIS_SET &&
-                             setobj->encoding == REDIS_ENCODING_INTSET);
+                             (setobj->encoding == REDIS_ENCODING_INTSET ||
+                              setobj->encoding == REDIS_ENCODING_CTABLE));
+
+    if (setobj->encoding == REDIS_ENCODING_CTABLE) {
+        dict *d = dictCreate(&setDictType,NULL);
+        robj *element;
 
-    if (enc == REDIS_ENCODING_HT) {
+        redisAssertWithInfo(NULL,setobj,enc == REDIS_ENCODING_HT);
+        dictExpand(d,setTypeSize(setobj));
+
+        si = setTypeInitIterator(setobj);
+        while ((element = setTypeNextObject(si)) != NULL) {
+            element = tryObjectEncoding(element);
+            redisAssertWithInfo(NULL,element,dictAdd(d,element,NULL) == DICT_OK);
+        }
+        setTypeReleaseIterator(si);
+
+        setobj->encoding = REDIS_ENCODING_HT;
+        ctableRelease(setobj->ptr);
+        setobj->ptr = d;
+    } else if (enc == REDIS_ENCODING_CTABLE) {
+        int64_t intele;
+        ctable *ct = ctableCreate(0);
+        char buf[REDIS_LONGSTR_SIZE];
+
+        ctableExpand(ct,intsetLen(setobj->ptr)+1);
+        si = setTypeInitIterator(setobj);
+        while (setTypeNext(si,NULL,&intele) != -1)
+            ctableSet(ct,buf,ll2string(buf,sizeof(buf),intele),NULL,0);
+        setTypeReleaseIterator(si);
+
+        setobj->encoding = REDIS_ENCODING_CTABLE;
+        zfree(setobj->ptr);
+        setobj->ptr = ct;
+    } else if (enc == REDIS_ENCODING_HT) {
         int64_t intele;
         dict *d = dictCreate(&setDictType,NULL);
         robj *element;
@@ -389,6 +489,9 @@ void spopCommand(redisClient *c) {
     if (encoding == REDIS_ENCODING_INTSET) {
         ele = createStringObjectFromLongLong(llele);
         set->ptr = intsetRemove(set->ptr,llele,NULL);
+    } else if (encoding == REDIS_ENCODING_CTABLE) {
+        ele = dupStringObject(ele);
+        setTypeRemove(set,ele);
     } else {
         incrRefCount(ele);
         setTypeRemove(set,ele);
@@ -587,6 +690,30 @@ int qsortCompareSetsByRevCardinality(const void *s1, const void *s2) {
     return  (o2 ? setTypeSize(o2) : 0) - (o1 ? setTypeSize(o1) : 0);
 }
 
+/* Return 1 if all the 'setnum' sets in 'sets' are intsets, so that the
+ * result of an operation between them can be computed merging the intsets
+ * with the functions of intset.c. NULL entries, that are non existing keys,
+ * are ignored. */
+static int setTypeAllIntsets(robj **sets, unsigned long setnum) {
+    unsigned long j;
+
+    for (j = 0; j < setnum; j++)
+        if (sets[j] && sets[j]->encoding != REDIS_ENCODING_INTSET) return 0;
+    return 1;
+}
+
+/* Return a set object for 'is', the result of an operation between
+ * intsets, converted to the encoding that adding the elements one after
+ * the other with setTypeAdd() would have produced. */
+static robj *setTypeFromIntset(intset *is) {
+    robj *o = createObject(REDIS_SET,is);
+
+    o->encoding = REDIS_ENCODING_INTSET;
+    if (intsetLen(is) > server.set_max_intset_entries)
+        setTypeConvert(o,setTypeTableEncoding(intsetLen(is)));
+    return o;
+}
+
 void sinterGenericCommand(redisClient *c, robj **setkeys, unsigned long setnum, robj *dstkey) {
     robj **sets = zmalloc(sizeof(robj*)*setnum);
     setTypeIterator *si;
@@ -623,6 +750,28 @@ void sinterGenericCommand(redisClient *c, robj **setkeys, unsigned long setnum,
      * algorithm's performance */
     qsort(sets,setnum,sizeof(robj*),qsortCompareSetsByCardinality);
 
+    /* The intersection of intsets is computed merging them, starting from
+     * the smallest ones, so that the intermediate results are small too. */
+    if (setnum > 1 && setTypeAllIntsets(sets,setnum)) {
+        intset *is = intsetIntersection(sets[0]->ptr,sets[1]->ptr);
+
+        for (j = 2; j < setnum && intsetLen(is); j++) {
+            intset *aux = intsetIntersection(is,sets[j]->ptr);
+            zfree(is);
+            is = aux;
+        }
+        if (!dstkey) {
+            addReplyMultiBulkLen(c,intsetLen(is));
+            for (j = 0; intsetGet(is,j,&intobj); j++)
+                addReplyBulkLongLong(c,intobj);
+            zfree(is);
+            zfree(sets);
+            return;
+        }
+        dstset = setTypeFromIntset(is);
+        goto store;
+    }
+
     /* The first thing we should output is the total number of elements...
      * since this is a multi-bulk write, but at this stage we don't know
      * the intersection set size, so we use a trick, append an empty object
@@ -652,7 +801,7 @@ void sinterGenericCommand(redisClient *c, robj **setkeys, unsigned long setnum,
                 /* in order to compare an integer with an object we
                  * have to use the generic function, creating an object
                  * for this */
-                } else if (sets[j]->encoding == REDIS_ENCODING_HT) {
+                } else if (sets[j]->encoding != REDIS_ENCODING_INTSET) {
                     eleobj = createStringObjectFromLongLong(intobj);
                     if (!setTypeIsMember(sets[j],eleobj)) {
                         decrRefCount(eleobj);
@@ -660,7 +809,7 @@ void sinterGenericCommand(redisClient *c, robj **setkeys, unsigned long setnum,
                     }
                     decrRefCount(eleobj);
                 }
-            } else if (encoding == REDIS_ENCODING_HT) {
+            } else {
                 /* Optimization... if the source object is integer
                  * encoded AND the target set is an intset, we can get
                  * a much faster path. */
@@ -680,7 +829,7 @@ void sinterGenericCommand(redisClient *c, robj **setkeys, unsigned long setnum,
         /* Only take action when all sets contain the member */
         if (j == setnum) {
             if (!dstkey) {
-                if (encoding == REDIS_ENCODING_HT)
+                if (encoding != REDIS_ENCODING_INTSET)
                     addReplyBulk(c,eleobj);
                 else
                     addReplyBulkLongLong(c,intobj);
@@ -690,6 +839,11 @@ void sinterGenericCommand(redisClient *c, robj **setkeys, unsigned long setnum,
                     eleobj = createStringObjectFromLongLong(intobj);
                     setTypeAdd(dstset,eleobj);
                     decrRefCount(eleobj);
+                } else if (encoding == REDIS_ENCODING_CTABLE) {
+                    /* The iterator owns the object of compact tables. */
+                    eleobj = dupStringObject(eleobj);
+                    setTypeAdd(dstset,eleobj);
+                    decrRefCount(eleobj);
                 } else {
                     setTypeAdd(dstset,eleobj);
                 }
@@ -698,6 +852,7 @@ void sinterGenericCommand(redisClient *c, robj **setkeys, unsigned long setnum,
     }
     setTypeReleaseIterator(si);
 
+store:
     if (dstkey) {
         /* Store the resulting set into the target, if the intersection
          * is not an empty set. */
@@ -794,7 +949,26 @@ void sunionDiffGenericCommand(redisClient *c, robj **setkeys, int setnum, robj *
      * this set object will be the resulting object to set into the target key*/
     dstset = createIntsetObject();
 
-    if (op == REDIS_OP_UNION) {
+    if (setTypeAllIntsets(sets,setnum)) {
+        /* Intsets are merged one after the other into the result. The
+         * difference is empty if the first set does not exist. */
+        intset *is = intsetNew(), *aux;
+
+        for (j = 0; j < setnum; j++) {
+            if (!sets[j]) continue; /* non existing keys are like empty sets */
+            if (op == REDIS_OP_UNION || j == 0) {
+                aux = intsetUnion(is,sets[j]->ptr);
+            } else {
+                if (intsetLen(is) == 0) break;
+                aux = intsetDifference(is,sets[j]->ptr);
+            }
+            zfree(is);
+            is = aux;
+        }
+        decrRefCount(dstset);
+        dstset = setTypeFromIntset(is);
+        cardinality = setTypeSize(dstset);
+    } else if (op == REDIS_OP_UNION) {
         /* Union is trivial, just add every element of every set to the
          * temporary set. */
         for (j = 0; j < setnum; j++) {
@@ -910,7 +1084,7 @@ void sdiffstoreCommand(redisClient *c) {
 
 void sscanCommand(redisClient *c) {
     robj *set;
-    unsigned long cursor;
+    unsigned long long cursor;
 
     if (parseScanCursorOrReply(c,c->argv[2],&cursor) == REDIS_ERR) return;
     if ((set = lookupKeyReadOrReply(c,c->argv[1],shared.emptyscan)) == NULL ||
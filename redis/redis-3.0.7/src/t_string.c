@@ -269,6 +269,7 @@ void getrangeCommand(redisClient *c) {
 void mgetCommand(redisClient *c) {
     int j;
 
+    dbPrefetchKeys(c->db,c->argv+1,c->argc-1);
     addReplyMultiBulkLen(c,c->argc-1);
     for (j = 1; j < c->argc; j++) {
         robj *o = lookupKeyRead(c->db,c->argv[j]);
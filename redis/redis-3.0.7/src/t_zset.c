@@ -55,8 +55,136 @@
 static int zslLexValueGteMin(robj *value, zlexrangespec *spec);
 static int zslLexValueLteMax(robj *value, zlexrangespec *spec);
 
-zskiplistNode *zslCreateNode(int level, double score, robj *obj) {
-    zskiplistNode *zn = zmalloc(sizeof(*zn)+level*sizeof(struct zskiplistLevel));
+static size_t zslNodeSize(int level) {
+    return sizeof(zskiplistNode)+level*sizeof(struct zskiplistLevel);
+}
+
+/* Add the slab in front of the list of the slabs of its level with free
+ * slots, or remove it from the list. */
+static void zslLinkSlab(zskiplist *zsl, zskiplistSlab *s) {
+    zskiplistSlab **head = zsl->partial+s->level-1;
+
+    s->prev = NULL;
+    s->next = *head;
+    if (*head) (*head)->prev = s;
+    *head = s;
+}
+
+static void zslUnlinkSlab(zskiplist *zsl, zskiplistSlab *s) {
+    if (s->prev)
+        s->prev->next = s->next;
+    else
+        zsl->partial[s->level-1] = s->next;
+    if (s->next) s->next->prev = s->prev;
+}
+
+/* Return the index of the first slab with an address greater than 'ptr'
+ * in the array of the slabs, sorted by address. */
+static unsigned long zslSlabIndex(zskiplist *zsl, void *ptr) {
+    unsigned long lo = 0, hi = zsl->numslabs;
+
+    while (lo < hi) {
+        unsigned long mid = lo+(hi-lo)/2;
+
+        if ((char*)zsl->slabs[mid] <= (char*)ptr)
+            lo = mid+1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/* Return the slab holding the node 'x', or NULL if the node was allocated
+ * with zmalloc(). */
+zskiplistSlab *zslNodeSlab(zskiplist *zsl, zskiplistNode *x) {
+    unsigned long j = zslSlabIndex(zsl,x);
+    zskiplistSlab *s;
+
+    if (j == 0) return NULL;
+    s = zsl->slabs[j-1];
+    if ((char*)x >= s->buf+(size_t)s->slots*zslNodeSize(s->level))
+        return NULL;
+    return s;
+}
+
+/* Create a new slab for nodes of the specified level. Slabs grow with the
+ * skiplist: a new slab has about as many slots as the nodes of its level
+ * already in the skiplist, from ZSKIPLIST_SLAB_MIN to ZSKIPLIST_SLAB_MAX,
+ * so that small sorted sets don't waste memory and big ones use few
+ * allocations. */
+static zskiplistSlab *zslAddSlab(zskiplist *zsl, int level) {
+    unsigned long slots = (zsl->length*3/4) >> (2*(level-1)), j;
+    size_t nodesize = zslNodeSize(level);
+    zskiplistSlab *s;
+
+    if (slots < ZSKIPLIST_SLAB_MIN) slots = ZSKIPLIST_SLAB_MIN;
+    if (slots > ZSKIPLIST_SLAB_MAX) slots = ZSKIPLIST_SLAB_MAX;
+    s = zmalloc(sizeof(*s)+slots*nodesize);
+    s->slots = (zmalloc_size(s)-sizeof(*s))/nodesize;
+    s->used = 0;
+    s->live = 0;
+    s->level = level;
+    s->free = NULL;
+
+    j = zslSlabIndex(zsl,s);
+    zsl->slabs = zrealloc(zsl->slabs,sizeof(zskiplistSlab*)*(zsl->numslabs+1));
+    memmove(zsl->slabs+j+1,zsl->slabs+j,
+            sizeof(zskiplistSlab*)*(zsl->numslabs-j));
+    zsl->slabs[j] = s;
+    zsl->numslabs++;
+    zslLinkSlab(zsl,s);
+    return s;
+}
+
+/* Release a slab with no slot in use. */
+static void zslFreeSlab(zskiplist *zsl, zskiplistSlab *s) {
+    unsigned long j = zslSlabIndex(zsl,s)-1;
+
+    zslUnlinkSlab(zsl,s);
+    memmove(zsl->slabs+j,zsl->slabs+j+1,
+            sizeof(zskiplistSlab*)*(zsl->numslabs-j-1));
+    if (--zsl->numslabs == 0) {
+        zfree(zsl->slabs);
+        zsl->slabs = NULL;
+    }
+    zfree(s);
+}
+
+/* Take a slot from a slab with free slots. */
+static zskiplistNode *zslSlabAlloc(zskiplist *zsl, zskiplistSlab *s) {
+    zskiplistNode *zn;
+
+    if (s->free) {
+        zn = s->free;
+        s->free = zn->backward;
+    } else {
+        zn = (zskiplistNode*)(s->buf+(size_t)s->used*zslNodeSize(s->level));
+        s->used++;
+    }
+    s->live++;
+    if (s->free == NULL && s->used == s->slots) zslUnlinkSlab(zsl,s);
+    return zn;
+}
+
+/* Return a slot to its slab, releasing the slab if it is now empty. */
+static void zslSlabFree(zskiplist *zsl, zskiplistSlab *s, zskiplistNode *zn) {
+    if (s->free == NULL && s->used == s->slots) zslLinkSlab(zsl,s);
+    zn->backward = s->free;
+    s->free = zn;
+    if (--s->live == 0) zslFreeSlab(zsl,s);
+}
+
+zskiplistNode *zslCreateNode(zskiplist *zsl, int level, double score, robj *obj) {
+    zskiplistNode *zn;
+
+    if (level > ZSKIPLIST_SLAB_LEVELS) {
+        zn = zmalloc(zslNodeSize(level));
+    } else {
+        zskiplistSlab *s = zsl->partial[level-1];
+
+        if (s == NULL) s = zslAddSlab(zsl,level);
+        zn = zslSlabAlloc(zsl,s);
+    }
     zn->score = score;
     zn->obj = obj;
     return zn;
@@ -69,7 +197,12 @@ zskiplist *zslCreate(void) {
     zsl = zmalloc(sizeof(*zsl));
     zsl->level = 1;
     zsl->length = 0;
-    zsl->header = zslCreateNode(ZSKIPLIST_MAXLEVEL,0,NULL);
+    zsl->slabs = NULL;
+    zsl->numslabs = 0;
+    for (j = 0; j < ZSKIPLIST_SLAB_LEVELS; j++) zsl->partial[j] = NULL;
+    zsl->header = zmalloc(zslNodeSize(ZSKIPLIST_MAXLEVEL));
+    zsl->header->score = 0;
+    zsl->header->obj = NULL;
     for (j = 0; j < ZSKIPLIST_MAXLEVEL; j++) {
         zsl->header->level[j].forward = NULL;
         zsl->header->level[j].span = 0;
@@ -79,23 +212,71 @@ zskiplist *zslCreate(void) {
     return zsl;
 }
 
-void zslFreeNode(zskiplistNode *node) {
+/* Release the element of a node already unlinked from the skiplist with
+ * zslDeleteNode(), and the node itself. */
+void zslFreeNode(zskiplist *zsl, zskiplistNode *node, int level) {
     decrRefCount(node->obj);
-    zfree(node);
+    if (level > ZSKIPLIST_SLAB_LEVELS)
+        zfree(node);
+    else
+        zslSlabFree(zsl,zslNodeSlab(zsl,node),node);
 }
 
-void zslFree(zskiplist *zsl) {
-    zskiplistNode *node = zsl->header->level[0].forward, *next;
+/* Free the header and all the nodes of the skiplist, and the skiplist
+ * itself. The elements are not released. The nodes allocated with zmalloc()
+ * are exactly the ones linked at level ZSKIPLIST_SLAB_LEVELS+1. */
+static void zslFreeNodes(zskiplist *zsl) {
+    zskiplistNode *node = zsl->header->level[ZSKIPLIST_SLAB_LEVELS].forward;
+    unsigned long j;
 
-    zfree(zsl->header);
     while(node) {
-        next = node->level[0].forward;
-        zslFreeNode(node);
+        zskiplistNode *next = node->level[ZSKIPLIST_SLAB_LEVELS].forward;
+        zfree(node);
         node = next;
     }
+    for (j = 0; j < zsl->numslabs; j++) zfree(zsl->slabs[j]);
+    zfree(zsl->slabs);
+    zfree(zsl->header);
     zfree(zsl);
 }
 
+/* Used by active defrag: if the node 'x' lives in a slab less than a
+ * quarter full, move it to the first slab of the same level with free
+ * slots, so that the sparse slab can be released once all its nodes are
+ * gone. Nodes are never moved out of the first slab, that fills up and
+ * leaves the list, so the nodes of sparse slabs end up packed together.
+ * Returns the new address of the node, or NULL if it was not moved. The
+ * caller must update the pointers to the node. */
+zskiplistNode *zslEvacuateNode(zskiplist *zsl, zskiplistNode *x) {
+    zskiplistSlab *s = zslNodeSlab(zsl,x), *t;
+    zskiplistNode *newx;
+
+    if (s == NULL || (size_t)s->live*4 > s->slots) return NULL;
+    t = zsl->partial[s->level-1];
+    if (t == NULL || t == s) return NULL;
+    newx = zslSlabAlloc(zsl,t);
+    memcpy(newx,x,zslNodeSize(s->level));
+    zslSlabFree(zsl,s,x);
+    return newx;
+}
+
+/* Free the dict and the skiplist of a sorted set. The elements are owned
+ * by the skiplist, the dict only borrows them: every element loses the
+ * single reference of the sorted set, so the lazy free thread finds it
+ * either owned by the sorted set or shared with the main thread, see
+ * decrRefCount(). */
+void zsetFree(zset *zs) {
+    zskiplistNode *node = zs->zsl->header->level[0].forward;
+
+    dictRelease(zs->dict);
+    while(node) {
+        decrRefCount(node->obj);
+        node = node->level[0].forward;
+    }
+    zslFreeNodes(zs->zsl);
+    zfree(zs);
+}
+
 /* Returns a random level for the new skiplist node we are going to create.
  * The return value of this function is between 1 and ZSKIPLIST_MAXLEVEL
  * (both inclusive), with a powerlaw-alike distribution where higher
@@ -139,7 +320,7 @@ zskiplistNode *zslInsert(zskiplist *zsl, double score, robj *obj) {
         }
         zsl->level = level;
     }
-    x = zslCreateNode(level,score,obj);
+    x = zslCreateNode(zsl,level,score,obj);
     for (i = 0; i < level; i++) {
         x->level[i].forward = update[i]->level[i].forward;
         update[i]->level[i].forward = x;
@@ -163,11 +344,13 @@ zskiplistNode *zslInsert(zskiplist *zsl, double score, robj *obj) {
     return x;
 }
 
-/* Internal function used by zslDelete, zslDeleteByScore and zslDeleteByRank */
-void zslDeleteNode(zskiplist *zsl, zskiplistNode *x, zskiplistNode **update) {
-    int i;
+/* Internal function used by zslDelete, zslDeleteByScore and zslDeleteByRank.
+ * Returns the level of the unlinked node, needed by zslFreeNode(). */
+int zslDeleteNode(zskiplist *zsl, zskiplistNode *x, zskiplistNode **update) {
+    int i, level = 0;
     for (i = 0; i < zsl->level; i++) {
         if (update[i]->level[i].forward == x) {
+            level++;
             update[i]->level[i].span += x->level[i].span - 1;
             update[i]->level[i].forward = x->level[i].forward;
         } else {
@@ -182,6 +365,7 @@ void zslDeleteNode(zskiplist *zsl, zskiplistNode *x, zskiplistNode **update) {
     while(zsl->level > 1 && zsl->header->level[zsl->level-1].forward == NULL)
         zsl->level--;
     zsl->length--;
+    return level;
 }
 
 /* Delete an element with matching score/object from the skiplist. */
@@ -202,8 +386,7 @@ int zslDelete(zskiplist *zsl, double score, robj *obj) {
      * is to find the element with both the right score and object. */
     x = x->level[0].forward;
     if (x && score == x->score && equalStringObjects(x->obj,obj)) {
-        zslDeleteNode(zsl, x, update);
-        zslFreeNode(x);
+        zslFreeNode(zsl,x,zslDeleteNode(zsl,x,update));
         return 1;
     }
     return 0; /* not found */
@@ -311,9 +494,9 @@ unsigned long zslDeleteRangeByScore(zskiplist *zsl, zrangespec *range, dict *dic
            (range->maxex ? x->score < range->max : x->score <= range->max))
     {
         zskiplistNode *next = x->level[0].forward;
-        zslDeleteNode(zsl,x,update);
+        int level = zslDeleteNode(zsl,x,update);
         dictDelete(dict,x->obj);
-        zslFreeNode(x);
+        zslFreeNode(zsl,x,level);
         removed++;
         x = next;
     }
@@ -340,9 +523,9 @@ unsigned long zslDeleteRangeByLex(zskiplist *zsl, zlexrangespec *range, dict *di
     /* Delete nodes while in range. */
     while (x && zslLexValueLteMax(x->obj,range)) {
         zskiplistNode *next = x->level[0].forward;
-        zslDeleteNode(zsl,x,update);
+        int level = zslDeleteNode(zsl,x,update);
         dictDelete(dict,x->obj);
-        zslFreeNode(x);
+        zslFreeNode(zsl,x,level);
         removed++;
         x = next;
     }
@@ -369,9 +552,9 @@ unsigned long zslDeleteRangeByRank(zskiplist *zsl, unsigned int start, unsigned
     x = x->level[0].forward;
     while (x && traversed <= end) {
         zskiplistNode *next = x->level[0].forward;
-        zslDeleteNode(zsl,x,update);
+        int level = zslDeleteNode(zsl,x,update);
         dictDelete(dict,x->obj);
-        zslFreeNode(x);
+        zslFreeNode(zsl,x,level);
         removed++;
         traversed++;
         x = next;
@@ -1092,7 +1275,7 @@ unsigned int zsetLength(robj *zobj) {
 
 void zsetConvert(robj *zobj, int encoding) {
     zset *zs;
-    zskiplistNode *node, *next;
+    zskiplistNode *node;
     robj *ele;
     double score;
 
@@ -1127,7 +1310,6 @@ void zsetConvert(robj *zobj, int encoding) {
             /* Has incremented refcount since it was just created. */
             node = zslInsert(zs->zsl,score,ele);
             redisAssertWithInfo(NULL,zobj,dictAdd(zs->dict,ele,&node->score) == DICT_OK);
-            incrRefCount(ele); /* Added to dictionary. */
             zzlNext(zl,&eptr,&sptr);
         }
 
@@ -1140,24 +1322,21 @@ void zsetConvert(robj *zobj, int encoding) {
         if (encoding != REDIS_ENCODING_ZIPLIST)
             redisPanic("Unknown target encoding");
 
-        /* Approach similar to zslFree(), since we want to free the skiplist at
+        /* Approach similar to zsetFree(), since we want to free the skiplist at
          * the same time as creating the ziplist. */
         zs = zobj->ptr;
         dictRelease(zs->dict);
         node = zs->zsl->header->level[0].forward;
-        zfree(zs->zsl->header);
-        zfree(zs->zsl);
 
         while (node) {
             ele = getDecodedObject(node->obj);
             zl = zzlInsertAt(zl,NULL,ele,node->score);
             decrRefCount(ele);
-
-            next = node->level[0].forward;
-            zslFreeNode(node);
-            node = next;
+            decrRefCount(node->obj);
+            node = node->level[0].forward;
         }
 
+        zslFreeNodes(zs->zsl);
         zfree(zs);
         zobj->ptr = zl;
         zobj->encoding = REDIS_ENCODING_ZIPLIST;
@@ -1323,13 +1502,13 @@ void zaddGenericCommand(redisClient *c, int flags) {
                     }
                 }
 
-                /* Remove and re-insert when score changed. We can safely
-                 * delete the key object from the skiplist, since the
-                 * dictionary still has a reference to it. */
+                /* Remove and re-insert when score changed. The skiplist
+                 * owns the element, so a reference is taken before the
+                 * node is deleted and handed to the new node. */
                 if (score != curscore) {
+                    incrRefCount(curobj); /* Re-inserted in skiplist. */
                     redisAssertWithInfo(c,curobj,zslDelete(zs->zsl,curscore,curobj));
                     znode = zslInsert(zs->zsl,score,curobj);
-                    incrRefCount(curobj); /* Re-inserted in skiplist. */
                     dictGetVal(de) = &znode->score; /* Update score ptr. */
                     server.dirty++;
                     updated++;
@@ -1339,7 +1518,6 @@ void zaddGenericCommand(redisClient *c, int flags) {
                 znode = zslInsert(zs->zsl,score,ele);
                 incrRefCount(ele); /* Inserted in skiplist. */
                 redisAssertWithInfo(c,NULL,dictAdd(zs->dict,ele,&znode->score) == DICT_OK);
-                incrRefCount(ele); /* Added to dictionary. */
                 server.dirty++;
                 added++;
                 processed++;
@@ -1408,12 +1586,13 @@ void zremCommand(redisClient *c) {
             if (de != NULL) {
                 deleted++;
 
-                /* Delete from the skiplist */
+                /* Delete from the hash table first, since the element
+                 * is released with the skiplist node. */
                 score = *(double*)dictGetVal(de);
-                redisAssertWithInfo(c,c->argv[j],zslDelete(zs->zsl,score,c->argv[j]));
-
-                /* Delete from the hash table */
                 dictDelete(zs->dict,c->argv[j]);
+
+                /* Delete from the skiplist */
+                redisAssertWithInfo(c,c->argv[j],zslDelete(zs->zsl,score,c->argv[j]));
                 if (htNeedsResize(zs->dict)) dictResize(zs->dict);
                 if (dictSize(zs->dict) == 0) {
                     dbDelete(c->db,key);
@@ -1570,6 +1749,10 @@ typedef struct {
                 dictIterator *di;
                 dictEntry *de;
             } ht;
+            struct {
+                ctable *ct;
+                unsigned long pos;
+            } ct;
         } set;
 
         /* Sorted set iterators. */
@@ -1624,6 +1807,9 @@ void zuiInitIterator(zsetopsrc *op) {
             it->ht.dict = op->subject->ptr;
             it->ht.di = dictGetIterator(op->subject->ptr);
             it->ht.de = dictNext(it->ht.di);
+        } else if (op->encoding == REDIS_ENCODING_CTABLE) {
+            it->ct.ct = op->subject->ptr;
+            it->ct.pos = 0;
         } else {
             redisPanic("Unknown set encoding");
         }
@@ -1657,6 +1843,8 @@ void zuiClearIterator(zsetopsrc *op) {
             REDIS_NOTUSED(it); /* skip */
         } else if (op->encoding == REDIS_ENCODING_HT) {
             dictReleaseIterator(it->ht.di);
+        } else if (op->encoding == REDIS_ENCODING_CTABLE) {
+            REDIS_NOTUSED(it); /* skip */
         } else {
             redisPanic("Unknown set encoding");
         }
@@ -1684,6 +1872,8 @@ int zuiLength(zsetopsrc *op) {
         } else if (op->encoding == REDIS_ENCODING_HT) {
             dict *ht = op->subject->ptr;
             return dictSize(ht);
+        } else if (op->encoding == REDIS_ENCODING_CTABLE) {
+            return ctableLen((ctable*)op->subject->ptr);
         } else {
             redisPanic("Unknown set encoding");
         }
@@ -1733,6 +1923,14 @@ int zuiNext(zsetopsrc *op, zsetopval *val) {
 
             /* Move to next element. */
             it->ht.de = dictNext(it->ht.di);
+        } else if (op->encoding == REDIS_ENCODING_CTABLE) {
+            sds ele = ctableNext(it->ct.ct,&it->ct.pos);
+
+            if (ele == NULL)
+                return 0;
+            val->estr = (unsigned char*)ele;
+            val->elen = sdslen(ele);
+            val->score = 1.0;
         } else {
             redisPanic("Unknown set encoding");
         }
@@ -1846,6 +2044,14 @@ int zuiFind(zsetopsrc *op, zsetopval *val, double *score) {
             } else {
                 return 0;
             }
+        } else if (op->encoding == REDIS_ENCODING_CTABLE) {
+            zuiBufferFromValue(val);
+            if (ctableFind(op->subject->ptr,(char*)val->estr,val->elen)) {
+                *score = 1.0;
+                return 1;
+            } else {
+                return 0;
+            }
         } else {
             redisPanic("Unknown set encoding");
         }
@@ -2030,7 +2236,6 @@ void zunionInterGenericCommand(redisClient *c, robj *dstkey, int op) {
                     znode = zslInsert(dstzset->zsl,score,tmp);
                     incrRefCount(tmp); /* added to skiplist */
                     dictAdd(dstzset->dict,tmp,&znode->score);
-                    incrRefCount(tmp); /* added to dictionary */
 
                     if (sdsEncodedObject(tmp)) {
                         if (sdslen(tmp->ptr) > maxelelen)
@@ -2106,7 +2311,6 @@ void zunionInterGenericCommand(redisClient *c, robj *dstkey, int op) {
             znode = zslInsert(dstzset->zsl,score,ele);
             incrRefCount(ele); /* added to skiplist */
             dictAdd(dstzset->dict,ele,&znode->score);
-            incrRefCount(ele); /* added to dictionary */
         }
         dictReleaseIterator(di);
 
@@ -2909,7 +3113,7 @@ void zrevrankCommand(redisClient *c) {
 
 void zscanCommand(redisClient *c) {
     robj *o;
-    unsigned long cursor;
+    unsigned long long cursor;
 
     if (parseScanCursorOrReply(c,c->argv[2],&cursor) == REDIS_ERR) return;
     if ((o = lookupKeyReadOrReply(c,c->argv[1],shared.emptyscan)) == NULL ||
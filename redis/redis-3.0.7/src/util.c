@@ -170,6 +170,19 @@ int stringmatch(const char *pattern, const char *string, int nocase) {
     return stringmatchlen(pattern,strlen(pattern),string,strlen(string),nocase);
 }
 
+/* Return the length of the literal prefix of the glob-style pattern, that is
+ * the number of characters before the first special one. Every string
+ * matched by the pattern (case sensitive) starts with this prefix. */
+int stringmatchPrefixLen(const char *pattern, int patternLen) {
+    int j;
+
+    for (j = 0; j < patternLen; j++) {
+        char c = pattern[j];
+        if (c == '*' || c == '?' || c == '[' || c == '\\') break;
+    }
+    return j;
+}
+
 /* Convert a string representing an amount of memory into the number of
  * bytes, so for instance memtoll("1Gb") will return 1073741824 that is
  * (1024*1024*1024).
@@ -39,6 +39,7 @@ void zlibc_free(void *ptr) {
     free(ptr);
 }
 
+#include <stdint.h>
 #include <string.h>
 #include <pthread.h>
 #include "config.h"
@@ -210,6 +211,42 @@ void zfree(void *ptr) {
 #endif
 }
 
+#ifdef HAVE_DEFRAG
+/* Allocation and free functions that bypass the thread cache of jemalloc, so
+ * that the new allocation is served from the bin itself (its lowest address
+ * non full run) and the old one is returned to its run immediately. This is
+ * what the active defragmentation needs in order to move data away from
+ * sparse runs: going through the thread cache would just hand back the
+ * recently freed regions.
+ *
+ * The arena is looked up once and cached: these functions are only meant to
+ * be called by the main thread. */
+static unsigned zmalloc_thread_arena(void) {
+    static int cached = 0;
+    static unsigned arena = 0;
+
+    if (!cached) {
+        size_t sz = sizeof(arena);
+        je_mallctl("thread.arena",&arena,&sz,NULL,0);
+        cached = 1;
+    }
+    return arena;
+}
+
+void *zmalloc_no_tcache(size_t size) {
+    void *ptr = je_mallocx(size,MALLOCX_ARENA(zmalloc_thread_arena()));
+    if (!ptr) zmalloc_oom_handler(size);
+    update_zmalloc_stat_alloc(zmalloc_size(ptr));
+    return ptr;
+}
+
+void zfree_no_tcache(void *ptr) {
+    if (ptr == NULL) return;
+    update_zmalloc_stat_free(zmalloc_size(ptr));
+    je_dallocx(ptr,MALLOCX_ARENA(zmalloc_thread_arena()));
+}
+#endif
+
 char *zstrdup(const char *s) {
     size_t l = strlen(s)+1;
     char *p = zmalloc(l);
@@ -328,6 +365,39 @@ float zmalloc_get_fragmentation_ratio(size_t rss) {
     return (float)rss/zmalloc_used_memory();
 }
 
+/* Fill the allocated, active and resident byte counters as seen by the
+ * allocator itself, returning 1 on success. The ratio between active and
+ * allocated is the fragmentation inside the allocator runs, that unlike the
+ * RSS based ratio is something the active defragmentation can fix. When the
+ * allocator does not provide these statistics 0 is returned. */
+#if defined(USE_JEMALLOC)
+int zmalloc_get_allocator_info(size_t *allocated, size_t *active,
+                               size_t *resident)
+{
+    uint64_t epoch = 1;
+    size_t sz;
+
+    *allocated = *active = *resident = 0;
+    /* Update the statistics cached by jemalloc. */
+    sz = sizeof(epoch);
+    je_mallctl("epoch",&epoch,&sz,&epoch,sz);
+    sz = sizeof(size_t);
+    if (je_mallctl("stats.allocated",allocated,&sz,NULL,0) ||
+        je_mallctl("stats.active",active,&sz,NULL,0)) return 0;
+    /* jemalloc 3.6 has no "stats.resident": "stats.mapped" is the closest
+     * match, counting the chunks currently mapped by the allocator. */
+    je_mallctl("stats.mapped",resident,&sz,NULL,0);
+    return 1;
+}
+#else
+int zmalloc_get_allocator_info(size_t *allocated, size_t *active,
+                               size_t *resident)
+{
+    *allocated = *active = *resident = 0;
+    return 0;
+}
+#endif
+
 /* Get the sum of the specified field (converted form kb to bytes) in
  * /proc/self/smaps. The field must be specified with trailing ":" as it
  * apperas in the smaps output.
@@ -54,6 +54,9 @@
 #else
 #error "Newer version of jemalloc required"
 #endif
+#if defined(JEMALLOC_FRAG_HINT)
+#define HAVE_DEFRAG
+#endif
 
 #elif defined(__APPLE__)
 #include <malloc/malloc.h>
@@ -78,6 +81,12 @@ size_t zmalloc_get_rss(void);
 size_t zmalloc_get_private_dirty(void);
 size_t zmalloc_get_smap_bytes_by_field(char *field);
 void zlibc_free(void *ptr);
+int zmalloc_get_allocator_info(size_t *allocated, size_t *active, size_t *resident);
+
+#ifdef HAVE_DEFRAG
+void *zmalloc_no_tcache(size_t size);
+void zfree_no_tcache(void *ptr);
+#endif
 
 #ifndef HAVE_MALLOC_SIZE
 size_t zmalloc_size(void *ptr);
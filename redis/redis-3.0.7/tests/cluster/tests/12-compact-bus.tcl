@@ -0,0 +1,80 @@
+# Check that nodes using the compact cluster bus messages work together
+# with nodes that only use the full messages, and that compact messages
+# actually use less bandwidth.
+
+source "../tests/includes/init-tests.tcl"
+
+proc bus_bytes_per_msg {id from_bytes from_msgs} {
+    set bytes [expr {[CI $id cluster_stats_bytes_sent]-$from_bytes}]
+    set msgs [expr {[CI $id cluster_stats_messages_sent]-$from_msgs}]
+    expr {double($bytes)/$msgs}
+}
+
+test "Create a 5 nodes cluster" {
+    create_cluster 5 5
+}
+
+test "Disable compact messages in instances #0 and #5" {
+    R 0 config set cluster-compact-bus no
+    R 5 config set cluster-compact-bus no
+    assert {[lindex [R 0 config get cluster-compact-bus] 1] eq {no}}
+}
+
+test "Cluster is up" {
+    assert_cluster_state ok
+}
+
+test "Cluster is writable" {
+    cluster_write_test 0
+}
+
+test "Compact messages use less bytes per message" {
+    foreach id {0 2} {
+        set bytes($id) [CI $id cluster_stats_bytes_sent]
+        set msgs($id) [CI $id cluster_stats_messages_sent]
+    }
+    after 3000
+    set full [bus_bytes_per_msg 0 $bytes(0) $msgs(0)]
+    set compact [bus_bytes_per_msg 2 $bytes(2) $msgs(2)]
+    assert {$compact < $full/2}
+    assert {[CI 2 cluster_stats_bytes_received] > 0}
+}
+
+set current_epoch [CI 1 cluster_current_epoch]
+
+test "Killing one master node" {
+    kill_instance redis 1
+}
+
+test "Wait for failover" {
+    wait_for_condition 1000 50 {
+        [CI 0 cluster_current_epoch] > $current_epoch
+    } else {
+        fail "No failover detected"
+    }
+}
+
+test "Cluster should eventually be up again" {
+    assert_cluster_state ok
+}
+
+test "Cluster is writable" {
+    cluster_write_test 0
+}
+
+test "Restarting the old master node" {
+    restart_instance redis 1
+}
+
+test "Instance #1 gets converted into a slave" {
+    wait_for_condition 1000 50 {
+        [RI 1 role] eq {slave}
+    } else {
+        fail "Old master was not converted into slave"
+    }
+}
+
+test "Enable compact messages again" {
+    R 0 config set cluster-compact-bus yes
+    R 5 config set cluster-compact-bus yes
+}
@@ -0,0 +1,177 @@
+# CLUSTER MIGRATESLOT: a slot is streamed to the node it is migrating to
+# while the clients keep writing to it, and a migration can be cancelled
+# and started again.
+
+source "../tests/includes/init-tests.tcl"
+
+test "Create a 3 nodes cluster" {
+    create_cluster 3 0
+}
+
+test "Cluster is up" {
+    assert_cluster_state ok
+}
+
+set ::slot [R 0 cluster keyslot "{mig}"]
+foreach id {0 1 2} {
+    if {![catch {R $id exists "{mig}"}]} {set ::src $id}
+}
+set ::dst [expr {($::src+1)%3}]
+
+# Call a command about a key of the slot: in the source node first, and in
+# the target node if the source replies with an -ASK redirection.
+proc migslot_call args {
+    if {[catch {R $::src {*}$args} reply]} {
+        if {![string match {ASK *} $reply]} {error $reply}
+        R $::dst asking
+        set reply [R $::dst {*}$args]
+    }
+    return $reply
+}
+
+proc migslot_status {field} {
+    get_info_field [R $::src cluster migrateslot status] $field
+}
+
+proc migslot_wait {state} {
+    wait_for_condition 1000 50 {
+        [migslot_status state] eq $state
+    } else {
+        fail "Migration state is [migslot_status state], not $state: \
+              [migslot_status error]"
+    }
+}
+
+proc migslot_open {} {
+    set srcid [dict get [get_myself $::src] id]
+    set dstid [dict get [get_myself $::dst] id]
+    R $::dst cluster setslot $::slot importing $srcid
+    R $::src cluster setslot $::slot migrating $dstid
+}
+
+# Assign the slot to the target. The next migration moves it back.
+proc migslot_close {} {
+    set dstid [dict get [get_myself $::dst] id]
+    R $::dst cluster setslot $::slot node $dstid
+    R $::src cluster setslot $::slot node $dstid
+    lassign [list $::dst $::src] ::src ::dst
+}
+
+proc migslot_populate {prefix count} {
+    catch {unset ::content}
+    array set ::content {}
+    for {set j 0} {$j < $count} {incr j} {
+        set key "{mig}:$prefix:$j"
+        set val [randstring 1000 1000 alpha]
+        R $::src set $key $val
+        set ::content($key) $val
+    }
+}
+
+proc migslot_verify {} {
+    foreach {key val} [array get ::content] {
+        assert_equal $val [migslot_call get $key]
+    }
+}
+
+test "Keys are moved by CLUSTER MIGRATESLOT" {
+    migslot_populate str 500
+    for {set j 0} {$j < 100} {incr j} {
+        R $::src rpush "{mig}:list:$j" a b c
+        R $::src setex "{mig}:ttl:$j" 1000 $j
+    }
+    migslot_open
+    assert_equal OK [R $::src cluster migrateslot $::slot batch 50]
+    migslot_wait done
+    assert_equal 700 [migslot_status keys_migrated]
+    assert_equal 0 [R $::src cluster countkeysinslot $::slot]
+    assert_equal 700 [R $::dst cluster countkeysinslot $::slot]
+    migslot_verify
+    assert_equal {a b c} [migslot_call lrange "{mig}:list:10" 0 -1]
+    set ttl [migslot_call ttl "{mig}:ttl:10"]
+    assert {$ttl > 900 && $ttl <= 1000}
+    R $::dst flushall
+}
+
+test "Migrated slot is served by the target" {
+    set old $::dst
+    migslot_close
+    assert_equal $old $::src
+    wait_for_condition 1000 50 {
+        [catch {R $::dst get "{mig}"} e] && [string match {MOVED *} $e]
+    } else {
+        fail "The old source node doesn't redirect to the new owner"
+    }
+}
+
+# Keys deleted while in flight are served by the source until their
+# migration is complete: if a write was redirected to the target in the
+# meantime, the DEL sent to the target for the key would delete it.
+test "Writes performed during CLUSTER MIGRATESLOT are not lost" {
+    migslot_populate str 300
+    migslot_open
+    # Keep all the keys in flight for a while.
+    set rd [redis 127.0.0.1 [get_instance_attrib redis $::dst port] 1]
+    $rd debug sleep 1
+    assert_equal OK [R $::src cluster migrateslot $::slot batch 100]
+    set ops 0
+    while {[migslot_status state] in {connecting running} && $ops < 20000} {
+        for {set j 0} {$j < 50} {incr j} {
+            set key "{mig}:str:[randomInt 300]"
+            set val [randstring 10 10 alpha]
+            switch [randomInt 3] {
+                0 {
+                    migslot_call set $key $val
+                    set ::content($key) $val
+                }
+                1 {
+                    migslot_call del $key
+                    migslot_call set $key $val
+                    set ::content($key) $val
+                }
+                2 {
+                    if {[migslot_call del $key]} {
+                        set ::content($key) {}
+                    }
+                }
+            }
+            incr ops
+        }
+    }
+    $rd read
+    $rd close
+    migslot_wait done
+    assert {[migslot_status keys_resent] > 0}
+    assert_equal 0 [R $::src cluster countkeysinslot $::slot]
+    migslot_close
+    migslot_verify
+}
+
+test "A cancelled CLUSTER MIGRATESLOT can be started again" {
+    migslot_populate str 300
+    migslot_open
+    assert_equal OK \
+        [R $::src cluster migrateslot $::slot batch 10 maxbytes 50000]
+    wait_for_condition 1000 50 {
+        [migslot_status keys_migrated] >= 50
+    } else {
+        fail "Migration not progressing"
+    }
+    # Delete keys that may be in flight while cancelling.
+    for {set j 0} {$j < 300} {incr j 3} {
+        set key "{mig}:str:$j"
+        migslot_call del $key
+        set ::content($key) {}
+    }
+    assert_equal OK [R $::src cluster migrateslot cancel]
+    migslot_wait cancelled
+    set left [R $::src cluster countkeysinslot $::slot]
+    assert {$left > 0 && $left < 300}
+    migslot_verify
+
+    assert_equal OK [R $::src cluster migrateslot $::slot replace]
+    migslot_wait done
+    assert_equal 0 [R $::src cluster countkeysinslot $::slot]
+    migslot_close
+    migslot_verify
+}
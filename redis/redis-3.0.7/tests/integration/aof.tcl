@@ -227,6 +227,51 @@ tags {"aof"} {
         }
     }
 
+    ## Test that an AOF with an RDB preamble and a command tail is loaded
+    create_aof {}
+
+    start_server_aof [list dir $server_path aof-use-rdb-preamble yes] {
+        set client [redis [dict get $srv host] [dict get $srv port]]
+        test "AOF+RDB preamble: rewrite starts with an RDB payload" {
+            $client set foo bar
+            $client rpush list a b c
+            $client hmset hash f1 v1 f2 v2
+            $client zadd zset 1 a 2 b
+            $client sadd set 1 2 3
+            $client set volatile x
+            $client pexpire volatile 1000000
+            $client bgrewriteaof
+            wait_for_condition 50 100 {
+                [status $client aof_rewrite_in_progress] == 0
+            } else {
+                fail "AOF rewrite did not complete"
+            }
+            set fp [open $aof_path r]
+            fconfigure $fp -translation binary
+            set sig [read $fp 5]
+            close $fp
+            assert_equal "REDIS" $sig
+        }
+        $client incr counter
+        $client rpush list d
+        $client del set
+        set digest [$client debug digest]
+    }
+
+    start_server_aof [list dir $server_path aof-load-truncated no] {
+        test "AOF+RDB preamble: dataset and tail are loaded" {
+            set client [redis [dict get $srv host] [dict get $srv port]]
+            wait_for_condition 50 100 {
+                [catch {$client ping} e] == 0
+            } else {
+                fail "Loading DB is taking too much time."
+            }
+            assert_equal $digest [$client debug digest]
+            assert_equal {a b c d} [$client lrange list 0 -1]
+            assert {[$client pttl volatile] > 0}
+        }
+    }
+
     start_server {overrides {appendonly {yes} appendfilename {appendonly.aof}}} {
         test {Redis should not try to convert DEL into EXPIREAT for EXPIRE -1} {
             r set x 10
@@ -0,0 +1,92 @@
+start_server {tags {"psync2"}} {
+start_server {} {
+start_server {} {
+start_server {} {
+    # Server -3 is the master, -2 and -1 its slaves, 0 a slave of -1.
+    set master [srv -3 client]
+    set master_host [srv -3 host]
+    set master_port [srv -3 port]
+    set a_host [srv -2 host]
+    set a_port [srv -2 port]
+
+    proc wait_for_offsets_and_digests {servers} {
+        wait_for_condition 50 100 {
+            [llength [lsort -unique [lmap j $servers {
+                status [srv $j client] master_repl_offset}]]] == 1 &&
+            [llength [lsort -unique [lmap j $servers {
+                [srv $j client] debug digest}]]] == 1
+        } else {
+            fail "Offsets or data sets of the replication chain differ"
+        }
+    }
+
+    test {PSYNC2: set up the replication chain} {
+        r -2 slaveof $master_host $master_port
+        r -1 slaveof $master_host $master_port
+        r 0 slaveof [srv -1 host] [srv -1 port]
+        foreach j {-2 -1 0} {
+            wait_for_condition 50 100 {
+                [status [srv $j client] master_link_status] eq {up}
+            } else {
+                fail "Replication not started."
+            }
+        }
+    }
+
+    test {PSYNC2: slaves share the replication ID and offset of the master} {
+        $master select 9
+        for {set j 0} {$j < 1000} {incr j} {
+            $master set key:$j $j
+            $master incr counter
+        }
+        wait_for_offsets_and_digests {-3 -2 -1 0}
+        assert_equal [status $master master_replid] [status [srv 0 client] master_replid]
+    }
+
+    test {PSYNC2: siblings, old master and chained slaves continue after failover} {
+        set old_replid [status $master master_replid]
+        r -2 slaveof no one
+        assert_equal $old_replid [status [srv -2 client] master_replid2]
+        r -1 slaveof $a_host $a_port
+        r -3 slaveof $a_host $a_port
+        foreach j {-3 -1 0} {
+            wait_for_condition 50 100 {
+                [status [srv $j client] master_link_status] eq {up}
+            } else {
+                fail "Replication not started."
+            }
+        }
+        r -2 select 9
+        for {set j 0} {$j < 100} {incr j} {r -2 incr counter}
+        wait_for_offsets_and_digests {-3 -2 -1 0}
+        assert_equal 1100 [r -2 get counter]
+        assert_equal 0 [status [srv -2 client] sync_full]
+        assert_equal 2 [status [srv -2 client] sync_partial_ok]
+        # The chained slave may reconnect to its master only after the
+        # latter has its own link up again.
+        wait_for_condition 50 100 {
+            [status [srv -1 client] sync_partial_ok] >= 1 &&
+            [status [srv 0 client] master_link_status] eq {up}
+        } else {
+            fail "The chained slave did not partially resynchronize"
+        }
+    }
+
+    test {PSYNC2: a new slave of a slave gets the right DB} {
+        set sync_full [status [srv -1 client] sync_full]
+        r 0 slaveof no one
+        r 0 flushall
+        r 0 slaveof [srv -1 host] [srv -1 port]
+        wait_for_condition 50 100 {
+            [status [srv 0 client] master_link_status] eq {up}
+        } else {
+            fail "Replication not started."
+        }
+        # The stream of the master already selected DB 9.
+        r -2 set newkey 1
+        wait_for_offsets_and_digests {-3 -2 -1 0}
+        assert_equal [expr {$sync_full+1}] [status [srv -1 client] sync_full]
+        r 0 select 9
+        assert_equal 1 [r 0 get newkey]
+    }
+}}}}
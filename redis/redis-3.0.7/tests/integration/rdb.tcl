@@ -96,3 +96,78 @@ start_server_and_kill_it [list "dir" $server_path] {
         }
     }
 }
+
+set server_path [tmpdir "server.rdb-forkless-test"]
+
+start_server [list overrides [list "dir" $server_path "rdb-forkless" "yes"]] {
+    test {Forkless BGSAVE saves a point-in-time snapshot} {
+        # Keep the dataset small: the test framework can't wait for the
+        # server started below to load a big file.
+        r debug populate 20000
+        r select 1
+        r rpush mylist a b c
+        r sadd myset a b c
+        r setex volatile 1000 foo
+        r select 9
+        set digest [r debug digest]
+
+        r bgsave
+        assert_equal 1 [s rdb_bgsave_in_progress]
+        set writes 0
+        while 1 {
+            r select 9
+            r set key:[randomInt 20000] changed
+            r del key:[randomInt 20000]
+            r expire key:[randomInt 20000] 100
+            r set newkey:$writes foo
+            r select 1
+            r rpush mylist $writes
+            r sadd myset $writes
+            r persist volatile
+            incr writes
+            if {![s rdb_bgsave_in_progress]} break
+        }
+        assert_equal ok [s rdb_last_bgsave_status]
+        assert {[r debug digest] ne $digest}
+
+        set load_path [tmpdir "server.rdb-forkless-load"]
+        file copy [file join $server_path dump.rdb] $load_path
+        start_server [list overrides [list "dir" $load_path]] {
+            assert_equal $digest [r debug digest]
+        }
+    }
+
+    test {FLUSHALL aborts a forkless BGSAVE} {
+        r bgsave
+        r flushall
+        wait_for_condition 50 100 {
+            [s rdb_bgsave_in_progress] == 0
+        } else {
+            fail "Forkless BGSAVE still in progress after FLUSHALL"
+        }
+        assert_equal ok [s rdb_last_bgsave_status]
+        assert {[glob -nocomplain [file join $server_path temp-*]] eq {}}
+    }
+}
+
+start_server {tags {"rdb"}} {
+    test {Threaded RDB loading gives the same dataset} {
+        createComplexDataset r 10000
+        for {set j 0} {$j < 100} {incr j} {
+            r setex volatile:$j 10000 foo
+        }
+        r select 1
+        r set bigstring [string repeat abcdefghij 100000]
+        r rpush biglist {*}[lrepeat 1000 [string repeat x 500]]
+        r select 9
+        r debug populate 20000
+        set digest [r debug digest]
+
+        foreach threads {1 4} {
+            r config set rdb-load-threads $threads
+            r debug reload
+            assert_equal $digest [r debug digest]
+        }
+        r config set rdb-load-threads 0
+    }
+}
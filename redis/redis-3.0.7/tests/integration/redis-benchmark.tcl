@@ -0,0 +1,67 @@
+proc redis_benchmark {args} {
+    exec src/redis-benchmark -h [srv host] -p [srv port] {*}$args
+}
+
+# The test client uses DB 9 out of cluster mode.
+proc redis_benchmark_db9 {args} {
+    redis_benchmark --dbnum 9 {*}$args
+}
+
+start_server {tags {"benchmark"}} {
+    test {redis-benchmark runs every request once with several threads} {
+        r flushall
+        redis_benchmark_db9 -t set,incr -n 5000 -c 20 --threads 4 -q
+        assert_equal 5000 [r get counter:__rand_int__]
+        r exists key:__rand_int__
+    } {1}
+
+    test {redis-benchmark -r keys stay in the keyspace with several threads} {
+        r flushall
+        redis_benchmark_db9 -t set -n 5000 -c 20 --threads 4 -r 100 -q
+        set keys [r keys key:*]
+        assert {[llength $keys] > 1 && [llength $keys] <= 100}
+        foreach k $keys {assert_match {key:0000000000[0-9][0-9]} $k}
+    }
+
+    test {redis-benchmark CSV output reports the latency percentiles} {
+        set lines [split [redis_benchmark -t set,get -n 1000 -c 5 --csv] "\n"]
+        assert_equal 3 [llength $lines]
+        assert_match {"test","rps","avg_latency_ms",*"p99_latency_ms",*} \
+            [lindex $lines 0]
+        assert_match {"SET",*} [lindex $lines 1]
+        assert_match {"GET",*} [lindex $lines 2]
+        foreach line [lrange $lines 1 end] {
+            assert_equal 9 [llength [split $line ,]]
+        }
+    }
+
+    test {redis-benchmark JSON output has one object per test} {
+        set lines [split [redis_benchmark -t set,get -n 1000 -c 5 --json] "\n"]
+        assert_equal 2 [llength $lines]
+        assert_match {{"test":"SET","requests":1000,*"latency_ms":{*}}} \
+            [lindex $lines 0]
+        assert_match {{"test":"GET",*}} [lindex $lines 1]
+    }
+}
+
+start_server {tags {"benchmark cluster"} overrides {cluster-enabled yes}} {
+    for {set j 0} {$j < 16384} {incr j} {lappend slots $j}
+    r cluster addslots {*}$slots
+    wait_for_condition 50 100 {
+        [string match {*cluster_state:ok*} [r cluster info]]
+    } else {
+        fail "The cluster state is not ok"
+    }
+
+    test {redis-benchmark --cluster uses keys with a hash tag} {
+        redis_benchmark --cluster -t set,incr -n 2000 -c 10 --threads 2 -q
+        set keys [r keys *]
+        assert {[llength $keys] > 0}
+        set total 0
+        foreach k $keys {
+            assert_match {*\{*\}*} $k
+            if {[string match counter* $k]} {incr total [r get $k]}
+        }
+        set total
+    } {2000}
+}
@@ -266,3 +266,32 @@ foreach dl {no yes} {
         }
     }
 }
+
+start_server {tags {"repl"} overrides {rdb-forkless yes}} {
+    set master [srv 0 client]
+    set master_host [srv 0 host]
+    set master_port [srv 0 port]
+    $master debug populate 200000
+
+    start_server {} {
+        set slave [srv 0 client]
+
+        test {Full resync with a forkless BGSAVE while the master is written} {
+            $slave slaveof $master_host $master_port
+            set writes 0
+            while {![string match {*state=online*} [$master info replication]]} {
+                $master set key:[randomInt 200000] changed
+                $master del key:[randomInt 200000]
+                $master set newkey:$writes foo
+                incr writes
+            }
+            assert {$writes > 0}
+
+            wait_for_condition 500 100 {
+                [$master debug digest] eq [$slave debug digest]
+            } else {
+                fail "Master and slave have different digest: [$master debug digest] VS [$slave debug digest]"
+            }
+        }
+    }
+}
@@ -35,10 +35,12 @@ set ::all_tests {
     integration/replication-3
     integration/replication-4
     integration/replication-psync
+    integration/psync2
     integration/aof
     integration/rdb
     integration/convert-zipmap-hash-on-load
     integration/logging
+    integration/redis-benchmark
     unit/pubsub
     unit/slowlog
     unit/scripting
@@ -49,6 +51,10 @@ set ::all_tests {
     unit/bitops
     unit/memefficiency
     unit/hyperloglog
+    unit/io-threads
+    unit/lazyfree
+    unit/dict-async-alloc
+    unit/cluster-keyslots
 }
 # Index to the next test to run in the ::all_tests list.
 set ::next_test 0
@@ -126,8 +132,10 @@ proc reconnect {args} {
     set client [redis $host $port]
     dict set srv "client" $client
 
-    # select the right db when we don't have to authenticate
-    if {![dict exists $config "requirepass"]} {
+    # select the right db when we don't have to authenticate, and the
+    # server is not in cluster mode (only DB 0 exists in cluster mode)
+    if {![dict exists $config "requirepass"] &&
+        ![dict exists $config "cluster-enabled"]} {
         $client select 9
     }
 
@@ -338,4 +338,97 @@ start_server {tags {"bitops"}} {
             }
         }
     }
+
+    test {DEBUG BITOPS-KERNEL rejects unknown kernels} {
+        assert_error "*Unknown bitops kernel*" {r debug bitops-kernel foo}
+        r debug bitops-kernel auto
+    } {*}
+
+    foreach kernel {scalar popcnt avx2} {
+        if {[catch {r debug bitops-kernel $kernel}]} continue
+
+        test "BITCOUNT fuzzing with start/end ($kernel kernel)" {
+            for {set i 0} {$i < 50} {incr i} {
+                set str [randstring 0 3000]
+                r set str $str
+                set l [string length $str]
+                set start [randomInt [expr {$l+1}]]
+                set end [expr {$start+[randomInt [expr {$l-$start+1}]]-1}]
+                # An end of -1 would mean the last byte to BITCOUNT.
+                if {$end < 0} {set end 0}
+                assert_equal [count_bits [string range $str $start $end]] \
+                             [r bitcount str $start $end]
+            }
+        }
+
+        test "BITOP fuzzing with many keys ($kernel kernel)" {
+            foreach op {and or xor not} {
+                for {set i 0} {$i < 5} {incr i} {
+                    r flushall
+                    set vec {}
+                    set veckeys {}
+                    set numvec [expr {$op eq {not} ? 1 : [randomInt 30]+1}]
+                    for {set j 0} {$j < $numvec} {incr j} {
+                        set str [randstring 200 3000]
+                        lappend vec $str
+                        lappend veckeys vector_$j
+                        r set vector_$j $str
+                    }
+                    r bitop $op target {*}$veckeys
+                    assert_equal [r get target] [simulate_bit_op $op {*}$vec]
+                }
+            }
+        }
+
+        test "BITPOS fuzzing with long runs ($kernel kernel)" {
+            foreach bit {0 1} {
+                set fill [expr {$bit ? "\x00" : "\xff"}]
+                for {set i 0} {$i < 50} {incr i} {
+                    set len [expr {[randomInt 2000]+1}]
+                    set pos [randomInt [expr {$len*8}]]
+                    r set str [string repeat $fill $len]
+                    r setbit str $pos $bit
+                    set start [randomInt [expr {$pos/8+1}]]
+                    assert_equal $pos [r bitpos str $bit $start]
+                }
+            }
+        }
+    }
+
+    test {BITOP gives the same result with every kernel on any length} {
+        set kernels {}
+        foreach kernel {scalar popcnt avx2} {
+            if {![catch {r debug bitops-kernel $kernel}]} {
+                lappend kernels $kernel
+            }
+        }
+        foreach op {and or xor not} {
+            foreach len {31 33 63 65 100 129 161 255 1000 1031} {
+                r flushall
+                set vec {}
+                set veckeys {}
+                set numvec [expr {$op eq {not} ? 1 : 3}]
+                for {set j 0} {$j < $numvec} {incr j} {
+                    # Keys of different lengths, so that the shortest one
+                    # ends in the middle of a SIMD block.
+                    set l [expr {$len+$j*7}]
+                    set str [randstring $l $l binary]
+                    lappend vec $str
+                    lappend veckeys vector_$j
+                    r set vector_$j $str
+                }
+                set results {}
+                foreach kernel $kernels {
+                    r debug bitops-kernel $kernel
+                    r bitop $op target_$kernel {*}$veckeys
+                    lappend results [r get target_$kernel]
+                }
+                assert_equal [simulate_bit_op $op {*}$vec] [lindex $results 0]
+                foreach res $results {
+                    assert_equal [lindex $results 0] $res
+                }
+            }
+        }
+    }
+    r debug bitops-kernel auto
 }
@@ -0,0 +1,84 @@
+start_server {tags {"cluster"} overrides {cluster-enabled yes}} {
+    for {set j 0} {$j < 16384} {incr j} {lappend slots $j}
+    r cluster addslots {*}$slots
+    wait_for_condition 50 100 {
+        [string match {*cluster_state:ok*} [r cluster info]]
+    } else {
+        fail "The cluster state is not ok"
+    }
+
+    test "COUNTKEYSINSLOT and GETKEYSINSLOT track SET and DEL" {
+        for {set j 0} {$j < 100} {incr j} {
+            r set "{user1}:$j" $j
+            r set "{user2}:$j" $j
+        }
+        set slot1 [r cluster keyslot "{user1}"]
+        set slot2 [r cluster keyslot "{user2}"]
+        assert_equal 100 [r cluster countkeysinslot $slot1]
+        assert_equal 100 [r cluster countkeysinslot $slot2]
+        set keys [lsort [r cluster getkeysinslot $slot1 1000]]
+        assert_equal 100 [llength $keys]
+        foreach k $keys {assert_match "{user1}:*" $k}
+        assert_equal 10 [llength [r cluster getkeysinslot $slot1 10]]
+
+        for {set j 0} {$j < 50} {incr j} {
+            r del "{user1}:$j"
+        }
+        assert_equal 50 [r cluster countkeysinslot $slot1]
+        assert_equal 100 [r cluster countkeysinslot $slot2]
+        for {set j 50} {$j < 100} {incr j} {
+            r del "{user1}:$j"
+        }
+        assert_equal 0 [r cluster countkeysinslot $slot1]
+        assert_equal {} [r cluster getkeysinslot $slot1 10]
+        assert_equal 100 [r cluster countkeysinslot $slot2]
+    }
+
+    test "The slots index follows RENAME, expires and UNLINK" {
+        r flushall
+        set slot1 [r cluster keyslot "{a}"]
+        r set "{a}x" 1
+        r rename "{a}x" "{a}y"
+        set keys [r cluster getkeysinslot $slot1 10]
+        assert_equal 1 [llength $keys]
+        assert_equal "{a}y" [lindex $keys 0]
+        r pexpire "{a}y" 1
+        wait_for_condition 50 100 {
+            [r cluster countkeysinslot $slot1] == 0
+        } else {
+            fail "Expired key still in the slots index"
+        }
+        # A big value is released by the lazy free thread.
+        for {set j 0} {$j < 1000} {incr j} {lappend members m$j}
+        r sadd "{a}big" {*}$members
+        r set "{a}small" foo
+        assert_equal 2 [r cluster countkeysinslot $slot1]
+        assert_equal 2 [r unlink "{a}big" "{a}small"]
+        assert_equal 0 [r cluster countkeysinslot $slot1]
+    }
+
+    test "FLUSHALL ASYNC empties the slots index" {
+        for {set j 0} {$j < 1000} {incr j} {
+            r set "key:$j" $j
+        }
+        set slot [r cluster keyslot key:0]
+        assert_equal 1 [r cluster countkeysinslot $slot]
+        r flushall async
+        assert_equal 0 [r cluster countkeysinslot $slot]
+        r set key:0 0
+        assert_equal {key:0} [r cluster getkeysinslot $slot 10]
+    }
+
+    test "The slots index is rebuilt when loading the RDB" {
+        r flushall
+        for {set j 0} {$j < 1000} {incr j} {
+            r set "{user1}:$j" $j
+        }
+        r set other 1
+        set slot [r cluster keyslot "{user1}"]
+        r debug reload
+        assert_equal 1000 [r cluster countkeysinslot $slot]
+        assert_equal 1 [r cluster countkeysinslot [r cluster keyslot other]]
+        assert_equal 1001 [r dbsize]
+    }
+}
@@ -0,0 +1,91 @@
+start_server {tags {"rehash"} overrides {dict-async-alloc-threshold 1024}} {
+    test "Big keyspace tables are allocated in background on expand" {
+        set allocs [s dict_async_allocs]
+        r eval {for i=0,49999 do redis.call('set','key:'..i,'value:'..i) end} 0
+        wait_for_condition 50 100 {
+            [s dict_async_allocs] > $allocs
+        } else {
+            fail "No table was allocated in background"
+        }
+        assert_equal 50000 [r dbsize]
+        for {set j 0} {$j < 50000} {incr j 997} {
+            assert_equal "value:$j" [r get key:$j]
+        }
+    }
+
+    test "Big keyspace tables are allocated in background on shrink" {
+        set allocs [s dict_async_allocs]
+        r eval {for i=0,47999 do redis.call('del','key:'..i) end} 0
+        wait_for_condition 50 100 {
+            [s dict_async_allocs] > $allocs
+        } else {
+            fail "The keyspace table was not resized"
+        }
+        assert_equal 2000 [r dbsize]
+        for {set j 48000} {$j < 50000} {incr j} {
+            assert_equal "value:$j" [r get key:$j]
+        }
+    }
+
+    test "Expires table is resized in background as well" {
+        r flushall
+        set allocs [s dict_async_allocs]
+        r eval {for i=0,9999 do redis.call('setex','k'..i,1000,i) end} 0
+        wait_for_condition 50 100 {
+            [s dict_async_allocs] >= $allocs+2
+        } else {
+            fail "The expires table was not resized in background"
+        }
+        assert_equal 10000 [r dbsize]
+        assert_equal 5000 [r get k5000]
+        assert {[r ttl k5000] > 900}
+    }
+
+    test "dict-async-alloc-threshold 0 allocates tables inline" {
+        r flushall
+        r config set dict-async-alloc-threshold 0
+        set allocs [s dict_async_allocs]
+        r eval {for i=0,49999 do redis.call('set','key:'..i,'value:'..i) end} 0
+        after 200
+        assert_equal $allocs [s dict_async_allocs]
+        assert_equal 50000 [r dbsize]
+        r config set dict-async-alloc-threshold 1024
+    }
+
+    test "Active rehash budget is reported and bounded" {
+        set budget [s active_rehash_budget_usec]
+        assert {$budget >= 250 && $budget <= 4000}
+    }
+}
+
+start_server {tags {"rehash"}} {
+    test "Active rehash budget adapts to the event loop lag" {
+        # The latency monitor is disabled by default: the budget must follow
+        # how late the cron runs when the server is busy. Growing the full
+        # table of 1M buckets starts the active rehashing, and the budget
+        # only changes while rehashing. Keep the event loop busy meanwhile,
+        # without a child saving the DB, that would pause the rehashing.
+        r config set latency-monitor-threshold 0
+        r config set save ""
+        # A cron that happens to run on time between two sleeps grows the
+        # budget again, so the lowest budget seen is checked.
+        r debug populate 1048576
+        r set foo bar
+        set min_budget [s active_rehash_budget_usec]
+        for {set j 0} {$j < 20} {incr j} {
+            r debug sleep 0.03
+            set budget [s active_rehash_budget_usec]
+            if {$budget < $min_budget} {set min_budget $budget}
+        }
+        assert {[s dict_async_allocs] > 0}
+        assert_equal 250 $min_budget
+
+        # The budget grows back once the server is idle.
+        wait_for_condition 50 100 {
+            [s active_rehash_budget_usec] > 1000
+        } else {
+            fail "The rehash budget is [s active_rehash_budget_usec]"
+        }
+        r flushall
+    }
+}
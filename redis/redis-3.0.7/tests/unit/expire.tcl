@@ -198,4 +198,75 @@ start_server {tags {"expire"}} {
         r set foo b
         lsort [r keys *]
     } {a e foo s t}
+
+    test {Active expire index reclaims the keys that are due} {
+        r flushdb
+        r config set active-expire-index yes
+        for {set j 0} {$j < 100} {incr j} {
+            r psetex key:$j [expr {1000+($j%10)*50}] a
+        }
+        # Keys with changed, removed or renamed expires must be tracked.
+        r pexpire key:1 100000
+        r persist key:2
+        r set key:3 b
+        r rename key:4 renamed
+        r del key:5
+        r psetex key:6 100000 a
+        wait_for_condition 100 100 {
+            [r dbsize] == 4
+        } else {
+            fail "Keys not reclaimed by the active expire index"
+        }
+        lsort [r keys *]
+    } {key:1 key:2 key:3 key:6}
+
+    test {Active expire index is built for existing keys on CONFIG SET} {
+        r flushdb
+        r config set active-expire-index no
+        for {set j 0} {$j < 100} {incr j} {
+            r psetex key:$j 1000 a
+        }
+        r set persistent a
+        assert_equal 0 [s used_memory_expire_index]
+        r config set active-expire-index yes
+        assert {[s used_memory_expire_index] > 0}
+        wait_for_condition 100 100 {
+            [r dbsize] == 1
+        } else {
+            fail "Keys not reclaimed by the active expire index"
+        }
+        r flushall
+        r config set active-expire-index no
+        assert_equal 0 [s used_memory_expire_index]
+        r exists persistent
+    } {0}
+
+    test {Active expire index doesn't spin on keys due in the current ms} {
+        # A key is expired only after its expire time: if the cycle does
+        # not stop at the keys due exactly now, it spins until its time
+        # limit, and the latency monitor logs it.
+        r flushdb
+        r config set active-expire-index yes
+        r config set latency-monitor-threshold 20
+        r latency reset
+        set now [r time]
+        set base [expr {[lindex $now 0]*1000+[lindex $now 1]/1000+1000}]
+        # One key every millisecond, so that every cycle finds a key that
+        # is due in the current millisecond.
+        for {set j 0} {$j < 2000} {incr j} {
+            r set key:$j a
+            r pexpireat key:$j [expr {$base+$j}]
+        }
+        wait_for_condition 100 100 {
+            [r dbsize] == 0
+        } else {
+            fail "Keys not reclaimed by the active expire index"
+        }
+        set events [r latency latest]
+        r config set latency-monitor-threshold 0
+        r config set active-expire-index no
+        foreach event $events {
+            assert {[lindex $event 0] ne {expire-cycle}}
+        }
+    }
 }
@@ -0,0 +1,124 @@
+start_server {tags {"io-threads"} overrides {io-threads 2 io-threads-do-reads yes}} {
+    # The I/O threads are only activated when enough clients have pending
+    # replies in the same event loop iteration: a PUBLISH to many
+    # subscribers is a reliable way to get there. Once activated, the
+    # following reads are served by the threads as well.
+    set subscribers {}
+    for {set j 0} {$j < 10} {incr j} {
+        set rd [redis_deferring_client]
+        $rd subscribe chan
+        $rd read
+        lappend subscribers $rd
+    }
+
+    proc activate_io_threads {subscribers} {
+        r publish chan hello
+        foreach rd $subscribers {
+            assert_equal {message chan hello} [$rd read]
+        }
+    }
+
+    test {I/O threads write the replies of many clients} {
+        activate_io_threads $subscribers
+        assert {[status r io_threaded_writes_processed] > 0}
+    }
+
+    test {I/O threads read client requests} {
+        # A timer event may stop the threads between the PUBLISH and the
+        # PING, so try a few times.
+        for {set j 0} {$j < 10} {incr j} {
+            activate_io_threads $subscribers
+            r ping
+            if {[status r io_threaded_reads_processed] > 0} break
+        }
+        assert {[status r io_threaded_reads_processed] > 0}
+    }
+
+    test {I/O threads read and parse pipelined commands in order} {
+        r del mylist
+        activate_io_threads $subscribers
+        set buf {}
+        for {set j 0} {$j < 1000} {incr j} {
+            append buf "RPUSH mylist $j\r\n"
+        }
+        append buf "LRANGE mylist 0 -1\r\n"
+        r write $buf
+        r flush
+        for {set j 0} {$j < 1000} {incr j} {
+            assert_equal [expr {$j+1}] [r read]
+        }
+        set expected {}
+        for {set j 0} {$j < 1000} {incr j} {lappend expected $j}
+        assert_equal $expected [r read]
+    }
+
+    test {Big arguments are read correctly by the I/O threads} {
+        set big [string repeat x 200000]
+        activate_io_threads $subscribers
+        r set bigkey $big
+        activate_io_threads $subscribers
+        assert_equal $big [r get bigkey]
+    }
+
+    test {Objects shared by replies written by the I/O threads stay valid} {
+        # Big replies are queued by reference to the object, that is shared
+        # with the keyspace or by all the subscribers of a PUBLISH.
+        set big [string repeat y 100000]
+        r set bigkey $big
+        set clients {}
+        for {set j 0} {$j < 10} {incr j} {
+            lappend clients [redis_deferring_client]
+        }
+        for {set i 0} {$i < 20} {incr i} {
+            foreach rd $clients {$rd get bigkey}
+            foreach rd $clients {assert_equal $big [$rd read]}
+            r publish chan $big
+            foreach rd $subscribers {
+                assert_equal [list message chan $big] [$rd read]
+            }
+        }
+        foreach rd $clients {$rd close}
+        assert_equal 1 [r object refcount bigkey]
+        assert_equal $big [r get bigkey]
+    }
+
+    test {Protocol errors are reported after the parsed commands} {
+        set rd [redis_deferring_client]
+        $rd ping
+        $rd read
+        activate_io_threads $subscribers
+        $rd write "SET errkey 1\r\nINCR errkey\r\n*3\r\n\$3\r\nSET\r\n\$1\r\nx\r\nfooz\r\n"
+        $rd flush
+        assert_equal OK [$rd read]
+        assert_equal 2 [$rd read]
+        assert_error "*expected '$', got 'f'*" {$rd read}
+        $rd close
+        assert_equal 2 [r get errkey]
+    }
+
+    test {Blocked clients resume the commands parsed by the I/O threads} {
+        set rd [redis_deferring_client]
+        $rd ping
+        $rd read
+        r del blist
+        activate_io_threads $subscribers
+        $rd write "BLPOP blist 0\r\nPING\r\n"
+        $rd flush
+        wait_for_condition 50 100 {
+            [s blocked_clients] eq 1
+        } else {
+            fail "Client never blocked"
+        }
+        r rpush blist a
+        assert_equal {blist a} [$rd read]
+        assert_equal PONG [$rd read]
+        $rd close
+    }
+
+    test {CONFIG GET io-threads} {
+        assert_equal {io-threads 2} [r config get io-threads]
+        assert_equal {io-threads-do-reads yes} [r config get io-threads-do-reads]
+    }
+
+    foreach rd $subscribers {$rd close}
+}
@@ -0,0 +1,128 @@
+start_server {tags {"lazyfree"}} {
+    test "UNLINK can reclaim memory in background" {
+        set orig_mem [s used_memory]
+        set args {}
+        for {set i 0} {$i < 100000} {incr i} {
+            lappend args $i
+        }
+        r sadd myset {*}$args
+        assert {[r scard myset] == 100000}
+        set peak_mem [s used_memory]
+        assert {[r unlink myset] == 1}
+        assert {$peak_mem > $orig_mem+1000000}
+        wait_for_condition 50 100 {
+            [s used_memory] < $peak_mem &&
+            [s used_memory] < $orig_mem*2 &&
+            [s lazyfree_pending_objects] == 0
+        } else {
+            fail "Memory is not reclaimed by UNLINK"
+        }
+    }
+
+    test "FLUSHDB ASYNC can reclaim memory in background" {
+        set orig_mem [s used_memory]
+        set args {}
+        for {set i 0} {$i < 100000} {incr i} {
+            lappend args $i
+        }
+        r sadd myset {*}$args
+        assert {[r scard myset] == 100000}
+        set peak_mem [s used_memory]
+        r flushdb async
+        assert {$peak_mem > $orig_mem+1000000}
+        assert {[r dbsize] == 0}
+        wait_for_condition 50 100 {
+            [s used_memory] < $peak_mem &&
+            [s used_memory] < $orig_mem*2 &&
+            [s lazyfree_pending_objects] == 0
+        } else {
+            fail "Memory is not reclaimed by FLUSHDB ASYNC"
+        }
+    }
+
+    test "UNLINK of a value whose elements are also in the slow log" {
+        # Without the ziplist encoding the arguments of ZADD are stored into
+        # the sorted set as they are.
+        r config set zset-max-ziplist-entries 0
+        r config set slowlog-log-slower-than 0
+        r slowlog reset
+        set args {}
+        for {set i 0} {$i < 200} {incr i} {
+            lappend args $i elem-$i
+        }
+        r zadd myzset {*}$args
+        r config set slowlog-log-slower-than 10000
+        r config set zset-max-ziplist-entries 128
+        assert {[r unlink myzset] == 1}
+        wait_for_condition 50 100 {
+            [s lazyfree_pending_objects] == 0
+        } else {
+            fail "Value is not reclaimed by UNLINK"
+        }
+        # The elements referenced by the slow log entry of ZADD are left to
+        # the main thread by the lazy free thread, and must still be valid.
+        set zadd {}
+        foreach entry [r slowlog get 128] {
+            if {[lindex $entry 3 0] eq {zadd}} {set zadd [lindex $entry 3]}
+        }
+        assert_equal {zadd myzset 0 elem-0 1 elem-1} [lrange $zadd 0 5]
+        r slowlog reset
+        assert_equal PONG [r ping]
+    }
+
+    test "FLUSHALL and FLUSHDB only accept the ASYNC option" {
+        assert_error "*syntax*" {r flushall sync}
+        assert_error "*syntax*" {r flushdb async async}
+    }
+
+    test "Overwritten values are lazily freed with lazyfree-lazy-server-del" {
+        r config set lazyfree-lazy-server-del yes
+        set orig_mem [s used_memory]
+        set args {}
+        for {set i 0} {$i < 100000} {incr i} {
+            lappend args $i
+        }
+        r sadd myset {*}$args
+        set peak_mem [s used_memory]
+        r set myset foo
+        assert_equal foo [r get myset]
+        wait_for_condition 50 100 {
+            [s used_memory] < $peak_mem &&
+            [s used_memory] < $orig_mem*2 &&
+            [s lazyfree_pending_objects] == 0
+        } else {
+            fail "Memory is not reclaimed on overwrite"
+        }
+        r config set lazyfree-lazy-server-del no
+    }
+
+    test "Lazy expire and lazy eviction remove big values" {
+        r config set lazyfree-lazy-expire yes
+        r flushall
+        r sadd myset {*}[lrange $args 0 999]
+        r pexpire myset 1
+        wait_for_condition 50 100 {
+            [r exists myset] == 0 && [s expired_keys] > 0
+        } else {
+            fail "Big value not expired"
+        }
+        r config set lazyfree-lazy-expire no
+
+        r config set lazyfree-lazy-eviction yes
+        r config set maxmemory-policy allkeys-random
+        for {set j 0} {$j < 10} {incr j} {
+            r sadd set$j {*}[lrange $args 0 999]
+        }
+        r config set maxmemory [expr {[s used_memory]-50000}]
+        r set foo bar
+        assert {[s evicted_keys] > 0}
+        wait_for_condition 50 100 {
+            [s lazyfree_pending_objects] == 0
+        } else {
+            fail "Evicted values are not reclaimed"
+        }
+        r config set maxmemory 0
+        r config set maxmemory-policy noeviction
+        r config set lazyfree-lazy-eviction no
+    }
+}
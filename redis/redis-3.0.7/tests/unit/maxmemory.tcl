@@ -18,13 +18,54 @@ start_server {tags {"maxmemory"}} {
         r set a 1
         r config set maxmemory-policy volatile-lru
         r set b 1
+        r config set maxmemory-policy allkeys-lfu
+        r set c 1
         assert {[r object refcount a] == 1}
         assert {[r object refcount b] == 1}
+        assert {[r object refcount c] == 1}
         r config set maxmemory 0
     }
 
+    test "OBJECT FREQ grows with accesses only with LFU policies" {
+        r config set maxmemory-policy allkeys-lfu
+        r set foo bar
+        set initial [r object freq foo]
+        for {set j 0} {$j < 100} {incr j} {r get foo}
+        assert {[r object freq foo] > $initial}
+        assert_error "*idle time not tracked*" {r object idletime foo}
+        r config set maxmemory-policy allkeys-lru
+        assert_error "*frequency not tracked*" {r object freq foo}
+        r config set maxmemory-policy noeviction
+    }
+
+    test "allkeys-lfu keeps frequently accessed keys under cold key scans" {
+        r flushall
+        r config set maxmemory-policy allkeys-lfu
+        r config set maxmemory-samples 10
+        # No decay: crossing a minute boundary would halve the hot counters.
+        r config set lfu-decay-time 0
+        for {set j 0} {$j < 20} {incr j} {
+            r set "hot:$j" [string repeat x 100]
+            for {set k 0} {$k < 50} {incr k} {r get "hot:$j"}
+        }
+        set used [s used_memory]
+        r config set maxmemory [expr {$used+200*1024}]
+        for {set j 0} {$j < 10000} {incr j} {
+            r set "cold:$j" [string repeat x 100]
+        }
+        assert {[s evicted_keys] > 0}
+        for {set j 0} {$j < 20} {incr j} {
+            assert {[r exists "hot:$j"]}
+        }
+        r config set maxmemory 0
+        r config set maxmemory-samples 5
+        r config set lfu-decay-time 1
+        r config set maxmemory-policy noeviction
+    }
+
     foreach policy {
-        allkeys-random allkeys-lru volatile-lru volatile-random volatile-ttl
+        allkeys-random allkeys-lru allkeys-lfu volatile-lru volatile-lfu
+        volatile-random volatile-ttl
     } {
         test "maxmemory - is the memory limit honoured? (policy $policy)" {
             # make sure to start with a blank instance
@@ -56,7 +97,8 @@ start_server {tags {"maxmemory"}} {
     }
 
     foreach policy {
-        allkeys-random allkeys-lru volatile-lru volatile-random volatile-ttl
+        allkeys-random allkeys-lru allkeys-lfu volatile-lru volatile-lfu
+        volatile-random volatile-ttl
     } {
         test "maxmemory - only allkeys-* should remove non-volatile keys ($policy)" {
             # make sure to start with a blank instance
@@ -98,7 +140,7 @@ start_server {tags {"maxmemory"}} {
     }
 
     foreach policy {
-        volatile-lru volatile-random volatile-ttl
+        volatile-lru volatile-lfu volatile-random volatile-ttl
     } {
         test "maxmemory - policy $policy should only remove volatile keys." {
             # make sure to start with a blank instance
@@ -35,3 +35,96 @@ start_server {tags {"memefficiency"}} {
         }
     }
 }
+
+start_server {tags {"defrag"}} {
+    if {[string match {*jemalloc*} [s mem_allocator]]} {
+        test "Active defrag" {
+            r config set activedefrag no
+            r config set active-defrag-threshold-lower 5
+            r config set active-defrag-ignore-bytes 2mb
+            r config set active-defrag-max-scan-fields 100
+            # Fill the memory, then delete half of the keys and of the
+            # elements of a few big aggregates, leaving sparse runs behind.
+            r eval {
+                for i=1,200000 do
+                    redis.call('set','key:'..i,string.rep('x',100))
+                    if i%3 == 0 then redis.call('expire','key:'..i,10000) end
+                end
+                for i=1,40000 do
+                    redis.call('hset','h'..(i%10),'f'..i,string.rep('y',60))
+                    redis.call('zadd','z'..(i%10),i,'m'..i..string.rep('z',40))
+                    redis.call('sadd','s'..(i%10),'e'..i..string.rep('w',30))
+                    redis.call('rpush','l'..(i%10),string.rep('v',50)..i)
+                end
+                for i=1,200000,2 do redis.call('del','key:'..i) end
+                for i=1,40000,4 do
+                    redis.call('hdel','h'..(i%10),'f'..i)
+                    redis.call('zrem','z'..(i%10),'m'..i..string.rep('z',40))
+                    redis.call('srem','s'..(i%10),'e'..i..string.rep('w',30))
+                end
+            } 0
+            set digest [r debug digest]
+            assert {[s allocator_frag_ratio] >= 1.4}
+
+            r config set activedefrag yes
+            # Wait for the scan to start, and then to complete.
+            wait_for_condition 50 100 {
+                [s active_defrag_running] ne 0
+            } else {
+                fail "active defrag didn't start"
+            }
+            wait_for_condition 150 100 {
+                [s active_defrag_running] eq 0 &&
+                [s allocator_frag_ratio] < 1.2
+            } else {
+                puts [r info memory]
+                fail "active defrag didn't lower the fragmentation"
+            }
+            r config set activedefrag no
+
+            assert {[s active_defrag_hits] > 0}
+            assert_equal $digest [r debug digest]
+            assert_equal 2 [r zscore z2 m2[string repeat z 40]]
+            assert_equal 2 [r zrank z2 m22[string repeat z 40]]
+        }
+
+        test "Active defrag releases the sparse slabs of skiplists" {
+            r flushall
+            r config set activedefrag no
+            # Nine elements out of ten are removed: every slab of skiplist
+            # nodes is left with few nodes, and can't be released.
+            r eval {
+                for i=1,100000 do
+                    redis.call('zadd','zsparse',i,'m'..i..string.rep('z',20))
+                end
+                for i=1,100000 do
+                    if i%10 ~= 0 then
+                        redis.call('zrem','zsparse',
+                                   'm'..i..string.rep('z',20))
+                    end
+                end
+            } 0
+            set digest [r debug digest]
+            set mem [s used_memory]
+            set hits [s active_defrag_hits]
+
+            # The slabs are not seen as fragmentation by the allocator: let
+            # the scan start anyway.
+            r config set active-defrag-threshold-lower 0
+            r config set active-defrag-ignore-bytes 1
+            r config set activedefrag yes
+            # The nodes use about 4MB, mostly in slabs that can be released.
+            wait_for_condition 150 100 {
+                [s used_memory] < $mem-2000000
+            } else {
+                puts [r info memory]
+                fail "active defrag didn't release the sparse slabs"
+            }
+            r config set activedefrag no
+            assert {[s active_defrag_hits] > $hits}
+            assert_equal $digest [r debug digest]
+            assert_equal 10000 [r zcard zsparse]
+            assert_equal 9 [r zrank zsparse m100[string repeat z 20]]
+        }
+    }
+}
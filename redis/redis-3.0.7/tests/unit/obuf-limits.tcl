@@ -70,4 +70,54 @@ start_server {tags {"obuf-limits"}} {
         assert {$omem >= 100000 && $time_elapsed < 6}
         $rd1 close
     }
+
+    test {Pipelined replies spanning many reply blocks are sent in order} {
+        r config set client-output-buffer-limit {normal 0 0 0}
+        r set big [string repeat x 100000]
+        r del list
+        for {set j 0} {$j < 1000} {incr j} {lappend elements e$j}
+        r rpush list {*}$elements
+        set rd1 [redis_deferring_client]
+        # Small replies filling the blocks, interleaved with replies bigger
+        # than a block, and more blocks than a single writev() can send.
+        for {set j 0} {$j < 100} {incr j} {
+            $rd1 ping
+            $rd1 get big
+            $rd1 lrange list 0 -1
+            $rd1 incr counter
+        }
+        for {set j 0} {$j < 100} {incr j} {
+            assert_equal PONG [$rd1 read]
+            assert_equal 100000 [string length [$rd1 read]]
+            assert_equal $elements [$rd1 read]
+            assert_equal [expr {$j+1}] [$rd1 read]
+        }
+        $rd1 close
+    }
+
+    test {Output buffer memory of a client not reading its replies} {
+        set rd1 [redis_deferring_client]
+        $rd1 client setname reader
+        $rd1 read
+        for {set j 0} {$j < 200} {incr j} {$rd1 get big}
+        $rd1 flush
+        set omem 0
+        wait_for_condition 50 100 {
+            [regexp {name=reader .*omem=([0-9]+)} [r client list] - omem] &&
+            $omem > 1000000
+        } else {
+            fail "Pending output not accounted in omem: $omem"
+        }
+        # The pending output is made of reply blocks holding the values.
+        assert {$omem <= 200*100000*2}
+        for {set j 0} {$j < 200} {incr j} {
+            assert_equal 100000 [string length [$rd1 read]]
+        }
+        wait_for_condition 50 100 {
+            [regexp {name=reader .*omem=0 } [r client list]]
+        } else {
+            fail "omem not back to zero once the replies are read"
+        }
+        $rd1 close
+    }
 }
@@ -227,6 +227,39 @@ start_server {tags {"other"}} {
         set _ $err
     } {}
 
+    test {APPEND and SETRANGE across the sds header sizes} {
+        # Crossing 32, 256 and 65536 bytes changes the sds header type, and
+        # the string must be the same after every conversion.
+        r del x
+        set buf {}
+        foreach len {31 32 255 256 65535 65536 70000} {
+            set bin [randstring [expr {$len-[string length $buf]}] \
+                                [expr {$len-[string length $buf]}] binary]
+            append buf $bin
+            assert_equal $len [r append x $bin]
+            assert_equal $len [r strlen x]
+            assert_equal $buf [r get x]
+        }
+        r del y
+        r setrange y 65535 a
+        assert_equal 65536 [r strlen y]
+        assert_equal "\x00a" [r getrange y 65534 -1]
+        r debug reload
+        assert_equal $buf [r get x]
+        assert_equal 65536 [r strlen y]
+    }
+
+    test {Strings up to 44 bytes use the embstr encoding} {
+        r set foo [string repeat x 44]
+        assert_encoding embstr foo
+        r set foo [string repeat x 45]
+        assert_encoding raw foo
+        r set foo [string repeat x 44]
+        r append foo y
+        assert_encoding raw foo
+        r get foo
+    } [string repeat x 44]y
+
     # Leave the user with a clean DB before to exit
     test {FLUSHDB} {
         set aux {}
@@ -115,3 +115,90 @@ start_server {tags {"regression"}} {
         $rd read
     }
 }
+
+start_server {tags {"pipelining"}} {
+    test "Pipelined commands see the effects of the previous ones" {
+        set rd [redis_deferring_client]
+        $rd write "SELECT 10\r\nSET foo bar\r\nGET foo\r\nSELECT 9\r\n"
+        $rd write "EXISTS foo\r\nDEL foo\r\nSET foo 1\r\nINCR foo\r\nGET foo\r\n"
+        $rd flush
+        set res {}
+        for {set j 0} {$j < 9} {incr j} {lappend res [$rd read]}
+        $rd close
+        r select 10
+        lappend res [r get foo]
+        r select 9
+        set res
+    } {OK OK bar OK 0 0 OK 2 2 bar}
+
+    test "Protocol errors are replied to after the pipelined commands" {
+        set rd [redis_deferring_client]
+        $rd write "SET errkey 1\r\nINCR errkey\r\n*1\r\nfoo\r\n"
+        $rd flush
+        assert_equal OK [$rd read]
+        assert_equal 2 [$rd read]
+        assert_error "*expected '$', got 'f'*" {$rd read}
+        $rd close
+        r get errkey
+    } {2}
+
+    test "Pipelined transactions and blocking commands keep their order" {
+        r del c l
+        set rd [redis_deferring_client]
+        $rd write "MULTI\r\nINCR c\r\nINCR c\r\nEXEC\r\nRPUSH l a\r\n"
+        $rd write "BLPOP l 0\r\nBLPOP l 0\r\nGET c\r\n"
+        $rd flush
+        set res {}
+        for {set j 0} {$j < 6} {incr j} {lappend res [$rd read]}
+        wait_for_condition 50 100 {
+            [s blocked_clients] == 1
+        } else {
+            fail "The pipelined BLPOP did not block"
+        }
+        r rpush l b
+        lappend res [$rd read] [$rd read]
+        $rd close
+        set res
+    } {OK QUEUED QUEUED {1 2} 1 {l a} {l b} 2}
+
+    test "Multi-key commands on keys that are expired or missing" {
+        r flushdb
+        set keys {}
+        for {set j 0} {$j < 100} {incr j} {
+            lappend keys key:$j
+            if {$j % 2} {
+                r set key:$j $j
+            } else {
+                r psetex key:$j 1 $j
+            }
+        }
+        after 10
+        set values [r mget {*}$keys missing]
+        assert_equal 101 [llength $values]
+        for {set j 0} {$j < 100} {incr j} {
+            assert_equal [expr {$j % 2 ? $j : {}}] [lindex $values $j]
+        }
+        assert_equal 50 [r exists {*}$keys missing]
+        assert_equal 50 [r del {*}$keys missing]
+        r dbsize
+    } {0}
+
+    test "HMGET on a big hash after pipelined writes" {
+        r config set hash-max-ziplist-entries 0
+        set rd [redis_deferring_client]
+        set fields {}
+        for {set j 0} {$j < 100} {incr j} {
+            $rd write "HSET h f$j $j\r\n"
+            lappend fields f$j
+        }
+        $rd flush
+        for {set j 0} {$j < 100} {incr j} {$rd read}
+        $rd close
+        r config set hash-max-ziplist-entries 512
+        assert_encoding hashtable h
+        set expected {}
+        for {set j 0} {$j < 100} {incr j} {lappend expected $j}
+        lappend expected {}
+        assert_equal $expected [r hmget h {*}$fields nofield]
+    }
+}
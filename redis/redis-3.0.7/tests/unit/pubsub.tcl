@@ -196,6 +196,43 @@ start_server {tags {"pubsub"}} {
         $rd1 close
     }
 
+    test "PUBLISH/PSUBSCRIBE with patterns sharing a literal prefix" {
+        set rd1 [redis_deferring_client]
+        set rd2 [redis_deferring_client]
+        set patterns {news.* news.art.* news.arts news* *.art.* n?ws.* news\\*}
+        psubscribe $rd1 $patterns
+        psubscribe $rd2 {news.art.*}
+        assert_equal 8 [r pubsub numpat]
+
+        assert_equal 6 [r publish news.art.1 hello]
+        set received {}
+        for {set i 0} {$i < 5} {incr i} {
+            lappend received [lindex [$rd1 read] 1]
+        }
+        assert_equal [lsort {news.* news.art.* news* *.art.* n?ws.*}] \
+                     [lsort $received]
+        assert_equal {pmessage news.art.* news.art.1 hello} [$rd2 read]
+        assert_equal 2 [r publish news* hello]
+        assert_equal [lsort {news* news\\*}] \
+                     [lsort [list [lindex [$rd1 read] 1] [lindex [$rd1 read] 1]]]
+        assert_equal 0 [r publish new hello]
+        assert_equal 0 [r publish other hello]
+
+        # Removing patterns must leave the remaining ones reachable.
+        punsubscribe $rd1 {news.* news.art.* n?ws.*}
+        assert_equal 5 [r pubsub numpat]
+        assert_equal 3 [r publish news.art.2 hello]
+        assert_equal 2 [r publish news.arts hello]
+        punsubscribe $rd1
+        punsubscribe $rd2
+        assert_equal 0 [r pubsub numpat]
+        assert_equal 0 [r publish news.art.3 hello]
+
+        # clean up clients
+        $rd1 close
+        $rd2 close
+    }
+
     test "NUMSUB returns numbers, not strings (#1561)" {
         r pubsub numsub abc def
     } {abc 0 def 0}
@@ -53,10 +53,222 @@ start_server {tags {"scan"}} {
         assert_equal 100 [llength $keys]
     }
 
-    foreach enc {intset hashtable} {
+    proc scan_all {args} {
+        set cur 0
+        set keys {}
+        while 1 {
+            set res [r scan $cur {*}$args]
+            set cur [lindex $res 0]
+            lappend keys {*}[lindex $res 1]
+            if {$cur == 0} break
+        }
+        lsort -unique $keys
+    }
+
+    proc populate_types {} {
+        r flushdb
+        for {set j 0} {$j < 200} {incr j} {
+            r set "t:str:$j" $j
+            r rpush "t:list:$j" $j
+            r sadd "t:set:$j" $j
+            r zadd "t:zset:$j" $j $j
+            r hset "t:hash:$j" $j $j
+            r set "other:$j" $j
+        }
+    }
+
+    foreach idx {no yes} {
+        r config set key-index $idx
+
+        test "SCAN TYPE (key-index $idx)" {
+            populate_types
+            set keys [scan_all type list count 7]
+            assert_equal 200 [llength $keys]
+            foreach k $keys {assert_equal list [r type $k]}
+            assert_equal 400 [llength [scan_all type string]]
+            assert_equal 200 [llength [scan_all match t:* type string]]
+        }
+
+        test "SCAN MATCH with literal prefix (key-index $idx)" {
+            populate_types
+            assert_equal 1000 [llength [scan_all match t:* count 3]]
+            set keys [scan_all match t:h*:1? count 3]
+            assert_equal [lsort [r keys t:h*:1?]] $keys
+            assert_equal 10 [llength $keys]
+            assert_equal {} [scan_all match nokey:*]
+        }
+
+        test "KEYS with literal prefix (key-index $idx)" {
+            populate_types
+            assert_equal 1000 [llength [r keys t:*]]
+            assert_equal {t:set:10 t:str:10} [lsort [r keys t:s*:10]]
+        }
+    }
+
+    test "SCAN unknown TYPE" {
+        catch {r scan 0 type foo} e
+        set e
+    } {ERR*unknown type*}
+
+    # Like scan_all, but fails if the iteration doesn't terminate, and checks
+    # that no call returns more than COUNT keys if 'exact' is true.
+    proc scan_index {exact count args} {
+        set cur 0
+        set keys {}
+        for {set calls 0} {$calls < 10000} {incr calls} {
+            set res [r scan $cur count $count {*}$args]
+            set cur [lindex $res 0]
+            if {$exact} {assert {[llength [lindex $res 1]] <= $count}}
+            lappend keys {*}[lindex $res 1]
+            if {$cur == 0} {return $keys}
+        }
+        fail "SCAN $args doesn't terminate"
+    }
+
+    test "SCAN with key-index terminates with COUNT smaller than the range" {
+        r config set key-index yes
+        populate_types
+        foreach count {1 3 7} {
+            assert_equal 200 [llength [lsort -unique \
+                [scan_index 0 $count type list]]]
+            assert_equal 1000 [llength [lsort -unique \
+                [scan_index 0 $count match t:*]]]
+            assert_equal 200 [llength [lsort -unique \
+                [scan_index 0 $count match t:s* type set]]]
+        }
+    }
+
+    test "SCAN with key-index returns at most COUNT keys" {
+        r flushdb
+        for {set j 0} {$j < 500} {incr j} {
+            r set "user:$j" $j
+            r rpush "user:l$j" $j
+        }
+        foreach count {1 3 10} {
+            set keys [scan_index 1 $count match user:*]
+            assert_equal 1000 [llength $keys]
+            assert_equal 1000 [llength [lsort -unique $keys]]
+            assert_equal 500 [llength [scan_index 1 $count match user:* type list]]
+        }
+    }
+
+    test "SCAN with key-index and many keys sharing a long prefix" {
+        r flushdb
+        set prefix "p:[string repeat a 30]"
+        for {set j 0} {$j < 300} {incr j} {
+            r set "$prefix:$j" $j
+            r rpush "$prefix:list:$j" $j
+        }
+        foreach opts [list {match p:*} {match p:* type list} {type string}] {
+            set keys [lsort -unique [scan_index 0 7 {*}$opts]]
+            set expected [expr {[dict exists $opts type] ? 300 : 600}]
+            assert_equal $expected [llength $keys]
+        }
+    }
+
+    test "SCAN with key-index and NUL bytes after the prefix" {
+        r flushdb
+        set names {n: n:\x00 n:\x00\x00 n:\x00\x00\x00\x00\x00\x00\x00\x00a}
+        lappend names n:\x00\x01 n:\x00a n:a\x00 n:a
+        for {set j 0} {$j < 50} {incr j} {
+            lappend names "n:\x00\x00\x00\x00\x00$j"
+        }
+        foreach name $names {r set $name 1}
+        foreach count {1 2 5} {
+            assert_equal [lsort $names] [lsort [scan_index 1 $count match n:*]]
+        }
+    }
+
+    test "SCAN with key-index guarantees while many keys are deleted" {
+        foreach prefix [list d "d[string repeat x 20]"] {
+            r flushdb
+            for {set j 0} {$j < 1000} {incr j} {
+                r set "$prefix:$j" $j
+                r set "$prefix:$j-tmp" $j
+            }
+            set res [r scan 0 match d* count 10]
+            set cur [lindex $res 0]
+            set keys [lindex $res 1]
+            # Delete all the keys that don't have to be returned, before and
+            # after the cursor, and add new ones.
+            for {set j 0} {$j < 1000} {incr j} {
+                r del "$prefix:$j-tmp"
+                r set "$prefix:$j-new" $j
+            }
+            while {$cur != 0} {
+                set res [r scan $cur match d* count 10]
+                set cur [lindex $res 0]
+                lappend keys {*}[lindex $res 1]
+            }
+            set keys [lsort -unique $keys]
+            for {set j 0} {$j < 1000} {incr j} {
+                assert {[lsearch -exact -sorted $keys "$prefix:$j"] != -1}
+            }
+        }
+    }
+
+    test "SCAN with key-index guarantees while keys are added and deleted" {
+        r flushdb
+        for {set j 0} {$j < 1000} {incr j} {
+            r set "stay:$j" $j
+            r set "stay:$j-tmp" $j
+        }
+        set cur 0
+        set keys {}
+        set step 0
+        while 1 {
+            set res [r scan $cur match stay:* count 10]
+            set cur [lindex $res 0]
+            lappend keys {*}[lindex $res 1]
+            # Delete and add keys both before and after the cursor, so that
+            # the position of the cursor in the index moves.
+            r del "stay:[expr {$step*7%1000}]-tmp" "stay:[expr {999-$step}]-tmp"
+            r set "stay:$step-new" 1
+            r set "stay:[expr {999-$step}]-new" 1
+            incr step
+            if {$cur == 0} break
+        }
+        set keys [lsort -unique $keys]
+        for {set j 0} {$j < 1000} {incr j} {
+            assert {[lsearch -exact -sorted $keys "stay:$j"] != -1}
+        }
+    }
+
+    test "Key index follows overwrites, renames and expires" {
+        r flushdb
+        r rpush k1 a
+        r set k1 v
+        assert_equal {} [scan_all match k* type list]
+        assert_equal {k1} [scan_all match k* type string]
+        r rename k1 k2
+        assert_equal {k2} [scan_all match k* type string]
+        r pexpire k2 1
+        after 10
+        assert_equal {} [scan_all match k*]
+        r sadd k3 a
+        r debug reload
+        assert_equal {k3} [scan_all match k* type set]
+    }
+
+    test "Key index memory is reported in INFO" {
+        r flushdb
+        set empty [s used_memory_key_index]
+        r debug populate 1000
+        assert {[s used_memory_key_index] > $empty+1000*16}
+        r config set key-index no
+        assert_equal 0 [s used_memory_key_index]
+        r config set key-index yes
+        assert {[s used_memory_key_index] > $empty+1000*16}
+        r flushall async
+        assert_equal $empty [s used_memory_key_index]
+        r config set key-index no
+    }
+
+    foreach enc {intset hashtable ctable} {
         test "SSCAN with encoding $enc" {
             # Create the Set
             r del set
+            r config set set-max-ctable-entries [expr {$enc eq {ctable} ? 1000 : 0}]
             if {$enc eq {intset}} {
                 set prefix ""
             } else {
@@ -86,11 +298,13 @@ start_server {tags {"scan"}} {
             assert_equal 100 [llength $keys]
         }
     }
+    r config set set-max-ctable-entries 0
 
-    foreach enc {ziplist hashtable} {
+    foreach enc {ziplist hashtable ctable} {
         test "HSCAN with encoding $enc" {
             # Create the Hash
             r del hash
+            r config set hash-max-ctable-entries [expr {$enc eq {ctable} ? 2000 : 0}]
             if {$enc eq {ziplist}} {
                 set count 30
             } else {
@@ -126,6 +340,7 @@ start_server {tags {"scan"}} {
             assert_equal $count [llength $keys2]
         }
     }
+    r config set hash-max-ctable-entries 0
 
     foreach enc {ziplist skiplist} {
         test "ZSCAN with encoding $enc" {
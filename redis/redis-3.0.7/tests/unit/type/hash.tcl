@@ -467,4 +467,75 @@ start_server {tags {"hash"}} {
             assert {[r object encoding myhash] eq {hashtable}}
         }
     }
+
+    test {Hash ziplist -> ctable -> hashtable encoding conversion} {
+        r config set hash-max-ziplist-entries 32
+        r config set hash-max-ctable-entries 128
+        r del myhash
+        catch {unset hash}
+        array set hash {}
+        for {set i 0} {$i < 200} {incr i} {
+            r hset myhash field:$i $i
+            set hash(field:$i) $i
+            if {$i == 100} {
+                assert_encoding ctable myhash
+                assert_equal [lsort [array get hash]] [lsort [r hgetall myhash]]
+            }
+        }
+        assert_encoding hashtable myhash
+        assert_equal [lsort [array get hash]] [lsort [r hgetall myhash]]
+    }
+
+    test {Hash fuzzing - ctable encoding} {
+        r config set hash-max-ctable-entries 2048
+        for {set times 0} {$times < 10} {incr times} {
+            catch {unset hash}
+            array set hash {}
+            r del myhash
+            for {set j 0} {$j < 1000} {incr j} {
+                randpath {
+                    set field [randomValue]
+                    set value [randomValue]
+                    r hset myhash $field $value
+                    set hash($field) $value
+                } {
+                    set field [randomSignedInt 256]
+                    set value [randomSignedInt 256]
+                    r hset myhash $field $value
+                    set hash($field) $value
+                } {
+                    set field [randomSignedInt 256]
+                    set incr [randomSignedInt 256]
+                    if {[catch {r hincrby myhash $field $incr} value]} {
+                        set value $hash($field)
+                    }
+                    set hash($field) $value
+                } {
+                    randpath {
+                        set field [randomValue]
+                    } {
+                        set field [randomSignedInt 256]
+                    }
+                    r hdel myhash $field
+                    unset -nocomplain hash($field)
+                }
+            }
+            if {[array size hash] > 32} {
+                assert_encoding ctable myhash
+            }
+
+            # Verify, also after the hash was saved and loaded back.
+            foreach {k v} [array get hash] {
+                assert_equal $v [r hget myhash $k]
+            }
+            assert_equal [array size hash] [r hlen myhash]
+            r debug reload
+            if {[array size hash] > 32} {
+                assert_encoding ctable myhash
+            }
+            assert_equal [lsort [array get hash]] [lsort [r hgetall myhash]]
+        }
+    }
+
+    r config set hash-max-ctable-entries 0
 }
@@ -1,8 +1,7 @@
 start_server {
     tags {list ziplist}
     overrides {
-        "list-max-ziplist-value" 200000
-        "list-max-ziplist-entries" 256
+        "list-max-ziplist-size" 16
     }
 } {
     test {Explicit regression for a list bug} {
@@ -76,4 +75,71 @@ start_server {
             }
         }
     }
+
+    test {Quicklist: interior nodes are compressed} {
+        r config set list-compress-depth 1
+        r del l
+        for {set i 0} {$i < 100} {incr i} {
+            r rpush l [string repeat "compressible$i" 10]
+        }
+        set info [r debug object l]
+        assert_match {*encoding:quicklist*} $info
+        regexp {ql_nodes:(\d+)} $info -> nodes
+        regexp {ql_compressed_nodes:(\d+)} $info -> compressed
+        # All the nodes but the head and the tail are compressed
+        assert_equal [expr {$nodes-2}] $compressed
+        regexp {ql_uncompressed_size:(\d+)} $info -> rawsize
+        regexp {ql_compressed_size:(\d+)} $info -> zipsize
+        assert {$zipsize < $rawsize}
+        r config set list-compress-depth 0
+    }
+
+    foreach depth {0 1 2} {
+        test "Quicklist: random operations with compress depth $depth" {
+            r config set list-compress-depth $depth
+            r del l
+            set l {}
+            for {set j 0} {$j < 2000} {incr j} {
+                set v [string repeat "v[randomInt 10]" [randomInt 10]]
+                randpath {
+                    r rpush l $v
+                    lappend l $v
+                } {
+                    r lpush l $v
+                    set l [linsert $l 0 $v]
+                } {
+                    if {[llength $l]} {
+                        assert_equal [lindex $l end] [r rpop l]
+                        set l [lrange $l 0 end-1]
+                    }
+                } {
+                    set idx [randomInt [expr {[llength $l]+1}]]
+                    if {[llength $l]} {
+                        set pivot [lindex $l $idx]
+                        if {$pivot ne {}} {
+                            r linsert l before $pivot $v
+                            set l [linsert $l [lsearch -exact $l $pivot] $v]
+                        }
+                    }
+                } {
+                    if {[llength $l]} {
+                        set idx [randomInt [llength $l]]
+                        r lset l $idx $v
+                        lset l $idx $v
+                    }
+                } {
+                    if {[llength $l]} {
+                        set e [lindex $l [randomInt [llength $l]]]
+                        r lrem l 1 $e
+                        set pos [lsearch -exact $l $e]
+                        set l [lreplace $l $pos $pos]
+                    }
+                }
+            }
+            assert_equal $l [r lrange l 0 -1]
+            r debug reload
+            assert_equal $l [r lrange l 0 -1]
+            r config set list-compress-depth 0
+        }
+    }
 }
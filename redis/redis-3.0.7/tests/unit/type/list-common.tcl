@@ -1,5 +1,6 @@
-# We need a value larger than list-max-ziplist-value to make sure
-# the list has the right encoding when it is swapped in again.
+# Small and large values used to exercise the list commands. Both end up
+# in a quicklist: the large one is only used to make sure values that can't
+# be stored as integers and span more bytes are handled across nodes.
 array set largevalue {}
 set largevalue(ziplist) "hello"
 set largevalue(linkedlist) [string repeat "hello" 4]
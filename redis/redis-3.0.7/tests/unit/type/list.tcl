@@ -1,8 +1,7 @@
 start_server {
     tags {"list"}
     overrides {
-        "list-max-ziplist-value" 16
-        "list-max-ziplist-entries" 256
+        "list-max-ziplist-size" 5
     }
 } {
     source "tests/unit/type/list-common.tcl"
@@ -19,7 +18,7 @@ start_server {
         assert_equal {} [r lindex myziplist2 3]
         assert_equal c [r rpop myziplist1]
         assert_equal a [r lpop myziplist1]
-        assert_encoding ziplist myziplist1
+        assert_encoding quicklist myziplist1
 
         # first rpush then lpush
         assert_equal 1 [r rpush myziplist2 a]
@@ -32,13 +31,13 @@ start_server {
         assert_equal {} [r lindex myziplist2 3]
         assert_equal a [r rpop myziplist2]
         assert_equal c [r lpop myziplist2]
-        assert_encoding ziplist myziplist2
+        assert_encoding quicklist myziplist2
     }
 
     test {LPUSH, RPUSH, LLENGTH, LINDEX, LPOP - regular list} {
         # first lpush then rpush
         assert_equal 1 [r lpush mylist1 $largevalue(linkedlist)]
-        assert_encoding linkedlist mylist1
+        assert_encoding quicklist mylist1
         assert_equal 2 [r rpush mylist1 b]
         assert_equal 3 [r rpush mylist1 c]
         assert_equal 3 [r llen mylist1]
@@ -51,7 +50,7 @@ start_server {
 
         # first rpush then lpush
         assert_equal 1 [r rpush mylist2 $largevalue(linkedlist)]
-        assert_encoding linkedlist mylist2
+        assert_encoding quicklist mylist2
         assert_equal 2 [r lpush mylist2 b]
         assert_equal 3 [r lpush mylist2 c]
         assert_equal 3 [r llen mylist2]
@@ -89,13 +88,13 @@ start_server {
     proc create_ziplist {key entries} {
         r del $key
         foreach entry $entries { r rpush $key $entry }
-        assert_encoding ziplist $key
+        assert_encoding quicklist $key
     }
 
     proc create_linkedlist {key entries} {
         r del $key
         foreach entry $entries { r rpush $key $entry }
-        assert_encoding linkedlist $key
+        assert_encoding quicklist $key
     }
 
     foreach {type large} [array get largevalue] {
@@ -547,52 +546,43 @@ start_server {
         set e
     } {*ERR*syntax*error*}
 
-    test {LPUSHX, RPUSHX convert from ziplist to list} {
+    test {LPUSHX, RPUSHX with large values and across nodes} {
         set large $largevalue(linkedlist)
 
-        # convert when a large value is pushed
         create_ziplist xlist a
         assert_equal 2 [r rpushx xlist $large]
-        assert_encoding linkedlist xlist
-        create_ziplist xlist a
-        assert_equal 2 [r lpushx xlist $large]
-        assert_encoding linkedlist xlist
+        assert_equal 3 [r lpushx xlist $large]
+        assert_equal "$large a $large" [r lrange xlist 0 -1]
 
-        # convert when the length threshold is exceeded
-        create_ziplist xlist [lrepeat 256 a]
-        assert_equal 257 [r rpushx xlist b]
-        assert_encoding linkedlist xlist
-        create_ziplist xlist [lrepeat 256 a]
-        assert_equal 257 [r lpushx xlist b]
-        assert_encoding linkedlist xlist
+        # Lists longer than list-max-ziplist-size span multiple nodes
+        create_ziplist xlist [lrepeat 5 a]
+        assert_equal 6 [r rpushx xlist b]
+        assert_equal 7 [r lpushx xlist c]
+        assert_equal "c a a a a a b" [r lrange xlist 0 -1]
+        assert_encoding quicklist xlist
     }
 
-    test {LINSERT convert from ziplist to list} {
+    test {LINSERT with large values and across nodes} {
         set large $largevalue(linkedlist)
 
-        # convert when a large value is inserted
         create_ziplist xlist a
         assert_equal 2 [r linsert xlist before a $large]
-        assert_encoding linkedlist xlist
-        create_ziplist xlist a
-        assert_equal 2 [r linsert xlist after a $large]
-        assert_encoding linkedlist xlist
-
-        # convert when the length threshold is exceeded
-        create_ziplist xlist [lrepeat 256 a]
-        assert_equal 257 [r linsert xlist before a a]
-        assert_encoding linkedlist xlist
-        create_ziplist xlist [lrepeat 256 a]
-        assert_equal 257 [r linsert xlist after a a]
-        assert_encoding linkedlist xlist
-
-        # don't convert when the value could not be inserted
-        create_ziplist xlist [lrepeat 256 a]
+        assert_equal 3 [r linsert xlist after a $large]
+        assert_equal "$large a $large" [r lrange xlist 0 -1]
+
+        # Insert in the middle of full nodes, forcing a split
+        create_ziplist xlist {a b c d e f g h i j}
+        assert_equal 11 [r linsert xlist before c x]
+        assert_equal 12 [r linsert xlist after e y]
+        assert_equal 13 [r linsert xlist after j z]
+        assert_equal 14 [r linsert xlist before a w]
+        assert_equal {w a b x c d e y f g h i j z} [r lrange xlist 0 -1]
+        assert_encoding quicklist xlist
+
+        # The list is not touched when the pivot is not found
         assert_equal -1 [r linsert xlist before foo a]
-        assert_encoding ziplist xlist
-        create_ziplist xlist [lrepeat 256 a]
         assert_equal -1 [r linsert xlist after foo a]
-        assert_encoding ziplist xlist
+        assert_equal 14 [r llen xlist]
     }
 
     foreach {type num} {ziplist 250 linkedlist 500} {
@@ -618,18 +608,18 @@ start_server {
             for {set i 0} {$i < $num} {incr i} {
                 r rpush mylist $i
             }
-            assert_encoding $type mylist
+            assert_encoding quicklist mylist
             check_numbered_list_consistency mylist
         }
 
         test "LINDEX random access - $type" {
-            assert_encoding $type mylist
+            assert_encoding quicklist mylist
             check_random_access_consistency mylist
         }
 
         test "Check if list is still ok after a DEBUG RELOAD - $type" {
             r debug reload
-            assert_encoding $type mylist
+            assert_encoding quicklist mylist
             check_numbered_list_consistency mylist
             check_random_access_consistency mylist
         }
@@ -669,7 +659,7 @@ start_server {
             assert_equal c [r rpoplpush mylist1 mylist2]
             assert_equal "a $large" [r lrange mylist1 0 -1]
             assert_equal "c d" [r lrange mylist2 0 -1]
-            assert_encoding ziplist mylist2
+            assert_encoding quicklist mylist2
         }
 
         test "RPOPLPUSH with the same list as src and dst - $type" {
@@ -688,11 +678,7 @@ start_server {
                 assert_equal "a b" [r lrange srclist 0 -1]
                 assert_equal "c $large $otherlarge" [r lrange dstlist 0 -1]
 
-                # When we rpoplpush'ed a large value, dstlist should be
-                # converted to the same encoding as srclist.
-                if {$type eq "linkedlist"} {
-                    assert_encoding linkedlist dstlist
-                }
+                assert_encoding quicklist dstlist
             }
         }
     }
@@ -753,7 +739,7 @@ start_server {
                 r lpush mylist $i
                 incr sum1 $i
             }
-            assert_encoding $type mylist
+            assert_encoding quicklist mylist
             set sum2 0
             for {set i 0} {$i < [expr $num/2]} {incr i} {
                 incr sum2 [r lpop mylist]
@@ -111,7 +111,8 @@ start_server {
         r srem myset 1 2 3 4 5 6 7 8
     } {3}
 
-    foreach {type} {hashtable intset} {
+    foreach {type} {hashtable intset ctable} {
+        r config set set-max-ctable-entries [expr {$type eq {ctable} ? 512 : 0}]
         for {set i 1} {$i <= 5} {incr i} {
             r del [format "set%d" $i]
         }
@@ -132,7 +133,7 @@ start_server {
         # while the tests are running -- an extra element is added to every
         # set that determines its encoding.
         set large 200
-        if {$type eq "hashtable"} {
+        if {$type ne "intset"} {
             set large foo
         }
 
@@ -206,6 +207,7 @@ start_server {
             assert_equal {1 2 3 4} [lsort [r smembers setres]]
         }
     }
+    r config set set-max-ctable-entries 0
 
     test "SDIFF with first set empty" {
         r del set1 set2 set3
@@ -246,6 +248,79 @@ start_server {
         }
     }
 
+    test "SINTER, SUNION, SDIFF of intsets fuzzing" {
+        for {set j 0} {$j < 100} {incr j} {
+            unset -nocomplain s
+            array set s {}
+            set args {}
+            set num_sets [expr {[randomInt 6]+2}]
+            for {set i 0} {$i < $num_sets} {incr i} {
+                # Mix sets of different encodings and densities.
+                set range [lindex {100 1000 100000 10000000000} [randomInt 4]]
+                set offset [expr {$range > 100000 ? -$range/2 : 0}]
+                r del set_$i
+                lappend args set_$i
+                set elements {}
+                for {set n [randomInt 300]} {$n > 0} {incr n -1} {
+                    lappend elements [expr {[randomInt $range]+$offset}]
+                }
+                if {[llength $elements]} {r sadd set_$i {*}$elements}
+                set s($i) [lsort -unique -integer $elements]
+            }
+
+            set inter $s(0)
+            set union $s(0)
+            set diff $s(0)
+            for {set i 1} {$i < $num_sets} {incr i} {
+                set res {}
+                foreach e $inter {
+                    if {[lsearch -sorted -integer $s($i) $e] != -1} {lappend res $e}
+                }
+                set inter $res
+                set union [lsort -unique -integer [concat $union $s($i)]]
+                set res {}
+                foreach e $diff {
+                    if {[lsearch -sorted -integer $s($i) $e] == -1} {lappend res $e}
+                }
+                set diff $res
+            }
+
+            # Intsets are returned sorted, while big unions are converted.
+            assert_equal $inter [r sinter {*}$args]
+            assert_equal $union [lsort -integer [r sunion {*}$args]]
+            assert_equal $diff [r sdiff {*}$args]
+            assert_equal [llength $inter] [r sinterstore setres {*}$args]
+            assert_equal $inter [lsort -integer [r smembers setres]]
+            assert_equal [llength $union] [r sunionstore setres {*}$args]
+            assert_equal $union [lsort -integer [r smembers setres]]
+            if {[llength $union] > 512} {
+                assert_encoding hashtable setres
+            } elseif {[llength $union]} {
+                assert_encoding intset setres
+            }
+            assert_equal [llength $diff] [r sdiffstore setres {*}$args]
+            assert_equal $diff [lsort -integer [r smembers setres]]
+            assert_equal {} [r sinter {*}$args nokey_1]
+            assert_equal $union [lsort -integer [r sunion nokey_1 {*}$args]]
+            assert_equal {} [r sdiff nokey_1 {*}$args]
+        }
+    }
+
+    test "SINTERSTORE of intsets uses the smallest encoding" {
+        r del set1 set2 setres setref
+        r sadd set1 1 2 3 5000000000
+        r sadd set2 2 3 4
+        r sadd setref 2 3
+        r sinterstore setres set1 set2
+        assert_encoding intset setres
+        assert_equal [r dump setref] [r dump setres]
+        r srem set1 5000000000
+        r sunionstore setres set1 set2
+        r sadd setref 1 4
+        assert_equal [r dump setref] [r dump setres]
+        lsort [r smembers setres]
+    } {1 2 3 4}
+
     test "SINTER against non-set should throw error" {
         r set key1 x
         assert_error "WRONGTYPE*" {r sinter key1 noset}
@@ -285,7 +360,8 @@ start_server {
         assert_equal 0 [r exists setres]
     }
 
-    foreach {type contents} {hashtable {a b c} intset {1 2 3}} {
+    foreach {type contents} {hashtable {a b c} intset {1 2 3} ctable {a b c}} {
+        r config set set-max-ctable-entries [expr {$type eq {ctable} ? 512 : 0}]
         test "SPOP basics - $type" {
             create_set myset $contents
             assert_encoding $type myset
@@ -303,6 +379,7 @@ start_server {
             assert_equal $contents [lsort [array names myset]]
         }
     }
+    r config set set-max-ctable-entries 0
 
     test "SRANDMEMBER with <count> against non existing key" {
         r srandmember nonexisting_key 100
@@ -324,9 +401,20 @@ start_server {
             30 31 32 33 34 35 36 37 38 39
             40 41 42 43 44 45 46 47 48 49
         }
+        ctable {
+            1 5 10 50 125 50000 33959417 4775547 65434162
+            12098459 427716 483706 2726473884 72615637475
+            MARY PATRICIA LINDA BARBARA ELIZABETH JENNIFER MARIA
+            SUSAN MARGARET DOROTHY LISA NANCY KAREN BETTY HELEN
+            SANDRA DONNA CAROL RUTH SHARON MICHELLE LAURA SARAH
+            KIMBERLY DEBORAH JESSICA SHIRLEY CYNTHIA ANGELA MELISSA
+            BRENDA AMY ANNA REBECCA VIRGINIA KATHLEEN
+        }
     } {
+        r config set set-max-ctable-entries [expr {$type eq {ctable} ? 512 : 0}]
         test "SRANDMEMBER with <count> - $type" {
             create_set myset $contents
+            assert_encoding $type myset
             unset -nocomplain myset
             array set myset {}
             foreach ele [r smembers myset] {
@@ -415,6 +503,7 @@ start_server {
             }
         }
     }
+    r config set set-max-ctable-entries 0
 
     proc setup_move {} {
         r del myset3 myset4
@@ -494,6 +583,71 @@ start_server {
         lsort [r smembers set]
     } {a b c}
 
+    test "Set intset -> ctable -> hashtable encoding conversion" {
+        r config set set-max-ctable-entries 256
+        r del myset
+        r sadd myset 1 2 3
+        assert_encoding intset myset
+        r sadd myset a
+        assert_encoding ctable myset
+        for {set i 0} {$i < 300} {incr i} {
+            r sadd myset ele:$i
+        }
+        assert_encoding hashtable myset
+        assert_equal 304 [r scard myset]
+        r config set set-max-ctable-entries 0
+    }
+
+    test "Set fuzzing - ctable encoding" {
+        r config set set-max-ctable-entries 2048
+        for {set j 0} {$j < 10} {incr j} {
+            unset -nocomplain s
+            array set s {}
+            r del myset
+            for {set i 0} {$i < 1000} {incr i} {
+                randpath {
+                    set ele [randomValue]
+                    r sadd myset $ele
+                    set s($ele) {}
+                } {
+                    set ele [randomInt 256]
+                    r sadd myset $ele
+                    set s($ele) {}
+                } {
+                    randpath {
+                        set ele [randomValue]
+                    } {
+                        set ele [randomInt 256]
+                    }
+                    assert_equal [info exists s($ele)] [r srem myset $ele]
+                    unset -nocomplain s($ele)
+                }
+            }
+            set expected [lsort [array names s]]
+            assert_equal $expected [lsort [r smembers myset]]
+            assert_equal $expected [lsort [r sort myset alpha]]
+            r debug reload
+            if {[llength $expected] > 512} {
+                assert_encoding ctable myset
+            }
+            assert_equal $expected [lsort [r smembers myset]]
+            foreach ele [lrange $expected 0 50] {
+                assert_equal 1 [r sismember myset $ele]
+            }
+            r zunionstore myzset 1 myset
+            assert_equal $expected [lsort [r zrange myzset 0 -1]]
+            r sunionstore myset2 myset
+            assert_equal $expected [lsort [r smembers myset2]]
+            for {set i 0} {$i < [llength $expected]} {incr i} {
+                set e [r spop myset]
+                assert {[info exists s($e)]}
+                unset s($e)
+            }
+            assert_equal 0 [r exists myset]
+        }
+        r config set set-max-ctable-entries 0
+    }
+
     tags {slow} {
         test {intsets implementation stress testing} {
             for {set j 0} {$j < 20} {incr j} {
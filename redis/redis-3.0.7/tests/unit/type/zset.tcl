@@ -1021,4 +1021,48 @@ start_server {tags {"zset"}} {
         stressers ziplist
         stressers skiplist
     }
+
+    test {ZADD/ZREM churn reuses the memory of the skiplist nodes} {
+        r del zset
+        set script {
+            local base = tonumber(ARGV[1])
+            for i=base,base+9999 do
+                redis.call('zadd',KEYS[1],i,'m'..(1000000+i))
+            end
+            for i=base-10000,base-1,2 do
+                redis.call('zrem',KEYS[1],'m'..(1000000+i))
+            end
+            local card = redis.call('zcard',KEYS[1])
+            if card > 10000 then
+                redis.call('zremrangebyrank',KEYS[1],0,card-10001)
+            end
+        }
+        # Every round adds 10000 elements and removes the ones added by the
+        # previous round: half of them one by one, and the others by rank.
+        for {set j 0} {$j < 30} {incr j} {
+            if {$j == 10} {set mem [s used_memory]}
+            r eval $script 1 zset [expr {$j*10000}]
+        }
+        assert_encoding skiplist zset
+        assert_equal 10000 [r zcard zset]
+        assert_equal {m1290000 290000} [r zrange zset 0 0 withscores]
+        assert_equal 9999 [r zrank zset m1299999]
+        assert {[s used_memory] < $mem*1.1}
+    }
+
+    test {Skiplist nodes memory is released when the sorted set shrinks} {
+        r del zset
+        set mem [s used_memory]
+        r eval {
+            for i=1,100000 do redis.call('zadd',KEYS[1],i,'m'..i) end
+        } 1 zset
+        set peak [expr {[s used_memory]-$mem}]
+        r zremrangebyrank zset 0 98999
+        assert_equal 1000 [r zcard zset]
+        assert_equal {m99001 99001} [r zrange zset 0 0 withscores]
+        # What is left is mostly the old table of the dict, being resized.
+        set left [expr {[s used_memory]-$mem}]
+        assert {$left < $peak/4}
+        r del zset
+    }
 }